@@ -178,12 +178,10 @@ static LLVMValueRef llvm_int1(bool b)
    return LLVMConstInt(llvm_int1_type(), b, false);
 }
 
-#if 0
 static LLVMValueRef llvm_int8(int8_t i)
 {
    return LLVMConstInt(llvm_int8_type(), i, false);
 }
-#endif
 
 static LLVMValueRef llvm_int32(int32_t i)
 {
@@ -821,6 +819,18 @@ static LLVMValueRef cgen_mspace_alloc(LLVMValueRef bytes, LLVMValueRef nelems,
    return LLVMBuildPointerCast(builder, raw, LLVMPointerType(type, 0), "");
 }
 
+static LLVMValueRef cgen_tlab_global(void)
+{
+   LLVMValueRef global = LLVMGetNamedGlobal(module, "__nvc_tlab");
+   if (global == NULL) {
+      global = LLVMAddGlobal(module, llvm_tlab_type(), "__nvc_tlab");
+      LLVMSetLinkage(global, LLVMExternalLinkage);
+      LLVMSetThreadLocal(global, true);   // Each thread has its own TLAB
+   }
+
+   return global;
+}
+
 static LLVMValueRef cgen_tlab_alloc(LLVMValueRef bytes, LLVMTypeRef type)
 {
    LLVMValueRef fn = LLVMGetNamedFunction(module, "tlab_alloc");
@@ -836,12 +846,7 @@ static LLVMValueRef cgen_tlab_alloc(LLVMValueRef bytes, LLVMTypeRef type)
       LLVMPositionBuilderAtEnd(builder, entry_bb);
 
       LLVMTypeRef tlab_type = llvm_tlab_type();
-
-      LLVMValueRef global = LLVMGetNamedGlobal(module, "__nvc_tlab");
-      if (global == NULL) {
-         global = LLVMAddGlobal(module, tlab_type, "__nvc_tlab");
-         LLVMSetLinkage(global, LLVMExternalLinkage);
-      }
+      LLVMValueRef global = cgen_tlab_global();
 
       LLVMValueRef alloc_ptr =
          LLVMBuildStructGEP2(builder, tlab_type, global, 2, "");
@@ -899,12 +904,7 @@ static LLVMValueRef cgen_tlab_alloc(LLVMValueRef bytes, LLVMTypeRef type)
 static LLVMValueRef cgen_tlab_watermark(void)
 {
    LLVMTypeRef tlab_type = llvm_tlab_type();
-
-   LLVMValueRef global = LLVMGetNamedGlobal(module, "__nvc_tlab");
-   if (global == NULL) {
-      global = LLVMAddGlobal(module, tlab_type, "__nvc_tlab");
-      LLVMSetLinkage(global, LLVMExternalLinkage);
-   }
+   LLVMValueRef global = cgen_tlab_global();
 
    LLVMValueRef alloc_ptr =
       LLVMBuildStructGEP2(builder, tlab_type, global, 2, "");
@@ -913,8 +913,7 @@ static LLVMValueRef cgen_tlab_watermark(void)
 
 static void cgen_tlab_restore(LLVMValueRef watermark)
 {
-   LLVMValueRef global = LLVMGetNamedGlobal(module, "__nvc_tlab");
-   assert(global != NULL);
+   LLVMValueRef global = cgen_tlab_global();
 
    LLVMTypeRef tlab_type = llvm_tlab_type();
 
@@ -3088,25 +3087,64 @@ static LLVMValueRef cgen_get_cover_cnt(int op, const char *cnt_name)
    return ptr;
 }
 
+static LLVMValueRef cgen_get_cover_shard(int op, const char *fn_name)
+{
+   LLVMValueRef fn = LLVMGetNamedFunction(module, fn_name);
+   LLVMValueRef shard = LLVMBuildCall(builder, fn, NULL, 0, "");
+
+   LLVMValueRef indexes[] = { llvm_int32(vcode_get_tag(op)) };
+   return LLVMBuildInBoundsGEP(builder, shard, indexes,
+                               ARRAY_LEN(indexes), "");
+}
+
 static void cgen_op_cover_stmt(int op, cgen_ctx_t *ctx)
 {
-   LLVMValueRef count_ptr = cgen_get_cover_cnt(op, "cover_stmts");
+   if (LLVMGetNamedGlobal(module, "cover_stmts") != NULL) {
+      // Only record whether the statement was executed: storing a
+      // constant is safe without synchronisation
+      LLVMBuildStore(builder, llvm_int8(1),
+                     cgen_get_cover_cnt(op, "cover_stmts"));
+      return;
+   }
+
+   LLVMValueRef count_ptr = cgen_get_cover_shard(op, "cover_stmt_shard");
 
    LLVMValueRef count = LLVMBuildLoad(builder, count_ptr, "cover_count");
-   LLVMValueRef count1 = LLVMBuildAdd(builder, count, llvm_int32(1), "");
+   LLVMValueRef count1 = LLVMBuildAdd(builder, count, llvm_int64(1), "");
+
+   // Saturate instead of wrapping around to zero
+   LLVMValueRef max = LLVMBuildICmp(builder, LLVMIntEQ, count,
+                                    llvm_int64(UINT64_MAX), "");
+   LLVMValueRef count2 = LLVMBuildSelect(builder, max, count, count1, "");
 
-   LLVMBuildStore(builder, count1, count_ptr);
+   LLVMBuildStore(builder, count2, count_ptr);
 }
 
 static void cgen_op_cover_branch(int op, cgen_ctx_t *ctx)
 {
-   LLVMValueRef mask_ptr = cgen_get_cover_cnt(op, "cover_branches");
+   LLVMValueRef result = cgen_get_arg(op, 0, ctx);
+
+   if (LLVMGetNamedGlobal(module, "cover_branches") != NULL) {
+      // Each branch has a pair of flags for the true and false outcomes
+      LLVMValueRef hits = LLVMGetNamedGlobal(module, "cover_branches");
+      LLVMValueRef index =
+         LLVMBuildSelect(builder, result,
+                         llvm_int32(vcode_get_tag(op) * 2),
+                         llvm_int32(vcode_get_tag(op) * 2 + 1), "");
+      LLVMValueRef indexes[] = { llvm_int32(0), index };
+      LLVMValueRef ptr = LLVMBuildGEP(builder, hits, indexes,
+                                      ARRAY_LEN(indexes), "");
+      LLVMBuildStore(builder, llvm_int8(1), ptr);
+      return;
+   }
+
+   LLVMValueRef mask_ptr = cgen_get_cover_shard(op, "cover_branch_shard");
 
    LLVMValueRef mask = LLVMBuildLoad(builder, mask_ptr, "cover_branches");
 
    // Bit zero means evaluated false, bit one means evaluated true
 
-   LLVMValueRef or = LLVMBuildSelect(builder, cgen_get_arg(op, 0, ctx),
+   LLVMValueRef or = LLVMBuildSelect(builder, result,
                                      llvm_int32(1 << 0),
                                      llvm_int32(1 << 1),
                                      "cond_mask_or");
@@ -4413,32 +4451,85 @@ static void cgen_reset_function(void)
    cgen_pop_debug_scope();
 }
 
+static void cgen_cover_hits(const char *name, int32_t count, bool external)
+{
+   LLVMTypeRef type = LLVMArrayType(llvm_int8_type(), count);
+   LLVMValueRef var = LLVMAddGlobal(module, type, name);
+   if (external)
+      LLVMSetLinkage(var, LLVMExternalLinkage);
+   else {
+      LLVMSetInitializer(var, LLVMGetUndef(type));
+      cgen_add_func_attr(var, FUNC_ATTR_DLLEXPORT, -1);
+   }
+}
+
+static void cgen_cover_shard_fn(const char *name, unsigned field,
+                                int32_t stmt_tags, int32_t branch_tags)
+{
+   // Statement counters and branch masks are updated without any
+   // synchronisation so each thread gets a private copy which is
+   // allocated by the runtime on first use and summed at the end
+
+   LLVMTypeRef fields[] = {
+      LLVMPointerType(llvm_int64_type(), 0),
+      LLVMPointerType(llvm_int32_type(), 0)
+   };
+   LLVMTypeRef shard_type =
+      LLVMStructTypeInContext(llvm_context(), fields, ARRAY_LEN(fields), false);
+
+   LLVMValueRef global = LLVMGetNamedGlobal(module, "__nvc_cover");
+   if (global == NULL) {
+      global = LLVMAddGlobal(module, shard_type, "__nvc_cover");
+      LLVMSetLinkage(global, LLVMExternalLinkage);
+      LLVMSetThreadLocal(global, true);
+   }
+
+   LLVMTypeRef ftype = LLVMFunctionType(fields[field], NULL, 0, false);
+   LLVMValueRef fn = LLVMAddFunction(module, name, ftype);
+   LLVMSetLinkage(fn, LLVMPrivateLinkage);
+
+   LLVMBasicBlockRef entry_bb = llvm_append_block(fn, "entry");
+   LLVMBasicBlockRef claim_bb = llvm_append_block(fn, "claim");
+   LLVMBasicBlockRef ready_bb = llvm_append_block(fn, "ready");
+
+   LLVMPositionBuilderAtEnd(builder, entry_bb);
+
+   LLVMValueRef shard_ptr =
+      LLVMBuildStructGEP2(builder, shard_type, global, field, "");
+   LLVMValueRef shard = LLVMBuildLoad(builder, shard_ptr, "");
+   LLVMValueRef null = LLVMBuildIsNull(builder, shard, "");
+   LLVMBuildCondBr(builder, null, claim_bb, ready_bb);
+
+   LLVMPositionBuilderAtEnd(builder, claim_bb);
+
+   LLVMValueRef args[] = { llvm_int32(stmt_tags), llvm_int32(branch_tags) };
+   LLVMBuildCall(builder, llvm_fn("__nvc_claim_cover"), args,
+                 ARRAY_LEN(args), "");
+   LLVMBuildRet(builder, LLVMBuildLoad(builder, shard_ptr, ""));
+
+   LLVMPositionBuilderAtEnd(builder, ready_bb);
+   LLVMBuildRet(builder, shard);
+}
+
 static void cgen_coverage_state(tree_t t, cover_tagging_t *tagging,
                                 bool external)
 {
    int32_t stmt_tags, branch_tags, toggle_tags;
    cover_count_tags(tagging, &stmt_tags, &branch_tags, &toggle_tags);
 
-   if (stmt_tags > 0) {
-      LLVMTypeRef type = LLVMArrayType(llvm_int32_type(), stmt_tags);
-      LLVMValueRef var = LLVMAddGlobal(module, type, "cover_stmts");
-      if (external)
-         LLVMSetLinkage(var, LLVMExternalLinkage);
-      else {
-         LLVMSetInitializer(var, LLVMGetUndef(type));
-         cgen_add_func_attr(var, FUNC_ATTR_DLLEXPORT, -1);
-      }
+   if (cover_enabled(tagging, COVER_MASK_HITS_ONLY)) {
+      if (stmt_tags > 0)
+         cgen_cover_hits("cover_stmts", stmt_tags, external);
+
+      if (branch_tags > 0)
+         cgen_cover_hits("cover_branches", branch_tags * 2, external);
    }
+   else {
+      if (stmt_tags > 0)
+         cgen_cover_shard_fn("cover_stmt_shard", 0, stmt_tags, branch_tags);
 
-   if (branch_tags > 0) {
-      LLVMTypeRef type = LLVMArrayType(llvm_int32_type(), branch_tags);
-      LLVMValueRef var = LLVMAddGlobal(module, type, "cover_branches");
-      if (external)
-         LLVMSetLinkage(var, LLVMExternalLinkage);
-      else {
-         LLVMSetInitializer(var, LLVMGetUndef(type));
-         cgen_add_func_attr(var, FUNC_ATTR_DLLEXPORT, -1);
-      }
+      if (branch_tags > 0)
+         cgen_cover_shard_fn("cover_branch_shard", 1, stmt_tags, branch_tags);
    }
 
    if (toggle_tags > 0) {
@@ -5166,6 +5257,16 @@ static LLVMValueRef cgen_support_fn(const char *name)
                            LLVMFunctionType(llvm_void_type(),
                                             args, ARRAY_LEN(args), false));
    }
+   else if (strcmp(name, "__nvc_claim_cover") == 0) {
+      LLVMTypeRef args[] = {
+         llvm_int32_type(),
+         llvm_int32_type()
+      };
+      fn = LLVMAddFunction(module, "__nvc_claim_cover",
+                           LLVMFunctionType(llvm_void_type(),
+                                            args, ARRAY_LEN(args), false));
+      cgen_add_func_attr(fn, FUNC_ATTR_COLD, -1);
+   }
    else if (strcmp(name, "__nvc_setup_toggle_cb") == 0) {
       LLVMTypeRef args[] = {
          LLVMPointerType(llvm_signal_shared_struct(), 0),
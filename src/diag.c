@@ -20,6 +20,7 @@
 #include "diag.h"
 #include "fbuf.h"
 #include "opt.h"
+#include "thread.h"
 
 #include <ctype.h>
 #include <string.h>
@@ -89,7 +90,9 @@ typedef struct _hint_rec {
 static diag_consumer_t  consumer = NULL;
 static unsigned         n_errors = 0;
 static file_list_t      loc_files;
+static nvc_lock_t       loc_lock = 0;
 static vhdl_severity_t  exit_severity = SEVERITY_ERROR;
+static int              max_severity = -1;
 static diag_level_t     stderr_level = DIAG_DEBUG;
 
 #define MAX_HINT_RECS 4
@@ -113,6 +116,8 @@ loc_file_ref_t loc_file_ref(const char *name, const char *linebuf)
    if (name == NULL)
       return FILE_INVALID;
 
+   SCOPED_LOCK(loc_lock);
+
    for (unsigned i = 0; i < loc_files.count; i++) {
       if (strcmp(loc_files.items[i].name_str, name) == 0)
          return loc_files.items[i].ref;
@@ -271,24 +276,27 @@ void loc_read(loc_t *loc, loc_rd_ctx_t *ctx)
          fatal("corrupt location file reference %x", old_ref);
 
       if (ctx->ref_map[old_ref] == FILE_INVALID) {
+         // Coverage databases are read concurrently when merging
+         SCOPED_LOCK(loc_lock);
+
          for (unsigned i = 0; i < loc_files.count; i++) {
             if (strcmp(loc_files.items[i].name_str,
                        ctx->file_map[old_ref]) == 0)
                ctx->ref_map[old_ref] = loc_files.items[i].ref;
          }
-      }
 
-      if (ctx->ref_map[old_ref] == FILE_INVALID) {
-         loc_file_t new = {
-            .linebuf  = NULL,
-            .name_str = ctx->file_map[old_ref],
-            .ref      = loc_files.count
-         };
+         if (ctx->ref_map[old_ref] == FILE_INVALID) {
+            loc_file_t new = {
+               .linebuf  = NULL,
+               .name_str = ctx->file_map[old_ref],
+               .ref      = loc_files.count
+            };
 
-         APUSH(loc_files, new);
+            APUSH(loc_files, new);
 
-         ctx->ref_map[old_ref]  = new.ref;
-         ctx->file_map[old_ref] = NULL;   // Owned by loc_file_t now
+            ctx->ref_map[old_ref]  = new.ref;
+            ctx->file_map[old_ref] = NULL;   // Owned by loc_file_t now
+         }
       }
 
       new_ref = ctx->ref_map[old_ref];
@@ -983,6 +991,7 @@ unsigned error_count(void)
 void reset_error_count(void)
 {
    n_errors = 0;
+   max_severity = -1;
 }
 
 void fmt_loc(FILE *f, const loc_t *loc)
@@ -997,6 +1006,14 @@ void fmt_loc(FILE *f, const loc_t *loc)
 
 diag_level_t diag_severity(vhdl_severity_t severity)
 {
+   // Every report and assertion passes through here so remember the
+   // most severe seen so far, which may be updated concurrently by
+   // processes running on other threads
+   int old = relaxed_load(&max_severity);
+   while (old < (int)severity
+          && !__atomic_cas(&max_severity, &old, (int)severity))
+      ;
+
    if (severity >= exit_severity)
       return DIAG_FATAL;
 
@@ -1020,6 +1037,11 @@ vhdl_severity_t get_exit_severity(void)
    return exit_severity;
 }
 
+bool severity_reported(vhdl_severity_t severity)
+{
+   return relaxed_load(&max_severity) >= (int)severity;
+}
+
 void set_stderr_severity(vhdl_severity_t severity)
 {
    switch (severity) {
@@ -123,5 +123,6 @@ void set_exit_severity(vhdl_severity_t severity);
 void set_stderr_severity(vhdl_severity_t severity);
 diag_level_t diag_severity(vhdl_severity_t severity);
 vhdl_severity_t get_exit_severity(void);
+bool severity_reported(vhdl_severity_t severity);
 
 #endif  // _DIAG_H
@@ -18,6 +18,7 @@
 #include "util.h"
 #include "fbuf.h"
 #include "fastlz.h"
+#include "thread.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -77,7 +78,8 @@ struct _fbuf {
    fbuf_zip_t   zip;
 };
 
-static fbuf_t *open_list = NULL;
+static fbuf_t     *open_list = NULL;
+static nvc_lock_t  open_lock = 0;   // Files may be opened by worker threads
 
 static void adler32_update(adler32_t *state, uint8_t *input, size_t length)
 {
@@ -296,7 +298,6 @@ static fbuf_t *fbuf_new(FILE *file, char *fname, fbuf_mode_t mode,
    f->file  = file;
    f->fname = fname;
    f->mode  = mode;
-   f->next  = open_list;
    f->zip   = zip;
 
    checksum_init(&(f->checksum), csum);
@@ -308,6 +309,9 @@ static fbuf_t *fbuf_new(FILE *file, char *fname, fbuf_mode_t mode,
    else
       fbuf_decompress(f);
 
+   SCOPED_LOCK(open_lock);
+
+   f->next = open_list;
    if (open_list != NULL)
       open_list->prev = f;
 
@@ -388,6 +392,8 @@ void fbuf_close(fbuf_t *f, uint32_t *checksum)
 
    fclose(f->file);
 
+   nvc_lock(&open_lock);
+
    if (f->prev == NULL) {
       assert(f == open_list);
       if (f->next != NULL)
@@ -400,6 +406,8 @@ void fbuf_close(fbuf_t *f, uint32_t *checksum)
          f->next->prev = f->prev;
    }
 
+   nvc_unlock(&open_lock);
+
    if (checksum != NULL)
       *checksum = checksum_finish(&(f->checksum));
 
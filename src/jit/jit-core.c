@@ -53,6 +53,7 @@
 
 #define FUNC_HASH_SZ  1024
 #define FUNC_LIST_SZ  512
+#define COMPILE_QUEUE 64
 
 typedef struct _jit_tier {
    jit_tier_t    *next;
@@ -66,23 +67,45 @@ typedef struct {
    jit_func_t *items[0];
 } func_array_t;
 
+typedef enum {
+   COMPILE_IDLE,
+   COMPILE_PENDING,
+   COMPILE_STOP
+} compile_state_t;
+
+typedef struct {
+   nvc_thread_t *thread;
+   nvc_lock_t    lock;
+   int32_t       state;
+   int           count;
+   jit_func_t   *queue[COMPILE_QUEUE];
+} jit_compiler_t;
+
 typedef struct _jit {
-   chash_t        *index;
-   mspace_t       *mspace;
-   jit_lower_fn_t  lower_fn;
-   void           *lower_ctx;
-   hash_t         *layouts;
-   bool            silent;
-   bool            runtime;
-   unsigned        backedge;
-   int             exit_status;
-   jit_tier_t     *tiers;
-   jit_dll_t      *aotlib;
-   func_array_t   *funcs;
-   unsigned        next_handle;
-   nvc_lock_t      lock;
+   chash_t          *index;
+   mspace_t         *mspace;
+   jit_lower_fn_t    lower_fn;
+   void             *lower_ctx;
+   hash_t           *layouts;
+   bool              silent;
+   bool              runtime;
+   unsigned          backedge;
+   int               exit_status;
+   jit_tier_t       *tiers;
+   jit_dll_t        *aotlib;
+   func_array_t     *funcs;
+   unsigned          next_handle;
+   nvc_lock_t        lock;
+   bool              async;
+   bool              threaded;
+   jit_compiler_t    compiler;
+   jit_optim_stats_t optstats;
 } jit_t;
 
+static A(jit_t *) async_jits;
+static nvc_lock_t async_lock = 0;
+static bool       async_atexit = false;
+
 static void jit_oom_cb(mspace_t *m, size_t size)
 {
    diag_t *d = diag_new(DIAG_FATAL, NULL);
@@ -121,6 +144,9 @@ jit_t *jit_new(void)
 
    mspace_set_oom_handler(j->mspace, jit_oom_cb);
 
+   j->async = opt_get_int(OPT_JIT_ASYNC);
+   j->threaded = opt_get_int(OPT_JIT_THREADED);
+
    // Ensure we can resolve symbols from the executable
    ffi_load_dll(NULL);
 
@@ -132,13 +158,78 @@ static void jit_free_func(jit_func_t *f)
    jit_free_cfg(f);
    mptr_free(f->jit->mspace, &(f->privdata));
    free(f->irbuf);
+   free(f->threaded);
    free(f->varoff);
    free(f->cpool);
    free(f);
 }
 
+void jit_suspend_compiler(jit_t *j)
+{
+   // Functions queued later start a new compile thread so this is also
+   // used before forking as the thread would not exist in the child
+   jit_compiler_t *c = &(j->compiler);
+
+   {
+      SCOPED_LOCK(c->lock);
+
+      if (c->thread == NULL)
+         return;
+
+      // Functions still in the queue stay interpreted
+      for (int i = 0; i < c->count; i++)
+         c->queue[i]->queued = false;
+      c->count = 0;
+
+      store_release(&(c->state), COMPILE_STOP);
+   }
+
+   thread_wake(&(c->state));
+   thread_join(c->thread);
+
+   c->thread = NULL;
+   c->state  = COMPILE_IDLE;
+
+   SCOPED_LOCK(async_lock);
+
+   for (int i = 0; i < async_jits.count; i++) {
+      if (async_jits.items[i] == j) {
+         async_jits.items[i] = async_jits.items[--async_jits.count];
+         break;
+      }
+   }
+}
+
+static void jit_stop_all_compilers(void)
+{
+   // The thread library treats user threads still running at exit as
+   // leaked so stop any compilation started before an early exit
+   for (;;) {
+      jit_t *j = NULL;
+      {
+         SCOPED_LOCK(async_lock);
+         if (async_jits.count > 0)
+            j = async_jits.items[async_jits.count - 1];
+      }
+
+      if (j == NULL)
+         break;
+
+      jit_suspend_compiler(j);
+   }
+}
+
 void jit_free(jit_t *j)
 {
+   jit_suspend_compiler(j);
+
+   if (opt_get_int(OPT_JIT_LOG) && j->optstats.deleted > 0)
+      debugf("JIT optimiser: %u operands propagated, %u branches folded, "
+             "%u unreachable blocks, %u dead instructions, %u dead stores, "
+             "%u instructions deleted", j->optstats.cprop,
+             j->optstats.folded, j->optstats.unreachable, j->optstats.dead,
+             j->optstats.stores, j->optstats.deleted);
+
    if (j->aotlib != NULL)
       ffi_unload_dll(j->aotlib);
 
@@ -166,6 +257,17 @@ void jit_free(jit_t *j)
    free(j);
 }
 
+void jit_add_optim_stats(jit_t *j, const jit_optim_stats_t *stats)
+{
+   // Functions may be generated concurrently by the compile thread
+   relaxed_add(&(j->optstats.cprop), stats->cprop);
+   relaxed_add(&(j->optstats.folded), stats->folded);
+   relaxed_add(&(j->optstats.unreachable), stats->unreachable);
+   relaxed_add(&(j->optstats.dead), stats->dead);
+   relaxed_add(&(j->optstats.stores), stats->stores);
+   relaxed_add(&(j->optstats.deleted), stats->deleted);
+}
+
 mspace_t *jit_get_mspace(jit_t *j)
 {
    return j->mspace;
@@ -261,6 +363,18 @@ jit_handle_t jit_lazy_compile(jit_t *j, ident_t name)
 
    jit_install(j, f);
 
+   // Load code saved by an earlier run on the first call instead of
+   // waiting for the function to become hot
+   for (jit_tier_t *tier = f->next_tier; tier && vu; tier = tier->next) {
+      if (tier->plugin.cached != NULL
+          && (*tier->plugin.cached)(j, f->handle, tier->context)) {
+         f->next_tier = tier;
+         f->hotness   = 0;
+         f->cached    = true;
+         break;
+      }
+   }
+
    if (alias != NULL && alias != name)
       chash_put(j->index, name, f);
 
@@ -935,6 +1049,11 @@ int jit_backedge_limit(jit_t *j)
    return j->backedge;
 }
 
+bool jit_use_threaded(jit_t *j)
+{
+   return j->threaded;
+}
+
 void jit_load_dll(jit_t *j, ident_t name)
 {
    lib_t lib = lib_require(ident_until(name, '.'));
@@ -1020,15 +1139,118 @@ int jit_exit_status(jit_t *j)
    return j->exit_status;
 }
 
+static void jit_next_tier(jit_func_t *f)
+{
+   // Code from a lower tier keeps counting down towards the next one
+   jit_tier_t *next = f->next_tier->next;
+   relaxed_store(&(f->hotness), next ? next->threshold : 0);
+   store_release(&(f->next_tier), next);
+}
+
+static void *jit_compile_thread(void *arg)
+{
+   jit_t *j = arg;
+   jit_compiler_t *c = &(j->compiler);
+
+   // Code loaded by the plugin may look up functions by name
+   jit_thread_local()->jit = j;
+
+   for (;;) {
+      thread_wait(&(c->state), COMPILE_IDLE);
+
+      jit_func_t *f = NULL;
+      {
+         SCOPED_LOCK(c->lock);
+
+         if (load_acquire(&(c->state)) == COMPILE_STOP)
+            break;
+         else if (c->count == 0) {
+            store_release(&(c->state), COMPILE_IDLE);
+            continue;
+         }
+
+         // Functions keep counting down while they wait in the queue
+         // so the one called most often since being queued goes first
+         int best = 0;
+         for (int i = 1; i < c->count; i++) {
+            if (relaxed_load(&(c->queue[i]->hotness))
+                < relaxed_load(&(c->queue[best]->hotness)))
+               best = i;
+         }
+
+         f = c->queue[best];
+         c->queue[best] = c->queue[--c->count];
+      }
+
+      // The interpreter keeps running this function until the plugin
+      // publishes the native entry point with store_release
+      (*f->next_tier->plugin.cgen)(j, f->handle, f->next_tier->context);
+
+      jit_next_tier(f);
+      store_release(&(f->queued), false);
+   }
+
+   return NULL;
+}
+
+static void jit_queue_tier_up(jit_func_t *f)
+{
+   if (relaxed_load(&(f->queued)))
+      return;   // Called on every entry until compilation finishes
+
+   jit_t *j = f->jit;
+   jit_compiler_t *c = &(j->compiler);
+
+   SCOPED_LOCK(c->lock);
+
+   if (f->queued || f->next_tier == NULL)
+      return;
+   else if (c->count == COMPILE_QUEUE) {
+      // Try again later rather than blocking the caller
+      relaxed_store(&(f->hotness), f->next_tier->threshold);
+      return;
+   }
+
+   if (c->thread == NULL) {
+      {
+         SCOPED_LOCK(async_lock);
+
+         if (!async_atexit) {
+            atexit(jit_stop_all_compilers);
+            async_atexit = true;
+         }
+
+         APUSH(async_jits, j);
+      }
+
+      c->thread = thread_create(jit_compile_thread, j, "jit compiler");
+   }
+
+   f->queued = true;
+   c->queue[c->count++] = f;
+
+   if (load_acquire(&(c->state)) == COMPILE_IDLE) {
+      store_release(&(c->state), COMPILE_PENDING);
+      thread_wake(&(c->state));
+   }
+}
+
 void jit_tier_up(jit_func_t *f)
 {
-   assert(f->hotness <= 0);
-   assert(f->next_tier != NULL);
+   // The compile thread may have moved the function to the next tier
+   // and reset the counter since the caller decremented it
+   jit_tier_t *next = load_acquire(&(f->next_tier));
+   if (next == NULL || relaxed_load(&(f->hotness)) > 0)
+      return;
 
-   (*f->next_tier->plugin.cgen)(f->jit, f->handle, f->next_tier->context);
+   if (f->jit->async && !f->cached) {
+      jit_queue_tier_up(f);
+      return;
+   }
+
+   (*next->plugin.cgen)(f->jit, f->handle, next->context);
 
-   f->hotness   = 0;
-   f->next_tier = NULL;
+   jit_next_tier(f);
 }
 
 void jit_add_tier(jit_t *j, int threshold, const jit_plugin_t *plugin)
@@ -1036,12 +1258,18 @@ void jit_add_tier(jit_t *j, int threshold, const jit_plugin_t *plugin)
    assert(threshold > 0);
 
    jit_tier_t *t = xcalloc(sizeof(jit_tier_t));
-   t->next      = j->tiers;
    t->threshold = threshold;
    t->plugin    = *plugin;
    t->context   = (*plugin->init)();
 
-   j->tiers = t;
+   // Keep the list sorted so functions move through the tiers in
+   // order of increasing threshold
+   jit_tier_t **where = &(j->tiers);
+   while (*where && (*where)->threshold <= threshold)
+      where = &((*where)->next);
+
+   t->next = *where;
+   *where = t;
 }
 
 ident_t jit_get_name(jit_t *j, jit_handle_t handle)
@@ -1049,6 +1277,35 @@ ident_t jit_get_name(jit_t *j, jit_handle_t handle)
    return jit_get_func(j, handle)->name;
 }
 
+bool jit_find_cpool(jit_t *j, const void *ptr, ident_t *name, size_t *offset)
+{
+   func_array_t *list = load_acquire(&(j->funcs));
+   const unsigned nfuncs = load_acquire(&(j->next_handle));
+
+   for (unsigned i = 0; i < nfuncs && i < list->length; i++) {
+      jit_func_t *f = load_acquire(&(list->items[i]));
+      if (f == NULL || f->cpool == NULL)
+         continue;
+      else if ((unsigned char *)ptr >= f->cpool
+               && (unsigned char *)ptr < f->cpool + f->cpoolsz) {
+         *name = f->name;
+         *offset = (unsigned char *)ptr - f->cpool;
+         return true;
+      }
+   }
+
+   return false;
+}
+
+void *jit_get_cpool(jit_t *j, ident_t name)
+{
+   jit_handle_t handle = jit_compile(j, name);
+   if (handle == JIT_HANDLE_INVALID)
+      return NULL;
+
+   return jit_get_func(j, handle)->cpool;
+}
+
 jit_handle_t jit_assemble(jit_t *j, ident_t name, const char *text)
 {
    jit_func_t *f = chash_get(j->index, name);
@@ -1088,6 +1345,11 @@ jit_handle_t jit_assemble(jit_t *j, ident_t name, const char *text)
       { "JUMP",  J_JUMP,     0, 1 },
       { "$COPY", MACRO_COPY, 1, 2 },
       { "$CASE", MACRO_CASE, 1, 2 },
+      { "CSET",  J_CSET,     1, 0 },
+      { "LOAD",  J_LOAD,     1, 1 },
+      { "STORE", J_STORE,    0, 2 },
+      { "FCMP",  J_FCMP,     0, 2 },
+      { "CSEL",  J_CSEL,     1, 2 },
    };
 
    static const struct {
@@ -1097,6 +1359,11 @@ jit_handle_t jit_assemble(jit_t *j, ident_t name, const char *text)
       { "T",  JIT_CC_T },
       { "F",  JIT_CC_F },
       { "EQ", JIT_CC_EQ },
+      { "NE", JIT_CC_NE },
+      { "LT", JIT_CC_LT },
+      { "GE", JIT_CC_GE },
+      { "GT", JIT_CC_GT },
+      { "LE", JIT_CC_LE },
       { "O",  JIT_CC_O },
       { "C",  JIT_CC_C },
    };
@@ -1170,6 +1437,11 @@ jit_handle_t jit_assemble(jit_t *j, ident_t name, const char *text)
 
       case CCSIZE:
          {
+            // A condition code and size may both be given as in ADD.O.8
+            char *dot = strchr(tok, '.');
+            if (dot != NULL)
+               *dot++ = '\0';
+
             if (isdigit((int)tok[0])) {
                switch (atoi(tok)) {
                case 8: ir->size = JIT_SZ_8; break;
@@ -1192,6 +1464,11 @@ jit_handle_t jit_assemble(jit_t *j, ident_t name, const char *text)
                ir->cc = cctab[cpos].cc;
             }
 
+            if (dot != NULL) {
+               tok = dot;
+               goto again;
+            }
+
             state = nresult > 0 ? RESULT : (nargs > 0 ? ARG1 : NEWLINE);
          }
          break;
@@ -1202,7 +1479,7 @@ jit_handle_t jit_assemble(jit_t *j, ident_t name, const char *text)
 
          ir->result = atoi(tok + 1);
          f->nregs = MAX(ir->result + 1, f->nregs);
-         state = ARG1;
+         state = nargs > 0 ? ARG1 : NEWLINE;
          break;
 
       case ARG1:
@@ -1218,6 +1495,10 @@ jit_handle_t jit_assemble(jit_t *j, ident_t name, const char *text)
                arg.kind  = JIT_VALUE_INT64;
                arg.int64 = strtoll(tok + 1, NULL, 0);
             }
+            else if (tok[0] == '%') {
+               arg.kind = JIT_VALUE_DOUBLE;
+               arg.dval = strtod(tok + 1, NULL);
+            }
             else if (tok[0] == 'L') {
                APUSH(lpatch, ir - f->irbuf);
                arg.kind = JIT_VALUE_LABEL;
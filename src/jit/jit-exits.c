@@ -16,7 +16,9 @@
 //
 
 #include "util.h"
+#include "array.h"
 #include "diag.h"
+#include "fbuf.h"
 #include "jit/jit-exits.h"
 #include "jit/jit-ffi.h"
 #include "jit/jit-priv.h"
@@ -24,6 +26,7 @@
 #include "lib.h"
 #include "object.h"
 #include "rt/rt.h"
+#include "thread.h"
 #include "type.h"
 
 #include <assert.h>
@@ -35,6 +38,192 @@
 #include <stdlib.h>
 #include <string.h>
 
+typedef struct {
+   FILE     *fp;
+   char     *name;
+   int8_t    mode;
+   uint32_t  id;
+} open_file_t;
+
+typedef A(open_file_t) file_list_t;
+
+// Files opened by FILE_OPEN are tracked so they can be saved and
+// reopened by a simulation checkpoint
+static file_list_t   open_files;
+static uint32_t       next_file_id;
+static nvc_lock_t     files_lock;
+
+static void register_file(FILE *fp, const char *name, int8_t mode)
+{
+   SCOPED_LOCK(files_lock);
+
+   const open_file_t of = {
+      .fp   = fp,
+      .name = xstrdup(name),
+      .mode = mode,
+      .id   = next_file_id++,
+   };
+   APUSH(open_files, of);
+}
+
+static void unregister_file(FILE *fp)
+{
+   SCOPED_LOCK(files_lock);
+
+   for (int i = 0; i < open_files.count; i++) {
+      if (open_files.items[i].fp == fp) {
+         free(open_files.items[i].name);
+         for (int j = i + 1; j < open_files.count; j++)
+            open_files.items[j - 1] = open_files.items[j];
+         ATRIM(open_files, open_files.count - 1);
+         return;
+      }
+   }
+}
+
+bool jit_find_file(void *fp, uint32_t *id)
+{
+   SCOPED_LOCK(files_lock);
+
+   for (int i = 0; i < open_files.count; i++) {
+      if (open_files.items[i].fp == fp) {
+         *id = open_files.items[i].id;
+         return true;
+      }
+   }
+
+   return false;
+}
+
+void *jit_get_file(uint32_t id)
+{
+   SCOPED_LOCK(files_lock);
+
+   for (int i = 0; i < open_files.count; i++) {
+      if (open_files.items[i].id == id)
+         return open_files.items[i].fp;
+   }
+
+   return NULL;
+}
+
+void jit_save_files(fbuf_t *f)
+{
+   SCOPED_LOCK(files_lock);
+
+   write_u32(next_file_id, f);
+   write_u32(open_files.count, f);
+
+   for (int i = 0; i < open_files.count; i++) {
+      open_file_t *of = &(open_files.items[i]);
+
+      const size_t namelen = strlen(of->name);
+      write_u32(of->id, f);
+      write_u8(of->mode, f);
+      write_u32(namelen, f);
+      write_raw(of->name, namelen, f);
+
+      fflush(of->fp);
+
+      const long pos = ftell(of->fp);
+      if (pos < 0)
+         fatal_errno("cannot save position in %s", of->name);
+
+      write_u64(pos, f);
+
+      if (of->mode != 0) {
+         // The contents of files opened for writing are saved as they
+         // would otherwise be truncated when opened again
+         FILE *copy = fopen(of->name, "rb");
+         if (copy == NULL)
+            fatal_errno("cannot read %s", of->name);
+
+         char buf[4096];
+         for (long left = pos; left > 0; ) {
+            const size_t n = fread(buf, 1, MIN(left, sizeof(buf)), copy);
+            if (n == 0)
+               fatal("unexpected end of file reading %s", of->name);
+
+            write_raw(buf, n, f);
+            left -= n;
+         }
+
+         fclose(copy);
+      }
+   }
+}
+
+void jit_restore_files(fbuf_t *f)
+{
+   SCOPED_LOCK(files_lock);
+
+   const uint32_t saved_next_id = read_u32(f);
+   const int nfiles = read_u32(f);
+
+   file_list_t restored = AINIT;
+
+   for (int i = 0; i < nfiles; i++) {
+      open_file_t of = {};
+      of.id   = read_u32(f);
+      of.mode = read_u8(f);
+
+      const size_t namelen = read_u32(f);
+      of.name = xmalloc(namelen + 1);
+      read_raw(of.name, namelen, f);
+      of.name[namelen] = '\0';
+
+      const uint64_t pos = read_u64(f);
+
+      // Files opened before the checkpoint base image was taken are
+      // already open and must keep the same FILE pointer
+      for (int j = 0; j < open_files.count; j++) {
+         if (open_files.items[j].id == of.id) {
+            of.fp = open_files.items[j].fp;
+            free(open_files.items[j].name);
+            open_files.items[j].fp = NULL;
+            break;
+         }
+      }
+
+      const char *mode = of.mode == 0 ? "rb" : "wb";
+      if (of.fp == NULL)
+         of.fp = fopen(of.name, mode);
+      else
+         of.fp = freopen(of.name, mode, of.fp);
+
+      if (of.fp == NULL)
+         fatal_errno("failed to reopen %s", of.name);
+
+      if (of.mode == 0) {
+         if (fseek(of.fp, pos, SEEK_SET) != 0)
+            fatal_errno("cannot restore position in %s", of.name);
+      }
+      else {
+         char buf[4096];
+         for (uint64_t left = pos; left > 0; ) {
+            const size_t n = MIN(left, sizeof(buf));
+            read_raw(buf, n, f);
+            fwrite(buf, 1, n, of.fp);
+            left -= n;
+         }
+      }
+
+      APUSH(restored, of);
+   }
+
+   // Close any files that were not open at the checkpoint
+   for (int i = 0; i < open_files.count; i++) {
+      if (open_files.items[i].fp != NULL) {
+         fclose(open_files.items[i].fp);
+         free(open_files.items[i].name);
+      }
+   }
+
+   ACLEAR(open_files);
+   open_files = restored;
+   next_file_id = MAX(next_file_id, saved_next_id);
+}
+
 void x_file_open(int8_t *status, void **_fp, uint8_t *name_bytes,
                  int32_t name_len, int8_t mode, tree_t where)
 {
@@ -87,6 +276,8 @@ void x_file_open(int8_t *status, void **_fp, uint8_t *name_bytes,
             }
          }
       }
+      else
+         register_file(*fp, fname, mode);
    }
 }
 
@@ -118,6 +309,7 @@ void x_file_close(void **_fp)
    FILE **fp = (FILE **)_fp;
 
    if (*fp != NULL) {
+      unregister_file(*fp);
       fclose(*fp);
       *fp = NULL;
    }
@@ -1299,7 +1491,7 @@ void __nvc_report(const uint8_t *msg, int32_t msg_len, int8_t severity,
 DLLEXPORT
 void __nvc_claim_tlab(void)
 {
-   extern tlab_t __nvc_tlab;
+   extern __thread tlab_t __nvc_tlab;
    x_claim_tlab(&__nvc_tlab);
 }
 
@@ -1451,6 +1643,13 @@ void *__nvc_mspace_alloc2(uintptr_t size, jit_anchor_t *anchor)
    jit_thread_local_t *thread = jit_thread_local();
    thread->anchor = anchor;
 
+   if (unlikely(size > UINT32_MAX)) {
+      jit_msg(NULL, DIAG_FATAL, "attempting to allocate %"PRIu64" byte object "
+              "which is larger than the maximum supported %u bytes",
+              (uint64_t)size, UINT32_MAX);
+      __builtin_unreachable();
+   }
+
    void *ptr = x_mspace_alloc(size, 1);
 
    thread->anchor = NULL;
@@ -1496,6 +1695,12 @@ void __nvc_setup_toggle_cb(sig_shared_t *ss, int32_t* toggle_mask)
    x_cover_setup_toggle_cb(ss, toggle_mask);
 }
 
+DLLEXPORT
+void __nvc_claim_cover(int32_t n_stmts, int32_t n_branches)
+{
+   x_claim_cover(n_stmts, n_branches);
+}
+
 DLLEXPORT
 void __nvc_register(const char *name, jit_entry_fn_t fn, const uint8_t *debug,
                     int32_t bufsz, object_t *obj, ffi_spec_t spec)
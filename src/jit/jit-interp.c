@@ -23,6 +23,7 @@
 #include "jit/jit-priv.h"
 #include "jit/jit-ffi.h"
 #include "rt/mspace.h"
+#include "thread.h"
 #include "tree.h"
 #include "type.h"
 #include "vcode.h"
@@ -48,6 +49,35 @@ typedef struct _jit_interp {
    tlab_t        *tlab;
 } jit_interp_t;
 
+typedef void (*interp_fn_t)(jit_interp_t *, jit_ir_t *);
+
+// Pre-decoded form of each instruction for the threaded interpreter
+// with operands resolved to a register plus a constant
+typedef struct _interp_op {
+   const void   *label;
+   union {
+      jit_scalar_t  k1;
+      interp_fn_t   fn;
+   };
+   jit_scalar_t  k2;
+   jit_reg_t     r1;
+   jit_reg_t     r2;
+   jit_reg_t     result;
+} interp_op_t;
+
+typedef enum {
+   IOP_GENERIC, IOP_RECV, IOP_SEND, IOP_AND, IOP_OR, IOP_XOR, IOP_ADD,
+   IOP_SUB, IOP_MUL, IOP_DIV, IOP_REM, IOP_FADD, IOP_FSUB, IOP_FMUL,
+   IOP_FDIV, IOP_NEG, IOP_FNEG, IOP_NOT, IOP_SCVTF, IOP_FCVTNS, IOP_MOV,
+   IOP_CSEL, IOP_CSET, IOP_CMP_EQ, IOP_CMP_NE, IOP_CMP_LT, IOP_CMP_GE,
+   IOP_CMP_GT, IOP_CMP_LE, IOP_LOAD8, IOP_LOAD16, IOP_LOAD32, IOP_LOAD64,
+   IOP_ULOAD8, IOP_ULOAD16, IOP_ULOAD32, IOP_ULOAD64, IOP_STORE8,
+   IOP_STORE16, IOP_STORE32, IOP_STORE64, IOP_JUMP, IOP_JUMP_T, IOP_JUMP_F,
+   IOP_CASE, IOP_SALLOC, IOP_RET, IOP_NOP,
+
+   IOP_LAST
+} interp_iop_t;
+
 #ifdef DEBUG
 #define JIT_ASSERT(expr) do {                                           \
       if (unlikely(!(expr))) {                                          \
@@ -725,6 +755,12 @@ static void interp_case(jit_interp_t *state, jit_ir_t *ir)
       interp_branch_to(state, ir->arg2);
 }
 
+static void interp_bad_op(jit_interp_t *state, jit_ir_t *ir)
+{
+   interp_dump(state);
+   fatal_trace("cannot interpret opcode %s", jit_op_name(ir->op));
+}
+
 static void interp_loop(jit_interp_t *state)
 {
    for (;;) {
@@ -865,12 +901,435 @@ static void interp_loop(jit_interp_t *state)
          interp_case(state, ir);
          break;
       default:
-         interp_dump(state);
-         fatal_trace("cannot interpret opcode %s", jit_op_name(ir->op));
+         interp_bad_op(state, ir);
       }
    }
 }
 
+static void interp_decode_value(jit_func_t *f, jit_value_t value,
+                                jit_reg_t *reg, jit_scalar_t *k)
+{
+   // Register f->nregs always contains zero so every operand can be
+   // computed as a register plus a constant without branching
+   *reg = f->nregs;
+
+   switch (value.kind) {
+   case JIT_VALUE_REG:
+      *reg = value.reg;
+      k->integer = 0;
+      break;
+   case JIT_ADDR_REG:
+      *reg = value.reg;
+      k->integer = value.disp;
+      break;
+   case JIT_VALUE_INVALID:
+   case JIT_VALUE_LOC:
+      k->integer = 0;
+      break;
+   case JIT_VALUE_EXIT:
+      k->integer = value.exit;
+      break;
+   default:
+      {
+         jit_interp_t dummy = { .func = f };
+         *k = interp_get_value(&dummy, value);
+      }
+      break;
+   }
+}
+
+static interp_iop_t interp_select(jit_ir_t *ir, interp_fn_t *fn)
+{
+   switch (ir->op) {
+   case J_RECV: return IOP_RECV;
+   case J_SEND: return IOP_SEND;
+   case J_AND: return IOP_AND;
+   case J_OR: return IOP_OR;
+   case J_XOR: return IOP_XOR;
+   case J_DIV: return IOP_DIV;
+   case J_REM: return IOP_REM;
+   case J_FADD: return IOP_FADD;
+   case J_FSUB: return IOP_FSUB;
+   case J_FMUL: return IOP_FMUL;
+   case J_FDIV: return IOP_FDIV;
+   case J_NEG: return IOP_NEG;
+   case J_FNEG: return IOP_FNEG;
+   case J_NOT: return IOP_NOT;
+   case J_SCVTF: return IOP_SCVTF;
+   case J_FCVTNS: return IOP_FCVTNS;
+   case J_MOV:
+   case J_LEA: return IOP_MOV;
+   case J_CSEL: return IOP_CSEL;
+   case J_CSET: return IOP_CSET;
+   case MACRO_CASE: return IOP_CASE;
+   case MACRO_SALLOC: return IOP_SALLOC;
+   case J_RET: return IOP_RET;
+   case J_DEBUG:
+   case J_NOP: return IOP_NOP;
+   case J_ADD:
+      *fn = interp_add;
+      return ir->cc == JIT_CC_NONE ? IOP_ADD : IOP_GENERIC;
+   case J_SUB:
+      *fn = interp_sub;
+      return ir->cc == JIT_CC_NONE ? IOP_SUB : IOP_GENERIC;
+   case J_MUL:
+      *fn = interp_mul;
+      return ir->cc == JIT_CC_NONE ? IOP_MUL : IOP_GENERIC;
+   case J_CMP:
+      *fn = interp_cmp;
+      if (ir->cc >= JIT_CC_EQ && ir->cc <= JIT_CC_LE)
+         return IOP_CMP_EQ + ir->cc - JIT_CC_EQ;
+      else
+         return IOP_GENERIC;
+   case J_LOAD:
+      *fn = interp_load;
+      return ir->size <= JIT_SZ_64 ? IOP_LOAD8 + ir->size : IOP_GENERIC;
+   case J_ULOAD:
+      *fn = interp_uload;
+      return ir->size <= JIT_SZ_64 ? IOP_ULOAD8 + ir->size : IOP_GENERIC;
+   case J_STORE:
+      *fn = interp_store;
+      return ir->size <= JIT_SZ_64 ? IOP_STORE8 + ir->size : IOP_GENERIC;
+   case J_JUMP:
+      *fn = interp_jump;
+      switch (ir->cc) {
+      case JIT_CC_NONE: return IOP_JUMP;
+      case JIT_CC_T: return IOP_JUMP_T;
+      case JIT_CC_F: return IOP_JUMP_F;
+      default: return IOP_GENERIC;
+      }
+   case J_FCMP: *fn = interp_fcmp; return IOP_GENERIC;
+   case J_TRAP: *fn = interp_trap; return IOP_GENERIC;
+   case J_CALL: *fn = interp_call; return IOP_GENERIC;
+   case MACRO_COPY: *fn = interp_copy; return IOP_GENERIC;
+   case MACRO_BZERO: *fn = interp_bzero; return IOP_GENERIC;
+   case MACRO_GALLOC: *fn = interp_galloc; return IOP_GENERIC;
+   case MACRO_LALLOC: *fn = interp_lalloc; return IOP_GENERIC;
+   case MACRO_EXIT: *fn = interp_exit; return IOP_GENERIC;
+   case MACRO_FEXP: *fn = interp_fexp; return IOP_GENERIC;
+   case MACRO_EXP: *fn = interp_exp; return IOP_GENERIC;
+   case MACRO_FFICALL: *fn = interp_fficall; return IOP_GENERIC;
+   case MACRO_GETPRIV: *fn = interp_getpriv; return IOP_GENERIC;
+   case MACRO_PUTPRIV: *fn = interp_putpriv; return IOP_GENERIC;
+   default: *fn = interp_bad_op; return IOP_GENERIC;
+   }
+}
+
+static interp_op_t *interp_decode(jit_func_t *f, const void *const *dispatch)
+{
+   interp_op_t *ops = xcalloc_array(f->nirs, sizeof(interp_op_t));
+
+   for (int i = 0; i < f->nirs; i++) {
+      jit_ir_t *ir = &(f->irbuf[i]);
+      interp_op_t *op = &(ops[i]);
+
+      interp_fn_t fn = NULL;
+      const interp_iop_t iop = interp_select(ir, &fn);
+
+      op->label  = dispatch[iop];
+      op->result = ir->result;
+
+      if (iop == IOP_GENERIC)
+         op->fn = fn;
+      else {
+         interp_decode_value(f, ir->arg1, &(op->r1), &(op->k1));
+         interp_decode_value(f, ir->arg2, &(op->r2), &(op->k2));
+      }
+   }
+
+   // Another thread may have decoded the same function concurrently
+   if (!atomic_cas(&(f->threaded), NULL, ops)) {
+      free(ops);
+      return load_acquire(&(f->threaded));
+   }
+
+   return ops;
+}
+
+static void interp_backedge(jit_interp_t *state)
+{
+   // Limit the number of loop iterations in bounded mode
+   if (--(state->backedge) == 0)
+      jit_msg(NULL, DIAG_FATAL, "maximum iteration limit reached");
+}
+
+static void interp_threaded(jit_interp_t *state)
+{
+   static const void *const dispatch[IOP_LAST] = {
+      [IOP_GENERIC] = &&GENERIC, [IOP_RECV] = &&RECV, [IOP_SEND] = &&SEND,
+      [IOP_AND] = &&AND, [IOP_OR] = &&OR, [IOP_XOR] = &&XOR,
+      [IOP_ADD] = &&ADD, [IOP_SUB] = &&SUB, [IOP_MUL] = &&MUL,
+      [IOP_DIV] = &&DIV, [IOP_REM] = &&REM, [IOP_FADD] = &&FADD,
+      [IOP_FSUB] = &&FSUB, [IOP_FMUL] = &&FMUL, [IOP_FDIV] = &&FDIV,
+      [IOP_NEG] = &&NEG, [IOP_FNEG] = &&FNEG, [IOP_NOT] = &&NOT,
+      [IOP_SCVTF] = &&SCVTF, [IOP_FCVTNS] = &&FCVTNS, [IOP_MOV] = &&MOV,
+      [IOP_CSEL] = &&CSEL, [IOP_CSET] = &&CSET, [IOP_CMP_EQ] = &&CMP_EQ,
+      [IOP_CMP_NE] = &&CMP_NE, [IOP_CMP_LT] = &&CMP_LT,
+      [IOP_CMP_GE] = &&CMP_GE, [IOP_CMP_GT] = &&CMP_GT,
+      [IOP_CMP_LE] = &&CMP_LE, [IOP_LOAD8] = &&LOAD8,
+      [IOP_LOAD16] = &&LOAD16, [IOP_LOAD32] = &&LOAD32,
+      [IOP_LOAD64] = &&LOAD64, [IOP_ULOAD8] = &&ULOAD8,
+      [IOP_ULOAD16] = &&ULOAD16, [IOP_ULOAD32] = &&ULOAD32,
+      [IOP_ULOAD64] = &&ULOAD64, [IOP_STORE8] = &&STORE8,
+      [IOP_STORE16] = &&STORE16, [IOP_STORE32] = &&STORE32,
+      [IOP_STORE64] = &&STORE64, [IOP_JUMP] = &&JUMP,
+      [IOP_JUMP_T] = &&JUMP_T, [IOP_JUMP_F] = &&JUMP_F,
+      [IOP_CASE] = &&CASE, [IOP_SALLOC] = &&SALLOC, [IOP_RET] = &&RET,
+      [IOP_NOP] = &&NOP,
+   };
+
+   jit_func_t *f = state->func;
+
+   const interp_op_t *ops = load_acquire(&(f->threaded));
+   if (ops == NULL)
+      ops = interp_decode(f, dispatch);
+
+   jit_scalar_t *regs = state->regs;
+   const interp_op_t *op = ops;
+   unsigned target;
+
+#define VAL1 (regs[op->r1].integer + op->k1.integer)
+#define VAL2 (regs[op->r2].integer + op->k2.integer)
+#define REAL1 ((jit_scalar_t){ .integer = VAL1 }.real)
+#define REAL2 ((jit_scalar_t){ .integer = VAL2 }.real)
+#define PTR1 ((void *)(intptr_t)VAL1)
+#define PTR2 ((void *)(intptr_t)VAL2)
+#define RESULT regs[op->result]
+
+#ifdef DEBUG
+#define DISPATCH() do {                                         \
+      state->pc = op - ops + 1;                                 \
+      JIT_ASSERT(state->pc <= f->nirs);                         \
+      goto *op->label;                                          \
+   } while (0)
+#else
+#define DISPATCH() goto *op->label
+#endif
+
+#define NEXT() do { op++; DISPATCH(); } while (0)
+
+   DISPATCH();
+
+ GENERIC:
+   state->pc = op - ops + 1;
+   (*op->fn)(state, &(f->irbuf[op - ops]));
+   NEXT();
+
+ RECV:
+   RESULT = state->args[op->k1.integer];
+   state->nargs = MAX(state->nargs, op->k1.integer + 1);
+   NEXT();
+
+ SEND:
+   state->args[op->k1.integer].integer = VAL2;
+   state->nargs = MAX(state->nargs, op->k1.integer + 1);
+   NEXT();
+
+ AND:
+   RESULT.integer = VAL1 && VAL2;
+   NEXT();
+
+ OR:
+   RESULT.integer = VAL1 || VAL2;
+   NEXT();
+
+ XOR:
+   RESULT.integer = VAL1 ^ VAL2;
+   NEXT();
+
+ ADD:
+   RESULT.integer = VAL1 + VAL2;
+   NEXT();
+
+ SUB:
+   RESULT.integer = VAL1 - VAL2;
+   NEXT();
+
+ MUL:
+   RESULT.integer = VAL1 * VAL2;
+   NEXT();
+
+ DIV:
+   RESULT.integer = VAL1 / VAL2;
+   NEXT();
+
+ REM:
+   {
+      const int64_t x = VAL1, y = VAL2;
+      RESULT.integer = x - (x / y) * y;
+   }
+   NEXT();
+
+ FADD:
+   RESULT.real = REAL1 + REAL2;
+   NEXT();
+
+ FSUB:
+   RESULT.real = REAL1 - REAL2;
+   NEXT();
+
+ FMUL:
+   RESULT.real = REAL1 * REAL2;
+   NEXT();
+
+ FDIV:
+   RESULT.real = REAL1 / REAL2;
+   NEXT();
+
+ NEG:
+   RESULT.integer = -VAL1;
+   NEXT();
+
+ FNEG:
+   RESULT.real = -REAL1;
+   NEXT();
+
+ NOT:
+   RESULT.integer = !VAL1;
+   NEXT();
+
+ SCVTF:
+   RESULT.real = VAL1;
+   NEXT();
+
+ FCVTNS:
+   RESULT.integer = round(REAL1);
+   NEXT();
+
+ MOV:
+   RESULT.integer = VAL1;
+   NEXT();
+
+ CSEL:
+   RESULT.integer = state->flags ? VAL1 : VAL2;
+   NEXT();
+
+ CSET:
+   RESULT.integer = !!(state->flags);
+   NEXT();
+
+ CMP_EQ:
+   state->flags = (VAL1 == VAL2) << JIT_CC_EQ;
+   NEXT();
+
+ CMP_NE:
+   state->flags = (VAL1 != VAL2) << JIT_CC_NE;
+   NEXT();
+
+ CMP_LT:
+   state->flags = (VAL1 < VAL2) << JIT_CC_LT;
+   NEXT();
+
+ CMP_GE:
+   state->flags = (VAL1 >= VAL2) << JIT_CC_GE;
+   NEXT();
+
+ CMP_GT:
+   state->flags = (VAL1 > VAL2) << JIT_CC_GT;
+   NEXT();
+
+ CMP_LE:
+   state->flags = (VAL1 <= VAL2) << JIT_CC_LE;
+   NEXT();
+
+ LOAD8:
+   RESULT.integer = *(int8_t *)PTR1;
+   NEXT();
+
+ LOAD16:
+   RESULT.integer = *(int16_t *)PTR1;
+   NEXT();
+
+ LOAD32:
+   RESULT.integer = *(int32_t *)PTR1;
+   NEXT();
+
+ LOAD64:
+   RESULT.integer = *(int64_t *)PTR1;
+   NEXT();
+
+ ULOAD8:
+   RESULT.integer = *(uint8_t *)PTR1;
+   NEXT();
+
+ ULOAD16:
+   RESULT.integer = *(uint16_t *)PTR1;
+   NEXT();
+
+ ULOAD32:
+   RESULT.integer = *(uint32_t *)PTR1;
+   NEXT();
+
+ ULOAD64:
+   RESULT.integer = *(uint64_t *)PTR1;
+   NEXT();
+
+ STORE8:
+   *(uint8_t *)PTR2 = VAL1;
+   NEXT();
+
+ STORE16:
+   *(uint16_t *)PTR2 = VAL1;
+   NEXT();
+
+ STORE32:
+   *(uint32_t *)PTR2 = VAL1;
+   NEXT();
+
+ STORE64:
+   *(uint64_t *)PTR2 = VAL1;
+   NEXT();
+
+ JUMP_T:
+   if (!state->flags)
+      NEXT();
+   goto JUMP;
+
+ JUMP_F:
+   if (state->flags)
+      NEXT();
+   goto JUMP;
+
+ JUMP:
+   target = op->k1.integer;
+   goto BRANCH;
+
+ CASE:
+   if (RESULT.integer != VAL1)
+      NEXT();
+   target = op->k2.integer;
+   goto BRANCH;
+
+ BRANCH:
+   JIT_ASSERT(target < f->nirs);
+   if (unlikely(state->backedge > 0) && ops + target <= op) {
+      state->pc = op - ops + 1;
+      interp_backedge(state);
+   }
+   op = ops + target;
+   DISPATCH();
+
+ SALLOC:
+   RESULT.pointer = state->frame + op->k1.integer;
+   NEXT();
+
+ NOP:
+   NEXT();
+
+ RET:
+   return;
+
+#undef VAL1
+#undef VAL2
+#undef REAL1
+#undef REAL2
+#undef PTR1
+#undef PTR2
+#undef RESULT
+#undef DISPATCH
+#undef NEXT
+}
+
 void jit_interp(jit_func_t *f, jit_anchor_t *caller, jit_scalar_t *args,
                 tlab_t *tlab)
 {
@@ -884,7 +1343,7 @@ void jit_interp(jit_func_t *f, jit_anchor_t *caller, jit_scalar_t *args,
    if (load_acquire(&(f->state)) != JIT_FUNC_READY || f->symbol /* XXX */)
       jit_irgen(f);
 
-   if (f->next_tier && --(f->hotness) <= 0)
+   if (load_acquire(&(f->next_tier)) && relaxed_add(&(f->hotness), -1) <= 0)
       jit_tier_up(f);
 
    jit_anchor_t anchor = {
@@ -894,7 +1353,7 @@ void jit_interp(jit_func_t *f, jit_anchor_t *caller, jit_scalar_t *args,
 
    // Using VLAs here as we need these allocated on the stack so the
    // mspace GC can scan them
-   jit_scalar_t regs[f->nregs];
+   jit_scalar_t regs[f->nregs + 1];
    unsigned char frame[f->framesz];
 
 #ifdef DEBUG
@@ -902,6 +1361,8 @@ void jit_interp(jit_func_t *f, jit_anchor_t *caller, jit_scalar_t *args,
    memset(frame, 0xde, f->framesz);
 #endif
 
+   regs[f->nregs].integer = 0;   // Zero register for threaded code
+
    jit_interp_t state = {
       .args     = args,
       .regs     = regs,
@@ -915,5 +1376,8 @@ void jit_interp(jit_func_t *f, jit_anchor_t *caller, jit_scalar_t *args,
       .tlab     = tlab,
    };
 
-   interp_loop(&state);
+   if (f->symbol == NULL && jit_use_threaded(f->jit))
+      interp_threaded(&state);
+   else
+      interp_loop(&state);
 }
@@ -16,6 +16,7 @@
 //
 
 #include "util.h"
+#include "array.h"
 #include "diag.h"
 #include "jit/jit-ffi.h"
 #include "jit/jit-ffi.h"
@@ -3533,6 +3534,25 @@ static void irgen_block(jit_irgen_t *g, vcode_block_t block)
    }
 }
 
+static size_t irgen_frame_layout(unsigned *varoff)
+{
+   size_t sz = 0;
+   sz += sizeof(void *);   // Context parameter
+   sz += sizeof(void *);   // Suspended procedure state
+   sz += sizeof(int32_t);  // State number
+
+   const int nvars = vcode_count_vars();
+   for (int i = 0; i < nvars; i++) {
+      vcode_type_t vtype = vcode_var_type(i);
+      const int align = irgen_align_of(vtype);
+      sz = ALIGN_UP(sz, align);
+      varoff[i] = sz;
+      sz += irgen_size_bytes(vtype);
+   }
+
+   return sz;
+}
+
 static void irgen_locals(jit_irgen_t *g)
 {
    const int nvars = g->func->nvars = vcode_count_vars();
@@ -3560,18 +3580,7 @@ static void irgen_locals(jit_irgen_t *g)
    }
    else {
       // Local variables on heap
-      size_t sz = 0;
-      sz += sizeof(void *);   // Context parameter
-      sz += sizeof(void *);   // Suspended procedure state
-      sz += sizeof(int32_t);  // State number
-
-      for (int i = 0; i < nvars; i++) {
-         vcode_type_t vtype = vcode_var_type(i);
-         const int align = irgen_align_of(vtype);
-         sz = ALIGN_UP(sz, align);
-         varoff[i] = sz;
-         sz += irgen_size_bytes(vtype);
-      }
+      const size_t sz = irgen_frame_layout(varoff);
 
       jit_value_t mem = macro_lalloc(g, jit_value_from_int64(sz));
       if (g->statereg.kind != JIT_VALUE_INVALID) {
@@ -3784,8 +3793,9 @@ void jit_irgen(jit_func_t *f)
    }
    g->labels = NULL;
 
-   jit_do_lvn(f);
-   jit_free_cfg(f);
+   jit_optim_stats_t stats = {};
+   jit_optimise(f, &stats);
+   jit_add_optim_stats(f->jit, &stats);
 
    // Function can be executed immediately after this store
    store_release(&(f->state), JIT_FUNC_READY);
@@ -3804,6 +3814,8 @@ void jit_irgen(jit_func_t *f)
       diag_printf(d, "%s: %d instructions", istr(f->name), f->nirs);
       if (f->cpoolsz > 0)
          diag_printf(d, "; %d cpool bytes", f->cpoolsz);
+      if (stats.deleted > 0)
+         diag_printf(d, "; %u deleted", stats.deleted);
       diag_printf(d, " [%d us]", ticks);
       diag_emit(d);
    }
@@ -3813,3 +3825,376 @@ void jit_irgen(jit_func_t *f)
    free(g->vars);
    free(g);
 }
+
+////////////////////////////////////////////////////////////////////////////////
+// Frame pointer maps
+
+typedef struct {
+   vcode_unit_t  unit;
+   vcode_type_t  type;
+   ident_t       name;
+   char         *ptr;
+   size_t        count;
+   bool          native;
+} walk_item_t;
+
+typedef struct {
+   jit_t            *jit;
+   mspace_t         *mspace;
+   jit_pointer_fn_t  fn;
+   void             *ctx;
+   bool              native;
+   A(walk_item_t)    worklist;
+} jit_walk_t;
+
+static int irgen_native_align(vcode_type_t vtype)
+{
+   // Natural alignment of the LLVM type generated by cgen
+   switch (vtype_kind(vtype)) {
+   case VCODE_TYPE_CARRAY:
+      return irgen_native_align(vtype_elem(vtype));
+   case VCODE_TYPE_RECORD:
+      {
+         const int nfields = vtype_fields(vtype);
+         int align = 1;
+         for (int i = 0; i < nfields; i++)
+            align = MAX(align, irgen_native_align(vtype_field(vtype, i)));
+
+         return align;
+      }
+   default:
+      return irgen_align_of(vtype);
+   }
+}
+
+static int irgen_native_size(vcode_type_t vtype)
+{
+   // Allocation size of the LLVM type generated by cgen
+   switch (vtype_kind(vtype)) {
+   case VCODE_TYPE_CARRAY:
+      return vtype_size(vtype) * irgen_native_size(vtype_elem(vtype));
+   case VCODE_TYPE_RECORD:
+      {
+         const int nfields = vtype_fields(vtype);
+         int bytes = 0;
+         for (int i = 0; i < nfields; i++) {
+            vcode_type_t ftype = vtype_field(vtype, i);
+            bytes = ALIGN_UP(bytes, irgen_native_align(ftype));
+            bytes += irgen_native_size(ftype);
+         }
+
+         return ALIGN_UP(bytes, irgen_native_align(vtype));
+      }
+   case VCODE_TYPE_SIGNAL:
+      return 2 * sizeof(void *);
+   default:
+      return irgen_size_bytes(vtype);
+   }
+}
+
+static int irgen_walk_align(jit_walk_t *w, vcode_type_t vtype)
+{
+   return w->native ? irgen_native_align(vtype) : irgen_align_of(vtype);
+}
+
+static int irgen_walk_size(jit_walk_t *w, vcode_type_t vtype)
+{
+   return w->native ? irgen_native_size(vtype) : irgen_size_bytes(vtype);
+}
+
+static bool irgen_has_pointers(vcode_type_t vtype)
+{
+   switch (vtype_kind(vtype)) {
+   case VCODE_TYPE_INT:
+   case VCODE_TYPE_OFFSET:
+   case VCODE_TYPE_REAL:
+      return false;
+   case VCODE_TYPE_CARRAY:
+      return irgen_has_pointers(vtype_elem(vtype));
+   case VCODE_TYPE_RECORD:
+      {
+         const int nfields = vtype_fields(vtype);
+         for (int i = 0; i < nfields; i++) {
+            if (irgen_has_pointers(vtype_field(vtype, i)))
+               return true;
+         }
+
+         return false;
+      }
+   default:
+      return true;
+   }
+}
+
+static void irgen_walk_push(jit_walk_t *w, vcode_unit_t unit,
+                            vcode_type_t vtype, void *ptr, size_t count)
+{
+   walk_item_t item = {
+      .unit   = unit,
+      .type   = vtype,
+      .ptr    = ptr,
+      .count  = count,
+      .native = w->native,
+   };
+   APUSH(w->worklist, item);
+}
+
+static void irgen_walk_push_frame(jit_walk_t *w, ident_t name, void *ptr)
+{
+   walk_item_t item = {
+      .type = VCODE_INVALID_TYPE,
+      .name = name,
+      .ptr  = ptr,
+   };
+   APUSH(w->worklist, item);
+}
+
+__attribute__((no_sanitize_address))
+static void irgen_walk_pointer(jit_walk_t *w, vcode_type_t vtype, void **ptr)
+{
+   if (!(*w->fn)(ptr, w->ctx) || *ptr == NULL)
+      return;
+
+   size_t objsz;
+   char *base = mspace_find(w->mspace, *ptr, &objsz);
+   if (base == NULL)
+      return;   // Not allocated on the heap
+
+   vcode_unit_t unit = vcode_active_unit();
+   vcode_type_t pointed = vtype_pointed(vtype);
+   size_t count = 1;
+
+   vcode_state_t state;
+   vcode_state_save(&state);
+
+   if (vtype_kind(pointed) == VCODE_TYPE_OPAQUE) {
+      // Access to an incomplete type whose full record type may be
+      // declared in a different unit
+      ident_t name = vtype_name(pointed);
+      if ((unit = vcode_find_named_record(name, &pointed)) == NULL)
+         fatal_trace("layout of type %s is not known", istr(name));
+
+      vcode_select_unit(unit);
+   }
+   else if (vtype_kind(vtype) == VCODE_TYPE_ACCESS
+            && vtype_kind(pointed) != VCODE_TYPE_UARRAY) {
+      // The length of an array designated by an access value is not
+      // stored anywhere so visit every element up to the end of the
+      // heap object
+      count = (base + objsz - (char *)*ptr) / irgen_walk_size(w, pointed);
+   }
+
+   const bool has_pointers = irgen_has_pointers(pointed);
+   vcode_state_restore(&state);
+
+   if (has_pointers)
+      irgen_walk_push(w, unit, pointed, *ptr, count);
+}
+
+__attribute__((no_sanitize_address))
+static void irgen_walk_type(jit_walk_t *w, vcode_type_t vtype, char *ptr)
+{
+   switch (vtype_kind(vtype)) {
+   case VCODE_TYPE_CARRAY:
+      {
+         vcode_type_t elem = vtype_elem(vtype);
+         if (!irgen_has_pointers(elem))
+            break;
+
+         const int count = vtype_size(vtype);
+         const int elemsz = irgen_walk_size(w, elem);
+         for (int i = 0; i < count; i++)
+            irgen_walk_type(w, elem, ptr + i * elemsz);
+      }
+      break;
+
+   case VCODE_TYPE_RECORD:
+      {
+         const int nfields = vtype_fields(vtype);
+         int offset = 0;
+         for (int i = 0; i < nfields; i++) {
+            vcode_type_t ftype = vtype_field(vtype, i);
+            offset = ALIGN_UP(offset, irgen_walk_align(w, ftype));
+            irgen_walk_type(w, ftype, ptr + offset);
+            offset += irgen_walk_size(w, ftype);
+         }
+      }
+      break;
+
+   case VCODE_TYPE_ACCESS:
+   case VCODE_TYPE_POINTER:
+      irgen_walk_pointer(w, vtype, (void **)ptr);
+      break;
+
+   case VCODE_TYPE_UARRAY:
+      {
+         void **data = (void **)ptr;
+         vcode_type_t elem = vtype_elem(vtype);
+
+         if (!(*w->fn)(data, w->ctx) || *data == NULL)
+            break;
+         else if (vtype_kind(elem) == VCODE_TYPE_SIGNAL)
+            break;   // Shared signal data is not on the heap
+         else if (!irgen_has_pointers(elem))
+            break;
+
+         const int32_t *dims = (int32_t *)(ptr + sizeof(void *));
+         const int ndims = vtype_dims(vtype);
+
+         size_t count = 1;
+         for (int i = 0; i < ndims; i++) {
+            const int32_t length = dims[i*2 + 1];   // Negative for downto
+            count *= length < 0 ? -length : length;
+         }
+
+         irgen_walk_push(w, vcode_active_unit(), elem, *data, count);
+      }
+      break;
+
+   case VCODE_TYPE_CONTEXT:
+      if ((*w->fn)((void **)ptr, w->ctx) && *(void **)ptr != NULL)
+         irgen_walk_push_frame(w, vtype_name(vtype), *(void **)ptr);
+      break;
+
+   case VCODE_TYPE_SIGNAL:
+   case VCODE_TYPE_FILE:
+      (*w->fn)((void **)ptr, w->ctx);
+      break;
+
+   default:
+      break;
+   }
+}
+
+static vcode_unit_t irgen_walk_unit(jit_walk_t *w, ident_t name)
+{
+   vcode_unit_t vu = NULL;
+   w->native = false;
+
+   jit_handle_t handle = jit_lazy_compile(w->jit, name);
+   if (handle != JIT_HANDLE_INVALID) {
+      jit_func_t *f = jit_get_func(w->jit, handle);
+      vu = f->unit;
+
+      // Code loaded from the AOT library was generated by cgen which
+      // lays out frames and records differently
+      w->native = (f->symbol != NULL);
+   }
+
+   // Functions loaded from a shared library do not keep a reference to
+   // their intermediate code
+   if (vu == NULL && (vu = vcode_find_unit(name)) == NULL)
+      fatal_trace("missing intermediate code for %s", istr(name));
+
+   return vu;
+}
+
+static void irgen_native_layout(unsigned *varoff, size_t *pcalloff,
+                                size_t *stateoff)
+{
+   // Matches the frame structure generated by cgen_state_type
+   size_t sz = sizeof(void *);   // Context parameter
+
+   bool has_fsm = false;
+   switch (vcode_unit_kind()) {
+   case VCODE_UNIT_PROCESS:
+   case VCODE_UNIT_PROCEDURE:
+      has_fsm = true;
+      break;
+   case VCODE_UNIT_FUNCTION:
+      has_fsm = (vcode_unit_result() == VCODE_INVALID_TYPE);
+      break;
+   default:
+      break;
+   }
+
+   if (has_fsm) {
+      *stateoff = sz;
+      sz += sizeof(void *);   // State number
+      *pcalloff = sz;
+      sz += sizeof(void *);   // Suspended procedure state
+      sz += sizeof(void *);   // Saved TLAB watermark
+   }
+   else
+      *stateoff = *pcalloff = 0;
+
+   const int nvars = vcode_count_vars();
+   for (int i = 0; i < nvars; i++) {
+      vcode_type_t vtype = vcode_var_type(i);
+      sz = ALIGN_UP(sz, irgen_native_align(vtype));
+      varoff[i] = sz;
+      sz += irgen_native_size(vtype);
+   }
+}
+
+__attribute__((no_sanitize_address))
+static void irgen_walk_frame(jit_walk_t *w, ident_t name, char *frame)
+{
+   vcode_select_unit(irgen_walk_unit(w, name));
+
+   const int nvars = vcode_count_vars();
+   unsigned *varoff LOCAL = xmalloc_array(nvars, sizeof(unsigned));
+
+   size_t pcalloff = sizeof(void *), stateoff = 2 * sizeof(void *);
+   if (w->native) {
+      irgen_native_layout(varoff, &pcalloff, &stateoff);
+
+      // The saved TLAB watermark follows the suspended procedure state
+      if (pcalloff != 0)
+         (*w->fn)((void **)(frame + pcalloff + sizeof(void *)), w->ctx);
+   }
+   else
+      irgen_frame_layout(varoff);
+
+   // The context pointer always refers to an enclosing frame which is
+   // walked separately
+   (*w->fn)((void **)frame, w->ctx);
+
+   void **pcall = (void **)(frame + pcalloff);
+   if (pcalloff != 0 && (*w->fn)(pcall, w->ctx) && *pcall != NULL) {
+      // A procedure which suspended in a wait statement is resumed at
+      // the start of the block stored in the state number
+      const int32_t state = *(int32_t *)(frame + stateoff);
+      if (state >= 0 && state < vcode_count_blocks()) {
+         vcode_select_block(state);
+         if (vcode_count_ops() > 0 && vcode_get_op(0) == VCODE_OP_RESUME)
+            irgen_walk_push_frame(w, vcode_get_func(0), *pcall);
+      }
+   }
+
+   for (int i = 0; i < nvars; i++)
+      irgen_walk_type(w, vcode_var_type(i), frame + varoff[i]);
+}
+
+void jit_walk_frame(jit_t *j, jit_handle_t handle, void *frame,
+                    jit_pointer_fn_t fn, void *ctx)
+{
+   vcode_state_t state;
+   vcode_state_save(&state);
+
+   jit_walk_t w = {
+      .jit    = j,
+      .mspace = jit_get_mspace(j),
+      .fn     = fn,
+      .ctx    = ctx,
+   };
+
+   irgen_walk_push_frame(&w, jit_get_name(j, handle), frame);
+
+   while (w.worklist.count > 0) {
+      const walk_item_t item = APOP(w.worklist);
+      if (item.type == VCODE_INVALID_TYPE)
+         irgen_walk_frame(&w, item.name, item.ptr);
+      else {
+         vcode_select_unit(item.unit);
+         w.native = item.native;
+
+         const size_t elemsz = irgen_walk_size(&w, item.type);
+         for (size_t i = 0; i < item.count; i++)
+            irgen_walk_type(&w, item.type, item.ptr + i * elemsz);
+      }
+   }
+
+   ACLEAR(w.worklist);
+   vcode_state_restore(&state);
+}
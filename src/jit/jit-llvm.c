@@ -28,11 +28,22 @@
 #include "thread.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
 #include <libgen.h>
 #include <stdlib.h>
 #include <limits.h>
 #include <string.h>
 #include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#if HAVE_GIT_SHA
+#include "gitsha.h"
+#define GIT_SHA_ONLY(x) x
+#else
+#define GIT_SHA_ONLY(x)
+#endif
 
 #include <llvm-c/Analysis.h>
 #include <llvm-c/BitReader.h>
@@ -143,6 +154,7 @@ typedef struct _llvm_obj {
    LLVMValueRef          ctor[CTOR_MAX_ORDER];
    LLVMMetadataRef       debugcu;
    shash_t              *string_pool;
+   bool                  cached;   // JIT code saved for later runs
 } llvm_obj_t;
 
 typedef struct _cgen_block {
@@ -441,7 +453,9 @@ static void llvm_finalise(llvm_obj_t *obj)
 }
 
 static LLVMTargetMachineRef llvm_target_machine(LLVMRelocMode reloc,
-                                                LLVMCodeModel model)
+                                                LLVMCodeModel model,
+                                                const char *cpu,
+                                                const char *features)
 {
    char *def_triple = LLVMGetDefaultTargetTriple();
    char *error;
@@ -450,7 +464,7 @@ static LLVMTargetMachineRef llvm_target_machine(LLVMRelocMode reloc,
       fatal("failed to get LLVM target for %s: %s", def_triple, error);
 
    LLVMTargetMachineRef tm = LLVMCreateTargetMachine(target_ref, def_triple,
-                                                     "", "",
+                                                     cpu, features,
                                                      LLVMCodeGenLevelDefault,
                                                      reloc, model);
    LLVMDisposeMessage(def_triple);
@@ -1677,13 +1691,16 @@ static void cgen_op_call(llvm_obj_t *obj, cgen_block_t *cgb, jit_ir_t *ir)
 
       fptr = LLVMBuildLoad2(obj->builder, obj->types[LLVM_PTR], global, "");
 
-#if CLOSED_WORLD
-      entry = llvm_add_fn(obj, istr(callee->name), obj->types[LLVM_ENTRY_FN]);
-#else
-      // Must have acquire semantics to synchronise with installing new code
-      entry = LLVMBuildLoad2(obj->builder, obj->types[LLVM_PTR], fptr, "entry");
-      LLVMSetOrdering(entry, LLVMAtomicOrderingAcquire);
-#endif
+      if (CLOSED_WORLD && !obj->cached)
+         entry = llvm_add_fn(obj, istr(callee->name),
+                             obj->types[LLVM_ENTRY_FN]);
+      else {
+         // Must have acquire semantics to synchronise with installing
+         // new code
+         entry = LLVMBuildLoad2(obj->builder, obj->types[LLVM_PTR],
+                                fptr, "entry");
+         LLVMSetOrdering(entry, LLVMAtomicOrderingAcquire);
+      }
    }
    else {
       entry = llvm_ptr(obj, callee->entry);
@@ -1860,6 +1877,21 @@ static void cgen_macro_getpriv(llvm_obj_t *obj, cgen_block_t *cgb, jit_ir_t *ir)
 {
    jit_func_t *f = jit_get_func(cgb->func->source->jit, ir->arg1.handle);
 
+   if (obj->ctor[1] == NULL) {
+      // No constructor to cache the pointer in when generating code
+      // for the JIT
+      LLVMValueRef args[] = {
+         cgen_get_value(obj, cgb, ir->arg1)
+      };
+      LLVMValueRef ptrptr =
+         llvm_call_fn(obj, LLVM_GETPRIV, args, ARRAY_LEN(args));
+      LLVMValueRef ptr =
+         LLVMBuildLoad2(obj->builder, obj->types[LLVM_PTR], ptrptr, "");
+
+      cgen_pointer_result(obj, cgb, ir, ptr);
+      return;
+   }
+
    LOCAL_TEXT_BUF tb = tb_new();
    tb_istr(tb, f->name);
    tb_cat(tb, ".privdata");
@@ -2360,19 +2392,22 @@ static void cgen_function(llvm_obj_t *obj, cgen_func_t *func)
       cgen_add_ctor(obj, 0);
       cgen_aot_cpool(obj, func);
 
-      LLVMValueRef args[] = {
-         llvm_const_string(obj, func->name),
-         PTR(func->llvmfn),
-         PTR(cgen_debug_irbuf(obj, func->source)),
-         llvm_int32(obj, func->source->nirs),
-         cgen_rematerialise_object(obj, func->source->object),
-         llvm_int64(obj, func->source->spec),
-      };
-      llvm_call_fn(obj, LLVM_REGISTER, args, ARRAY_LEN(args));
+      // Cached JIT code is loaded for a function that already exists
+      if (!obj->cached) {
+         LLVMValueRef args[] = {
+            llvm_const_string(obj, func->name),
+            PTR(func->llvmfn),
+            PTR(cgen_debug_irbuf(obj, func->source)),
+            llvm_int32(obj, func->source->nirs),
+            cgen_rematerialise_object(obj, func->source->object),
+            llvm_int64(obj, func->source->spec),
+         };
+         llvm_call_fn(obj, LLVM_REGISTER, args, ARRAY_LEN(args));
 
 #if !CLOSED_WORLD
-      LLVMSetLinkage(func->llvmfn, LLVMInternalLinkage);
+         LLVMSetLinkage(func->llvmfn, LLVMInternalLinkage);
 #endif
+      }
    }
 
    LLVMBasicBlockRef entry_bb = llvm_append_block(obj, func->llvmfn, "entry");
@@ -2570,8 +2605,140 @@ typedef struct {
    LLVMOrcExecutionSessionRef  session;
    LLVMOrcJITDylibRef          dylib;
    LLVMTargetMachineRef        target;
+   char                       *cachedir;
+   uint64_t                    cachekey;
+   nvc_lock_t                  lock;
 } lljit_state_t;
 
+static uint64_t jit_cache_hash(uint64_t hash, const char *str)
+{
+   // FNV-1a including the terminating null so adjacent strings do not
+   // run together
+   do {
+      hash = (hash ^ (uint8_t)*str) * UINT64_C(0x100000001b3);
+   } while (*str++ != '\0');
+
+   return hash;
+}
+
+static void jit_cache_init(lljit_state_t *state, const char *cpu,
+                           const char *features)
+{
+   // Object code can only be reused with the same compiler, LLVM
+   // version, and host CPU
+   char config[64];
+   checked_sprintf(config, sizeof(config), "%d/%d", RT_ABI_VERSION,
+                   opt_get_int(OPT_OPTIMISE));
+
+   uint64_t key = UINT64_C(0xcbf29ce484222325);
+   key = jit_cache_hash(key, PACKAGE_VERSION);
+   GIT_SHA_ONLY(key = jit_cache_hash(key, GIT_SHA));
+   key = jit_cache_hash(key, LLVM_VERSION);
+   key = jit_cache_hash(key, cpu);
+   key = jit_cache_hash(key, features);
+   key = jit_cache_hash(key, config);
+
+   char *dir = xasprintf("%s" DIR_SEP "_NVC_JIT", lib_path(lib_work()));
+
+#ifdef __MINGW32__
+   const int rc = mkdir(dir);
+#else
+   const int rc = mkdir(dir, 0777);
+#endif
+   if (rc != 0 && errno != EEXIST) {
+      free(dir);
+      return;   // The cache is optional
+   }
+
+   state->cachedir = dir;
+   state->cachekey = key;
+}
+
+static char *jit_cache_path(lljit_state_t *state, jit_func_t *f)
+{
+   if (state->cachedir == NULL || f->object == NULL)
+      return NULL;
+
+   // The checksum of the library unit also covers its dependencies
+   const uint32_t checksum = arena_get_checksum(object_arena(f->object));
+   if (checksum == 0)
+      return NULL;   // Not saved in a library
+
+   const uint64_t hash = jit_cache_hash(state->cachekey, istr(f->name));
+   return xasprintf("%s" DIR_SEP "%08x%016"PRIx64".o", state->cachedir,
+                    checksum, hash);
+}
+
+static void jit_cache_save(const char *path, LLVMMemoryBufferRef buf)
+{
+   // Write to a temporary file first so other processes never see a
+   // partial object
+   char *tmp LOCAL = xasprintf("%s.%d.%d", path, getpid(), thread_id());
+
+   FILE *f = fopen(tmp, "wb");
+   if (f == NULL)
+      return;
+
+   const size_t size = LLVMGetBufferSize(buf);
+   const bool ok = fwrite(LLVMGetBufferStart(buf), size, 1, f) == 1;
+
+   if (fclose(f) != 0 || !ok || rename(tmp, path) != 0)
+      remove(tmp);
+}
+
+static bool jit_cache_check(LLVMErrorRef error, const char *path)
+{
+   if (error == LLVMErrorSuccess)
+      return true;
+
+   char *msg = LLVMGetErrorMessage(error);
+   if (opt_get_verbose(OPT_JIT_VERBOSE, NULL))
+      debugf("ignoring cached object %s: %s", path, msg);
+   LLVMDisposeErrorMessage(msg);
+
+   return false;
+}
+
+static jit_entry_fn_t jit_cache_link(lljit_state_t *state,
+                                     LLVMMemoryBufferRef buf,
+                                     const char *name, const char *path)
+{
+   // Symbols from an object which fails to link are removed with the
+   // resource tracker so the function can be generated again
+   LLVMOrcResourceTrackerRef rt =
+      LLVMOrcJITDylibCreateResourceTracker(state->dylib);
+
+   bool ok = jit_cache_check(
+      LLVMOrcLLJITAddObjectFileWithRT(state->jit, rt, buf), path);
+
+   // The constructors resolve references to other functions, foreign
+   // symbols, and design objects by name
+   LLVMOrcJITTargetAddress ctors[CTOR_MAX_ORDER];
+   for (int i = 0; ok && i < CTOR_MAX_ORDER; i++) {
+      char *ctor LOCAL = xasprintf("%s.ctor%d", name, i);
+      ok = jit_cache_check(
+         LLVMOrcLLJITLookup(state->jit, &(ctors[i]), ctor), path);
+   }
+
+   LLVMOrcJITTargetAddress addr = 0;
+   if (ok)
+      ok = jit_cache_check(LLVMOrcLLJITLookup(state->jit, &addr, name), path);
+
+   if (!ok) {
+      LLVMConsumeError(LLVMOrcResourceTrackerRemove(rt));
+      LLVMOrcReleaseResourceTracker(rt);
+      remove(path);   // Truncated or written by an incompatible version
+      return NULL;
+   }
+
+   LLVMOrcReleaseResourceTracker(rt);
+
+   for (int i = 0; i < CTOR_MAX_ORDER; i++)
+      (*(void (*)(void))ctors[i])();
+
+   return (jit_entry_fn_t)addr;
+}
+
 static void *jit_llvm_init(void)
 {
    LLVMInitializeNativeTarget();
@@ -2583,11 +2750,21 @@ static void *jit_llvm_init(void)
 
    LLVM_CHECK(LLVMOrcCreateLLJIT, &state->jit, builder);
 
+   char *cpu = LLVMGetHostCPUName();
+   char *features = LLVMGetHostCPUFeatures();
+
    state->session = LLVMOrcLLJITGetExecutionSession(state->jit);
    state->dylib   = LLVMOrcLLJITGetMainJITDylib(state->jit);
    state->context = LLVMOrcCreateNewThreadSafeContext();
    state->target  = llvm_target_machine(LLVMRelocDefault,
-                                        LLVMCodeModelJITDefault);
+                                        LLVMCodeModelJITDefault,
+                                        cpu, features);
+
+   if (opt_get_int(OPT_JIT_CACHE))
+      jit_cache_init(state, cpu, features);
+
+   LLVMDisposeMessage(cpu);
+   LLVMDisposeMessage(features);
 
    const char prefix = LLVMOrcLLJITGetGlobalPrefix(state->jit);
 
@@ -2600,6 +2777,18 @@ static void *jit_llvm_init(void)
    return state;
 }
 
+static void jit_llvm_add_ctors(llvm_obj_t *obj, const char *name)
+{
+   // Unlike ahead-of-time code these are called explicitly after
+   // linking so must have external names unique to this function
+   for (int i = 0; i < CTOR_MAX_ORDER; i++) {
+      char *ctor LOCAL = xasprintf("%s.ctor%d", name, i);
+      obj->ctor[i] = LLVMAddFunction(obj->module, ctor,
+                                     obj->types[LLVM_CTOR_FN]);
+      llvm_append_block(obj, obj->ctor[i], "entry");
+   }
+}
+
 static void jit_llvm_cgen(jit_t *j, jit_handle_t handle, void *context)
 {
    lljit_state_t *state = context;
@@ -2610,53 +2799,122 @@ static void jit_llvm_cgen(jit_t *j, jit_handle_t handle, void *context)
    if (only != NULL && !icmp(f->name, only))
       return;
 
-   const uint64_t start_us = get_timestamp_us();
+   // The LLVM context and target machine are shared between the
+   // background compile thread and synchronous callers such as cached
+   // functions so only one function can be generated at a time
+   SCOPED_LOCK(state->lock);
 
-   llvm_obj_t obj = {
-      .context = LLVMOrcThreadSafeContextGetContext(state->context),
-      .target  = state->target,
-   };
+   const uint64_t start_us = get_timestamp_us();
 
    LOCAL_TEXT_BUF tb = tb_new();
    tb_istr(tb, f->name);
 
-   obj.module    = LLVMModuleCreateWithNameInContext(tb_get(tb), obj.context);
-   obj.builder   = LLVMCreateBuilderInContext(obj.context);
-   obj.debuginfo = LLVMCreateDIBuilderDisallowUnresolved(obj.module);
-   obj.data_ref  = LLVMCreateTargetDataLayout(obj.target);
+   char *cache LOCAL = jit_cache_path(state, f);
+   jit_entry_fn_t addr = NULL;
 
-   llvm_register_types(&obj);
+   if (cache != NULL) {
+      LLVMMemoryBufferRef buf;
+      char *error;
+      if (!LLVMCreateMemoryBufferWithContentsOfFile(cache, &buf, &error))
+         addr = jit_cache_link(state, buf, tb_get(tb), cache);
+      else
+         LLVMDisposeMessage(error);
+   }
 
-   cgen_func_t func = {
-      .name   = tb_claim(tb),
-      .source = f,
-   };
+   if (addr == NULL) {
+      llvm_obj_t obj = {
+         .context = LLVMOrcThreadSafeContextGetContext(state->context),
+         .target  = state->target,
+         .cached  = cache != NULL,
+      };
+
+      obj.module    = LLVMModuleCreateWithNameInContext(tb_get(tb),
+                                                        obj.context);
+      obj.builder   = LLVMCreateBuilderInContext(obj.context);
+      obj.debuginfo = LLVMCreateDIBuilderDisallowUnresolved(obj.module);
+      obj.data_ref  = LLVMCreateTargetDataLayout(obj.target);
+
+      llvm_register_types(&obj);
+
+      if (obj.cached) {
+         // Generate position independent code which is saved to the
+         // cache as an object file
+         char *triple = LLVMGetTargetMachineTriple(obj.target);
+         LLVMSetTarget(obj.module, triple);
+         LLVMDisposeMessage(triple);
+
+         LLVMSetModuleDataLayout(obj.module, obj.data_ref);
+
+         jit_llvm_add_ctors(&obj, tb_get(tb));
+      }
+
+      cgen_func_t func = {
+         .name   = xstrdup(tb_get(tb)),
+         .source = f,
+      };
+
+      cgen_function(&obj, &func);
 
-   cgen_function(&obj, &func);
+      if (obj.fns[LLVM_TLAB_ALLOC] != NULL)
+         cgen_tlab_alloc_body(&obj);
 
-   if (obj.fns[LLVM_TLAB_ALLOC] != NULL)
-      cgen_tlab_alloc_body(&obj);
+      if (obj.cached) {
+         for (int i = 0; i < CTOR_MAX_ORDER; i++) {
+            LLVMBasicBlockRef bb = LLVMGetLastBasicBlock(obj.ctor[i]);
+            LLVMPositionBuilderAtEnd(obj.builder, bb);
+            LLVMBuildRetVoid(obj.builder);
+         }
+      }
 
-   llvm_finalise(&obj);
+      llvm_finalise(&obj);
 
-   LLVMOrcThreadSafeModuleRef tsm =
-      LLVMOrcCreateNewThreadSafeModule(obj.module, state->context);
-   LLVMOrcLLJITAddLLVMIRModule(state->jit, state->dylib, tsm);
+      if (obj.cached) {
+         LLVMMemoryBufferRef buf;
+         char *error;
+         if (LLVMTargetMachineEmitToMemoryBuffer(obj.target, obj.module,
+                                                 LLVMObjectFile, &error,
+                                                 &buf))
+            fatal("failed to generate object code for %s: %s",
+                  func.name, error);
 
-   LLVMOrcJITTargetAddress addr;
-   LLVM_CHECK(LLVMOrcLLJITLookup, state->jit, &addr, func.name);
+         LLVMDisposeModule(obj.module);
+
+         jit_cache_save(cache, buf);
+
+         if ((addr = jit_cache_link(state, buf, func.name, cache)) == NULL)
+            fatal("failed to link generated code for %s", func.name);
+      }
+      else {
+         LLVMOrcThreadSafeModuleRef tsm =
+            LLVMOrcCreateNewThreadSafeModule(obj.module, state->context);
+         LLVMOrcLLJITAddLLVMIRModule(state->jit, state->dylib, tsm);
+
+         LLVMOrcJITTargetAddress ptr;
+         LLVM_CHECK(LLVMOrcLLJITLookup, state->jit, &ptr, func.name);
+         addr = (jit_entry_fn_t)ptr;
+      }
+
+      LLVMDisposeTargetData(obj.data_ref);
+      LLVMDisposeBuilder(obj.builder);
+      free(func.name);
+   }
 
    const uint64_t end_us = get_timestamp_us();
    static __thread uint64_t slowest = 0;
-   if (end_us - start_us > slowest)
-      debugf("%s at %p [%"PRIi64" us]", func.name, (void *)addr,
+   if (opt_get_verbose(OPT_JIT_VERBOSE, tb_get(tb))
+       && end_us - start_us > slowest)
+      debugf("%s at %p [%"PRIi64" us]", tb_get(tb), addr,
              (slowest = end_us - start_us));
 
-   store_release(&f->entry, (jit_entry_fn_t)addr);
+   store_release(&f->entry, addr);
+}
 
-   LLVMDisposeTargetData(obj.data_ref);
-   LLVMDisposeBuilder(obj.builder);
-   free(func.name);
+static bool jit_llvm_cached(jit_t *j, jit_handle_t handle, void *context)
+{
+   lljit_state_t *state = context;
+
+   char *cache LOCAL = jit_cache_path(state, jit_get_func(j, handle));
+   return cache != NULL && access(cache, R_OK) == 0;
 }
 
 static void jit_llvm_cleanup(void *context)
@@ -2666,12 +2924,14 @@ static void jit_llvm_cleanup(void *context)
    LLVMOrcDisposeThreadSafeContext(state->context);
    LLVMOrcDisposeLLJIT(state->jit);
 
+   free(state->cachedir);
    free(state);
 }
 
 static const jit_plugin_t jit_llvm = {
    .init    = jit_llvm_init,
    .cgen    = jit_llvm_cgen,
+   .cached  = jit_llvm_cached,
    .cleanup = jit_llvm_cleanup
 };
 
@@ -2697,7 +2957,8 @@ llvm_obj_t *llvm_obj_new(const char *name)
    obj->context   = LLVMContextCreate();
    obj->module    = LLVMModuleCreateWithNameInContext(name, obj->context);
    obj->builder   = LLVMCreateBuilderInContext(obj->context);
-   obj->target    = llvm_target_machine(LLVMRelocPIC, LLVMCodeModelDefault);
+   obj->target    = llvm_target_machine(LLVMRelocPIC, LLVMCodeModelDefault,
+                                        "", "");
    obj->data_ref  = LLVMCreateTargetDataLayout(obj->target);
    obj->debuginfo = LLVMCreateDIBuilderDisallowUnresolved(obj->module);
 
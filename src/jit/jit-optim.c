@@ -361,6 +361,7 @@ static valnum_t lvn_value_num(jit_value_t value, lvn_state_t *state)
       return VN_INVALID;
 
    case JIT_VALUE_HANDLE:
+   case JIT_VALUE_DOUBLE:
       return state->nextvn++;
 
    default:
@@ -470,7 +471,7 @@ static void jit_lvn_mul(jit_ir_t *ir, lvn_state_t *state)
          lvn_mov_const(ir, state, 0);
          return;
       }
-      else if (ir->arg2.int64 == 1) {
+      else if (ir->arg2.int64 == 1 && ir->arg1.kind == JIT_VALUE_REG) {
          lvn_mov_reg(ir, state, ir->arg1.reg);
          return;
       }
@@ -499,7 +500,8 @@ static void jit_lvn_add(jit_ir_t *ir, lvn_state_t *state)
 
    lvn_commute_const(ir);
 
-   if (ir->arg2.kind == JIT_VALUE_INT64 && ir->arg2.int64 == 0) {
+   if (ir->arg2.kind == JIT_VALUE_INT64 && ir->arg2.int64 == 0
+       && ir->arg1.kind == JIT_VALUE_REG) {
       lvn_mov_reg(ir, state, ir->arg1.reg);
       return;
    }
@@ -525,7 +527,8 @@ static void jit_lvn_sub(jit_ir_t *ir, lvn_state_t *state)
 #undef FOLD_SUB
    }
 
-   if (ir->arg2.kind == JIT_VALUE_INT64 && ir->arg2.int64 == 0) {
+   if (ir->arg2.kind == JIT_VALUE_INT64 && ir->arg2.int64 == 0
+       && ir->arg1.kind == JIT_VALUE_REG) {
       lvn_mov_reg(ir, state, ir->arg1.reg);
       return;
    }
@@ -602,3 +605,630 @@ void jit_do_lvn(jit_func_t *f)
    free(state.regvn);
    free(state.hashtab);
 }
+
+////////////////////////////////////////////////////////////////////////////////
+// Helpers shared by the global passes
+
+static bool optim_is_pure(jit_ir_t *ir)
+{
+   // True for instructions whose only effect is to write the result
+   // register and so can be deleted if the result is never read
+   if (ir->cc != JIT_CC_NONE)
+      return false;   // Also writes flags
+
+   switch (ir->op) {
+   case J_MOV:
+   case J_ADD:
+   case J_SUB:
+   case J_MUL:
+   case J_NEG:
+   case J_NOT:
+   case J_AND:
+   case J_OR:
+   case J_XOR:
+   case J_LEA:
+   case J_CSET:
+   case J_CSEL:
+   case J_RECV:
+   case J_LOAD:
+   case J_ULOAD:
+   case J_FADD:
+   case J_FSUB:
+   case J_FMUL:
+   case J_FDIV:
+   case J_FNEG:
+   case J_SCVTF:
+   case J_FCVTNS:
+   case MACRO_EXP:
+   case MACRO_FEXP:
+      return true;
+   default:
+      return false;
+   }
+}
+
+static void optim_make_nop(jit_ir_t *ir)
+{
+   ir->op        = J_NOP;
+   ir->size      = JIT_SZ_UNSPEC;
+   ir->cc        = JIT_CC_NONE;
+   ir->result    = JIT_REG_INVALID;
+   ir->arg1.kind = JIT_VALUE_INVALID;
+   ir->arg2.kind = JIT_VALUE_INVALID;
+}
+
+static void optim_make_mov(jit_ir_t *ir, jit_value_t value)
+{
+   ir->op        = J_MOV;
+   ir->size      = JIT_SZ_UNSPEC;
+   ir->cc        = JIT_CC_NONE;
+   ir->arg1      = value;
+   ir->arg2.kind = JIT_VALUE_INVALID;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Global constant and copy propagation
+
+#define DEF_NONE     -1
+#define DEF_MULTIPLE -2
+
+static inline bool cprop_is_const(jit_value_t value)
+{
+   return value.kind == JIT_VALUE_INT64 || value.kind == JIT_VALUE_DOUBLE;
+}
+
+static bool cprop_accepts_double(jit_ir_t *ir)
+{
+   switch (ir->op) {
+   case J_MOV:
+   case J_FADD:
+   case J_FSUB:
+   case J_FMUL:
+   case J_FDIV:
+   case J_FNEG:
+   case J_FCMP:
+   case J_FCVTNS:
+   case MACRO_FEXP:
+      return true;
+   default:
+      return false;
+   }
+}
+
+static bool cprop_replace(jit_ir_t *ir, jit_value_t *value, jit_value_t subst)
+{
+   switch (subst.kind) {
+   case JIT_VALUE_INVALID:
+      return false;
+   case JIT_VALUE_REG:
+      if (value->kind != JIT_VALUE_REG && value->kind != JIT_ADDR_REG)
+         return false;
+      value->reg = subst.reg;   // Keep any displacement
+      return true;
+   case JIT_VALUE_DOUBLE:
+      if (value->kind != JIT_VALUE_REG || !cprop_accepts_double(ir))
+         return false;
+      *value = subst;
+      return true;
+   default:
+      if (value->kind != JIT_VALUE_REG)
+         return false;
+      *value = subst;
+      return true;
+   }
+}
+
+static bool cprop_reads_between(jit_func_t *f, int from, int to, jit_reg_t reg)
+{
+   for (int i = from + 1; i < to; i++) {
+      jit_ir_t *ir = &(f->irbuf[i]);
+      if (cfg_get_reg(ir->arg1) == reg || cfg_get_reg(ir->arg2) == reg)
+         return true;
+      else if (cfg_reads_result(ir) && ir->result == reg)
+         return true;
+   }
+
+   return false;
+}
+
+static bool cprop_copy_is_safe(jit_func_t *f, jit_cfg_t *cfg, int *defs,
+                               jit_reg_t dest, jit_reg_t src)
+{
+   // A copy "MOV dest, src" can replace every use of dest with src if
+   // src cannot change between the copy and any of those uses
+
+   const int srcdef = defs[src], destdef = defs[dest];
+   if (srcdef < 0 || src == dest)
+      return false;
+
+   jit_block_t *srcbb = jit_block_for(cfg, srcdef);
+   if (srcbb == cfg->blocks && srcbb->in.count == 0)
+      return true;   // Defined exactly once on entry
+
+   // Otherwise both definitions must be in the same block so that any
+   // path back to the copy first passes through the definition of src
+   // and then the copy itself
+   if (jit_block_for(cfg, destdef) != srcbb || srcdef > destdef)
+      return false;
+
+   return !cprop_reads_between(f, srcdef, destdef, dest);
+}
+
+int jit_do_cprop(jit_func_t *f)
+{
+   if (f->nregs == 0)
+      return 0;
+
+   jit_cfg_t *cfg = jit_get_cfg(f);
+
+   int *defs LOCAL = xmalloc_array(f->nregs, sizeof(int));
+   for (int i = 0; i < f->nregs; i++)
+      defs[i] = DEF_NONE;
+
+   for (int i = 0; i < f->nirs; i++) {
+      jit_ir_t *ir = &(f->irbuf[i]);
+      if (cfg_writes_result(ir))
+         defs[ir->result] = defs[ir->result] == DEF_NONE ? i : DEF_MULTIPLE;
+   }
+
+   // Registers that are read before being written on some path from
+   // the entry may hold a value from a previous call
+   bit_mask_t *entry = &(cfg->blocks[0].livein);
+
+   jit_value_t *subst LOCAL = xcalloc_array(f->nregs, sizeof(jit_value_t));
+
+   bool changed;
+   do {
+      changed = false;
+
+      for (int i = 0; i < f->nregs; i++) {
+         if (defs[i] < 0 || subst[i].kind != JIT_VALUE_INVALID)
+            continue;
+         else if (mask_test(entry, i))
+            continue;
+
+         jit_ir_t *ir = &(f->irbuf[defs[i]]);
+         if (ir->op != J_MOV)
+            continue;
+         else if (cprop_is_const(ir->arg1))
+            subst[i] = ir->arg1;
+         else if (ir->arg1.kind != JIT_VALUE_REG)
+            continue;
+         else if (cprop_is_const(subst[ir->arg1.reg]))
+            subst[i] = subst[ir->arg1.reg];
+         else
+            continue;
+
+         changed = true;
+      }
+   } while (changed);
+
+   for (int i = 0; i < f->nregs; i++) {
+      if (defs[i] < 0 || subst[i].kind != JIT_VALUE_INVALID)
+         continue;
+      else if (mask_test(entry, i))
+         continue;
+
+      jit_ir_t *ir = &(f->irbuf[defs[i]]);
+      if (ir->op != J_MOV || ir->arg1.kind != JIT_VALUE_REG)
+         continue;
+
+      const jit_reg_t src = ir->arg1.reg;
+      if (subst[src].kind != JIT_VALUE_INVALID || mask_test(entry, src))
+         continue;
+      else if (cprop_copy_is_safe(f, cfg, defs, i, src))
+         subst[i] = ir->arg1;
+   }
+
+   // Constants assigned to registers with multiple definitions can
+   // still be propagated within a block
+   jit_value_t *local LOCAL = xcalloc_array(f->nregs, sizeof(jit_value_t));
+   SCOPED_A(jit_reg_t) dirty = AINIT;
+
+   int count = 0;
+   for (int i = 0; i < cfg->nblocks; i++) {
+      jit_block_t *bb = &(cfg->blocks[i]);
+
+      for (int j = 0; j < dirty.count; j++)
+         local[dirty.items[j]].kind = JIT_VALUE_INVALID;
+      ACLEAR(dirty);
+
+      for (int j = bb->first; j <= bb->last; j++) {
+         jit_ir_t *ir = &(f->irbuf[j]);
+
+         jit_reg_t reg1 = cfg_get_reg(ir->arg1);
+         if (reg1 != JIT_REG_INVALID) {
+            if (cprop_replace(ir, &(ir->arg1), subst[reg1]))
+               count++;
+            else if (cprop_replace(ir, &(ir->arg1), local[reg1]))
+               count++;
+         }
+
+         jit_reg_t reg2 = cfg_get_reg(ir->arg2);
+         if (reg2 != JIT_REG_INVALID) {
+            if (cprop_replace(ir, &(ir->arg2), subst[reg2]))
+               count++;
+            else if (cprop_replace(ir, &(ir->arg2), local[reg2]))
+               count++;
+         }
+
+         if (cfg_writes_result(ir)) {
+            if (ir->op == J_MOV && cprop_is_const(ir->arg1)) {
+               local[ir->result] = ir->arg1;
+               APUSH(dirty, ir->result);
+            }
+            else
+               local[ir->result].kind = JIT_VALUE_INVALID;
+         }
+      }
+   }
+
+   if (count > 0)
+      jit_free_cfg(f);   // Liveness has changed
+
+   return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Branch folding and unreachable code removal
+
+static jit_ir_t *fold_flags_source(jit_func_t *f, jit_block_t *bb, int pos)
+{
+   // Find the instruction in the same block that set the flags read by
+   // the instruction at pos
+   for (int i = pos - 1; i >= (int)bb->first; i--) {
+      jit_ir_t *ir = &(f->irbuf[i]);
+      if (ir->op == J_CMP)
+         return ir;
+      else if (ir->op == J_FCMP || ir->cc != JIT_CC_NONE)
+         return NULL;
+      else if (optim_is_pure(ir) || ir->op == J_STORE || ir->op == J_DEBUG
+               || ir->op == J_NOP)
+         continue;
+      else
+         return NULL;
+   }
+
+   return NULL;
+}
+
+static bool fold_eval_cmp(jit_ir_t *cmp, bool *flag)
+{
+   if (cmp->arg1.kind == JIT_VALUE_REG && cmp->arg2.kind == JIT_VALUE_REG
+       && cmp->arg1.reg == cmp->arg2.reg) {
+      switch (cmp->cc) {
+      case JIT_CC_EQ:
+      case JIT_CC_LE:
+      case JIT_CC_GE:
+         *flag = true;
+         return true;
+      case JIT_CC_NE:
+      case JIT_CC_LT:
+      case JIT_CC_GT:
+         *flag = false;
+         return true;
+      default:
+         return false;
+      }
+   }
+   else if (cmp->arg1.kind != JIT_VALUE_INT64
+            || cmp->arg2.kind != JIT_VALUE_INT64)
+      return false;
+
+   const int64_t lhs = cmp->arg1.int64, rhs = cmp->arg2.int64;
+
+   switch (cmp->cc) {
+   case JIT_CC_EQ: *flag = (lhs == rhs); return true;
+   case JIT_CC_NE: *flag = (lhs != rhs); return true;
+   case JIT_CC_LT: *flag = (lhs < rhs); return true;
+   case JIT_CC_GT: *flag = (lhs > rhs); return true;
+   case JIT_CC_LE: *flag = (lhs <= rhs); return true;
+   case JIT_CC_GE: *flag = (lhs >= rhs); return true;
+   default: return false;
+   }
+}
+
+int jit_do_fold_branches(jit_func_t *f)
+{
+   jit_cfg_t *cfg = jit_get_cfg(f);
+
+   int count = 0;
+   for (int i = 0; i < cfg->nblocks; i++) {
+      jit_block_t *bb = &(cfg->blocks[i]);
+
+      for (int j = bb->first; j <= bb->last; j++) {
+         jit_ir_t *ir = &(f->irbuf[j]);
+
+         if (ir->op == J_JUMP && ir->cc == JIT_CC_NONE) {
+            if (ir->arg1.label == j + 1) {
+               optim_make_nop(ir);
+               count++;
+            }
+            continue;
+         }
+         else if (ir->op != J_JUMP && ir->op != J_CSET && ir->op != J_CSEL)
+            continue;
+
+         jit_ir_t *cmp = fold_flags_source(f, bb, j);
+         bool flag;
+         if (cmp == NULL || !fold_eval_cmp(cmp, &flag))
+            continue;
+
+         switch (ir->op) {
+         case J_JUMP:
+            if (flag == (ir->cc == JIT_CC_T))
+               ir->cc = JIT_CC_NONE;
+            else
+               optim_make_nop(ir);
+            break;
+         case J_CSET:
+            optim_make_mov(ir, (jit_value_t){
+                  .kind  = JIT_VALUE_INT64,
+                  .int64 = flag
+               });
+            break;
+         case J_CSEL:
+            optim_make_mov(ir, flag ? ir->arg1 : ir->arg2);
+            break;
+         default:
+            break;
+         }
+
+         count++;
+      }
+   }
+
+   if (count > 0)
+      jit_free_cfg(f);   // Control flow has changed
+
+   return count;
+}
+
+int jit_do_unreachable(jit_func_t *f)
+{
+   jit_cfg_t *cfg = jit_get_cfg(f);
+
+   bit_mask_t reached;
+   mask_init(&reached, cfg->nblocks);
+
+   unsigned *worklist LOCAL = xmalloc_array(cfg->nblocks, sizeof(unsigned));
+   int wptr = 0;
+
+   mask_set(&reached, 0);
+   worklist[wptr++] = 0;
+
+   while (wptr > 0) {
+      jit_block_t *bb = &(cfg->blocks[worklist[--wptr]]);
+      for (int i = 0; i < bb->out.count; i++) {
+         const int edge = jit_get_edge(&bb->out, i);
+         if (!mask_test(&reached, edge)) {
+            mask_set(&reached, edge);
+            worklist[wptr++] = edge;
+         }
+      }
+   }
+
+   int count = 0;
+   for (int i = 1; i < cfg->nblocks; i++) {
+      if (mask_test(&reached, i))
+         continue;
+
+      jit_block_t *bb = &(cfg->blocks[i]);
+      for (int j = bb->first; j <= bb->last; j++)
+         optim_make_nop(&(f->irbuf[j]));
+
+      count++;
+   }
+
+   mask_free(&reached);
+
+   if (count > 0)
+      jit_free_cfg(f);
+
+   return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Dead code and dead store elimination
+
+int jit_do_dce(jit_func_t *f)
+{
+   if (f->nregs == 0)
+      return 0;
+
+   bit_mask_t live;
+   mask_init(&live, f->nregs);
+
+   // Deleting an instruction can make the definitions of its operands
+   // dead so repeat a few times with updated liveness
+   int count = 0;
+   for (int pass = 0; pass < 4; pass++) {
+      jit_cfg_t *cfg = jit_get_cfg(f);
+
+      int deleted = 0;
+      for (int i = 0; i < cfg->nblocks; i++) {
+         jit_block_t *bb = &(cfg->blocks[i]);
+         mask_copy(&live, &bb->liveout);
+
+         for (int j = bb->last; j >= (int)bb->first; j--) {
+            jit_ir_t *ir = &(f->irbuf[j]);
+
+            if (cfg_writes_result(ir)) {
+               if (!mask_test(&live, ir->result) && optim_is_pure(ir)) {
+                  optim_make_nop(ir);
+                  deleted++;
+                  continue;
+               }
+
+               mask_clear(&live, ir->result);
+            }
+
+            jit_reg_t reg1 = cfg_get_reg(ir->arg1);
+            if (reg1 != JIT_REG_INVALID)
+               mask_set(&live, reg1);
+
+            jit_reg_t reg2 = cfg_get_reg(ir->arg2);
+            if (reg2 != JIT_REG_INVALID)
+               mask_set(&live, reg2);
+
+            if (cfg_reads_result(ir))
+               mask_set(&live, ir->result);
+         }
+      }
+
+      if (deleted == 0)
+         break;
+
+      jit_free_cfg(f);
+      count += deleted;
+   }
+
+   mask_free(&live);
+   return count;
+}
+
+#define DSE_MAX_STORES 8
+
+typedef struct {
+   jit_reg_t  base;
+   int32_t    disp;
+   jit_size_t size;
+} dse_store_t;
+
+static inline int dse_size_bytes(jit_size_t size)
+{
+   return size == JIT_SZ_UNSPEC ? 8 : 1 << size;
+}
+
+int jit_do_dse(jit_func_t *f)
+{
+   // Delete stores that are overwritten later in the same block before
+   // anything could read memory: the scan runs backwards keeping a
+   // small set of addresses that are certain to be overwritten
+   jit_cfg_t *cfg = jit_get_cfg(f);
+
+   dse_store_t stores[DSE_MAX_STORES];
+
+   int count = 0;
+   for (int i = 0; i < cfg->nblocks; i++) {
+      jit_block_t *bb = &(cfg->blocks[i]);
+      int nstores = 0;
+
+      for (int j = bb->last; j >= (int)bb->first; j--) {
+         jit_ir_t *ir = &(f->irbuf[j]);
+
+         if (ir->op == J_STORE && ir->arg2.kind == JIT_ADDR_REG) {
+            const int bytes = dse_size_bytes(ir->size);
+
+            bool dead = false;
+            for (int k = 0; k < nstores && !dead; k++)
+               dead = stores[k].base == ir->arg2.reg
+                  && stores[k].disp == ir->arg2.disp
+                  && dse_size_bytes(stores[k].size) >= bytes;
+
+            if (dead) {
+               optim_make_nop(ir);
+               count++;
+            }
+            else if (nstores < DSE_MAX_STORES) {
+               stores[nstores].base = ir->arg2.reg;
+               stores[nstores].disp = ir->arg2.disp;
+               stores[nstores].size = ir->size;
+               nstores++;
+            }
+         }
+         else if (ir->op == J_STORE || ir->op == J_DEBUG || ir->op == J_NOP
+                  || ir->op == J_CMP || ir->op == J_FCMP
+                  || (optim_is_pure(ir) && ir->op != J_LOAD
+                      && ir->op != J_ULOAD)) {
+            // Does not read memory but the base register of a later
+            // store may be redefined here
+            if (cfg_writes_result(ir)) {
+               for (int k = 0; k < nstores; ) {
+                  if (stores[k].base == ir->result)
+                     stores[k] = stores[--nstores];
+                  else
+                     k++;
+               }
+            }
+         }
+         else
+            nstores = 0;
+      }
+   }
+
+   return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Instruction buffer compaction
+
+int jit_delete_nops(jit_func_t *f)
+{
+   jit_free_cfg(f);
+
+   // Maps each old position to the next instruction that is kept
+   int *map LOCAL = xmalloc_array(f->nirs + 1, sizeof(int));
+
+   int nkept = 0;
+   for (int i = 0; i < f->nirs; i++) {
+      map[i] = nkept;
+      if (f->irbuf[i].op != J_NOP)
+         nkept++;
+   }
+   map[f->nirs] = nkept;
+
+   const int count = f->nirs - nkept;
+   if (count == 0)
+      return 0;
+
+   bool target = false;
+   for (int i = 0, wptr = 0; i < f->nirs; i++) {
+      jit_ir_t *ir = &(f->irbuf[i]);
+      if (ir->op == J_NOP) {
+         target |= ir->target;
+         continue;
+      }
+
+      jit_ir_t *dest = &(f->irbuf[wptr++]);
+      *dest = *ir;
+      dest->target |= target;
+      target = false;
+
+      if (dest->arg1.kind == JIT_VALUE_LABEL)
+         dest->arg1.label = map[dest->arg1.label];
+      if (dest->arg2.kind == JIT_VALUE_LABEL)
+         dest->arg2.label = map[dest->arg2.label];
+
+      assert(dest->arg1.kind != JIT_VALUE_LABEL || dest->arg1.label < nkept);
+      assert(dest->arg2.kind != JIT_VALUE_LABEL || dest->arg2.label < nkept);
+   }
+
+   f->nirs = nkept;
+   return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Optimisation pipeline
+
+void jit_optimise(jit_func_t *f, jit_optim_stats_t *stats)
+{
+   jit_do_lvn(f);
+   jit_free_cfg(f);
+
+   const int cprop = jit_do_cprop(f);
+   if (cprop > 0) {
+      // Constant propagation exposes more folding opportunities
+      jit_do_lvn(f);
+      jit_free_cfg(f);
+      stats->cprop += cprop + jit_do_cprop(f);
+   }
+
+   stats->folded += jit_do_fold_branches(f);
+   stats->unreachable += jit_do_unreachable(f);
+   stats->dead += jit_do_dce(f);
+   stats->stores += jit_do_dse(f);
+   stats->deleted += jit_delete_nops(f);
+
+   jit_free_cfg(f);
+}
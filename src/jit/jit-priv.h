@@ -208,6 +208,7 @@ typedef struct _jit_tier jit_tier_t;
 typedef struct _jit_func jit_func_t;
 typedef struct _jit_block jit_block_t;
 typedef struct _jit_anchor jit_anchor_t;
+typedef struct _interp_op interp_op_t;
 
 typedef void (*jit_entry_fn_t)(jit_func_t *, jit_anchor_t *,
                                jit_scalar_t *, tlab_t *);
@@ -238,6 +239,15 @@ typedef struct {
    jit_block_t blocks[0];
 } jit_cfg_t;
 
+typedef struct {
+   unsigned cprop;         // Operands replaced by constants or copies
+   unsigned folded;        // Branches and selects on constant flags
+   unsigned unreachable;   // Unreachable blocks deleted
+   unsigned dead;          // Instructions with unused results deleted
+   unsigned stores;        // Stores overwritten before being read
+   unsigned deleted;       // Total instructions removed from buffer
+} jit_optim_stats_t;
+
 typedef enum {
    JIT_FUNC_PLACEHOLDER,
    JIT_FUNC_COMPILING,
@@ -253,6 +263,7 @@ typedef struct _jit_func {
    unsigned       *varoff;
    mptr_t          privdata;
    jit_ir_t       *irbuf;
+   interp_op_t    *threaded;
    unsigned char  *cpool;
    unsigned        framesz;
    unsigned        nirs;
@@ -261,7 +272,9 @@ typedef struct _jit_func {
    unsigned        cpoolsz;
    jit_handle_t    handle;
    void           *symbol;
-   unsigned        hotness;
+   int             hotness;
+   bool            queued;
+   bool            cached;
    jit_tier_t     *next_tier;
    jit_cfg_t      *cfg;
    ffi_spec_t      spec;
@@ -316,11 +329,13 @@ void jit_hexdump(const unsigned char *data, size_t sz, int blocksz,
 void **jit_get_privdata_ptr(jit_t *j, jit_func_t *f);
 bool jit_has_runtime(jit_t *j);
 int jit_backedge_limit(jit_t *j);
+bool jit_use_threaded(jit_t *j);
 void jit_tier_up(jit_func_t *f);
 jit_thread_local_t *jit_thread_local(void);
 void jit_register(jit_t *j, ident_t name, jit_entry_fn_t fn,
                   const uint8_t *debug, size_t bufsz, object_t *obj,
                   ffi_spec_t spec);
+void jit_add_optim_stats(jit_t *j, const jit_optim_stats_t *stats);
 
 jit_cfg_t *jit_get_cfg(jit_func_t *f);
 void jit_free_cfg(jit_func_t *f);
@@ -328,10 +343,18 @@ jit_block_t *jit_block_for(jit_cfg_t *cfg, int pos);
 int jit_get_edge(jit_edge_list_t *list, int nth);
 
 void jit_do_lvn(jit_func_t *f);
+int jit_do_cprop(jit_func_t *f);
+int jit_do_fold_branches(jit_func_t *f);
+int jit_do_unreachable(jit_func_t *f);
+int jit_do_dce(jit_func_t *f);
+int jit_do_dse(jit_func_t *f);
+int jit_delete_nops(jit_func_t *f);
+void jit_optimise(jit_func_t *f, jit_optim_stats_t *stats);
 
 void __nvc_do_exit(jit_exit_t which, jit_anchor_t *anchor, jit_scalar_t *args,
                    tlab_t *tlab);
 void __nvc_do_fficall(jit_foreign_t *ff, jit_anchor_t *anchor,
                       jit_scalar_t *args);
+void *__nvc_mspace_alloc2(uintptr_t size, jit_anchor_t *anchor);
 
 #endif  // _JIT_PRIV_H
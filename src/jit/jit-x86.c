@@ -0,0 +1,1052 @@
+//
+//  Copyright (C) 2022  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "util.h"
+#include "array.h"
+#include "diag.h"
+#include "ident.h"
+#include "jit/jit-priv.h"
+#include "opt.h"
+#include "rt/mspace.h"
+#include "thread.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined __x86_64__ && !defined __MINGW32__ && !__SANITIZE_ADDRESS__
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+//
+// Baseline native code generator which translates each JIT IR
+// instruction into a fixed template of x86-64 machine code.  All JIT
+// registers live in the stack frame so there is no register allocation
+// and compilation is a single linear pass over the IR.
+//
+
+typedef enum {
+   X86_RAX, X86_RCX, X86_RDX, X86_RBX, X86_RSP, X86_RBP, X86_RSI, X86_RDI,
+   X86_R8, X86_R9, X86_R10, X86_R11, X86_R12, X86_R13, X86_R14, X86_R15
+} x86_reg_t;
+
+typedef enum {
+   X86_XMM0, X86_XMM1
+} x86_xmm_t;
+
+typedef enum {
+   X86_CC_O, X86_CC_NO, X86_CC_B, X86_CC_AE, X86_CC_E, X86_CC_NE,
+   X86_CC_BE, X86_CC_A, X86_CC_S, X86_CC_NS, X86_CC_P, X86_CC_NP,
+   X86_CC_L, X86_CC_GE, X86_CC_LE, X86_CC_G
+} x86_cc_t;
+
+// Registers preserved across calls
+#define X86_ARGS X86_RBX
+#define X86_TLAB X86_R12
+
+// Stack frame layout relative to RBP
+#define ANCHOR_OFFSET -40
+#define FLAGS_OFFSET  -48
+
+#define ANCHOR_FIELD(name) (ANCHOR_OFFSET + (int)offsetof(jit_anchor_t, name))
+
+typedef struct {
+   unsigned offset;
+   unsigned target;
+} x86_patch_t;
+
+typedef A(x86_patch_t) patch_list_t;
+
+typedef struct {
+   jit_func_t   *func;
+   uint8_t      *buf;
+   size_t        len;
+   size_t        max;
+   unsigned     *labels;
+   patch_list_t  patches;
+   int           regoff;
+   int           frameoff;
+   bool          failed;
+} x86_asm_t;
+
+typedef struct {
+   void   *mem;
+   size_t  size;
+} x86_code_t;
+
+typedef struct {
+   nvc_lock_t     lock;
+   A(x86_code_t)  code;
+} x86_state_t;
+
+static void x86_emit(x86_asm_t *a, const void *bytes, size_t len)
+{
+   if (a->len + len > a->max) {
+      a->max = MAX(a->max * 2, a->len + len);
+      a->buf = xrealloc(a->buf, a->max);
+   }
+
+   memcpy(a->buf + a->len, bytes, len);
+   a->len += len;
+}
+
+static void x86_byte(x86_asm_t *a, uint8_t byte)
+{
+   x86_emit(a, &byte, 1);
+}
+
+static void x86_imm32(x86_asm_t *a, int32_t imm)
+{
+   x86_emit(a, &imm, 4);
+}
+
+static void x86_rex(x86_asm_t *a, bool w, int reg, int base)
+{
+   const uint8_t rex = 0x40 | (w << 3) | ((reg & 8) >> 1) | ((base & 8) >> 3);
+   if (rex != 0x40)
+      x86_byte(a, rex);
+}
+
+static void x86_opcode(x86_asm_t *a, unsigned op)
+{
+   // Two byte opcodes are written as 0x0fXX
+   if (op > 0xff)
+      x86_byte(a, op >> 8);
+   x86_byte(a, op & 0xff);
+}
+
+static void x86_op_reg(x86_asm_t *a, bool w, unsigned op, int reg, int rm)
+{
+   // Opcode with a register-direct ModRM operand
+   x86_rex(a, w, reg, rm);
+   x86_opcode(a, op);
+   x86_byte(a, 0xc0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+static void x86_op_mem(x86_asm_t *a, bool w, unsigned op, int reg,
+                       x86_reg_t base, int32_t disp)
+{
+   // Opcode with a [base + disp] ModRM operand
+   x86_rex(a, w, reg, base);
+   x86_opcode(a, op);
+
+   int mod;
+   if (disp == 0 && (base & 7) != X86_RBP)
+      mod = 0;
+   else if (disp >= INT8_MIN && disp <= INT8_MAX)
+      mod = 1;
+   else
+      mod = 2;
+
+   x86_byte(a, (mod << 6) | ((reg & 7) << 3) | (base & 7));
+
+   if ((base & 7) == X86_RSP)
+      x86_byte(a, 0x24);   // SIB with no index
+
+   if (mod == 1)
+      x86_byte(a, disp);
+   else if (mod == 2)
+      x86_imm32(a, disp);
+}
+
+static void x86_sse(x86_asm_t *a, uint8_t prefix, bool w, uint8_t op,
+                    int reg, int rm)
+{
+   x86_byte(a, prefix);
+   x86_rex(a, w, reg, rm);
+   x86_byte(a, 0x0f);
+   x86_byte(a, op);
+   x86_byte(a, 0xc0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+static void x86_load(x86_asm_t *a, x86_reg_t reg, x86_reg_t base, int32_t disp)
+{
+   x86_op_mem(a, true, 0x8b, reg, base, disp);
+}
+
+static void x86_store(x86_asm_t *a, x86_reg_t reg, x86_reg_t base,
+                      int32_t disp)
+{
+   x86_op_mem(a, true, 0x89, reg, base, disp);
+}
+
+static void x86_lea(x86_asm_t *a, x86_reg_t reg, x86_reg_t base, int32_t disp)
+{
+   x86_op_mem(a, true, 0x8d, reg, base, disp);
+}
+
+static void x86_mov(x86_asm_t *a, x86_reg_t dst, x86_reg_t src)
+{
+   x86_op_reg(a, true, 0x89, src, dst);
+}
+
+static void x86_mov_imm(x86_asm_t *a, x86_reg_t reg, int64_t imm)
+{
+   if (imm >= 0 && imm <= UINT32_MAX) {
+      x86_rex(a, false, 0, reg);
+      x86_byte(a, 0xb8 + (reg & 7));   // Zero extends to 64 bits
+      x86_imm32(a, imm);
+   }
+   else if (imm >= INT32_MIN && imm <= INT32_MAX) {
+      x86_op_reg(a, true, 0xc7, 0, reg);
+      x86_imm32(a, imm);
+   }
+   else {
+      x86_rex(a, true, 0, reg);
+      x86_byte(a, 0xb8 + (reg & 7));
+      x86_emit(a, &imm, 8);
+   }
+}
+
+static void x86_setcc(x86_asm_t *a, x86_cc_t cc, x86_reg_t reg)
+{
+   x86_op_reg(a, false, 0x0f90 + cc, 0, reg);
+   x86_op_reg(a, false, 0x0fb6, reg, reg);   // MOVZX
+}
+
+static void x86_call(x86_asm_t *a, const void *fn)
+{
+   x86_mov_imm(a, X86_RAX, (intptr_t)fn);
+   x86_op_reg(a, false, 0xff, 2, X86_RAX);
+}
+
+static void x86_branch(x86_asm_t *a, int cc, jit_value_t label)
+{
+   assert(label.kind == JIT_VALUE_LABEL);
+
+   x86_opcode(a, cc < 0 ? 0xe9 : 0x0f80 + cc);
+
+   const x86_patch_t patch = { a->len, label.label };
+   APUSH(a->patches, patch);
+
+   x86_imm32(a, 0);
+}
+
+static int32_t x86_reg_offset(x86_asm_t *a, jit_reg_t reg)
+{
+   assert(reg < a->func->nregs);
+   return a->regoff + (int)(reg * sizeof(jit_scalar_t));
+}
+
+static void x86_get_value(x86_asm_t *a, x86_reg_t reg, jit_value_t value)
+{
+   switch (value.kind) {
+   case JIT_VALUE_REG:
+      x86_load(a, reg, X86_RBP, x86_reg_offset(a, value.reg));
+      break;
+   case JIT_VALUE_INT64:
+   case JIT_ADDR_ABS:
+      x86_mov_imm(a, reg, value.int64);
+      break;
+   case JIT_VALUE_DOUBLE:
+      x86_mov_imm(a, reg, (jit_scalar_t){ .real = value.dval }.integer);
+      break;
+   case JIT_ADDR_REG:
+      x86_load(a, reg, X86_RBP, x86_reg_offset(a, value.reg));
+      if (value.disp != 0)
+         x86_lea(a, reg, reg, value.disp);
+      break;
+   case JIT_ADDR_CPOOL:
+      x86_mov_imm(a, reg, (intptr_t)(a->func->cpool + value.int64));
+      break;
+   case JIT_VALUE_LABEL:
+      x86_mov_imm(a, reg, value.label);
+      break;
+   case JIT_VALUE_HANDLE:
+      x86_mov_imm(a, reg, value.handle);
+      break;
+   case JIT_VALUE_EXIT:
+      x86_mov_imm(a, reg, value.exit);
+      break;
+   case JIT_VALUE_FOREIGN:
+      x86_mov_imm(a, reg, (intptr_t)value.foreign);
+      break;
+   case JIT_VALUE_TREE:
+      x86_mov_imm(a, reg, (intptr_t)value.tree);
+      break;
+   default:
+      a->failed = true;
+      break;
+   }
+}
+
+static int32_t x86_get_address(x86_asm_t *a, x86_reg_t reg, jit_value_t value)
+{
+   // Fold the displacement into the memory operand where possible
+   if (value.kind == JIT_ADDR_REG) {
+      x86_load(a, reg, X86_RBP, x86_reg_offset(a, value.reg));
+      return value.disp;
+   }
+   else {
+      x86_get_value(a, reg, value);
+      return 0;
+   }
+}
+
+static void x86_put_result(x86_asm_t *a, x86_reg_t reg, jit_ir_t *ir)
+{
+   x86_store(a, reg, X86_RBP, x86_reg_offset(a, ir->result));
+}
+
+static void x86_put_flags(x86_asm_t *a, x86_reg_t reg)
+{
+   x86_store(a, reg, X86_RBP, FLAGS_OFFSET);
+}
+
+static void x86_test_flags(x86_asm_t *a)
+{
+   x86_op_mem(a, true, 0x83, 7, X86_RBP, FLAGS_OFFSET);   // CMP imm8
+   x86_byte(a, 0);
+}
+
+static void x86_sync_irpos(x86_asm_t *a, jit_ir_t *ir)
+{
+   const int32_t irpos = ir - a->func->irbuf;
+   x86_op_mem(a, false, 0xc7, 0, X86_RBP, ANCHOR_FIELD(irpos));
+   x86_imm32(a, irpos);
+}
+
+static void x86_load_args(x86_asm_t *a, jit_ir_t *ir)
+{
+   x86_get_value(a, X86_RAX, ir->arg1);
+   x86_get_value(a, X86_RCX, ir->arg2);
+}
+
+static void x86_load_fargs(x86_asm_t *a, jit_ir_t *ir)
+{
+   x86_load_args(a, ir);
+   x86_sse(a, 0x66, true, 0x6e, X86_XMM0, X86_RAX);   // MOVQ
+   x86_sse(a, 0x66, true, 0x6e, X86_XMM1, X86_RCX);
+}
+
+static void x86_put_fresult(x86_asm_t *a, jit_ir_t *ir)
+{
+   x86_sse(a, 0x66, true, 0x7e, X86_XMM0, X86_RAX);   // MOVQ
+   x86_put_result(a, X86_RAX, ir);
+}
+
+static void x86_trap(jit_anchor_t *anchor)
+{
+   fatal_trace("executed trap opcode in %s", istr(anchor->func->name));
+}
+
+static void *x86_lalloc(tlab_t *tlab, size_t bytes, jit_anchor_t *anchor)
+{
+   jit_thread_local_t *thread = jit_thread_local();
+   thread->anchor = anchor;
+
+   void *ptr;
+   if (tlab != NULL)
+      ptr = tlab_alloc(tlab, bytes);
+   else
+      ptr = mspace_alloc(jit_get_mspace(anchor->func->jit), bytes);
+
+   thread->anchor = NULL;
+   return ptr;
+}
+
+static void *x86_getpriv(jit_func_t *f)
+{
+   return *jit_get_privdata_ptr(f->jit, f);
+}
+
+static void x86_putpriv(jit_func_t *f, void *ptr)
+{
+   *jit_get_privdata_ptr(f->jit, f) = ptr;
+}
+
+static void x86_prologue(x86_asm_t *a)
+{
+   jit_func_t *f = a->func;
+
+   a->regoff   = FLAGS_OFFSET - (int)(f->nregs * sizeof(jit_scalar_t));
+   a->frameoff = a->regoff - (int)ALIGN_UP(f->framesz, 8);
+
+   // RSP is aligned to 16 bytes after pushing RBP, RBX, and R12
+   const int32_t locals = ALIGN_UP(-a->frameoff, 16) - 16;
+
+   x86_byte(a, 0x55);                    // PUSH RBP
+   x86_mov(a, X86_RBP, X86_RSP);
+   x86_byte(a, 0x53);                    // PUSH RBX
+   x86_rex(a, false, 0, X86_R12);
+   x86_byte(a, 0x50 + (X86_R12 & 7));    // PUSH R12
+   x86_op_reg(a, true, 0x81, 5, X86_RSP);   // SUB RSP, imm32
+   x86_imm32(a, locals);
+
+   x86_mov(a, X86_ARGS, X86_RDX);
+   x86_mov(a, X86_TLAB, X86_RCX);
+
+   x86_store(a, X86_RSI, X86_RBP, ANCHOR_FIELD(caller));
+   x86_store(a, X86_RDI, X86_RBP, ANCHOR_FIELD(func));
+   x86_op_mem(a, false, 0xc7, 0, X86_RBP, ANCHOR_FIELD(irpos));
+   x86_imm32(a, 0);
+
+   // Count down towards the next tier the same way as the interpreter
+   x86_load(a, X86_RAX, X86_RDI, offsetof(jit_func_t, next_tier));
+   x86_op_reg(a, true, 0x85, X86_RAX, X86_RAX);   // TEST
+   x86_opcode(a, 0x0f80 + X86_CC_E);
+   const size_t skip1 = a->len;
+   x86_imm32(a, 0);
+
+   x86_byte(a, 0xf0);                    // LOCK prefix
+   x86_op_mem(a, false, 0x83, 5, X86_RDI, offsetof(jit_func_t, hotness));
+   x86_byte(a, 1);                       // SUB dword, 1
+   x86_opcode(a, 0x0f80 + X86_CC_G);
+   const size_t skip2 = a->len;
+   x86_imm32(a, 0);
+
+   x86_call(a, jit_tier_up);
+
+   const int32_t rel1 = a->len - (skip1 + 4);
+   const int32_t rel2 = a->len - (skip2 + 4);
+   memcpy(a->buf + skip1, &rel1, 4);
+   memcpy(a->buf + skip2, &rel2, 4);
+}
+
+static void x86_epilogue(x86_asm_t *a)
+{
+   x86_lea(a, X86_RSP, X86_RBP, -16);
+   x86_rex(a, false, 0, X86_R12);
+   x86_byte(a, 0x58 + (X86_R12 & 7));    // POP R12
+   x86_byte(a, 0x5b);                    // POP RBX
+   x86_byte(a, 0x5d);                    // POP RBP
+   x86_byte(a, 0xc3);                    // RET
+}
+
+static void x86_op_arith(x86_asm_t *a, jit_ir_t *ir)
+{
+   x86_load_args(a, ir);
+
+   unsigned op64;
+   switch (ir->op) {
+   case J_ADD: op64 = 0x01; break;
+   case J_SUB: op64 = 0x29; break;
+   default: op64 = 0x0faf; break;   // IMUL
+   }
+
+   if (ir->cc == JIT_CC_NONE) {
+      if (ir->op == J_MUL)
+         x86_op_reg(a, true, op64, X86_RAX, X86_RCX);
+      else
+         x86_op_reg(a, true, op64, X86_RCX, X86_RAX);
+
+      x86_put_result(a, X86_RAX, ir);
+      return;
+   }
+
+   const bool is_signed = ir->cc == JIT_CC_O;
+   const jit_size_t size = ir->size == JIT_SZ_UNSPEC ? JIT_SZ_64 : ir->size;
+
+   if (size == JIT_SZ_16)
+      x86_byte(a, 0x66);
+
+   const bool w = size == JIT_SZ_64;
+
+   if (ir->op == J_MUL) {
+      // Single operand forms leave the low half of the product in RAX
+      // and set OF and CF if the upper half is significant
+      if (size == JIT_SZ_8)
+         x86_op_reg(a, false, 0xf6, is_signed ? 5 : 4, X86_RCX);
+      else if (is_signed)
+         x86_op_reg(a, w, 0x0faf, X86_RAX, X86_RCX);
+      else
+         x86_op_reg(a, w, 0xf7, 4, X86_RCX);
+   }
+   else {
+      const unsigned op = ir->op == J_ADD
+         ? (size == JIT_SZ_8 ? 0x00 : 0x01)
+         : (size == JIT_SZ_8 ? 0x28 : 0x29);
+      x86_op_reg(a, w, op, X86_RCX, X86_RAX);
+   }
+
+   x86_setcc(a, is_signed ? X86_CC_O : X86_CC_B, X86_RDX);
+
+   // Extend the result from the operation width like the interpreter
+   switch (size) {
+   case JIT_SZ_8:
+      x86_op_reg(a, is_signed, is_signed ? 0x0fbe : 0x0fb6,
+                 X86_RAX, X86_RAX);
+      break;
+   case JIT_SZ_16:
+      x86_op_reg(a, is_signed, is_signed ? 0x0fbf : 0x0fb7,
+                 X86_RAX, X86_RAX);
+      break;
+   case JIT_SZ_32:
+      if (is_signed)
+         x86_op_reg(a, true, 0x63, X86_RAX, X86_RAX);   // MOVSXD
+      else
+         x86_op_reg(a, false, 0x89, X86_RAX, X86_RAX);
+      break;
+   default:
+      break;
+   }
+
+   x86_put_result(a, X86_RAX, ir);
+   x86_put_flags(a, X86_RDX);
+}
+
+static void x86_op_div(x86_asm_t *a, jit_ir_t *ir)
+{
+   x86_load_args(a, ir);
+   x86_rex(a, true, 0, 0);
+   x86_byte(a, 0x99);                    // CQO
+   x86_op_reg(a, true, 0xf7, 7, X86_RCX);   // IDIV
+   x86_put_result(a, ir->op == J_REM ? X86_RDX : X86_RAX, ir);
+}
+
+static void x86_op_logical(x86_asm_t *a, jit_ir_t *ir)
+{
+   x86_load_args(a, ir);
+
+   if (ir->op == J_XOR) {
+      x86_op_reg(a, true, 0x31, X86_RCX, X86_RAX);
+      x86_put_result(a, X86_RAX, ir);
+      return;
+   }
+
+   x86_op_reg(a, true, 0x85, X86_RAX, X86_RAX);
+   x86_setcc(a, X86_CC_NE, X86_RAX);
+   x86_op_reg(a, true, 0x85, X86_RCX, X86_RCX);
+   x86_setcc(a, X86_CC_NE, X86_RCX);
+   x86_op_reg(a, false, ir->op == J_AND ? 0x21 : 0x09, X86_RCX, X86_RAX);
+   x86_put_result(a, X86_RAX, ir);
+}
+
+static void x86_op_float(x86_asm_t *a, jit_ir_t *ir)
+{
+   x86_load_fargs(a, ir);
+
+   uint8_t op;
+   switch (ir->op) {
+   case J_FADD: op = 0x58; break;
+   case J_FMUL: op = 0x59; break;
+   case J_FSUB: op = 0x5c; break;
+   default: op = 0x5e; break;
+   }
+
+   x86_sse(a, 0xf2, false, op, X86_XMM0, X86_XMM1);
+   x86_put_fresult(a, ir);
+}
+
+static void x86_op_cmp(x86_asm_t *a, jit_ir_t *ir)
+{
+   x86_load_args(a, ir);
+   x86_op_reg(a, true, 0x39, X86_RCX, X86_RAX);   // CMP RAX, RCX
+
+   switch (ir->cc) {
+   case JIT_CC_EQ: x86_setcc(a, X86_CC_E, X86_RAX); break;
+   case JIT_CC_NE: x86_setcc(a, X86_CC_NE, X86_RAX); break;
+   case JIT_CC_LT: x86_setcc(a, X86_CC_L, X86_RAX); break;
+   case JIT_CC_GE: x86_setcc(a, X86_CC_GE, X86_RAX); break;
+   case JIT_CC_GT: x86_setcc(a, X86_CC_G, X86_RAX); break;
+   case JIT_CC_LE: x86_setcc(a, X86_CC_LE, X86_RAX); break;
+   default: x86_mov_imm(a, X86_RAX, 0); break;
+   }
+
+   x86_put_flags(a, X86_RAX);
+}
+
+static void x86_op_fcmp(x86_asm_t *a, jit_ir_t *ir)
+{
+   x86_load_fargs(a, ir);
+
+   // UCOMISD sets ZF, PF, and CF for unordered operands so the
+   // comparisons are arranged to be false in that case
+   switch (ir->cc) {
+   case JIT_CC_EQ:
+   case JIT_CC_NE:
+      x86_sse(a, 0x66, false, 0x2e, X86_XMM0, X86_XMM1);
+      if (ir->cc == JIT_CC_EQ) {
+         x86_setcc(a, X86_CC_E, X86_RAX);
+         x86_setcc(a, X86_CC_NP, X86_RCX);
+         x86_op_reg(a, false, 0x21, X86_RCX, X86_RAX);
+      }
+      else {
+         x86_setcc(a, X86_CC_NE, X86_RAX);
+         x86_setcc(a, X86_CC_P, X86_RCX);
+         x86_op_reg(a, false, 0x09, X86_RCX, X86_RAX);
+      }
+      break;
+   case JIT_CC_GT:
+   case JIT_CC_GE:
+      x86_sse(a, 0x66, false, 0x2e, X86_XMM0, X86_XMM1);
+      x86_setcc(a, ir->cc == JIT_CC_GT ? X86_CC_A : X86_CC_AE, X86_RAX);
+      break;
+   case JIT_CC_LT:
+   case JIT_CC_LE:
+      x86_sse(a, 0x66, false, 0x2e, X86_XMM1, X86_XMM0);
+      x86_setcc(a, ir->cc == JIT_CC_LT ? X86_CC_A : X86_CC_AE, X86_RAX);
+      break;
+   default:
+      x86_mov_imm(a, X86_RAX, 0);
+      break;
+   }
+
+   x86_put_flags(a, X86_RAX);
+}
+
+static void x86_op_load(x86_asm_t *a, jit_ir_t *ir)
+{
+   const int32_t disp = x86_get_address(a, X86_RAX, ir->arg1);
+   const bool sign = ir->op == J_LOAD;
+
+   switch (ir->size) {
+   case JIT_SZ_8:
+      x86_op_mem(a, sign, sign ? 0x0fbe : 0x0fb6,
+                 X86_RAX, X86_RAX, disp);
+      break;
+   case JIT_SZ_16:
+      x86_op_mem(a, sign, sign ? 0x0fbf : 0x0fb7,
+                 X86_RAX, X86_RAX, disp);
+      break;
+   case JIT_SZ_32:
+      x86_op_mem(a, sign, sign ? 0x63 : 0x8b, X86_RAX, X86_RAX, disp);
+      break;
+   case JIT_SZ_64:
+      x86_load(a, X86_RAX, X86_RAX, disp);
+      break;
+   default:
+      a->failed = true;
+      break;
+   }
+
+   x86_put_result(a, X86_RAX, ir);
+}
+
+static void x86_op_store(x86_asm_t *a, jit_ir_t *ir)
+{
+   x86_get_value(a, X86_RAX, ir->arg1);
+   const int32_t disp = x86_get_address(a, X86_RCX, ir->arg2);
+
+   switch (ir->size) {
+   case JIT_SZ_8:
+      x86_op_mem(a, false, 0x88, X86_RAX, X86_RCX, disp);
+      break;
+   case JIT_SZ_16:
+      x86_byte(a, 0x66);
+      x86_op_mem(a, false, 0x89, X86_RAX, X86_RCX, disp);
+      break;
+   case JIT_SZ_32:
+      x86_op_mem(a, false, 0x89, X86_RAX, X86_RCX, disp);
+      break;
+   case JIT_SZ_64:
+      x86_store(a, X86_RAX, X86_RCX, disp);
+      break;
+   default:
+      a->failed = true;
+      break;
+   }
+}
+
+static void x86_op_jump(x86_asm_t *a, jit_ir_t *ir)
+{
+   switch (ir->cc) {
+   case JIT_CC_NONE:
+      x86_branch(a, -1, ir->arg1);
+      break;
+   case JIT_CC_T:
+      x86_test_flags(a);
+      x86_branch(a, X86_CC_NE, ir->arg1);
+      break;
+   case JIT_CC_F:
+      x86_test_flags(a);
+      x86_branch(a, X86_CC_E, ir->arg1);
+      break;
+   default:
+      a->failed = true;
+      break;
+   }
+}
+
+static void x86_op_call(x86_asm_t *a, jit_ir_t *ir)
+{
+   if (ir->arg1.kind != JIT_VALUE_HANDLE
+       || ir->arg1.handle == JIT_HANDLE_INVALID) {
+      a->failed = true;   // Let the interpreter report the error
+      return;
+   }
+
+   jit_func_t *callee = jit_get_func(a->func->jit, ir->arg1.handle);
+
+   x86_sync_irpos(a, ir);
+
+   // The entry point is loaded on each call so newly compiled code for
+   // the callee is picked up
+   x86_mov_imm(a, X86_RDI, (intptr_t)callee);
+   x86_load(a, X86_RAX, X86_RDI, offsetof(jit_func_t, entry));
+   x86_lea(a, X86_RSI, X86_RBP, ANCHOR_OFFSET);
+   x86_mov(a, X86_RDX, X86_ARGS);
+   x86_mov(a, X86_RCX, X86_TLAB);
+   x86_op_reg(a, false, 0xff, 2, X86_RAX);
+}
+
+static void x86_macro_exit(x86_asm_t *a, jit_ir_t *ir)
+{
+   x86_sync_irpos(a, ir);
+   x86_get_value(a, X86_RDI, ir->arg1);
+   x86_lea(a, X86_RSI, X86_RBP, ANCHOR_OFFSET);
+   x86_mov(a, X86_RDX, X86_ARGS);
+   x86_mov(a, X86_RCX, X86_TLAB);
+   x86_call(a, __nvc_do_exit);
+}
+
+static void x86_macro_fficall(x86_asm_t *a, jit_ir_t *ir)
+{
+   x86_sync_irpos(a, ir);
+   x86_get_value(a, X86_RDI, ir->arg1);
+   x86_lea(a, X86_RSI, X86_RBP, ANCHOR_OFFSET);
+   x86_mov(a, X86_RDX, X86_ARGS);
+   x86_call(a, __nvc_do_fficall);
+}
+
+static void x86_macro_galloc(x86_asm_t *a, jit_ir_t *ir)
+{
+   x86_sync_irpos(a, ir);
+   x86_get_value(a, X86_RDI, ir->arg1);
+   x86_lea(a, X86_RSI, X86_RBP, ANCHOR_OFFSET);
+   x86_call(a, __nvc_mspace_alloc2);
+   x86_put_result(a, X86_RAX, ir);
+}
+
+static void x86_macro_lalloc(x86_asm_t *a, jit_ir_t *ir)
+{
+   x86_sync_irpos(a, ir);
+   x86_mov(a, X86_RDI, X86_TLAB);
+   x86_get_value(a, X86_RSI, ir->arg1);
+   x86_lea(a, X86_RDX, X86_RBP, ANCHOR_OFFSET);
+   x86_call(a, x86_lalloc);
+   x86_put_result(a, X86_RAX, ir);
+}
+
+static void x86_macro_salloc(x86_asm_t *a, jit_ir_t *ir)
+{
+   assert(ir->arg1.kind == JIT_VALUE_INT64);
+   x86_lea(a, X86_RAX, X86_RBP, a->frameoff + ir->arg1.int64);
+   x86_put_result(a, X86_RAX, ir);
+}
+
+static void x86_macro_copy(x86_asm_t *a, jit_ir_t *ir)
+{
+   x86_load(a, X86_RDX, X86_RBP, x86_reg_offset(a, ir->result));
+   x86_get_value(a, X86_RDI, ir->arg1);
+   x86_get_value(a, X86_RSI, ir->arg2);
+   x86_call(a, memmove);
+}
+
+static void x86_macro_bzero(x86_asm_t *a, jit_ir_t *ir)
+{
+   x86_load(a, X86_RDX, X86_RBP, x86_reg_offset(a, ir->result));
+   x86_get_value(a, X86_RDI, ir->arg1);
+   x86_op_reg(a, false, 0x31, X86_RSI, X86_RSI);   // XOR ESI, ESI
+   x86_call(a, memset);
+}
+
+static void x86_macro_exp(x86_asm_t *a, jit_ir_t *ir)
+{
+   if (ir->op == MACRO_FEXP) {
+      x86_load_fargs(a, ir);
+      x86_call(a, pow);
+      x86_put_fresult(a, ir);
+   }
+   else {
+      x86_get_value(a, X86_RDI, ir->arg1);
+      x86_get_value(a, X86_RSI, ir->arg2);
+      x86_call(a, ipow);
+      x86_put_result(a, X86_RAX, ir);
+   }
+}
+
+static void x86_macro_priv(x86_asm_t *a, jit_ir_t *ir)
+{
+   assert(ir->arg1.kind == JIT_VALUE_HANDLE);
+   jit_func_t *f = jit_get_func(a->func->jit, ir->arg1.handle);
+
+   x86_mov_imm(a, X86_RDI, (intptr_t)f);
+
+   if (ir->op == MACRO_GETPRIV) {
+      x86_call(a, x86_getpriv);
+      x86_put_result(a, X86_RAX, ir);
+   }
+   else {
+      x86_get_value(a, X86_RSI, ir->arg2);
+      x86_call(a, x86_putpriv);
+   }
+}
+
+static void x86_macro_case(x86_asm_t *a, jit_ir_t *ir)
+{
+   x86_load(a, X86_RAX, X86_RBP, x86_reg_offset(a, ir->result));
+   x86_get_value(a, X86_RCX, ir->arg1);
+   x86_op_reg(a, true, 0x39, X86_RCX, X86_RAX);
+   x86_branch(a, X86_CC_E, ir->arg2);
+}
+
+static void x86_op(x86_asm_t *a, jit_ir_t *ir)
+{
+   switch (ir->op) {
+   case J_RECV:
+      x86_load(a, X86_RAX, X86_ARGS, ir->arg1.int64 * sizeof(jit_scalar_t));
+      x86_put_result(a, X86_RAX, ir);
+      break;
+   case J_SEND:
+      x86_get_value(a, X86_RAX, ir->arg2);
+      x86_store(a, X86_RAX, X86_ARGS, ir->arg1.int64 * sizeof(jit_scalar_t));
+      break;
+   case J_ADD:
+   case J_SUB:
+   case J_MUL:
+      x86_op_arith(a, ir);
+      break;
+   case J_DIV:
+   case J_REM:
+      x86_op_div(a, ir);
+      break;
+   case J_AND:
+   case J_OR:
+   case J_XOR:
+      x86_op_logical(a, ir);
+      break;
+   case J_FADD:
+   case J_FSUB:
+   case J_FMUL:
+   case J_FDIV:
+      x86_op_float(a, ir);
+      break;
+   case J_NEG:
+      x86_get_value(a, X86_RAX, ir->arg1);
+      x86_op_reg(a, true, 0xf7, 3, X86_RAX);
+      x86_put_result(a, X86_RAX, ir);
+      break;
+   case J_FNEG:
+      x86_get_value(a, X86_RAX, ir->arg1);
+      x86_op_reg(a, true, 0x0fba, 7, X86_RAX);   // BTC imm8
+      x86_byte(a, 63);
+      x86_put_result(a, X86_RAX, ir);
+      break;
+   case J_NOT:
+      x86_get_value(a, X86_RAX, ir->arg1);
+      x86_op_reg(a, true, 0x85, X86_RAX, X86_RAX);
+      x86_setcc(a, X86_CC_E, X86_RAX);
+      x86_put_result(a, X86_RAX, ir);
+      break;
+   case J_SCVTF:
+      x86_get_value(a, X86_RAX, ir->arg1);
+      x86_sse(a, 0xf2, true, 0x2a, X86_XMM0, X86_RAX);   // CVTSI2SD
+      x86_put_fresult(a, ir);
+      break;
+   case J_FCVTNS:
+      x86_get_value(a, X86_RAX, ir->arg1);
+      x86_sse(a, 0x66, true, 0x6e, X86_XMM0, X86_RAX);
+      x86_call(a, round);
+      x86_sse(a, 0xf2, true, 0x2c, X86_RAX, X86_XMM0);   // CVTTSD2SI
+      x86_put_result(a, X86_RAX, ir);
+      break;
+   case J_MOV:
+   case J_LEA:
+      x86_get_value(a, X86_RAX, ir->arg1);
+      x86_put_result(a, X86_RAX, ir);
+      break;
+   case J_CSEL:
+      x86_load_args(a, ir);
+      x86_test_flags(a);
+      x86_op_reg(a, true, 0x0f44, X86_RAX, X86_RCX);   // CMOVE
+      x86_put_result(a, X86_RAX, ir);
+      break;
+   case J_CSET:
+      x86_load(a, X86_RAX, X86_RBP, FLAGS_OFFSET);
+      x86_put_result(a, X86_RAX, ir);
+      break;
+   case J_CMP:
+      x86_op_cmp(a, ir);
+      break;
+   case J_FCMP:
+      x86_op_fcmp(a, ir);
+      break;
+   case J_LOAD:
+   case J_ULOAD:
+      x86_op_load(a, ir);
+      break;
+   case J_STORE:
+      x86_op_store(a, ir);
+      break;
+   case J_JUMP:
+      x86_op_jump(a, ir);
+      break;
+   case J_CALL:
+      x86_op_call(a, ir);
+      break;
+   case J_RET:
+      x86_epilogue(a);
+      break;
+   case J_TRAP:
+      x86_sync_irpos(a, ir);
+      x86_lea(a, X86_RDI, X86_RBP, ANCHOR_OFFSET);
+      x86_call(a, x86_trap);
+      break;
+   case J_DEBUG:
+   case J_NOP:
+      break;
+   case MACRO_EXIT:
+      x86_macro_exit(a, ir);
+      break;
+   case MACRO_FFICALL:
+      x86_macro_fficall(a, ir);
+      break;
+   case MACRO_GALLOC:
+      x86_macro_galloc(a, ir);
+      break;
+   case MACRO_LALLOC:
+      x86_macro_lalloc(a, ir);
+      break;
+   case MACRO_SALLOC:
+      x86_macro_salloc(a, ir);
+      break;
+   case MACRO_COPY:
+      x86_macro_copy(a, ir);
+      break;
+   case MACRO_BZERO:
+      x86_macro_bzero(a, ir);
+      break;
+   case MACRO_EXP:
+   case MACRO_FEXP:
+      x86_macro_exp(a, ir);
+      break;
+   case MACRO_GETPRIV:
+   case MACRO_PUTPRIV:
+      x86_macro_priv(a, ir);
+      break;
+   case MACRO_CASE:
+      x86_macro_case(a, ir);
+      break;
+   default:
+      a->failed = true;
+      break;
+   }
+}
+
+static void *x86_install(x86_state_t *state, const uint8_t *buf, size_t len)
+{
+   // Each function gets its own pages so they can be made executable
+   // without affecting code that is already running
+   const size_t size = ALIGN_UP(len, sysconf(_SC_PAGESIZE));
+
+   void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANON, -1, 0);
+   if (mem == MAP_FAILED)
+      fatal_errno("mmap");
+
+   memcpy(mem, buf, len);
+
+   if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0)
+      fatal_errno("mprotect");
+
+   SCOPED_LOCK(state->lock);
+
+   const x86_code_t code = { mem, size };
+   APUSH(state->code, code);
+
+   return mem;
+}
+
+static void *jit_x86_init(void)
+{
+   return xcalloc(sizeof(x86_state_t));
+}
+
+static void jit_x86_cgen(jit_t *j, jit_handle_t handle, void *context)
+{
+   x86_state_t *state = context;
+   jit_func_t *f = jit_get_func(j, handle);
+
+   if (f->symbol != NULL || f->irbuf == NULL || jit_backedge_limit(j) > 0)
+      return;   // Keep using the interpreter
+
+   const uint64_t start_us = get_timestamp_us();
+
+   x86_asm_t a = {
+      .func   = f,
+      .labels = xmalloc_array(f->nirs, sizeof(unsigned)),
+   };
+
+   x86_prologue(&a);
+
+   for (int i = 0; i < f->nirs && !a.failed; i++) {
+      a.labels[i] = a.len;
+      x86_op(&a, &(f->irbuf[i]));
+   }
+
+   for (int i = 0; i < a.patches.count; i++) {
+      const x86_patch_t *p = &(a.patches.items[i]);
+      assert(p->target < f->nirs);
+
+      const int32_t rel = a.labels[p->target] - (p->offset + 4);
+      memcpy(a.buf + p->offset, &rel, 4);
+   }
+
+   if (!a.failed) {
+      void *code = x86_install(state, a.buf, a.len);
+
+      if (opt_get_verbose(OPT_JIT_VERBOSE, istr(f->name)))
+         debugf("%s at %p [%zu bytes, %"PRIi64" us]", istr(f->name), code,
+                a.len, get_timestamp_us() - start_us);
+
+      store_release(&f->entry, code);
+   }
+
+   ACLEAR(a.patches);
+   free(a.labels);
+   free(a.buf);
+}
+
+static void jit_x86_cleanup(void *context)
+{
+   x86_state_t *state = context;
+
+   for (int i = 0; i < state->code.count; i++)
+      munmap(state->code.items[i].mem, state->code.items[i].size);
+
+   ACLEAR(state->code);
+   free(state);
+}
+
+static const jit_plugin_t jit_x86 = {
+   .init    = jit_x86_init,
+   .cgen    = jit_x86_cgen,
+   .cleanup = jit_x86_cleanup
+};
+
+void jit_register_native_plugin(jit_t *j)
+{
+   const int threshold = opt_get_int(OPT_JIT_BASELINE);
+   if (threshold > 0)
+      jit_add_tier(j, threshold, &jit_x86);
+   else if (threshold < 0)
+      warnf("invalid NVC_JIT_BASELINE setting %d", threshold);
+}
+
+#else  // __x86_64__
+
+void jit_register_native_plugin(jit_t *j)
+{
+   // No baseline code generator for this platform
+}
+
+#endif  // __x86_64__
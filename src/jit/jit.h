@@ -46,20 +46,25 @@ typedef struct {
 } jit_layout_t;
 
 typedef vcode_unit_t (*jit_lower_fn_t)(ident_t, void *);
+typedef bool (*jit_pointer_fn_t)(void **, void *);
 
 typedef struct {
    void *(*init)(void);
    void (*cgen)(jit_t *, jit_handle_t, void *);
+   bool (*cached)(jit_t *, jit_handle_t, void *);
    void (*cleanup)(void *);
 } jit_plugin_t;
 
 jit_t *jit_new(void);
 void jit_free(jit_t *j);
+void jit_suspend_compiler(jit_t *j);
 jit_handle_t jit_compile(jit_t *j, ident_t name);
 jit_handle_t jit_lazy_compile(jit_t *j, ident_t name);
 jit_handle_t jit_assemble(jit_t *j, ident_t name, const char *text);
 void *jit_link(jit_t *j, jit_handle_t handle);
 void *jit_get_frame_var(jit_t *j, jit_handle_t handle, uint32_t var);
+void jit_walk_frame(jit_t *j, jit_handle_t handle, void *frame,
+                    jit_pointer_fn_t fn, void *ctx);
 void jit_set_lower_fn(jit_t *j, jit_lower_fn_t fn, void *ctx);
 void jit_set_silent(jit_t *j, bool silent);
 const jit_layout_t *jit_layout(jit_t *j, type_t type);
@@ -70,7 +75,15 @@ void jit_load_dll(jit_t *j, ident_t name);
 int jit_exit_status(jit_t *j);
 void jit_reset_exit_status(jit_t *j);
 void jit_add_tier(jit_t *j, int threshold, const jit_plugin_t *plugin);
+void jit_register_native_plugin(jit_t *j);
 ident_t jit_get_name(jit_t *j, jit_handle_t handle);
+bool jit_find_cpool(jit_t *j, const void *ptr, ident_t *name, size_t *offset);
+void *jit_get_cpool(jit_t *j, ident_t name);
+
+bool jit_find_file(void *fp, uint32_t *id);
+void *jit_get_file(uint32_t id);
+void jit_save_files(fbuf_t *f);
+void jit_restore_files(fbuf_t *f);
 
 bool jit_try_call(jit_t *j, jit_handle_t handle, jit_scalar_t *result, ...);
 bool jit_try_call_packed(jit_t *j, jit_handle_t handle, jit_scalar_t context,
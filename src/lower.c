@@ -687,7 +687,7 @@ static vcode_type_t lower_type(type_t type)
       }
 
    case T_INCOMPLETE:
-      return vtype_opaque();
+      return vtype_opaque(type_ident(type));
 
    default:
       fatal_trace("cannot lower type kind %s", type_kind_str(type_kind(type)));
@@ -28,6 +28,7 @@
 #include "rt/model.h"
 #include "rt/mspace.h"
 #include "rt/rt.h"
+#include "rt/server.h"
 #include "rt/wave.h"
 #include "scan.h"
 #include "thread.h"
@@ -233,6 +234,7 @@ static void parse_cover_options(const char *str, cover_mask_t *mask,
       { "count-from-undefined",  COVER_MASK_TOGGLE_COUNT_FROM_UNDEFINED },
       { "count-from-to-z",       COVER_MASK_TOGGLE_COUNT_FROM_TO_Z      },
       { "ignore-mems",           COVER_MASK_TOGGLE_IGNORE_MEMS          },
+      { "hits-only",             COVER_MASK_HITS_ONLY                   },
    };
 
    for (const char *start = str; ; str++) {
@@ -363,8 +365,10 @@ static int elaborate(int argc, char **argv)
    if (error_count() > 0)
       return EXIT_FAILURE;
 
+   // Also saved for AOT builds as checkpoints need the layout of each
+   // process's variables
    lib_t work = lib_work();
-   NOT_AOT_ONLY(lib_put_vcode(work, top, vu));
+   lib_put_vcode(work, top, vu);
 
    if (!opt_get_int(OPT_NO_SAVE)) {
       lib_save(work);
@@ -443,39 +447,57 @@ static void ctrl_c_handler(void *arg)
 #endif
 }
 
-static int run(int argc, char **argv)
+typedef struct {
+   wave_format_t   wave_fmt;
+   uint64_t        stop_time;
+   uint64_t        wave_start;
+   uint64_t        wave_stop;
+   uint64_t        flight_time;
+   vhdl_severity_t flight_trigger;
+   const char     *wave_fname;
+   const char     *gtkw_fname;
+   const char     *vhpi_plugins;
+   uint64_t        checkpoint_time;
+   char           *checkpoint_fname;
+   const char     *restore_fname;
+   const char     *server_path;
+   const char     *connect_path;
+   bool            have_generics;
+} run_args_t;
+
+static int parse_run_args(int argc, char **argv, run_args_t *args)
 {
    static struct option long_options[] = {
-      { "trace",         no_argument,       0, 't' },
-      { "profile",       no_argument,       0, 'p' },
-      { "stop-time",     required_argument, 0, 's' },
-      { "stats",         no_argument,       0, 'S' },
-      { "wave",          optional_argument, 0, 'w' },
-      { "stop-delta",    required_argument, 0, 'd' },
-      { "format",        required_argument, 0, 'f' },
-      { "include",       required_argument, 0, 'i' },
-      { "ieee-warnings", required_argument, 0, 'I' },
-      { "exclude",       required_argument, 0, 'e' },
-      { "exit-severity", required_argument, 0, 'x' },
-      { "dump-arrays",   no_argument,       0, 'a' },
-      { "load",          required_argument, 0, 'l' },
-      { "vhpi-trace",    no_argument,       0, 'T' },
-      { "gtkw",          optional_argument, 0, 'g' },
+      { "trace",           no_argument,       0, 't' },
+      { "profile",         no_argument,       0, 'p' },
+      { "stop-time",       required_argument, 0, 's' },
+      { "stats",           no_argument,       0, 'S' },
+      { "wave",            optional_argument, 0, 'w' },
+      { "stop-delta",      required_argument, 0, 'd' },
+      { "format",          required_argument, 0, 'f' },
+      { "include",         required_argument, 0, 'i' },
+      { "ieee-warnings",   required_argument, 0, 'I' },
+      { "exclude",         required_argument, 0, 'e' },
+      { "exit-severity",   required_argument, 0, 'x' },
+      { "dump-arrays",     optional_argument, 0, 'a' },
+      { "load",            required_argument, 0, 'l' },
+      { "vhpi-trace",      no_argument,       0, 'T' },
+      { "gtkw",            optional_argument, 0, 'g' },
+      { "parallel",        no_argument,       0, 'P' },
+      { "event-horizon",   required_argument, 0, 'E' },
+      { "checkpoint",      required_argument, 0, 'C' },
+      { "restore",         required_argument, 0, 'R' },
+      { "server",          required_argument, 0, 'V' },
+      { "connect",         required_argument, 0, 'c' },
+      { "generic",         required_argument, 0, 'G' },
+      { "wave-thread",     no_argument,       0, 'W' },
+      { "wave-start",      required_argument, 0, 'B' },
+      { "wave-stop",       required_argument, 0, 'O' },
+      { "flight-recorder", required_argument, 0, 'F' },
+      { "flight-trigger",  required_argument, 0, 'Y' },
       { 0, 0, 0, 0 }
    };
 
-   wave_format_t wave_fmt = WAVE_FORMAT_FST;
-   uint64_t      stop_time = TIME_HIGH;
-   const char   *wave_fname = NULL;
-   const char   *gtkw_fname = NULL;
-   const char   *vhpi_plugins = NULL;
-
-   static bool have_run = false;
-   if (have_run)
-      fatal("multiple run commands are not supported");
-
-   have_run = true;
-
    const int next_cmd = scan_cmd(2, argc, argv);
 
    int c, index = 0;
@@ -497,13 +519,13 @@ static int run(int argc, char **argv)
          opt_set_str(OPT_VHPI_TRACE, "1");
          break;
       case 's':
-         stop_time = parse_time(optarg);
+         args->stop_time = parse_time(optarg);
          break;
       case 'f':
          if (strcmp(optarg, "vcd") == 0)
-            wave_fmt = WAVE_FORMAT_VCD;
+            args->wave_fmt = WAVE_FORMAT_VCD;
          else if (strcmp(optarg, "fst") == 0)
-            wave_fmt = WAVE_FORMAT_FST;
+            args->wave_fmt = WAVE_FORMAT_FST;
          else
             fatal("invalid waveform format: %s", optarg);
          break;
@@ -512,15 +534,15 @@ static int run(int argc, char **argv)
          break;
       case 'w':
          if (optarg == NULL)
-            wave_fname = "";
+            args->wave_fname = "";
          else
-            wave_fname = optarg;
+            args->wave_fname = optarg;
          break;
       case 'g':
          if (optarg == NULL)
-            gtkw_fname = "";
+            args->gtkw_fname = "";
          else
-            gtkw_fname = optarg;
+            args->gtkw_fname = optarg;
          break;
       case 'd':
          opt_set_int(OPT_STOP_DELTA, parse_int(optarg));
@@ -532,7 +554,7 @@ static int run(int argc, char **argv)
          wave_exclude_glob(optarg);
          break;
       case 'l':
-         vhpi_plugins = optarg;
+         args->vhpi_plugins = optarg;
          break;
       case 'x':
          set_exit_severity(parse_severity(optarg));
@@ -541,30 +563,86 @@ static int run(int argc, char **argv)
          opt_set_int(OPT_IEEE_WARNINGS, parse_on_off(optarg));
          break;
       case 'a':
-         opt_set_int(OPT_DUMP_ARRAYS, 1);
+         if (optarg == NULL || strcmp(optarg, "all") == 0)
+            opt_set_int(OPT_DUMP_ARRAYS, DUMP_ARRAYS_ALL);
+         else if (strcmp(optarg, "sparse") == 0)
+            opt_set_int(OPT_DUMP_ARRAYS, DUMP_ARRAYS_SPARSE);
+         else
+            fatal("invalid $bold$--dump-arrays$$ mode: %s", optarg);
+         break;
+      case 'P':
+         opt_set_int(OPT_RT_PARALLEL, 1);
+         break;
+      case 'E':
+         opt_set_int(OPT_EVENT_HORIZON, ilog2(parse_time(optarg)));
+         break;
+      case 'C':
+         {
+            char *sep = strchr(optarg, ':');
+            if (sep == NULL || sep[1] == '\0')
+               fatal("$bold$--checkpoint$$ argument must be of the form "
+                     "TIME:FILE");
+
+            free(args->checkpoint_fname);
+            args->checkpoint_fname = xstrdup(sep + 1);
+            *sep = '\0';
+            args->checkpoint_time = parse_time(optarg);
+         }
+         break;
+      case 'R':
+         args->restore_fname = optarg;
+         break;
+      case 'V':
+         args->server_path = optarg;
+         break;
+      case 'c':
+         args->connect_path = optarg;
+         break;
+      case 'G':
+         parse_generic(optarg);
+         args->have_generics = true;
+         break;
+      case 'W':
+         opt_set_int(OPT_WAVE_THREAD, 1);
+         break;
+      case 'B':
+         args->wave_start = parse_time(optarg);
+         break;
+      case 'O':
+         args->wave_stop = parse_time(optarg);
+         break;
+      case 'F':
+         if ((args->flight_time = parse_time(optarg)) == 0)
+            fatal("$bold$--flight-recorder$$ history must be greater "
+                  "than zero");
+         break;
+      case 'Y':
+         args->flight_trigger = parse_severity(optarg);
          break;
       default:
          abort();
       }
    }
 
-   set_top_level(argv, next_cmd);
-
-   ident_t ename = ident_prefix(top_level, well_known(W_ELAB), '.');
-   tree_t top = lib_get(lib_work(), ename);
-   if (top == NULL)
-      fatal("%s not elaborated", istr(top_level));
+   return next_cmd;
+}
 
-   wave_dumper_t *dumper = NULL;
-   if (wave_fname != NULL) {
+static wave_dumper_t *create_dumper(run_args_t *args, tree_t top,
+                                    const char *include)
+{
+   if (args->wave_fname != NULL) {
       const char *name_map[] = { "FST", "VCD" };
       const char *ext_map[]  = { "fst", "vcd" };
       char *tmp LOCAL = NULL, *tmp2 LOCAL = NULL;
 
+      const char *wave_fname = args->wave_fname;
+      const char *gtkw_fname = args->gtkw_fname;
+
       if (*wave_fname == '\0') {
-         tmp = xasprintf("%s.%s", top_level_orig, ext_map[wave_fmt]);
+         tmp = xasprintf("%s.%s", top_level_orig, ext_map[args->wave_fmt]);
          wave_fname = tmp;
-         notef("writing %s waveform data to %s", name_map[wave_fmt], tmp);
+         notef("writing %s waveform data to %s", name_map[args->wave_fmt],
+               tmp);
       }
 
       if (gtkw_fname != NULL && *gtkw_fname == '\0') {
@@ -572,20 +650,41 @@ static int run(int argc, char **argv)
          gtkw_fname = tmp2;
       }
 
-      wave_include_file(argv[optind]);
-      dumper = wave_dumper_new(wave_fname, gtkw_fname, top, wave_fmt);
+      if (args->wave_start >= args->wave_stop)
+         fatal("$bold$--wave-stop$$ time must be after $bold$--wave-start$$ "
+               "time");
+
+      wave_include_file(include);
+
+      wave_dumper_t *wd =
+         wave_dumper_new(wave_fname, gtkw_fname, top, args->wave_fmt);
+      wave_dumper_set_window(wd, args->wave_start, args->wave_stop);
+
+      if (args->flight_time > 0)
+         wave_dumper_set_flight(wd, args->flight_time, args->flight_trigger);
+
+      return wd;
    }
-   else if (gtkw_fname != NULL)
+   else if (args->gtkw_fname != NULL)
       warnf("$bold$--gtkw$$ option has no effect without $bold$--wave$$");
+   else if (args->flight_time > 0)
+      warnf("$bold$--flight-recorder$$ option has no effect without "
+            "$bold$--wave$$");
 
-   if (opt_get_int(OPT_HEAP_SIZE) < 0x100000)
-      warnf("recommended heap size is at least 1M");
+   return NULL;
+}
 
+static rt_model_t *load_model(run_args_t *args, tree_t top, jit_t **pjit)
+{
    jit_t *jit = jit_new();
    jit_enable_runtime(jit, true);
 
    AOT_ONLY(jit_load_dll(jit, tree_ident(top)));
 
+#ifdef ENABLE_JIT
+   jit_register_native_plugin(jit);
+#endif
+
 #if defined ENABLE_JIT && defined LLVM_HAS_LLJIT
    jit_register_llvm_plugin(jit);
 #endif
@@ -596,17 +695,161 @@ static int run(int argc, char **argv)
 
    rt_model_t *model = model_new(top, jit);
 
-   if (vhpi_plugins != NULL)
-      vhpi_load_plugins(top, model, vhpi_plugins);
+   if (args->vhpi_plugins != NULL)
+      vhpi_load_plugins(top, model, args->vhpi_plugins);
 
    set_ctrl_c_handler(ctrl_c_handler, model);
 
+   if (args->checkpoint_fname != NULL)
+      model_checkpoint(model, args->checkpoint_time, args->checkpoint_fname);
+
    model_reset(model);
 
+   *pjit = jit;
+   return model;
+}
+
+static tree_t reelaborate(void)
+{
+   // Generics are folded into the elaborated design so overriding them
+   // requires elaborating the top-level unit again
+#if defined ENABLE_LLVM && !defined ENABLE_JIT
+   fatal("overriding generics with $bold$--generic$$ requires the JIT "
+         "compiler");
+#else
+   tree_t unit = lib_get(lib_work(), top_level);
+   if (unit == NULL)
+      fatal("cannot find unit %s in library %s",
+            istr(top_level), istr(lib_name(lib_work())));
+
+   tree_t new = elab(unit);
+   if (new == NULL || error_count() > 0)
+      return NULL;
+
+   lib_put_vcode(lib_work(), new, lower_unit(new, NULL));
+   return new;
+#endif
+}
+
+static int serve(run_args_t *args, tree_t *ptop, rt_model_t **pmodel,
+                 jit_t **pjit, int *pargc, char ***pargv)
+{
+   // The parent process does not run the model so Ctrl-C should just
+   // terminate the server
+   set_ctrl_c_handler(NULL, NULL);
+
+   stop_workers();   // Threads are not copied into children
+   jit_suspend_compiler(*pjit);
+
+   // Only returns in the child process forked for each request
+   int req_argc;
+   char **req_argv;
+   server_listen(args->server_path, &req_argc, &req_argv);
+
+   restart_workers();
+
+   run_args_t req = *args;
+   req.server_path   = NULL;
+   req.vhpi_plugins  = NULL;
+   req.restore_fname = NULL;
+
+   optind = 2;
+   const int next_cmd = parse_run_args(req_argc, req_argv, &req);
+
+   // The request always includes the --connect option used by the client
+   req.connect_path = NULL;
+
+   if (req.vhpi_plugins != NULL || req.server_path != NULL
+       || req.restore_fname != NULL || req.checkpoint_fname != NULL)
+      fatal("only simulation and waveform options can be passed to "
+            "$bold$--server$$");
+   else if (optind != next_cmd && strcmp(req_argv[optind], top_level_orig))
+      fatal("server was started for %s not %s", top_level_orig,
+            req_argv[optind]);
+
+   *args  = req;
+   *pargc = req_argc;
+   *pargv = req_argv;
+
+   if (req.have_generics) {
+      if ((*ptop = reelaborate()) == NULL)
+         return EXIT_FAILURE;
+
+      *pmodel = load_model(args, *ptop, pjit);
+   }
+   else {
+      // Options such as --stop-delta and --parallel are normally read
+      // when the model is created
+      model_reload_options(*pmodel);
+      set_ctrl_c_handler(ctrl_c_handler, *pmodel);
+   }
+
+   return EXIT_SUCCESS;
+}
+
+static int run(int argc, char **argv)
+{
+   static bool have_run = false;
+   if (have_run)
+      fatal("multiple run commands are not supported");
+
+   have_run = true;
+
+   run_args_t args = {
+      .wave_fmt       = WAVE_FORMAT_FST,
+      .stop_time      = TIME_HIGH,
+      .wave_stop      = TIME_HIGH,
+      .flight_trigger = SEVERITY_ERROR,
+   };
+
+   const int next_cmd = parse_run_args(argc, argv, &args);
+
+   if (args.connect_path != NULL) {
+      // Forward the run options to a server started with --server
+      const int status = server_request(args.connect_path, next_cmd - 1,
+                                        argv + 1);
+
+      argc -= next_cmd - 1;
+      argv += next_cmd - 1;
+
+      return status == 0 && argc > 1 ? process_command(argc, argv) : status;
+   }
+   else if (args.have_generics && args.server_path == NULL)
+      fatal("$bold$--generic$$ can only be used with $bold$--connect$$");
+
+   set_top_level(argv, next_cmd);
+
+   ident_t ename = ident_prefix(top_level, well_known(W_ELAB), '.');
+   tree_t top = lib_get(lib_work(), ename);
+   if (top == NULL)
+      fatal("%s not elaborated", istr(top_level));
+
+   if (opt_get_int(OPT_HEAP_SIZE) < 0x100000)
+      warnf("recommended heap size is at least 1M");
+
+   const bool is_server = args.server_path != NULL;
+   if (is_server && args.checkpoint_fname != NULL)
+      fatal("$bold$--checkpoint$$ cannot be used with $bold$--server$$");
+
+   jit_t *jit;
+   rt_model_t *model = load_model(&args, top, &jit);
+
+   if (args.restore_fname != NULL)
+      model_restore(model, args.restore_fname);
+
+   if (is_server) {
+      const int status = serve(&args, &top, &model, &jit, &argc, &argv);
+      if (status != EXIT_SUCCESS) {
+         server_reply(status);
+         return status;
+      }
+   }
+
+   wave_dumper_t *dumper = create_dumper(&args, top, top_level_orig);
    if (dumper != NULL)
       wave_dumper_restart(dumper, model);
 
-   model_run(model, stop_time);
+   model_run(model, args.stop_time);
 
    set_ctrl_c_handler(NULL, NULL);
 
@@ -618,6 +861,13 @@ static int run(int argc, char **argv)
    model_free(model);
    jit_free(jit);
 
+   free(args.checkpoint_fname);
+
+   if (is_server) {
+      server_reply(rc);
+      return rc;
+   }
+
    argc -= next_cmd - 1;
    argv += next_cmd - 1;
 
@@ -933,10 +1183,15 @@ static int coverage(int argc, char **argv)
    static struct option long_options[] = {
       { "report", required_argument, 0, 'r' },
       { "merge",  required_argument, 0, 'm' },
+      { "mapped", no_argument,       0, 'M' },
+      { "update", required_argument, 0, 'u' },
+      { "hier",   required_argument, 0, 'H' },
       { 0, 0, 0, 0 }
    };
 
-   const char *out_db = NULL, *rpt_file = NULL;
+   const char *out_db = NULL, *rpt_file = NULL, *update_db = NULL;
+   ident_t hier = NULL;
+   bool mapped = false;
    int c, index;
    const char *spec = "V";
 
@@ -948,6 +1203,20 @@ static int coverage(int argc, char **argv)
       case 'm':
          out_db = optarg;
          break;
+      case 'M':
+         mapped = true;
+         break;
+      case 'u':
+         update_db = optarg;
+         break;
+      case 'H':
+         {
+            char *name LOCAL = xstrdup(optarg);
+            for (char *p = name; *p; p++)
+               *p = toupper((int)*p);
+            hier = ident_new(name);
+         }
+         break;
       case 'V':
          opt_set_int(OPT_VERBOSE, 1);
          break;
@@ -960,29 +1229,29 @@ static int coverage(int argc, char **argv)
 
    progress("initialising");
 
-   if (optind == argc)
+   if (update_db != NULL && out_db != NULL)
+      fatal("the --update and --merge options cannot be used together");
+   else if (optind == argc && update_db == NULL)
       fatal("No input coverage database FILE specified");
 
-   cover_tagging_t *cover = NULL;
-
    // Rest of inputs are coverage input files
-   for (int i = optind; i < argc; i++) {
-      fbuf_t *f = fbuf_open(argv[i], FBUF_IN, FBUF_CS_NONE);
-
-      if (f != NULL) {
-         progress("Loading input coverage database: %s", argv[i]);
-         if (i == optind)
-            cover = cover_read_tags(f);
-         else
-            cover_merge_tags(f, cover);
-      }
-      else
-         fatal("Could not open coverage database: %s", argv[i]);
-
-      fbuf_close(f, NULL);
+   cover_tagging_t *cover;
+   if (update_db != NULL)
+      cover = cover_update_mapped(update_db, argv + optind, argc - optind);
+   else if (hier != NULL && out_db == NULL && optind + 1 == argc
+            && cover_is_mapped(argv[optind])) {
+      // Only load the requested part of the hierarchy
+      cover = cover_read_mapped(argv[optind], hier);
+      hier = NULL;
    }
+   else
+      cover = cover_merge_files(argv + optind, argc - optind);
 
-   if (out_db) {
+   if (out_db && mapped) {
+      progress("Saving merged coverage database to: %s", out_db);
+      cover_write_mapped(cover, out_db);
+   }
+   else if (out_db) {
       progress("Saving merged coverage database to: %s", out_db);
       fbuf_t *f = fbuf_open(out_db, FBUF_OUT, FBUF_CS_NONE);
       cover_dump_tags(cover, f, COV_DUMP_PROCESSING, NULL, NULL, NULL);
@@ -990,6 +1259,9 @@ static int coverage(int argc, char **argv)
    }
 
    if (rpt_file && cover) {
+      if (hier != NULL)
+         cover = cover_select_hier(cover, hier);
+
       progress("Generating coverage report to folder: %s.", rpt_file);
       cover_report(rpt_file, cover);
    }
@@ -1050,28 +1322,49 @@ static void usage(void)
           " -V, --verbose\t\tPrint resource usage at each step\n"
           "\n"
           "Run options:\n"
-          "     --dump-arrays\tInclude nested arrays in waveform dump\n"
+          "     --checkpoint=T:FILE\tSave simulation state at time T to FILE\n"
+          "     --connect=SOCKET\tRun using a server started with --server\n"
+          "     --dump-arrays[=M]\tInclude nested arrays in waveform dump;\n"
+          "     \t\t\tM is either all (default) or sparse\n"
+          "     --event-horizon=T\tSchedule events within T in a timing wheel\n"
           "     --exclude=GLOB\tExclude signals matching GLOB from wave dump\n"
           "     --exit-severity=\tExit after assertion failure of "
           "this severity\n"
+          "     --flight-recorder=T\tOnly write last T of waveform data on an\n"
+          "     \t\t\terror\n"
+          "     --flight-trigger=SEV\tSeverity of assertion that writes the\n"
+          "     \t\t\tflight recorder history (default error)\n"
           "     --format=FMT\tWaveform format is either fst or vcd\n"
+          "     --generic=N=V\tOverride generic N with value V when using\n"
+          "     \t\t\t--connect\n"
           "     --ieee-warnings=\tEnable ('on') or disable ('off') warnings\n"
           "     \t\t\tfrom IEEE packages\n"
           "     --include=GLOB\tInclude signals matching GLOB in wave dump\n"
           "     --load=PLUGIN\tLoad VHPI plugin at startup\n"
+          "     --parallel\t\tRun processes concurrently on worker threads\n"
           "     --profile\t\tDisplay detailed statistics at end of run\n"
+          "     --restore=FILE\tContinue simulation from checkpoint FILE\n"
+          "     --server=SOCKET\tInitialise the design once and fork a new\n"
+          "     \t\t\tsimulation for each request on SOCKET\n"
           "     --stats\t\tPrint time and memory usage at end of run\n"
           "     --stop-delta=N\tStop after N delta cycles (default %d)\n"
           "     --stop-time=T\tStop after simulation time T (e.g. 5ns)\n"
           "     --trace\t\tTrace simulation events\n"
           "     --vhpi-trace\tTrace VHPI calls and events\n"
           " -w, --wave=FILE\tWrite waveform data; file name is optional\n"
+          "     --wave-start=T\tStart dumping waveform data at time T\n"
+          "     --wave-stop=T\tStop dumping waveform data after time T\n"
+          "     --wave-thread\tWrite waveform data on a background thread\n"
           "\n"
           "Coverage processing options:\n"
+          "     --hier=NAME\tOnly report on hierarchy NAME and below.\n"
+          "     --mapped\t\tWrite merged database in memory-mappable format.\n"
           "     --merge=OUTPUT\tMerge all input coverage databases from FILEs\n"
           "                        to OUTPUT coverage database.\n"
           "     --report=DIR\tGenerate HTML report with code coverage results\n"
           "                    \tto DIR folder.\n"
+          "     --update=DB\tMerge FILEs into memory-mappable database DB\n"
+          "                    \tin place.\n"
           "\n"
           "Dump options:\n"
           " -e, --elab\t\tDump an elaborated unit\n"
@@ -155,6 +155,11 @@ void arena_set_checksum(object_arena_t *arena, uint32_t checksum)
    arena->checksum = checksum;
 }
 
+uint32_t arena_get_checksum(object_arena_t *arena)
+{
+   return arena->checksum;
+}
+
 object_t *arena_root(object_arena_t *arena)
 {
    return arena->root ?: (object_t *)arena->base;
@@ -241,6 +241,7 @@ object_arena_t *object_arena(object_t *object);
 size_t object_arena_default_size(void);
 object_t *arena_root(object_arena_t *arena);
 void arena_set_checksum(object_arena_t *arena, uint32_t checksum);
+uint32_t arena_get_checksum(object_arena_t *arena);
 bool arena_frozen(object_arena_t *arena);
 
 void object_write(object_t *object, fbuf_t *f, ident_wr_ctx_t ident_ctx,
@@ -138,4 +138,11 @@ void set_default_options(void)
    opt_set_int(OPT_NO_SAVE, 0);
    opt_set_str(OPT_LLVM_VERBOSE, getenv("NVC_LLVM_VERBOSE"));
    opt_set_int(OPT_JIT_THRESHOLD, atoi(getenv("NVC_JIT_THRESHOLD") ?: "100"));
+   opt_set_int(OPT_RT_PARALLEL, 0);
+   opt_set_int(OPT_EVENT_HORIZON, 36);   // Log2 femtoseconds
+   opt_set_int(OPT_WAVE_THREAD, 0);
+   opt_set_int(OPT_JIT_ASYNC, atoi(getenv("NVC_JIT_ASYNC") ?: "1"));
+   opt_set_int(OPT_JIT_CACHE, atoi(getenv("NVC_JIT_CACHE") ?: "1"));
+   opt_set_int(OPT_JIT_THREADED, atoi(getenv("NVC_JIT_THREADED") ?: "1"));
+   opt_set_int(OPT_JIT_BASELINE, atoi(getenv("NVC_JIT_BASELINE") ?: "10"));
 }
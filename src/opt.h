@@ -55,6 +55,13 @@ typedef enum {
    OPT_NO_SAVE,
    OPT_LLVM_VERBOSE,
    OPT_JIT_THRESHOLD,
+   OPT_RT_PARALLEL,
+   OPT_EVENT_HORIZON,
+   OPT_WAVE_THREAD,
+   OPT_JIT_ASYNC,
+   OPT_JIT_CACHE,
+   OPT_JIT_THREADED,
+   OPT_JIT_BASELINE,
 
    OPT_LAST_NAME
 } opt_name_t;
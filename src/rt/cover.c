@@ -19,11 +19,13 @@
 #include "array.h"
 #include "common.h"
 #include "cover.h"
+#include "hash.h"
 #include "lib.h"
 #include "opt.h"
 #include "rt/model.h"
 #include "rt/rt.h"
 #include "rt/structs.h"
+#include "thread.h"
 #include "type.h"
 
 #include <assert.h>
@@ -32,9 +34,14 @@
 #include <limits.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <time.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 //#define COVER_DEBUG
 
 #define MARGIN_LEFT "20%%"
@@ -60,6 +67,16 @@ typedef struct _cover_scope {
    range_array_t  ignore_lines;
 } cover_scope_t;
 
+typedef struct {
+   int32_t  *tags;
+   uint32_t  size;
+   uint8_t   from_u;    // Either _U or an invalid value if not counted
+   uint8_t   from_z;    // Either _Z or an invalid value if not counted
+   uint64_t  bits[];    // Rising edge bitmap followed by falling edges
+} cover_toggle_t;
+
+typedef A(cover_toggle_t *) toggle_array_t;
+
 struct _cover_tagging {
    int            next_stmt_tag;
    int            next_branch_tag;
@@ -72,8 +89,75 @@ struct _cover_tagging {
    int            array_depth;
    cover_scope_t *top_scope;
    int            level;
+   toggle_array_t toggles;
 };
 
+typedef A(ident_t) ident_list_t;
+
+#define COVER_MAP_MAGIC   0x4d43564e   // NVCM
+#define COVER_MAP_VERSION 1
+
+// Header of the uncompressed memory-mappable database format which is
+// followed by the counter column, the fixed-size tag records, an index
+// of tags sorted by hierarchical name, the source file table, and
+// finally the string table
+typedef struct {
+   uint32_t magic;
+   uint32_t version;
+   uint32_t mask;
+   uint32_t array_limit;
+   uint32_t next_stmt_tag;
+   uint32_t next_branch_tag;
+   uint32_t next_toggle_tag;
+   uint32_t next_hier_tag;
+   uint32_t ntags;
+   uint32_t nfiles;
+   uint64_t strtab_size;
+} cover_map_header_t;
+
+typedef struct {
+   uint32_t hier;           // Offset into string table
+   int32_t  tag;
+   uint32_t flags;
+   uint32_t level;
+   uint32_t file;           // Index into file table or UINT32_MAX
+   uint32_t first_line;
+   uint16_t first_column;
+   uint8_t  line_delta;
+   uint8_t  column_delta;
+   uint8_t  kind;
+   uint8_t  pad[3];
+} cover_map_tag_t;
+
+STATIC_ASSERT(sizeof(cover_map_tag_t) == 32);
+
+typedef struct {
+   void                     *base;
+   size_t                    size;
+   const cover_map_header_t *header;
+   int32_t                  *data;
+   const cover_map_tag_t    *tags;
+   const uint32_t           *index;
+   const uint32_t           *files;
+   const char               *strtab;
+} cover_map_t;
+
+typedef struct _cover_chunk cover_chunk_t;
+
+typedef struct {
+   cover_tagging_t  *tagging;
+   hash_t           *index;
+   char            **files;
+} cover_merge_t;
+
+typedef struct _cover_chunk {
+   int            first;
+   int            last;
+   int32_t       *data;
+   ident_list_t   dropped;
+   cover_chunk_t *peer;
+} cover_chunk_t;
+
 typedef struct {
    unsigned    total_stmts;
    unsigned    hit_stmts;
@@ -259,7 +343,7 @@ cover_tag_t *cover_add_tag(tree_t t, ident_t suffix, cover_tagging_t *ctx,
 }
 
 void cover_dump_tags(cover_tagging_t *ctx, fbuf_t *f, cover_dump_t dt,
-                     const int32_t *stmts, const int32_t *branches,
+                     const uint64_t *stmts, const int32_t *branches,
                      const int32_t *toggles)
 {
 
@@ -289,15 +373,15 @@ void cover_dump_tags(cover_tagging_t *ctx, fbuf_t *f, cover_dump_t dt,
       write_u32(tag->tag, f);
 
       if (dt == COV_DUMP_RUNTIME) {
-         const int32_t *cnts = NULL;
-         if (tag->kind == TAG_STMT)
-            cnts = stmts;
-         else if (tag->kind == TAG_BRANCH)
-            cnts = branches;
-         else if (tag->kind == TAG_TOGGLE)
-            cnts = toggles;
-
-         int32_t data = (cnts) ? cnts[tag->tag] : 0;
+         // Statement counts are clamped to fit in the database
+         int32_t data = 0;
+         if (tag->kind == TAG_STMT && stmts != NULL)
+            data = MIN(stmts[tag->tag], INT32_MAX);
+         else if (tag->kind == TAG_BRANCH && branches != NULL)
+            data = branches[tag->tag];
+         else if (tag->kind == TAG_TOGGLE && toggles != NULL)
+            data = toggles[tag->tag];
+
          write_u32(data, f);
 
 #ifdef COVER_DEBUG
@@ -527,11 +611,371 @@ cover_tagging_t *cover_read_tags(fbuf_t *f)
    return tagging;
 }
 
-void cover_merge_tags(fbuf_t *f, cover_tagging_t *tagging)
+static size_t cover_map_layout(uint32_t ntags, uint32_t nfiles,
+                               uint64_t strtab_size, size_t offsets[5])
 {
-   assert (tagging != NULL);
+   size_t pos = sizeof(cover_map_header_t);
+   offsets[0] = pos;   // Counters
+   pos = ALIGN_UP(pos + ntags * sizeof(int32_t), 8);
+   offsets[1] = pos;   // Tag records
+   pos += ntags * sizeof(cover_map_tag_t);
+   offsets[2] = pos;   // Sorted index
+   pos += ntags * sizeof(uint32_t);
+   offsets[3] = pos;   // File table
+   pos += nfiles * sizeof(uint32_t);
+   offsets[4] = pos;   // String table
+   return pos + strtab_size;
+}
 
-   cover_read_header(f, tagging);
+bool cover_is_mapped(const char *file)
+{
+   FILE *f = fopen(file, "rb");
+   if (f == NULL)
+      return false;
+
+   uint32_t magic = 0;
+   const bool mapped =
+      fread(&magic, sizeof(magic), 1, f) == 1 && magic == COVER_MAP_MAGIC;
+
+   fclose(f);
+   return mapped;
+}
+
+static void cover_map_open(const char *file, bool writable, cover_map_t *map)
+{
+   int fd = open(file, writable ? O_RDWR : O_RDONLY);
+   if (fd < 0)
+      fatal_errno("%s", file);
+
+   struct stat st;
+   if (fstat(fd, &st) != 0)
+      fatal_errno("%s", file);
+
+   if (st.st_size < sizeof(cover_map_header_t))
+      fatal("%s is not a coverage database", file);
+
+   map->size = st.st_size;
+   map->base = writable
+      ? map_file_writable(fd, map->size) : map_file(fd, map->size);
+   close(fd);
+
+   map->header = map->base;
+   if (map->header->magic != COVER_MAP_MAGIC)
+      fatal("%s is not a coverage database", file);
+   else if (map->header->version != COVER_MAP_VERSION)
+      fatal("%s was created by a different version of " PACKAGE_NAME, file);
+
+   const uint32_t ntags = map->header->ntags;
+   const uint32_t nfiles = map->header->nfiles;
+   const uint64_t strtab_size = map->header->strtab_size;
+
+   size_t offsets[5];
+   if (strtab_size > map->size
+       || cover_map_layout(ntags, nfiles, strtab_size, offsets) != map->size)
+      fatal("coverage database %s is corrupt", file);
+
+   char *base = map->base;
+   map->data   = (int32_t *)(base + offsets[0]);
+   map->tags   = (const cover_map_tag_t *)(base + offsets[1]);
+   map->index  = (const uint32_t *)(base + offsets[2]);
+   map->files  = (const uint32_t *)(base + offsets[3]);
+   map->strtab = base + offsets[4];
+
+   // Every string is read directly out of the mapping so the offsets
+   // must be validated here rather than trusted at each use
+   if (strtab_size > 0 && map->strtab[strtab_size - 1] != '\0')
+      fatal("coverage database %s is corrupt", file);
+
+   for (uint32_t i = 0; i < nfiles; i++) {
+      if (map->files[i] >= strtab_size)
+         fatal("coverage database %s is corrupt", file);
+   }
+
+   for (uint32_t i = 0; i < ntags; i++) {
+      const cover_map_tag_t *r = &(map->tags[i]);
+      if (map->index[i] >= ntags || r->hier >= strtab_size
+          || (r->file != UINT32_MAX && r->file >= nfiles)
+          || r->level > ntags || r->kind >= TAG_LAST)
+         fatal("coverage database %s is corrupt", file);
+   }
+}
+
+static void cover_map_close(cover_map_t *map)
+{
+   unmap_file(map->base, map->size);
+}
+
+static int cover_map_compare(const void *a, const void *b)
+{
+   const char *const *sa = a, *const *sb = b;
+   return strcmp(*sa, *sb);
+}
+
+void cover_write_mapped(cover_tagging_t *tagging, const char *file)
+{
+   const uint32_t ntags = tagging->tags.count;
+
+   A(char) strtab = AINIT;
+   A(uint32_t) files = AINIT;
+   hash_t *strings = hash_new(MAX(ntags * 2, 16));
+   ihash_t *refs = ihash_new(16);
+
+   cover_map_tag_t *records LOCAL =
+      xcalloc_array(MAX(ntags, 1), sizeof(cover_map_tag_t));
+
+   // Pairs of name and position used to build the sorted index
+   const char **names LOCAL = xmalloc_array(MAX(ntags, 1) * 2, sizeof(char *));
+
+   for (int i = 0; i < ntags; i++) {
+      const cover_tag_t *tag = &(tagging->tags.items[i]);
+      cover_map_tag_t *r = &(records[i]);
+
+      const uintptr_t off = (uintptr_t)hash_get(strings, tag->hier);
+      if (off == 0) {
+         const char *str = istr(tag->hier);
+         r->hier = strtab.count;
+         for (const char *p = str; *p; p++)
+            APUSH(strtab, *p);
+         APUSH(strtab, '\0');
+         hash_put(strings, tag->hier, (void *)(uintptr_t)(r->hier + 1));
+      }
+      else
+         r->hier = off - 1;
+
+      r->file = UINT32_MAX;
+      if (tag->loc.file_ref != FILE_INVALID) {
+         const uintptr_t idx = (uintptr_t)ihash_get(refs, tag->loc.file_ref);
+         if (idx == 0) {
+            APUSH(files, strtab.count);
+            for (const char *p = loc_file_str(&(tag->loc)); *p; p++)
+               APUSH(strtab, *p);
+            APUSH(strtab, '\0');
+            ihash_put(refs, tag->loc.file_ref, (void *)(uintptr_t)files.count);
+            r->file = files.count - 1;
+         }
+         else
+            r->file = idx - 1;
+      }
+
+      r->tag          = tag->tag;
+      r->flags        = tag->flags;
+      r->level        = tag->level;
+      r->kind         = tag->kind;
+      r->first_line   = tag->loc.first_line;
+      r->first_column = tag->loc.first_column;
+      r->line_delta   = tag->loc.line_delta;
+      r->column_delta = tag->loc.column_delta;
+   }
+
+   // Resolve string table offsets only after it has stopped growing
+   for (int i = 0; i < ntags; i++) {
+      names[i * 2] = strtab.items + records[i].hier;
+      names[i * 2 + 1] = (const char *)(uintptr_t)i;
+   }
+
+   qsort(names, ntags, sizeof(char *) * 2, cover_map_compare);
+
+   uint32_t *index LOCAL = xmalloc_array(MAX(ntags, 1), sizeof(uint32_t));
+   for (int i = 0; i < ntags; i++)
+      index[i] = (uintptr_t)names[i * 2 + 1];
+
+   int32_t *data LOCAL = xmalloc_array(MAX(ntags, 1), sizeof(int32_t));
+   for (int i = 0; i < ntags; i++)
+      data[i] = tagging->tags.items[i].data;
+
+   const cover_map_header_t header = {
+      .magic           = COVER_MAP_MAGIC,
+      .version         = COVER_MAP_VERSION,
+      .mask            = tagging->mask,
+      .array_limit     = tagging->array_limit,
+      .next_stmt_tag   = tagging->next_stmt_tag,
+      .next_branch_tag = tagging->next_branch_tag,
+      .next_toggle_tag = tagging->next_toggle_tag,
+      .next_hier_tag   = tagging->next_hier_tag,
+      .ntags           = ntags,
+      .nfiles          = files.count,
+      .strtab_size     = strtab.count,
+   };
+
+   size_t offsets[5];
+   cover_map_layout(ntags, files.count, strtab.count, offsets);
+
+   FILE *f = fopen(file, "wb");
+   if (f == NULL)
+      fatal_errno("%s", file);
+
+   static const uint8_t zeros[8] = {};
+   const size_t data_end = offsets[0] + ntags * sizeof(int32_t);
+   const size_t padding = offsets[1] - data_end;
+   assert(padding < sizeof(zeros));
+
+   if (fwrite(&header, sizeof(header), 1, f) != 1
+       || fwrite(data, sizeof(int32_t), ntags, f) != ntags
+       || (padding > 0 && fwrite(zeros, padding, 1, f) != 1)
+       || fwrite(records, sizeof(cover_map_tag_t), ntags, f) != ntags
+       || fwrite(index, sizeof(uint32_t), ntags, f) != ntags
+       || fwrite(files.items, sizeof(uint32_t), files.count, f) != files.count
+       || fwrite(strtab.items, 1, strtab.count, f) != strtab.count
+       || fclose(f) != 0)
+      fatal_errno("%s", file);
+
+   ACLEAR(strtab);
+   ACLEAR(files);
+   hash_free(strings);
+   ihash_free(refs);
+}
+
+static int cover_map_find_hier(const cover_map_t *map, const char *hier)
+{
+   // Binary search for the first entry in the sorted index with this
+   // name then pick the opening hierarchy tag from those
+   int low = 0, high = map->header->ntags;
+   while (low < high) {
+      const int mid = (low + high) / 2;
+      const char *str = map->strtab + map->tags[map->index[mid]].hier;
+      if (strcmp(str, hier) < 0)
+         low = mid + 1;
+      else
+         high = mid;
+   }
+
+   for (; low < map->header->ntags; low++) {
+      const cover_map_tag_t *r = &(map->tags[map->index[low]]);
+      if (strcmp(map->strtab + r->hier, hier) != 0)
+         break;
+      else if (r->kind == TAG_HIER && (r->flags & COV_FLAG_HIER_DOWN))
+         return map->index[low];
+   }
+
+   return -1;
+}
+
+static int cover_hier_end(const cover_tag_t *tags, int ntags, int start)
+{
+   // The closing tag is the first one at the parent's level
+   for (int i = start + 1; i < ntags; i++) {
+      if (tags[i].kind == TAG_HIER && (tags[i].flags & COV_FLAG_HIER_UP)
+          && tags[i].level == tags[start].level - 1)
+         return i + 1;
+   }
+
+   return ntags;
+}
+
+cover_tagging_t *cover_read_mapped(const char *file, ident_t hier)
+{
+   cover_map_t map;
+   cover_map_open(file, false, &map);
+
+   const cover_map_header_t *h = map.header;
+
+   cover_tagging_t *tagging = xcalloc(sizeof(cover_tagging_t));
+   tagging->mask            = h->mask;
+   tagging->array_limit     = h->array_limit;
+   tagging->next_stmt_tag   = h->next_stmt_tag;
+   tagging->next_branch_tag = h->next_branch_tag;
+   tagging->next_toggle_tag = h->next_toggle_tag;
+   tagging->next_hier_tag   = h->next_hier_tag;
+
+   int start = 0, end = h->ntags;
+   if (hier != NULL) {
+      // Only the tags for this hierarchy and its children are loaded
+      if ((start = cover_map_find_hier(&map, istr(hier))) < 0)
+         fatal("hierarchy %s not found in coverage database %s",
+               istr(hier), file);
+
+      for (end = start + 1; end < h->ntags; end++) {
+         const cover_map_tag_t *r = &(map.tags[end]);
+         if (r->kind == TAG_HIER && (r->flags & COV_FLAG_HIER_UP)
+             && r->level == map.tags[start].level - 1) {
+            end++;
+            break;
+         }
+      }
+   }
+
+   loc_file_ref_t *refs LOCAL =
+      xmalloc_array(MAX(h->nfiles, 1), sizeof(loc_file_ref_t));
+   for (int i = 0; i < h->nfiles; i++)
+      refs[i] = FILE_INVALID;
+
+   ARESIZE(tagging->tags, end - start);
+
+   for (int i = start; i < end; i++) {
+      const cover_map_tag_t *r = &(map.tags[i]);
+      cover_tag_t *tag = &(tagging->tags.items[i - start]);
+
+      loc_file_ref_t ref = FILE_INVALID;
+      if (r->file < h->nfiles) {
+         if (refs[r->file] == FILE_INVALID)
+            refs[r->file] = loc_file_ref(map.strtab + map.files[r->file], NULL);
+         ref = refs[r->file];
+      }
+
+      tag->kind  = r->kind;
+      tag->tag   = r->tag;
+      tag->data  = map.data[i];
+      tag->flags = r->flags;
+      tag->level = r->level;
+      tag->hier  = ident_new(map.strtab + r->hier);
+
+      tag->loc.first_line   = r->first_line;
+      tag->loc.first_column = r->first_column;
+      tag->loc.line_delta   = r->line_delta;
+      tag->loc.column_delta = r->column_delta;
+      tag->loc.file_ref     = ref;
+   }
+
+   cover_map_close(&map);
+   return tagging;
+}
+
+cover_tagging_t *cover_select_hier(cover_tagging_t *tagging, ident_t hier)
+{
+   const cover_tag_t *tags = tagging->tags.items;
+   const int ntags = tagging->tags.count;
+
+   int start = 0;
+   for (; start < ntags; start++) {
+      if (tags[start].kind == TAG_HIER && tags[start].hier == hier
+          && (tags[start].flags & COV_FLAG_HIER_DOWN))
+         break;
+   }
+
+   if (start == ntags)
+      fatal("hierarchy %s not found in coverage database", istr(hier));
+
+   const int end = cover_hier_end(tags, ntags, start);
+
+   cover_tagging_t *sub = xcalloc(sizeof(cover_tagging_t));
+   *sub = *tagging;
+   sub->tags.items = NULL;
+   sub->tags.count = sub->tags.limit = 0;
+
+   ARESIZE(sub->tags, end - start);
+   memcpy(sub->tags.items, tags + start, (end - start) * sizeof(cover_tag_t));
+
+   return sub;
+}
+
+static int32_t cover_merge_data(tag_kind_t kind, int32_t old, int32_t new)
+{
+   switch (kind) {
+   case TAG_STMT:
+      return MIN((int64_t)old + new, INT32_MAX);
+   case TAG_TOGGLE:
+   case TAG_BRANCH:
+      return old | new;
+   default:
+      return old;
+   }
+}
+
+static void cover_merge_stream(fbuf_t *f, cover_merge_t *merge,
+                               int32_t *data, ident_list_t *dropped)
+{
+   cover_tagging_t header = {};
+   cover_read_header(f, &header);
 
    loc_rd_ctx_t *loc_rd = loc_read_begin(f);
    ident_rd_ctx_t ident_ctx = ident_read_begin(f);
@@ -543,42 +987,204 @@ void cover_merge_tags(fbuf_t *f, cover_tagging_t *tagging)
       if (new.kind == TAG_LAST)
          break;
 
-      // TODO: Could merging be done more efficiently?
-      bool found = false;
-      for (int i = 0; i < tagging->tags.count; i++) {
-         cover_tag_t *old = AREF(tagging->tags, i);
-
-         // Compare based on hierarchical path, each
-         // statement / branch / signal has unique hierarchical name
-         if (new.hier == old->hier) {
-            assert(new.kind == old->kind);
-#ifdef COVER_DEBUG
-            printf("Merging coverage tag: %s\n", istr(old->hier));
-#endif
-            switch (new.kind) {
-            case TAG_STMT:
-               old->data += new.data;
-               break;
-            case TAG_TOGGLE:
-            case TAG_BRANCH:
-               old->data |= new.data;
-               break;
-            default:
-               break;
-            }
-
-            found = true;
-            break;
-         }
-      }
+      // Each statement / branch / signal has a unique hierarchical
+      // name so this is enough to find the matching tag even if the
+      // tag numbering differs between the databases
+      const uintptr_t pos = (uintptr_t)hash_get(merge->index, new.hier);
 
       // TODO: Append the new tag just before popping hierarchy tag
       //       with longest common prefix of new tag. That will allow to
       //       merge coverage of IPs from different configurations of
       //       generics which form hierarchy differently!
-      if (!found)
-         warnf("Dropping coverage tag: %s\n", istr(new.hier));
+      if (pos == 0) {
+         APUSH(*dropped, new.hier);
+         continue;
+      }
+
+      const tag_kind_t kind = merge->tagging->tags.items[pos - 1].kind;
+      if (new.kind != kind)
+         fatal("coverage tag %s has different kind in %s",
+               istr(new.hier), fbuf_file_name(f));
+
+      data[pos - 1] = cover_merge_data(kind, data[pos - 1], new.data);
+   }
+
+   loc_read_end(loc_rd);
+   ident_read_end(ident_ctx);
+}
+
+static void cover_merge_mapped(const char *file, cover_merge_t *merge,
+                               int32_t *data, ident_list_t *dropped)
+{
+   cover_map_t map;
+   cover_map_open(file, false, &map);
+
+   for (int i = 0; i < map.header->ntags; i++) {
+      const cover_map_tag_t *r = &(map.tags[i]);
+      ident_t hier = ident_new(map.strtab + r->hier);
+
+      const uintptr_t pos = (uintptr_t)hash_get(merge->index, hier);
+      if (pos == 0) {
+         APUSH(*dropped, hier);
+         continue;
+      }
+
+      const tag_kind_t kind = merge->tagging->tags.items[pos - 1].kind;
+      if (r->kind != kind)
+         fatal("coverage tag %s has different kind in %s", istr(hier), file);
+
+      data[pos - 1] = cover_merge_data(kind, data[pos - 1], map.data[i]);
    }
+
+   cover_map_close(&map);
+}
+
+static void cover_merge_chunk_cb(void *context, void *arg)
+{
+   cover_merge_t *merge = context;
+   cover_chunk_t *chunk = arg;
+
+   const int ntags = merge->tagging->tags.count;
+   chunk->data = xcalloc_array(MAX(ntags, 1), sizeof(int32_t));
+
+   for (int i = chunk->first; i < chunk->last; i++) {
+      if (cover_is_mapped(merge->files[i])) {
+         cover_merge_mapped(merge->files[i], merge, chunk->data,
+                            &(chunk->dropped));
+         continue;
+      }
+
+      fbuf_t *f = fbuf_open(merge->files[i], FBUF_IN, FBUF_CS_NONE);
+      if (f == NULL)
+         fatal("Could not open coverage database: %s", merge->files[i]);
+
+      cover_merge_stream(f, merge, chunk->data, &(chunk->dropped));
+      fbuf_close(f, NULL);
+   }
+}
+
+static void cover_reduce_chunk_cb(void *context, void *arg)
+{
+   cover_merge_t *merge = context;
+   cover_chunk_t *chunk = arg;
+
+   const cover_tag_t *tags = merge->tagging->tags.items;
+   const int ntags = merge->tagging->tags.count;
+
+   for (int i = 0; i < ntags; i++)
+      chunk->data[i] = cover_merge_data(tags[i].kind, chunk->data[i],
+                                        chunk->peer->data[i]);
+}
+
+static void cover_merge_into(cover_tagging_t *tagging, char **files,
+                             int nfiles)
+{
+   cover_merge_t merge = {
+      .tagging = tagging,
+      .index   = hash_new(MAX(tagging->tags.count * 2, 16)),
+      .files   = files,
+   };
+
+   for (int i = 0; i < tagging->tags.count; i++)
+      hash_put(merge.index, tagging->tags.items[i].hier,
+               (void *)(uintptr_t)(i + 1));
+
+   // Split the files into contiguous chunks which are read concurrently
+   // with each accumulating into a private array and then reduce the
+   // arrays pairwise
+   const int nchunks = MIN(nfiles, nvc_nprocs() * 4);
+   cover_chunk_t *chunks LOCAL = xcalloc_array(nchunks, sizeof(cover_chunk_t));
+
+   workq_t *wq = workq_new(&merge);
+
+   for (int i = 0; i < nchunks; i++) {
+      chunks[i].first = (int64_t)i * nfiles / nchunks;
+      chunks[i].last  = (int64_t)(i + 1) * nfiles / nchunks;
+      workq_do(wq, cover_merge_chunk_cb, &(chunks[i]));
+   }
+
+   workq_start(wq);
+   workq_drain(wq);
+
+   for (int stride = 1; stride < nchunks; stride *= 2) {
+      for (int i = 0; i + stride < nchunks; i += stride * 2) {
+         chunks[i].peer = &(chunks[i + stride]);
+         workq_do(wq, cover_reduce_chunk_cb, &(chunks[i]));
+      }
+
+      workq_start(wq);
+      workq_drain(wq);
+   }
+
+   workq_free(wq);
+
+   for (int i = 0; i < tagging->tags.count; i++) {
+      cover_tag_t *tag = &(tagging->tags.items[i]);
+      tag->data = cover_merge_data(tag->kind, tag->data, chunks[0].data[i]);
+   }
+
+   // Report dropped tags in the same order as a sequential merge
+   for (int i = 0; i < nchunks; i++) {
+      for (int j = 0; j < chunks[i].dropped.count; j++) {
+         ident_t hier = chunks[i].dropped.items[j];
+         warnf("Dropping coverage tag: %s\n", istr(hier));
+      }
+
+      ACLEAR(chunks[i].dropped);
+      free(chunks[i].data);
+   }
+
+   hash_free(merge.index);
+}
+
+cover_tagging_t *cover_merge_files(char **files, int nfiles)
+{
+   assert(nfiles > 0);
+
+   progress("Loading input coverage database: %s", files[0]);
+
+   // The first database provides the set of tags in the output
+   cover_tagging_t *tagging;
+   if (cover_is_mapped(files[0]))
+      tagging = cover_read_mapped(files[0], NULL);
+   else {
+      fbuf_t *f = fbuf_open(files[0], FBUF_IN, FBUF_CS_NONE);
+      if (f == NULL)
+         fatal("Could not open coverage database: %s", files[0]);
+
+      tagging = cover_read_tags(f);
+      fbuf_close(f, NULL);
+   }
+
+   if (nfiles > 1) {
+      progress("Merging %d more coverage databases", nfiles - 1);
+      cover_merge_into(tagging, files + 1, nfiles - 1);
+   }
+
+   return tagging;
+}
+
+cover_tagging_t *cover_update_mapped(const char *file, char **inputs,
+                                     int ninputs)
+{
+   progress("Updating coverage database: %s", file);
+
+   cover_tagging_t *tagging = cover_read_mapped(file, NULL);
+
+   if (ninputs > 0)
+      cover_merge_into(tagging, inputs, ninputs);
+
+   // Only the counter column changes so write it back in place rather
+   // than rewriting the whole file
+   cover_map_t map;
+   cover_map_open(file, true, &map);
+
+   assert(map.header->ntags == tagging->tags.count);
+   for (int i = 0; i < tagging->tags.count; i++)
+      map.data[i] = tagging->tags.items[i].data;
+
+   cover_map_close(&map);
+   return tagging;
 }
 
 void cover_count_tags(cover_tagging_t *tagging, int32_t *n_stmts,
@@ -600,59 +1206,69 @@ void cover_count_tags(cover_tagging_t *tagging, int32_t *n_stmts,
 // Runtime handling
 ///////////////////////////////////////////////////////////////////////////////
 
-static inline void cover_toggle_check_0_1(uint8_t old, uint8_t new,
-                                          int32_t *toggle_mask)
-{
-   if (old == _0 && new == _1)
-      *toggle_mask |= 0x1;
-   if (old == _1 && new == _0)
-      *toggle_mask |= 0x2;
-}
+#define TOGGLE_INVALID 0xff
+#define TOGGLE_WORDS(size) (((size) + 63) / 64)
 
-static inline void cover_toggle_check_u(uint8_t old, uint8_t new,
-                                        int32_t *toggle_mask)
+static inline unsigned cover_toggle_edges(const cover_toggle_t *t,
+                                          uint8_t old, uint8_t new)
 {
-   if (old == _U && new == _1)
-      *toggle_mask |= 0x1;
-   if (old == _U && new == _0)
-      *toggle_mask |= 0x2;
-}
+   const bool from_x = old == t->from_u || old == t->from_z;
 
-static inline void cover_toggle_check_z(uint8_t old, uint8_t new,
-                                        int32_t *toggle_mask)
-{
-   if (old == _0 && new == _Z)
-      *toggle_mask |= 0x1;
-   if (old == _Z && new == _1)
-      *toggle_mask |= 0x1;
-
-   if (old == _1 && new == _Z)
-      *toggle_mask |= 0x2;
-   if (old == _Z && new == _0)
-      *toggle_mask |= 0x2;
-}
+   // Bit zero is a 0 -> 1 transition and bit one is 1 -> 0
+   const bool rise = (new == _1 && (old == _0 || from_x))
+      || (new == t->from_z && old == _0);
+   const bool fall = (new == _0 && (old == _1 || from_x))
+      || (new == t->from_z && old == _1);
 
-static inline void cover_toggle_check_0_1_u(uint8_t old, uint8_t new,
-                                            int32_t *toggle_mask)
-{
-   cover_toggle_check_0_1(old, new, toggle_mask);
-   cover_toggle_check_u(old, new, toggle_mask);
+   return rise | (fall << 1);
 }
 
-static inline void cover_toggle_check_0_1_z(uint8_t old, uint8_t new,
-                                            int32_t *toggle_mask)
+#ifdef __SSE2__
+static int cover_toggle_sse2(cover_toggle_t *t, const uint8_t *old,
+                             const uint8_t *new)
 {
-   cover_toggle_check_0_1(old, new, toggle_mask);
-   cover_toggle_check_z(old, new, toggle_mask);
-}
+   // Compare sixteen elements at once and set the corresponding bits in
+   // the rising and falling edge bitmaps from the byte masks
+   uint64_t *rise_bits = t->bits, *fall_bits = t->bits + TOGGLE_WORDS(t->size);
 
-static inline void cover_toggle_check_0_1_u_z(uint8_t old, uint8_t new,
-                                              int32_t *toggle_mask)
-{
-   cover_toggle_check_0_1(old, new, toggle_mask);
-   cover_toggle_check_u(old, new, toggle_mask);
-   cover_toggle_check_z(old, new, toggle_mask);
+   const __m128i v0 = _mm_set1_epi8(_0);
+   const __m128i v1 = _mm_set1_epi8(_1);
+   const __m128i vu = _mm_set1_epi8(t->from_u);
+   const __m128i vz = _mm_set1_epi8(t->from_z);
+
+   int i = 0;
+   for (; i + 16 <= t->size; i += 16) {
+      const __m128i a = _mm_loadu_si128((const __m128i *)(old + i));
+      const __m128i b = _mm_loadu_si128((const __m128i *)(new + i));
+
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) == 0xffff)
+         continue;
+
+      const __m128i old0 = _mm_cmpeq_epi8(a, v0);
+      const __m128i old1 = _mm_cmpeq_epi8(a, v1);
+      const __m128i oldx =
+         _mm_or_si128(_mm_cmpeq_epi8(a, vu), _mm_cmpeq_epi8(a, vz));
+      const __m128i new0 = _mm_cmpeq_epi8(b, v0);
+      const __m128i new1 = _mm_cmpeq_epi8(b, v1);
+      const __m128i newz = _mm_cmpeq_epi8(b, vz);
+
+      const __m128i rise =
+         _mm_or_si128(_mm_and_si128(new1, _mm_or_si128(old0, oldx)),
+                      _mm_and_si128(newz, old0));
+      const __m128i fall =
+         _mm_or_si128(_mm_and_si128(new0, _mm_or_si128(old1, oldx)),
+                      _mm_and_si128(newz, old1));
+
+      const uint64_t rmask = (uint16_t)_mm_movemask_epi8(rise);
+      const uint64_t fmask = (uint16_t)_mm_movemask_epi8(fall);
+
+      rise_bits[i / 64] |= rmask << (i % 64);
+      fall_bits[i / 64] |= fmask << (i % 64);
+   }
+
+   return i;
 }
+#endif
 
 #ifdef COVER_DEBUG
 #define COVER_TGL_CB_MSG(signal)                                              \
@@ -678,47 +1294,74 @@ static inline void cover_toggle_check_0_1_u_z(uint8_t old, uint8_t new,
 #define COVER_TGL_SIGNAL_DETAILS(signal, size)
 #endif
 
+static void cover_toggle_cb(uint64_t now, rt_signal_t *s, rt_watch_t *w,
+                            void *user)
+{
+   cover_toggle_t *t = user;
+   const uint8_t *new = signal_value(s);
+   const uint8_t *old = signal_last_value(s);
 
-#define DEFINE_COVER_TOGGLE_CB(name, check_fnc)                               \
-   static void name(uint64_t now, rt_signal_t *s, rt_watch_t *w, void *user)  \
-   {                                                                          \
-      uint32_t s_size = s->shared.size;                                       \
-      int32_t *toggle_mask = ((int32_t *)user);                               \
-      COVER_TGL_CB_MSG(s)                                                     \
-      for (int i = 0; i < s_size; i++) {                                      \
-         uint8_t new = ((uint8_t*)signal_value(s))[i];                        \
-         uint8_t old = ((uint8_t*)signal_last_value(s))[i];                   \
-         check_fnc(old, new, toggle_mask);                                    \
-         toggle_mask++;                                                       \
-      }                                                                       \
-      COVER_TGL_SIGNAL_DETAILS(s, s_size)                                     \
-   }                                                                          \
+   COVER_TGL_CB_MSG(s)
 
+   int i = 0;
+#ifdef __SSE2__
+   i = cover_toggle_sse2(t, old, new);
+#endif
+
+   uint64_t *rise_bits = t->bits, *fall_bits = t->bits + TOGGLE_WORDS(t->size);
+
+   for (; i < t->size; i++) {
+      const unsigned edges = cover_toggle_edges(t, old[i], new[i]);
+      rise_bits[i / 64] |= (uint64_t)(edges & 1) << (i % 64);
+      fall_bits[i / 64] |= (uint64_t)(edges >> 1) << (i % 64);
+   }
 
-DEFINE_COVER_TOGGLE_CB(cover_toggle_cb_0_1,     cover_toggle_check_0_1)
-DEFINE_COVER_TOGGLE_CB(cover_toggle_cb_0_1_u,   cover_toggle_check_0_1_u)
-DEFINE_COVER_TOGGLE_CB(cover_toggle_cb_0_1_z,   cover_toggle_check_0_1_z)
-DEFINE_COVER_TOGGLE_CB(cover_toggle_cb_0_1_u_z, cover_toggle_check_0_1_u_z)
+   COVER_TGL_SIGNAL_DETAILS(s, t->size)
+}
+
+void cover_flush_toggles(cover_tagging_t *tagging)
+{
+   // Unpack the edge bitmaps into the per-tag toggle masks which are
+   // stored in the coverage database
+   for (int i = 0; i < tagging->toggles.count; i++) {
+      cover_toggle_t *t = tagging->toggles.items[i];
+      const int nwords = TOGGLE_WORDS(t->size);
 
+      for (int j = 0; j < nwords * 2; j++) {
+         const int32_t flag = j < nwords ? 0x1 : 0x2;
+         const int base = (j % nwords) * 64;
+
+         for (uint64_t word = t->bits[j]; word != 0; word &= word - 1)
+            t->tags[base + __builtin_ctzll(word)] |= flag;
+
+         t->bits[j] = 0;
+      }
+   }
+}
 
 void x_cover_setup_toggle_cb(sig_shared_t *ss, int32_t *toggle_mask)
 {
    rt_signal_t *s = container_of(ss, rt_signal_t, shared);
    rt_model_t *m = get_model();
-   cover_mask_t op_mask = get_coverage(m)->mask;
-   sig_event_fn_t fn = &cover_toggle_cb_0_1;
+   cover_tagging_t *tagging = get_coverage(m);
+
+   const int nwords = TOGGLE_WORDS(ss->size);
+   cover_toggle_t *t =
+      xcalloc_flex(sizeof(cover_toggle_t), nwords * 2, sizeof(uint64_t));
+   t->tags   = toggle_mask;
+   t->size   = ss->size;
+   t->from_u = TOGGLE_INVALID;
+   t->from_z = TOGGLE_INVALID;
 
-   if ((op_mask & COVER_MASK_TOGGLE_COUNT_FROM_UNDEFINED) &&
-       (op_mask & COVER_MASK_TOGGLE_COUNT_FROM_TO_Z))
-      fn = &cover_toggle_cb_0_1_u_z;
+   if (tagging->mask & COVER_MASK_TOGGLE_COUNT_FROM_UNDEFINED)
+      t->from_u = _U;
 
-   else if (op_mask & COVER_MASK_TOGGLE_COUNT_FROM_UNDEFINED)
-      fn = &cover_toggle_cb_0_1_u;
+   if (tagging->mask & COVER_MASK_TOGGLE_COUNT_FROM_TO_Z)
+      t->from_z = _Z;
 
-   else if (op_mask & COVER_MASK_TOGGLE_COUNT_FROM_TO_Z)
-      fn = &cover_toggle_cb_0_1_z;
+   APUSH(tagging->toggles, t);
 
-   model_set_event_cb(m, s, fn, toggle_mask, false);
+   model_set_event_cb(m, s, cover_toggle_cb, t, false);
 }
 
 
@@ -114,7 +114,8 @@ typedef enum {
    COVER_MASK_TOGGLE                      = (1 << 2),
    COVER_MASK_TOGGLE_COUNT_FROM_UNDEFINED = (1 << 8),
    COVER_MASK_TOGGLE_COUNT_FROM_TO_Z      = (1 << 9),
-   COVER_MASK_TOGGLE_IGNORE_MEMS          = (1 << 10)
+   COVER_MASK_TOGGLE_IGNORE_MEMS          = (1 << 10),
+   COVER_MASK_HITS_ONLY                   = (1 << 11)
 } cover_mask_t;
 
 #define COVER_MASK_ALL (COVER_MASK_STMT | COVER_MASK_BRANCH | COVER_MASK_TOGGLE)
@@ -145,11 +146,20 @@ void cover_count_tags(cover_tagging_t *tagging, int32_t *n_stmts,
                       int32_t *n_branches, int32_t *n_toggles);
 
 void cover_dump_tags(cover_tagging_t *ctx, fbuf_t *f, cover_dump_t dt,
-                     const int32_t *stmts, const int32_t *branches,
+                     const uint64_t *stmts, const int32_t *branches,
                      const int32_t *toggles);
 
 cover_tagging_t *cover_read_tags(fbuf_t *f);
 
-void cover_merge_tags(fbuf_t *f, cover_tagging_t *tagging);
+void cover_flush_toggles(cover_tagging_t *tagging);
+
+cover_tagging_t *cover_merge_files(char **files, int nfiles);
+
+bool cover_is_mapped(const char *file);
+void cover_write_mapped(cover_tagging_t *tagging, const char *file);
+cover_tagging_t *cover_read_mapped(const char *file, ident_t hier);
+cover_tagging_t *cover_update_mapped(const char *file, char **inputs,
+                                     int ninputs);
+cover_tagging_t *cover_select_hier(cover_tagging_t *tagging, ident_t hier);
 
 #endif  // _COVER_H
@@ -19,7 +19,9 @@
 #include "array.h"
 #include "common.h"
 #include "cover.h"
+#include "fbuf.h"
 #include "hash.h"
+#include "ident.h"
 #include "jit/jit.h"
 #include "lib.h"
 #include "opt.h"
@@ -27,6 +29,7 @@
 #include "rt/heap.h"
 #include "rt/model.h"
 #include "rt/structs.h"
+#include "rt/wheel.h"
 #include "thread.h"
 #include "tree.h"
 #include "type.h"
@@ -36,6 +39,15 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef __ELF__
+#include <link.h>
+#endif
+
+#if defined __x86_64__ && (defined __GNUC__ || defined __clang__)
+#define HAVE_SSSE3_RESOLVE 1
+#include <tmmintrin.h>
+#endif
+
 typedef struct _callback callback_t;
 typedef struct _memblock memblock_t;
 
@@ -55,6 +67,54 @@ typedef struct _memblock {
    char       *ptr;
 } memblock_t;
 
+typedef enum {
+   PHASE_DRIVER,
+   PHASE_EFFECTIVE,
+   PHASE_IMPLICIT,
+   PHASE_PROCESS,
+
+   PHASE_LAST
+} rt_phase_t;
+
+typedef struct {
+   uint64_t  cycles;
+   uint64_t  timesteps;
+   unsigned  max_deltas;
+   uint64_t  events;
+   uint64_t  queue_sum;
+   size_t    max_queue;
+   uint64_t  phase_ns[PHASE_LAST];
+} rt_profile_t;
+
+#define DRIVER_BATCH_BITS  4
+#define DRIVER_BATCH_CACHE (1 << DRIVER_BATCH_BITS)
+
+typedef struct {
+   task_fn_t  fn;
+   void      *arg;
+   uint32_t   key;
+   uint32_t   index;
+} update_task_t;
+
+typedef struct {
+   uint32_t   index;
+   uint32_t   seq;
+   rt_net_t  *net;
+} update_log_t;
+
+typedef struct {
+   update_task_t    *tasks;
+   unsigned          ntasks;
+   uint32_t          index;
+   waveform_t       *free_waveforms;
+   A(update_log_t)   log;
+} update_part_t;
+
+typedef struct {
+   uint64_t *stmts;
+   int32_t  *branches;
+} cover_shard_t;
+
 typedef struct _rt_model {
    tree_t             top;
    hash_t            *scopes;
@@ -70,7 +130,7 @@ typedef struct _rt_model {
    bool               next_is_delta;
    bool               force_stop;
    unsigned           n_signals;
-   heap_t            *eventq_heap;
+   wheel_t           *eventq;
    ihash_t           *res_memo;
    rt_alloc_stack_t   event_stack;
    rt_alloc_stack_t   watch_stack;
@@ -87,11 +147,35 @@ typedef struct _rt_model {
    cover_tagging_t   *cover;
    nvc_rusage_t       ready_rusage;
    memblock_t        *memblocks;
+   waveform_t        *free_waveforms;
+   tlab_t            *tlabs[MAX_THREADS];
+   cover_shard_t      cover_shards[MAX_THREADS];
+   A(rt_wakeable_t *) parallelq;
+   bool               parallel;
+   bool               parallel_phase;
+   nvc_lock_t         lock;
+   bool               collect_updates;
+   A(update_task_t)   updates;
+   A(update_part_t)   parts;
+   A(update_log_t)    update_log;
+   workq_t           *partq;
+   event_t           *batchcache[DRIVER_BATCH_CACHE];
+   A(driver_list_t)   spare_drivers;
+   A(rt_net_t *)      spare_nets;
+   uint32_t           next_net_id;
+   bool               profile;
+   rt_profile_t       prof;
+   char              *checkpoint_file;
+   uint64_t           checkpoint_time;
+   mspace_image_t    *base_image;
 } rt_model_t;
 
-#define FMT_VALUES_SZ   128
-#define NEXUS_INDEX_MIN 8
-#define TRACE_SIGNALS   1
+#define FMT_VALUES_SZ      128
+#define NEXUS_INDEX_MIN    8
+#define TRACE_SIGNALS      1
+#define PARALLEL_MIN_TASKS 16
+#define SERIAL_UPDATE_KEY  UINT32_MAX
+#define PROFILE_TOP_N      10
 
 #define TRACE(...) do {                                 \
       if (unlikely(__trace_on))                         \
@@ -115,15 +199,22 @@ typedef struct _rt_model {
    rt_model_t *__save __attribute__((unused, cleanup(__model_exit)));   \
    __model_entry(m, &__save);                                           \
 
+// Signal and nexus data structures are shared between processes and
+// must be locked while processes are running concurrently
+#define MODEL_LOCK(m)                                                   \
+   nvc_lock_t *__mlock __attribute__((unused, cleanup(__model_unlock))) \
+      = __model_lock(m);
+
 static __thread rt_proc_t    *active_proc = NULL;
 static __thread rt_scope_t   *active_scope = NULL;
 static __thread rt_signal_t **signals_tail = NULL;
 static __thread rt_scope_t  **scopes_tail = NULL;
 static __thread rt_model_t   *__model = NULL;
 static __thread tlab_t        spare_tlab = {};
-static __thread waveform_t   *free_waveforms = NULL;
+static __thread update_part_t *active_part = NULL;
 
-DLLEXPORT tlab_t __nvc_tlab = {};   // TODO: this should be thread-local
+DLLEXPORT __thread tlab_t __nvc_tlab = {};
+DLLEXPORT __thread cover_shard_t __nvc_cover = {};
 
 static bool __trace_on = false;
 
@@ -211,9 +302,15 @@ static void model_diag_cb(diag_t *d, void *arg)
 
 static void __model_entry(rt_model_t *m, rt_model_t **save)
 {
-   if (__model == NULL)
+   if (__model == NULL) {
       diag_add_hint_fn(model_diag_cb, m);
 
+      // Drop coverage counters claimed by this thread for another model
+      if (__nvc_cover.stmts != NULL
+          && __nvc_cover.stmts != m->cover_shards[thread_id()].stmts)
+         __nvc_cover = (cover_shard_t){};
+   }
+
    *save = __model;
    __model = m;
 }
@@ -227,6 +324,22 @@ static void __model_exit(rt_model_t **save)
       diag_remove_hint_fn(model_diag_cb);
 }
 
+static nvc_lock_t *__model_lock(rt_model_t *m)
+{
+   if (likely(!m->parallel_phase))
+      return NULL;
+   else if (!nvc_trylock(&(m->lock)))
+      mspace_safepoint_lock(m->mspace, &(m->lock));
+
+   return &(m->lock);
+}
+
+static void __model_unlock(nvc_lock_t **plock)
+{
+   if (*plock != NULL)
+      nvc_unlock(*plock);
+}
+
 static char *fmt_values_r(const void *values, size_t len, char *buf, size_t max)
 {
    char *p = buf;
@@ -421,9 +534,14 @@ rt_model_t *model_new(tree_t top, jit_t *jit)
    m->nexus_tail  = &(m->nexuses);
    m->iteration   = -1;
    m->stop_delta  = opt_get_int(OPT_STOP_DELTA);
-   m->eventq_heap = heap_new(512);
+   m->parallel    = opt_get_int(OPT_RT_PARALLEL);
+   m->profile     = opt_get_int(OPT_RT_PROFILE);
    m->res_memo    = ihash_new(128);
 
+   // Events further than this in the future are kept in a heap
+   const int horizon_bits = opt_get_int(OPT_EVENT_HORIZON);
+   m->eventq = wheel_new(UINT64_C(1) << MIN(horizon_bits, 63));
+
    m->can_create_delta = true;
 
    m->event_stack    = rt_alloc_stack_new(sizeof(event_t), "event");
@@ -441,6 +559,7 @@ rt_model_t *model_new(tree_t top, jit_t *jit)
    m->driverq       = workq_new(m);
    m->delta_driverq = workq_new(m);
    m->effq          = workq_new(m);
+   m->partq         = workq_new(m);
 
    scopes_tail = &(m->root->child);
    tree_walk_deps(top, scope_deps_cb, m);
@@ -470,10 +589,17 @@ rt_proc_t *get_active_proc(void)
    return active_proc;
 }
 
-static void free_waveform(waveform_t *w)
+static void free_waveform(rt_model_t *m, waveform_t *w)
 {
-   w->next = free_waveforms;
-   free_waveforms = w;
+   if (unlikely(active_part != NULL)) {
+      // Spliced back onto the global list by run_update_queue
+      w->next = active_part->free_waveforms;
+      active_part->free_waveforms = w;
+   }
+   else {
+      w->next = m->free_waveforms;
+      m->free_waveforms = w;
+   }
 }
 
 static void cleanup_net(rt_net_t *net)
@@ -494,7 +620,7 @@ static void cleanup_nexus(rt_model_t *m, rt_nexus_t *n)
          for (waveform_t *it = s->u.driver.waveforms.next, *next;
               it; it = next) {
             next = it->next;
-            free_waveform(it);
+            free_waveform(m, it);
          }
          break;
 
@@ -529,6 +655,7 @@ static void cleanup_scope(rt_model_t *m, rt_scope_t *scope)
       tmp = it->chain;
       mptr_free(m->mspace, &(it->privdata));
       tlab_release(&(it->tlab));
+      ACLEAR(it->deferred);
       free(it);
    }
 
@@ -551,6 +678,84 @@ static void cleanup_scope(rt_model_t *m, rt_scope_t *scope)
    free(scope);
 }
 
+static void collect_procs(rt_scope_t *s, rt_proc_t ***procs, int *count,
+                          int *max)
+{
+   for (rt_proc_t *p = s->procs; p; p = p->chain) {
+      if (*count == *max) {
+         *max = MAX(*max * 2, 64);
+         *procs = xrealloc_array(*procs, *max, sizeof(rt_proc_t *));
+      }
+      (*procs)[(*count)++] = p;
+   }
+
+   for (rt_scope_t *c = s->child; c; c = c->chain)
+      collect_procs(c, procs, count, max);
+}
+
+static int proc_profile_cmp(const void *a, const void *b)
+{
+   const rt_proc_t *pa = *(const rt_proc_t **)a;
+   const rt_proc_t *pb = *(const rt_proc_t **)b;
+
+   if (pa->profile_ns != pb->profile_ns)
+      return pa->profile_ns > pb->profile_ns ? -1 : 1;
+   else
+      return pa->profile_runs > pb->profile_runs ? -1
+         : (pa->profile_runs < pb->profile_runs);
+}
+
+static void print_profile(rt_model_t *m)
+{
+   const rt_profile_t *p = &(m->prof);
+
+   static const char *phase_names[PHASE_LAST] = {
+      "Driver updates", "Effective values", "Implicit signals", "Processes"
+   };
+
+   fprintf(stderr, "\nSimulation profile:\n");
+   fprintf(stderr, "  %-22s %"PRIu64"\n", "Time steps", p->timesteps);
+   fprintf(stderr, "  %-22s %"PRIu64" (max %u per time step, avg %.1f)\n",
+           "Delta cycles", p->cycles - p->timesteps, p->max_deltas,
+           p->timesteps ? (double)(p->cycles - p->timesteps) / p->timesteps
+           : 0.0);
+   fprintf(stderr, "  %-22s %"PRIu64"\n", "Events processed", p->events);
+   fprintf(stderr, "  %-22s max %zu avg %.1f\n", "Event queue depth",
+           p->max_queue,
+           p->timesteps ? (double)p->queue_sum / p->timesteps : 0.0);
+
+   for (int i = 0; i < PHASE_LAST; i++)
+      fprintf(stderr, "  %-22s %.3f ms\n", phase_names[i],
+              p->phase_ns[i] / 1e6);
+
+   rt_proc_t **procs = NULL;
+   int nprocs = 0, maxprocs = 0;
+   collect_procs(m->root, &procs, &nprocs, &maxprocs);
+
+   uint64_t total_ns = 0;
+   for (int i = 0; i < nprocs; i++)
+      total_ns += procs[i]->profile_ns;
+
+   qsort(procs, nprocs, sizeof(rt_proc_t *), proc_profile_cmp);
+
+   fprintf(stderr, "\n  %10s %10s %6s %8s  %s\n", "Runs", "Time (ms)",
+           "%", "Avg (us)", "Process");
+
+   for (int i = 0; i < MIN(nprocs, PROFILE_TOP_N); i++) {
+      const rt_proc_t *proc = procs[i];
+      if (proc->profile_runs == 0)
+         break;
+
+      fprintf(stderr, "  %10"PRIu64" %10.3f %5.1f%% %8.2f  %s\n",
+              proc->profile_runs, proc->profile_ns / 1e6,
+              total_ns ? 100.0 * proc->profile_ns / total_ns : 0.0,
+              proc->profile_ns / 1e3 / proc->profile_runs,
+              istr(proc->name));
+   }
+
+   free(procs);
+}
+
 void model_free(rt_model_t *m)
 {
    if (opt_get_int(OPT_RT_STATS)) {
@@ -565,10 +770,26 @@ void model_free(rt_model_t *m)
             m->ready_rusage.ms, ru.ms, ru.rss, mem / 1024);
    }
 
-   while (heap_size(m->eventq_heap) > 0)
-      rt_free(m->event_stack, heap_extract_min(m->eventq_heap));
+   if (m->profile)
+      print_profile(m);
+
+   while (wheel_size(m->eventq) > 0) {
+      event_t *e = wheel_extract_min(m->eventq);
+      if (e->kind == EVENT_DRIVER)
+         ACLEAR(e->drivers);
+      rt_free(m->event_stack, e);
+   }
+
+   for (int i = 0; i < MAX_THREADS; i++) {
+      if (m->tlabs[i] != NULL)
+         tlab_release(m->tlabs[i]);
+
+      free(m->cover_shards[i].stmts);
+      free(m->cover_shards[i].branches);
+   }
 
-   tlab_release(&__nvc_tlab);
+   // Other threads discard their stale shard when they next enter a model
+   __nvc_cover = (cover_shard_t){};
 
    cleanup_scope(m, m->root);
 
@@ -578,6 +799,7 @@ void model_free(rt_model_t *m)
    workq_free(m->driverq);
    workq_free(m->delta_driverq);
    workq_free(m->effq);
+   workq_free(m->partq);
 
    if (m->implicitq != NULL)
       workq_free(m->implicitq);
@@ -604,9 +826,27 @@ void model_free(rt_model_t *m)
       free(mb);
    }
 
-   heap_free(m->eventq_heap);
+   if (m->base_image != NULL)
+      mspace_image_free(m->base_image);
+
+   free(m->checkpoint_file);
+
+   wheel_free(m->eventq);
    hash_free(m->scopes);
    ihash_free(m->res_memo);
+   ACLEAR(m->parallelq);
+   ACLEAR(m->updates);
+
+   for (int i = 0; i < m->spare_drivers.count; i++)
+      ACLEAR(m->spare_drivers.items[i]);
+   ACLEAR(m->spare_drivers);
+   ACLEAR(m->spare_nets);
+   ACLEAR(m->update_log);
+
+   for (int i = 0; i < m->parts.count; i++)
+      ACLEAR(m->parts.items[i].log);
+   ACLEAR(m->parts);
+
    free(m);
 }
 
@@ -701,9 +941,21 @@ size_t signal_string(rt_signal_t *s, const char *map, char *buf, size_t max)
    return offset + 1;
 }
 
+static void defer_action(rt_deferred_t action)
+{
+   // Called while processes are running concurrently: the queues must
+   // only be modified by the main thread and in a deterministic order
+   assert(active_proc != NULL);
+   APUSH(active_proc->deferred, action);
+}
+
 static void deltaq_insert_proc(rt_model_t *m, uint64_t delta, rt_proc_t *wake)
 {
-   if (delta == 0) {
+   if (unlikely(m->parallel_phase)) {
+      assert(wake == active_proc);
+      defer_action((rt_deferred_t){ .kind = DEFER_PROCESS, .delta = delta });
+   }
+   else if (delta == 0) {
       assert(!wake->wakeable.pending);
       wake->wakeable.pending = true;
       ++(wake->wakeable.wakeup_gen);
@@ -719,50 +971,107 @@ static void deltaq_insert_proc(rt_model_t *m, uint64_t delta, rt_proc_t *wake)
       e->proc.wakeup_gen = wake->wakeable.wakeup_gen;
       e->proc.proc       = wake;
 
-      heap_insert(m->eventq_heap, e->when, e);
+      wheel_insert(m->eventq, e->when, e);
+   }
+}
+
+static inline int driver_batch_slot(uint64_t when)
+{
+   return (when * UINT64_C(0x9e3779b97f4a7c15)) >> (64 - DRIVER_BATCH_BITS);
+}
+
+static void eventq_insert_driver(rt_model_t *m, uint64_t when,
+                                 rt_nexus_t *nexus, rt_source_t *source)
+{
+   // Drivers are often scheduled many times for the same future time
+   // so transactions are grouped into a single event for each distinct
+   // time which is found using a small direct mapped cache
+   const int slot = driver_batch_slot(when);
+
+   event_t *e = m->batchcache[slot];
+   if (e == NULL || e->when != when) {
+      e = rt_alloc(m->event_stack);
+      e->when = when;
+      e->kind = EVENT_DRIVER;
+
+      if (m->spare_drivers.count > 0)
+         e->drivers = m->spare_drivers.items[--m->spare_drivers.count];
+      else
+         e->drivers = (driver_list_t){};
+
+      wheel_insert(m->eventq, e->when, e);
+
+      m->batchcache[slot] = e;
+   }
+
+   APUSH(e->drivers, ((event_driver_t){ nexus, source }));
+}
+
+static void eventq_drain_drivers(rt_model_t *m, event_t *e)
+{
+   for (int i = 0; i < e->drivers.count; i++) {
+      const event_driver_t *d = &(e->drivers.items[i]);
+      if (d->source != NULL)
+         workq_do(m->driverq, async_update_driver, d->source);
+      else
+         workq_do(m->driverq, async_update_driving, d->nexus);
    }
+
+   const int slot = driver_batch_slot(e->when);
+   if (m->batchcache[slot] == e)
+      m->batchcache[slot] = NULL;
+
+   ATRIM(e->drivers, 0);
+   APUSH(m->spare_drivers, e->drivers);
+
+   rt_free(m->event_stack, e);
 }
 
 static void deltaq_insert_driver(rt_model_t *m, uint64_t delta,
                                  rt_nexus_t *nexus, rt_source_t *source)
 {
-   if (delta == 0) {
+   if (unlikely(m->parallel_phase))
+      defer_action((rt_deferred_t){
+            .kind   = DEFER_DRIVER,
+            .delta  = delta,
+            .nexus  = nexus,
+            .source = source
+         });
+   else if (delta == 0) {
       workq_do(m->delta_driverq, async_update_driver, source);
       m->next_is_delta = true;
    }
-   else {
-      event_t *e = rt_alloc(m->event_stack);
-      e->when          = m->now + delta;
-      e->kind          = EVENT_DRIVER;
-      e->driver.nexus  = nexus;
-      e->driver.source = source;
-
-      heap_insert(m->eventq_heap, e->when, e);
-   }
+   else
+      eventq_insert_driver(m, m->now + delta, nexus, source);
 }
 
 static void deltaq_insert_force_release(rt_model_t *m, uint64_t delta,
                                         rt_nexus_t *nexus)
 {
-   if (delta == 0) {
+   if (unlikely(m->parallel_phase))
+      defer_action((rt_deferred_t){
+            .kind  = DEFER_FORCE_RELEASE,
+            .delta = delta,
+            .nexus = nexus
+         });
+   else if (delta == 0) {
       workq_do(m->delta_driverq, async_update_driving, nexus);
       m->next_is_delta = true;
    }
-   else {
-      event_t *e = rt_alloc(m->event_stack);
-      e->when          = m->now + delta;
-      e->kind          = EVENT_DRIVER;
-      e->driver.nexus  = nexus;
-      e->driver.source = NULL;
-
-      heap_insert(m->eventq_heap, e->when, e);
-   }
+   else
+      eventq_insert_driver(m, m->now + delta, nexus, NULL);
 }
 
 static void deltaq_insert_disconnect(rt_model_t *m, uint64_t delta,
                                      rt_source_t *source)
 {
-   if (delta == 0) {
+   if (unlikely(m->parallel_phase))
+      defer_action((rt_deferred_t){
+            .kind   = DEFER_DISCONNECT,
+            .delta  = delta,
+            .source = source
+         });
+   else if (delta == 0) {
       workq_do(m->delta_driverq, async_disconnect, source);
       m->next_is_delta = true;
    }
@@ -773,7 +1082,15 @@ static void deltaq_insert_disconnect(rt_model_t *m, uint64_t delta,
       e->driver.nexus  = source->u.driver.nexus;
       e->driver.source = source;
 
-      heap_insert(m->eventq_heap, e->when, e);
+      wheel_insert(m->eventq, e->when, e);
+   }
+}
+
+static void acquire_thread_tlab(rt_model_t *m)
+{
+   if (!tlab_valid(__nvc_tlab)) {
+      tlab_acquire(m->mspace, &__nvc_tlab);
+      m->tlabs[thread_id()] = &__nvc_tlab;   // Released in model_free
    }
 }
 
@@ -812,8 +1129,8 @@ static void run_process(rt_model_t *m, rt_proc_t *proc)
       tlab_move(__nvc_tlab, spare_tlab);
       tlab_move(proc->tlab, __nvc_tlab);
    }
-   else if (!tlab_valid(__nvc_tlab))
-      tlab_acquire(m->mspace, &__nvc_tlab);
+   else
+      acquire_thread_tlab(m);
 
    tlab_t *tlab = &__nvc_tlab;
 
@@ -831,9 +1148,16 @@ static void run_process(rt_model_t *m, rt_proc_t *proc)
       .pointer = *mptr_get(proc->scope->privdata)
    };
 
+   const uint64_t start_ns = m->profile ? get_timestamp_ns() : 0;
+
    if (!jit_fastcall(m->jit, proc->handle, &result, state, context, tlab))
       m->force_stop = true;
 
+   if (unlikely(m->profile)) {
+      proc->profile_runs++;
+      proc->profile_ns += get_timestamp_ns() - start_ns;
+   }
+
    active_proc = NULL;
 
    if (tlab_valid(__nvc_tlab)) {
@@ -903,6 +1227,7 @@ static res_memo_t *memo_resolution_fn(rt_model_t *m, rt_signal_t *signal,
    memo->closure = resolution->closure;
    memo->flags   = resolution->flags;
    memo->ileft   = resolution->ileft;
+   memo->nlits   = resolution->nlits;
 
    ihash_put(m->res_memo, memo->closure.handle, memo);
 
@@ -942,10 +1267,24 @@ static res_memo_t *memo_resolution_fn(rt_model_t *m, rt_signal_t *signal,
       }
    }
 
-   if (jit_exit_status(m->jit) == 0) {
+   // The tables can only be used if none of the calls above failed
+   const bool valid = (jit_exit_status(m->jit) == 0);
+   jit_reset_exit_status(m->jit);
+
+   // The standard STD_LOGIC resolution function gives the same result
+   // as applying the two value table from left to right so any number
+   // of drivers can be resolved with the table.  This cannot be checked
+   // for user functions as they may depend on the number of drivers.
+   ident_t name = jit_get_name(m->jit, resolution->closure.handle);
+   const bool fold =
+      valid && name == ident_new("IEEE.STD_LOGIC_1164.RESOLVED(Y)U");
+
+   if (valid) {
       memo->flags |= R_MEMO;
       if (identity)
          memo->flags |= R_IDENT;
+      if (fold)
+         memo->flags |= R_FOLD;
    }
 
    TRACE("memoised resolution function %s for type %s",
@@ -1070,25 +1409,71 @@ static rt_source_t *add_source(rt_model_t *m, rt_nexus_t *n, source_kind_t kind)
    return src;
 }
 
+static void init_net(rt_model_t *m, rt_net_t *net)
+{
+   net->pending      = NULL;
+   net->npending     = 0;
+   net->maxpend      = 0;
+   net->pend0.wake   = NULL;
+   net->last_active  = TIME_HIGH;
+   net->last_event   = TIME_HIGH;
+   net->active_delta = -1;
+   net->event_delta  = -1;
+   net->net_id       = ++m->next_net_id;
+}
+
 static rt_net_t *get_net(rt_model_t *m, rt_nexus_t *nexus)
 {
    if (likely(nexus->net != NULL))
       return nexus->net;
    else {
-      rt_net_t *net = static_alloc(m, sizeof(rt_net_t));
-      net->pending      = NULL;
-      net->last_active  = TIME_HIGH;
-      net->last_event   = TIME_HIGH;
-      net->active_delta = -1;
-      net->event_delta  = -1;
+      rt_net_t *net;
+      if (m->spare_nets.count > 0)
+         net = APOP(m->spare_nets);
+      else
+         net = static_alloc(m, sizeof(rt_net_t));
 
-      static uint32_t next_net_id = 1;
-      net->net_id = next_net_id++;
+      init_net(m, net);
 
       return (nexus->net = net);
    }
 }
 
+static void layout_nets(rt_model_t *m, rt_nexus_t **order, int count)
+{
+   // Nets are created on demand during elaboration and so are scattered
+   // between signals and nexuses in memory. Move them to a contiguous
+   // block in the order their nexuses are updated so the driver and
+   // effective value phases stream through the event and active times.
+
+   const size_t stride = ALIGN_UP(sizeof(rt_net_t), MEMBLOCK_LINE_SZ);
+   uint8_t *block = static_alloc(m, stride * MAX(count, 1));
+   int nnets = 0;
+
+   hash_t *map = hash_new(MAX(count, 16));
+
+   for (int i = 0; i < count; i++) {
+      rt_nexus_t *n = order[i];
+      rt_net_t *new = NULL;
+
+      if (n->net == NULL)
+         init_net(m, (new = (rt_net_t *)(block + stride * nnets++)));
+      else if ((new = hash_get(map, n->net)) == NULL) {
+         new = (rt_net_t *)(block + stride * nnets++);
+         *new = *(n->net);
+         hash_put(map, n->net, new);
+
+         // Static memory cannot be freed so keep the old net for any
+         // nexus split after this point
+         APUSH(m->spare_nets, n->net);
+      }
+
+      n->net = new;
+   }
+
+   hash_free(map);
+}
+
 static inline int map_index(rt_index_t *index, unsigned offset)
 {
    if (likely(index->how >= 0))
@@ -1196,21 +1581,21 @@ static rt_nexus_t *lookup_index(rt_signal_t *s, int *offset)
    }
 }
 
-static waveform_t *alloc_waveform(void)
+static waveform_t *alloc_waveform(rt_model_t *m)
 {
-   if (free_waveforms == NULL) {
+   if (m->free_waveforms == NULL) {
       // Ensure waveforms are always within one cache line
       STATIC_ASSERT(sizeof(waveform_t) <= 32);
       const int chunksz = 1024;
       char *mem = nvc_memalign(64, chunksz * 32);
       for (int i = 1; i < chunksz; i++)
-         free_waveform((waveform_t *)(mem + i*32));
+         free_waveform(m, (waveform_t *)(mem + i*32));
 
       return (waveform_t *)mem;
    }
    else {
-      waveform_t *w = free_waveforms;
-      free_waveforms = w->next;
+      waveform_t *w = m->free_waveforms;
+      m->free_waveforms = w->next;
       __builtin_prefetch(w->next, 1, 1);
       w->next = NULL;
       return w;
@@ -1294,7 +1679,7 @@ static void clone_source(rt_model_t *m, rt_nexus_t *nexus, rt_source_t *old,
 
          // Future transactions
          for (w_old = w_old->next; w_old; w_old = w_old->next) {
-            w_new = (w_new->next = alloc_waveform());
+            w_new = (w_new->next = alloc_waveform(m));
             clone_waveform(nexus, w_new, w_old, offset);
 
             assert(w_old->when >= m->now);
@@ -1573,6 +1958,75 @@ static void *source_value(rt_nexus_t *nexus, rt_source_t *src)
    return NULL;
 }
 
+#ifdef HAVE_SSSE3_RESOLVE
+__attribute__((target("ssse3")))
+static int resolve_tab1_ssse3(const res_memo_t *r, const uint8_t *p0,
+                              int8_t *out, int width)
+{
+   const __m128i tab = _mm_loadu_si128((const __m128i *)r->tab1);
+
+   int j = 0;
+   for (; j + 16 <= width; j += 16) {
+      const __m128i a = _mm_loadu_si128((const __m128i *)(p0 + j));
+      _mm_storeu_si128((__m128i *)(out + j), _mm_shuffle_epi8(tab, a));
+   }
+
+   return j;
+}
+
+__attribute__((target("ssse3")))
+static int resolve_tab2_ssse3(const res_memo_t *r, const uint8_t *p0,
+                              const uint8_t *p1, int8_t *out, int width)
+{
+   // Each row of the table is looked up with the second value as the
+   // shuffle index and then merged where the first value selects it
+
+   int j = 0;
+   for (; j + 16 <= width; j += 16) {
+      const __m128i a = _mm_loadu_si128((const __m128i *)(p0 + j));
+      const __m128i b = _mm_loadu_si128((const __m128i *)(p1 + j));
+
+      __m128i result = _mm_setzero_si128();
+      for (int i = 0; i < r->nlits; i++) {
+         const __m128i row = _mm_loadu_si128((const __m128i *)r->tab2[i]);
+         const __m128i sel = _mm_cmpeq_epi8(a, _mm_set1_epi8(i));
+         const __m128i val = _mm_shuffle_epi8(row, b);
+         result = _mm_or_si128(result, _mm_and_si128(sel, val));
+      }
+
+      _mm_storeu_si128((__m128i *)(out + j), result);
+   }
+
+   return j;
+}
+#endif
+
+static void resolve_tab1(const res_memo_t *r, const uint8_t *p0,
+                         int8_t *out, int width)
+{
+   int j = 0;
+#ifdef HAVE_SSSE3_RESOLVE
+   if (width >= 16 && __builtin_cpu_supports("ssse3"))
+      j = resolve_tab1_ssse3(r, p0, out, width);
+#endif
+
+   for (; j < width; j++)
+      out[j] = r->tab1[p0[j]];
+}
+
+static void resolve_tab2(const res_memo_t *r, const uint8_t *p0,
+                         const uint8_t *p1, int8_t *out, int width)
+{
+   int j = 0;
+#ifdef HAVE_SSSE3_RESOLVE
+   if (width >= 16 && __builtin_cpu_supports("ssse3"))
+      j = resolve_tab2_ssse3(r, p0, p1, out, width);
+#endif
+
+   for (; j < width; j++)
+      out[j] = r->tab2[p0[j]][p1[j]];
+}
+
 static void *call_resolution(rt_nexus_t *nexus, res_memo_t *r, int nonnull)
 {
    // Find the first non-null source
@@ -1588,28 +2042,25 @@ static void *call_resolution(rt_nexus_t *nexus, res_memo_t *r, int nonnull)
    else if ((r->flags & R_MEMO) && nonnull == 1) {
       // Resolution function has been memoised so do a table lookup
 
-      void *resolved = local_alloc(nexus->width * nexus->size);
-
-      for (int j = 0; j < nexus->width; j++) {
-         const int index = ((uint8_t *)p0)[j];
-         ((int8_t *)resolved)[j] = r->tab1[index];
-      }
-
+      int8_t *resolved = local_alloc(nexus->width * nexus->size);
+      resolve_tab1(r, (uint8_t *)p0, resolved, nexus->width);
       return resolved;
    }
-   else if ((r->flags & R_MEMO) && nonnull == 2) {
+   else if ((r->flags & R_MEMO) && nonnull >= 2
+            && (nonnull == 2 || (r->flags & R_FOLD))) {
       // Resolution function has been memoised so do a table lookup
+      // for each pair of values
 
-      void *resolved = local_alloc(nexus->width * nexus->size);
-
-      char *p1 = NULL;
-      for (rt_source_t *s1 = s0->chain_input;
-           s1 && (p1 = source_value(nexus, s1)) == NULL;
-           s1 = s1->chain_input)
-         ;
+      int8_t *resolved = local_alloc(nexus->width * nexus->size);
+      const uint8_t *left = (uint8_t *)p0;
 
-      for (int j = 0; j < nexus->width; j++)
-         ((int8_t *)resolved)[j] = r->tab2[(int)p0[j]][(int)p1[j]];
+      for (rt_source_t *s = s0->chain_input; s; s = s->chain_input) {
+         const uint8_t *right = source_value(nexus, s);
+         if (right != NULL) {
+            resolve_tab2(r, left, right, resolved, nexus->width);
+            left = (uint8_t *)resolved;
+         }
+      }
 
       return resolved;
    }
@@ -1799,13 +2250,15 @@ static void reset_coverage(rt_model_t *m)
    int32_t n_stmts, n_branches, n_toggles;
    cover_count_tags(m->cover, &n_stmts, &n_branches, &n_toggles);
 
-   int32_t *cover_stmts = ffi_find_symbol(NULL, "cover_stmts");
+   // Counters are allocated per-thread on first use unless only
+   // collecting hit flags
+   uint8_t *cover_stmts = ffi_find_symbol(NULL, "cover_stmts");
    if (cover_stmts != NULL)
-      memset(cover_stmts, '\0', sizeof(int32_t) * n_stmts);
+      memset(cover_stmts, '\0', n_stmts);
 
-   int32_t *cover_branches = ffi_find_symbol(NULL, "cover_branches");
+   uint8_t *cover_branches = ffi_find_symbol(NULL, "cover_branches");
    if (cover_branches != NULL)
-      memset(cover_branches, '\0', sizeof(int32_t) * n_branches);
+      memset(cover_branches, '\0', n_branches * 2);
 
    int32_t *cover_toggles = ffi_find_symbol(NULL, "cover_toggles");
    if (cover_toggles != NULL)
@@ -1814,11 +2267,100 @@ static void reset_coverage(rt_model_t *m)
    fbuf_close(f, NULL);
 }
 
+static cover_shard_t *claim_cover_shard(rt_model_t *m, int32_t n_stmts,
+                                        int32_t n_branches)
+{
+   // The model owns the storage for each thread's counters so they can
+   // be collected and freed after the thread has exited
+   cover_shard_t *shard = &(m->cover_shards[thread_id()]);
+   if (shard->stmts == NULL) {
+      shard->stmts = xcalloc_array(MAX(n_stmts, 1), sizeof(uint64_t));
+      shard->branches = xcalloc_array(MAX(n_branches, 1), sizeof(int32_t));
+   }
+
+   __nvc_cover = *shard;
+   return shard;
+}
+
+static void collect_coverage(rt_model_t *m, uint64_t *stmts,
+                             int32_t *branches)
+{
+   int32_t n_stmts, n_branches, n_toggles;
+   cover_count_tags(m->cover, &n_stmts, &n_branches, &n_toggles);
+
+   memset(stmts, '\0', n_stmts * sizeof(uint64_t));
+   memset(branches, '\0', n_branches * sizeof(int32_t));
+
+   const uint8_t *hit_stmts = ffi_find_symbol(NULL, "cover_stmts");
+   for (int i = 0; hit_stmts != NULL && i < n_stmts; i++)
+      stmts[i] = hit_stmts[i];
+
+   const uint8_t *hit_branches = ffi_find_symbol(NULL, "cover_branches");
+   for (int i = 0; hit_branches != NULL && i < n_branches; i++)
+      branches[i] = hit_branches[i * 2] | (hit_branches[i * 2 + 1] << 1);
+
+   for (int i = 0; i < MAX_THREADS; i++) {
+      const cover_shard_t *shard = &(m->cover_shards[i]);
+      if (shard->stmts == NULL)
+         continue;
+
+      for (int j = 0; j < n_stmts; j++) {
+         const uint64_t sum = stmts[j] + shard->stmts[j];
+         stmts[j] = sum < stmts[j] ? UINT64_MAX : sum;
+      }
+
+      for (int j = 0; j < n_branches; j++)
+         branches[j] |= shard->branches[j];
+   }
+}
+
+static void restore_coverage(rt_model_t *m, const uint64_t *stmts,
+                             const int32_t *branches)
+{
+   int32_t n_stmts, n_branches, n_toggles;
+   cover_count_tags(m->cover, &n_stmts, &n_branches, &n_toggles);
+
+   uint8_t *hit_stmts = ffi_find_symbol(NULL, "cover_stmts");
+   for (int i = 0; hit_stmts != NULL && i < n_stmts; i++)
+      hit_stmts[i] = stmts[i] > 0;
+
+   uint8_t *hit_branches = ffi_find_symbol(NULL, "cover_branches");
+   for (int i = 0; hit_branches != NULL && i < n_branches; i++) {
+      hit_branches[i * 2] = !!(branches[i] & 1);
+      hit_branches[i * 2 + 1] = !!(branches[i] & 2);
+   }
+
+   if (cover_enabled(m->cover, COVER_MASK_HITS_ONLY))
+      return;
+
+   for (int i = 0; i < MAX_THREADS; i++) {
+      cover_shard_t *shard = &(m->cover_shards[i]);
+      if (shard->stmts == NULL)
+         continue;
+
+      memset(shard->stmts, '\0', n_stmts * sizeof(uint64_t));
+      memset(shard->branches, '\0', n_branches * sizeof(int32_t));
+   }
+
+   // All the restored counts are attributed to the current thread
+   cover_shard_t *shard = claim_cover_shard(m, n_stmts, n_branches);
+   memcpy(shard->stmts, stmts, n_stmts * sizeof(uint64_t));
+   memcpy(shard->branches, branches, n_branches * sizeof(int32_t));
+}
+
 static void emit_coverage(rt_model_t *m)
 {
    if (m->cover != NULL) {
-      const int32_t *cover_stmts = ffi_find_symbol(NULL, "cover_stmts");
-      const int32_t *cover_branches = ffi_find_symbol(NULL, "cover_branches");
+      int32_t n_stmts, n_branches, n_toggles;
+      cover_count_tags(m->cover, &n_stmts, &n_branches, &n_toggles);
+
+      uint64_t *cover_stmts LOCAL =
+         xmalloc_array(MAX(n_stmts, 1), sizeof(uint64_t));
+      int32_t *cover_branches LOCAL =
+         xmalloc_array(MAX(n_branches, 1), sizeof(int32_t));
+      collect_coverage(m, cover_stmts, cover_branches);
+      cover_flush_toggles(m->cover);
+
       const int32_t *cover_toggles = ffi_find_symbol(NULL, "cover_toggles");
 
       fbuf_t *covdb =  cover_open_lib_file(m->top, FBUF_OUT, true);
@@ -1941,9 +2483,11 @@ void model_reset(rt_model_t *m)
    }
 
    SCOPED_A(rt_nexus_t *) effq = AINIT;
+   SCOPED_A(rt_nexus_t *) order = AINIT;
 
    while (heap_size(q) > 0) {
       rt_nexus_t *n = heap_extract_min(q);
+      APUSH(order, n);
 
       if (n->flags & NET_F_EFFECTIVE) {
          // Driving and effective values must be calculated separately
@@ -1980,6 +2524,13 @@ void model_reset(rt_model_t *m)
       TRACE("%s initial effective value %s", istr(tree_ident(n->signal->where)),
             fmt_nexus(n, initial));
    }
+
+   layout_nets(m, order.items, order.count);
+
+   // Words in the heap which are unchanged since now need not be saved
+   // in a checkpoint
+   if (m->checkpoint_file != NULL)
+      m->base_image = mspace_image_new(m->mspace);
 }
 
 static bool is_stale_event(event_t *e)
@@ -2053,7 +2604,7 @@ static inline bool insert_transaction(rt_model_t *m, rt_nexus_t *nexus,
          waveform_t *next = it->next;
          last->next = next;
          free_value(nexus, it->value);
-         free_waveform(it);
+         free_waveform(m, it);
          it = next;
       }
       else {
@@ -2072,7 +2623,7 @@ static inline bool insert_transaction(rt_model_t *m, rt_nexus_t *nexus,
       next = it->next;
       already_scheduled |= (it->when == when);
       free_value(nexus, it->value);
-      free_waveform(it);
+      free_waveform(m, it);
    }
 
    return already_scheduled;
@@ -2084,12 +2635,7 @@ static void sched_driver(rt_model_t *m, rt_nexus_t *nexus, uint64_t after,
    rt_source_t *d = find_driver(nexus);
    assert(d != NULL);
 
-   if (unlikely(reject > after))
-      jit_msg(NULL, DIAG_FATAL, "signal %s pulse reject limit %s is greater "
-              "than delay %s", istr(tree_ident(nexus->signal->where)),
-              trace_time(reject), trace_time(after));
-
-   waveform_t *w = alloc_waveform();
+   waveform_t *w = alloc_waveform(m);
    w->when  = m->now + after;
    w->next  = NULL;
    w->value = value;
@@ -2110,11 +2656,58 @@ static void sched_disconnect(rt_model_t *m, rt_nexus_t *nexus, uint64_t after,
    deltaq_insert_disconnect(m, after, d);
 }
 
+static bool nexus_is_isolated(rt_nexus_t *nexus)
+{
+   if (nexus->outputs != NULL || (nexus->flags & NET_F_EFFECTIVE))
+      return false;   // Propagates to other nets
+
+   res_memo_t *r = nexus->signal->resolution;
+   if (r != NULL && (r->flags & R_COMPOSITE))
+      return false;
+
+   if (nexus->n_sources > 0) {
+      for (rt_source_t *s = &(nexus->sources); s; s = s->chain_input) {
+         if (s->tag == SOURCE_PORT && (s->u.port.input->flags & NET_F_INOUT))
+            return false;
+      }
+   }
+
+   return true;
+}
+
+static bool collect_update(rt_model_t *m, task_fn_t fn, void *arg,
+                           rt_nexus_t *nexus)
+{
+   if (likely(!m->collect_updates))
+      return false;
+
+   // Updates to nexuses in different nets cannot affect each other
+   // unless the nexus is connected to another net through a port, has
+   // a separate effective value, or has a composite resolution
+   // function which reads sources from other nets
+   uint32_t key = SERIAL_UPDATE_KEY;
+   if (nexus != NULL && nexus_is_isolated(nexus))
+      key = get_net(m, nexus)->net_id;
+
+   const update_task_t task = {
+      .fn    = fn,
+      .arg   = arg,
+      .key   = key,
+      .index = m->updates.count,
+   };
+   APUSH(m->updates, task);
+
+   return true;
+}
+
 static void async_watch_callback(void *context, void *arg)
 {
    rt_model_t *m = context;
    rt_watch_t *w = arg;
 
+   if (m->parallel_phase)
+      return;   // Called later on the main thread by run_parallel_procq
+
    assert(w->wakeable.pending);
    w->wakeable.pending = false;
 
@@ -2127,6 +2720,9 @@ static void async_timeout_callback(void *context, void *arg)
    rt_model_t *m = context;
    event_t *e = arg;
 
+   if (collect_update(m, async_timeout_callback, arg, NULL))
+      return;
+
    MODEL_ENTRY(m);
    (*e->timeout.fn)(m->now, e->timeout.user);
    rt_free(m->event_stack, e);
@@ -2137,6 +2733,10 @@ static void async_update_implicit_signal(void *context, void *arg)
    rt_model_t *m = context;
    rt_implicit_t *imp = arg;
 
+   if (collect_update(m, async_update_implicit_signal, arg,
+                      &(imp->signal.nexus)))
+      return;
+
    assert(imp->wakeable.pending);
    imp->wakeable.pending = false;
 
@@ -2153,7 +2753,14 @@ static void async_run_process(void *context, void *arg)
    proc->wakeable.pending = false;
 
    MODEL_ENTRY(m);
-   run_process(m, proc);
+
+   if (m->parallel_phase) {
+      mspace_mutator_enter(m->mspace);
+      run_process(m, proc);
+      mspace_mutator_leave(m->mspace);
+   }
+   else
+      run_process(m, proc);
 }
 
 static void wakeup_one(rt_model_t *m, rt_pending_t *p)
@@ -2193,6 +2800,14 @@ static void wakeup_one(rt_model_t *m, rt_pending_t *p)
       case W_WATCH:
          {
             rt_watch_t *w = container_of(p->wake, rt_watch_t, wakeable);
+            if (w->dirty_map != NULL) {
+               // Only record that the signal changed: the owner scans
+               // the bitmap at the end of the time step
+               w->dirty_map[w->dirty_bit / 64] |=
+                  UINT64_C(1) << (w->dirty_bit % 64);
+               return;
+            }
+
             TRACE("wakeup implicit signal %s",
                   istr(tree_ident(w->signal->where)));
             workq_do(wq, async_watch_callback, w);
@@ -2208,11 +2823,8 @@ static void wakeup_one(rt_model_t *m, rt_pending_t *p)
       p->wake = NULL;   // Mark slot as empty
 }
 
-static void notify_event(rt_model_t *m, rt_net_t *net)
+static void wakeup_pending(rt_model_t *m, rt_net_t *net)
 {
-   net->last_event = net->last_active = m->now;
-   net->event_delta = net->active_delta = m->iteration;
-
    if (net->pend0.wake != NULL)
       wakeup_one(m, &(net->pend0));
 
@@ -2223,6 +2835,25 @@ static void notify_event(rt_model_t *m, rt_net_t *net)
    }
 }
 
+static void notify_event(rt_model_t *m, rt_net_t *net)
+{
+   net->last_event = net->last_active = m->now;
+   net->event_delta = net->active_delta = m->iteration;
+
+   if (unlikely(active_part != NULL)) {
+      // Wakeups modify the shared process queues so must be replayed
+      // on the main thread after the concurrent update phase
+      const update_log_t log = {
+         .index = active_part->index,
+         .seq   = active_part->log.count,
+         .net   = net,
+      };
+      APUSH(active_part->log, log);
+   }
+   else
+      wakeup_pending(m, net);
+}
+
 static void notify_active(rt_model_t *m, rt_net_t *net)
 {
    net->last_active = m->now;
@@ -2307,8 +2938,7 @@ static void update_driving(rt_model_t *m, rt_nexus_t *nexus)
 static void update_driver(rt_model_t *m, rt_nexus_t *nexus, rt_source_t *source)
 {
    // Updating drivers may involve calling resolution functions
-   if (!tlab_valid(__nvc_tlab))
-      tlab_acquire(m->mspace, &__nvc_tlab);
+   acquire_thread_tlab(m);
 
    if (likely(source != NULL)) {
       waveform_t *w_now  = &(source->u.driver.waveforms);
@@ -2317,7 +2947,7 @@ static void update_driver(rt_model_t *m, rt_nexus_t *nexus, rt_source_t *source)
       if (likely((w_next != NULL) && (w_next->when == m->now))) {
          free_value(nexus, w_now->value);
          *w_now = *w_next;
-         free_waveform(w_next);
+         free_waveform(m, w_next);
          source->disconnected = 0;
          update_driving(m, nexus);
       }
@@ -2335,6 +2965,9 @@ static void async_update_driver(void *context, void *arg)
    rt_model_t *m = context;
    rt_source_t *src = arg;
 
+   if (collect_update(m, async_update_driver, arg, src->u.driver.nexus))
+      return;
+
    MODEL_ENTRY(m);
    update_driver(m, src->u.driver.nexus, src);
 }
@@ -2344,6 +2977,9 @@ static void async_disconnect(void *context, void *arg)
    rt_model_t *m = context;
    rt_source_t *src = arg;
 
+   if (collect_update(m, async_disconnect, arg, src->u.driver.nexus))
+      return;
+
    MODEL_ENTRY(m);
    src->disconnected = 1;
    update_driver(m, src->u.driver.nexus, NULL);
@@ -2354,6 +2990,9 @@ static void async_update_driving(void *context, void *arg)
    rt_model_t *m = context;
    rt_nexus_t *nexus = arg;
 
+   if (collect_update(m, async_update_driving, arg, nexus))
+      return;
+
    MODEL_ENTRY(m);
    update_driver(m, nexus, NULL);
 }
@@ -2418,119 +3057,1336 @@ static void reached_iteration_limit(rt_model_t *m)
    jit_abort(EXIT_FAILURE);
 }
 
-static void swap_workq(workq_t **a, workq_t **b)
+static void replay_deferred(rt_model_t *m, rt_proc_t *proc)
 {
-   workq_t *tmp = *a;
-   *a = *b;
-   *b = tmp;
-}
-
-static void model_cycle(rt_model_t *m)
+   for (int i = 0; i < proc->deferred.count; i++) {
+      const rt_deferred_t *d = &(proc->deferred.items[i]);
+      switch (d->kind) {
+      case DEFER_PROCESS:
+         deltaq_insert_proc(m, d->delta, proc);
+         break;
+      case DEFER_DRIVER:
+         deltaq_insert_driver(m, d->delta, d->nexus, d->source);
+         break;
+      case DEFER_FORCE_RELEASE:
+         deltaq_insert_force_release(m, d->delta, d->nexus);
+         break;
+      case DEFER_DISCONNECT:
+         deltaq_insert_disconnect(m, d->delta, d->source);
+         break;
+      case DEFER_EVENT:
+         sched_event(m, get_net(m, d->nexus), d->wake, d->oneshot);
+         break;
+      }
+   }
+
+   ATRIM(proc->deferred, 0);
+}
+
+static void collect_wakeable_cb(void *context, void *arg, void *extra)
+{
+   rt_model_t *m = context;
+
+   // The process queue only contains rt_proc_t and rt_watch_t objects
+   // which both begin with an rt_wakeable_t
+   APUSH(m->parallelq, (rt_wakeable_t *)arg);
+}
+
+static void run_parallel_procq(rt_model_t *m)
+{
+   // Processes only read signal values which cannot change until the
+   // next cycle so they can safely run concurrently as long as any
+   // scheduling side effects are deferred and then applied in the
+   // original queue order to keep the simulation deterministic
+
+   assert(m->parallelq.count == 0);
+   workq_scan(m->procq, collect_wakeable_cb, NULL);
+
+   if (m->parallelq.count < PARALLEL_MIN_TASKS) {
+      ATRIM(m->parallelq, 0);
+      workq_start_serial(m->procq);
+      workq_drain(m->procq);
+      return;
+   }
+
+   m->parallel_phase = true;
+
+   workq_start(m->procq);
+   workq_drain(m->procq);
+
+   m->parallel_phase = false;
+
+   for (int i = 0; i < m->parallelq.count; i++) {
+      rt_wakeable_t *obj = m->parallelq.items[i];
+      switch (obj->kind) {
+      case W_PROC:
+         replay_deferred(m, container_of(obj, rt_proc_t, wakeable));
+         break;
+      case W_WATCH:
+         async_watch_callback(m, container_of(obj, rt_watch_t, wakeable));
+         break;
+      case W_IMPLICIT:
+         fatal_trace("unexpected implicit signal in process queue");
+      }
+   }
+
+   ATRIM(m->parallelq, 0);
+}
+
+static void async_update_part(void *context, void *arg)
+{
+   rt_model_t *m = context;
+   update_part_t *part = arg;
+
+   mspace_mutator_enter(m->mspace);
+   active_part = part;
+
+   for (unsigned i = 0; i < part->ntasks; i++) {
+      const update_task_t *t = &(part->tasks[i]);
+      part->index = t->index;
+      (*t->fn)(m, t->arg);
+   }
+
+   active_part = NULL;
+   mspace_mutator_leave(m->mspace);
+}
+
+static int update_task_cmp(const void *a, const void *b)
+{
+   const update_task_t *ta = a, *tb = b;
+
+   if (ta->key != tb->key)
+      return ta->key < tb->key ? -1 : 1;
+   else
+      return ta->index < tb->index ? -1 : (ta->index > tb->index);
+}
+
+static int update_log_cmp(const void *a, const void *b)
+{
+   const update_log_t *la = a, *lb = b;
+
+   if (la->index != lb->index)
+      return la->index < lb->index ? -1 : 1;
+   else
+      return la->seq < lb->seq ? -1 : (la->seq > lb->seq);
+}
+
+static void run_update_queue(rt_model_t *m, workq_t *wq)
+{
+   // Driver and implicit signal updates to a nexus that is not
+   // connected to any other net only write to nexuses in the same net
+   // so the queue is partitioned by net and each partition is run
+   // concurrently. Wakeups are replayed afterwards in the original
+   // queue order.
+
+   if (!m->parallel) {
+      workq_start_serial(wq);
+      workq_drain(wq);
+      return;
+   }
+
+   assert(m->updates.count == 0);
+
+   m->collect_updates = true;
+   workq_start_serial(wq);
+   workq_drain(wq);
+   m->collect_updates = false;
+
+   update_task_t *tasks = m->updates.items;
+   const unsigned ntasks = m->updates.count;
+
+   if (ntasks < PARALLEL_MIN_TASKS) {
+      for (unsigned i = 0; i < ntasks; i++)
+         (*tasks[i].fn)(m, tasks[i].arg);
+
+      ATRIM(m->updates, 0);
+      return;
+   }
+
+   qsort(tasks, ntasks, sizeof(update_task_t), update_task_cmp);
+
+   unsigned nserial = 0;
+   while (nserial < ntasks && tasks[ntasks - nserial - 1].key
+          == SERIAL_UPDATE_KEY)
+      nserial++;
+
+   // Group consecutive nets into partitions of at least
+   // PARALLEL_MIN_TASKS updates to amortise the scheduling overhead
+   int nparts = 0;
+   for (unsigned i = 0; i < ntasks - nserial; nparts++) {
+      unsigned end = MIN(i + PARALLEL_MIN_TASKS, ntasks - nserial);
+      while (end < ntasks - nserial && tasks[end].key == tasks[end - 1].key)
+         end++;
+
+      if (nparts == m->parts.count)
+         APUSH(m->parts, (update_part_t){});
+
+      update_part_t *part = &(m->parts.items[nparts]);
+      part->tasks  = tasks + i;
+      part->ntasks = end - i;
+      ATRIM(part->log, 0);
+
+      i = end;
+   }
+
+   for (int i = 0; i < nparts; i++)
+      workq_do(m->partq, async_update_part, &(m->parts.items[i]));
+
+   workq_start(m->partq);
+   workq_drain(m->partq);
+
+   assert(m->update_log.count == 0);
+
+   for (int i = 0; i < nparts; i++) {
+      update_part_t *part = &(m->parts.items[i]);
+
+      for (waveform_t *w = part->free_waveforms, *next; w; w = next) {
+         next = w->next;
+         free_waveform(m, w);
+      }
+      part->free_waveforms = NULL;
+
+      for (int j = 0; j < part->log.count; j++)
+         APUSH(m->update_log, part->log.items[j]);
+   }
+
+   qsort(m->update_log.items, m->update_log.count, sizeof(update_log_t),
+         update_log_cmp);
+
+   for (int i = 0; i < m->update_log.count; i++)
+      wakeup_pending(m, m->update_log.items[i].net);
+
+   ATRIM(m->update_log, 0);
+
+   // Remaining updates may read or write values in other nets
+   for (unsigned i = ntasks - nserial; i < ntasks; i++)
+      (*tasks[i].fn)(m, tasks[i].arg);
+
+   ATRIM(m->updates, 0);
+}
+
+static inline uint64_t profile_start(rt_model_t *m)
+{
+   return unlikely(m->profile) ? get_timestamp_ns() : 0;
+}
+
+static inline void profile_end(rt_model_t *m, rt_phase_t phase,
+                               uint64_t start)
+{
+   if (unlikely(m->profile))
+      m->prof.phase_ns[phase] += get_timestamp_ns() - start;
+}
+
+static void swap_workq(workq_t **a, workq_t **b)
+{
+   workq_t *tmp = *a;
+   *a = *b;
+   *b = tmp;
+}
+
+static void model_cycle(rt_model_t *m)
 {
    // Simulation cycle is described in LRM 93 section 12.6.4
 
-   const bool is_delta_cycle = m->next_is_delta;
-   m->next_is_delta = false;
+   const bool is_delta_cycle = m->next_is_delta;
+   m->next_is_delta = false;
+
+   if (is_delta_cycle)
+      m->iteration = m->iteration + 1;
+   else {
+      event_t *peek = wheel_min(m->eventq);
+      while (unlikely(is_stale_event(peek))) {
+         // Discard stale events
+         rt_free(m->event_stack, wheel_extract_min(m->eventq));
+         if (wheel_size(m->eventq) == 0) {
+            // Time does not advance so later events may be scheduled
+            // before the discarded one
+            wheel_rewind(m->eventq, m->now);
+            return;
+         }
+         else
+            peek = wheel_min(m->eventq);
+      }
+      m->now = peek->when;
+      m->iteration = 0;
+   }
+
+   if (unlikely(m->profile)) {
+      m->prof.cycles++;
+
+      if (is_delta_cycle)
+         m->prof.max_deltas = MAX(m->prof.max_deltas, m->iteration);
+      else {
+         const size_t depth = wheel_size(m->eventq);
+         m->prof.timesteps++;
+         m->prof.queue_sum += depth;
+         m->prof.max_queue = MAX(m->prof.max_queue, depth);
+      }
+   }
+
+   TRACE("begin cycle");
+
+#if TRACE_DELTAQ > 0
+   if (__trace_on)
+      deltaq_dump(m);
+#endif
+
+   swap_workq(&m->procq, &m->delta_procq);
+   swap_workq(&m->driverq, &m->delta_driverq);
+
+   if (!is_delta_cycle) {
+      global_event(m, RT_NEXT_TIME_STEP);
+
+      for (;;) {
+         event_t *e = wheel_extract_min(m->eventq);
+         m->prof.events++;
+
+         switch (e->kind) {
+         case EVENT_PROCESS:
+            if (!is_stale_event(e)) {
+               assert(!e->proc.proc->wakeable.pending);
+               workq_do(m->procq, async_run_process, e->proc.proc);
+               e->proc.proc->wakeable.pending = true;
+               ++(e->proc.proc->wakeable.wakeup_gen);
+            }
+            rt_free(m->event_stack, e);
+            break;
+         case EVENT_DRIVER:
+            eventq_drain_drivers(m, e);
+            break;
+         case EVENT_TIMEOUT:
+            workq_do(m->driverq, async_timeout_callback, e);
+            // Event freed in callback
+            break;
+         case EVENT_DISCONNECT:
+            workq_do(m->driverq, async_disconnect, e->driver.source);
+            rt_free(m->event_stack, e);
+            break;
+         }
+
+         if (wheel_size(m->eventq) == 0)
+            break;
+
+         event_t *peek = wheel_min(m->eventq);
+         if (peek->when > m->now)
+            break;
+      }
+   }
+
+   uint64_t start = profile_start(m);
+   run_update_queue(m, m->driverq);
+   profile_end(m, PHASE_DRIVER, start);
+
+   // Effective values depend on the values of other nets
+   start = profile_start(m);
+   workq_start_serial(m->effq);
+   workq_drain(m->effq);
+   profile_end(m, PHASE_EFFECTIVE, start);
+
+   // Update implicit signals
+   if (m->implicitq != NULL) {
+      start = profile_start(m);
+      run_update_queue(m, m->implicitq);
+      profile_end(m, PHASE_IMPLICIT, start);
+   }
+
+#if TRACE_SIGNALS > 0
+   if (__trace_on)
+      dump_signals(m, m->root);
+#endif
+
+   // Run all non-postponed processes and event callbacks
+   start = profile_start(m);
+   if (m->parallel)
+      run_parallel_procq(m);
+   else {
+      workq_start_serial(m->procq);
+      workq_drain(m->procq);
+   }
+   profile_end(m, PHASE_PROCESS, start);
+
+   global_event(m, RT_END_OF_PROCESSES);
+
+   if (!m->next_is_delta) {
+      m->can_create_delta = false;
+      global_event(m, RT_LAST_KNOWN_DELTA_CYCLE);
+
+      // Run all postponed processes and event callbacks
+      start = profile_start(m);
+      workq_start_serial(m->postponedq);
+      workq_drain(m->postponedq);
+      profile_end(m, PHASE_PROCESS, start);
+
+      m->can_create_delta = true;
+   }
+   else if (m->stop_delta > 0 && m->iteration == m->stop_delta)
+      reached_iteration_limit(m);
+}
+
+typedef enum {
+   CK_RAW, CK_MSPACE, CK_STATIC, CK_CPOOL, CK_IMAGE, CK_FILE
+} ckpt_ref_t;
+
+typedef struct {
+   ident_t   name;
+   uintptr_t base;
+   uintptr_t start;
+   uintptr_t end;
+} ckpt_image_t;
+
+typedef struct {
+   rt_model_t           *model;
+   fbuf_t               *fbuf;
+   ident_wr_ctx_t        ident_wr;
+   ident_rd_ctx_t        ident_rd;
+   A(rt_signal_t *)      signals;
+   A(rt_proc_t *)        procs;
+   A(rt_wakeable_t *)    wakeables;
+   A(rt_nexus_t *)       nexuses;
+   A(memblock_t *)       blocks;
+   A(ckpt_image_t)       images;
+   hash_t               *index;
+   hset_t               *nets;
+   hset_t               *pointers;
+} checkpoint_t;
+
+#define CHECKPOINT_MAGIC   0x4b43564e   // NVCK
+#define CHECKPOINT_VERSION 2
+
+#ifdef __ELF__
+static int checkpoint_image_cb(struct dl_phdr_info *info, size_t size,
+                               void *ctx)
+{
+   checkpoint_t *ck = ctx;
+
+   ckpt_image_t img = {
+      .name  = ident_new(info->dlpi_name),
+      .base  = info->dlpi_addr,
+      .start = UINTPTR_MAX,
+      .end   = 0,
+   };
+
+   for (int i = 0; i < info->dlpi_phnum; i++) {
+      const ElfW(Phdr) *ph = &(info->dlpi_phdr[i]);
+      if (ph->p_type != PT_LOAD)
+         continue;
+
+      img.start = MIN(img.start, info->dlpi_addr + ph->p_vaddr);
+      img.end   = MAX(img.end, info->dlpi_addr + ph->p_vaddr + ph->p_memsz);
+   }
+
+   if (img.start < img.end)
+      APUSH(ck->images, img);
+
+   return 0;
+}
+#endif
+
+static void checkpoint_begin(checkpoint_t *ck, rt_model_t *m, fbuf_t *f)
+{
+   ck->model = m;
+   ck->fbuf  = f;
+   ck->index = hash_new(1024);
+   ck->nets  = hset_new(1024);
+
+   // Static memory blocks are allocated in the same order on each run
+   for (memblock_t *mb = m->memblocks; mb; mb = mb->chain)
+      APUSH(ck->blocks, mb);
+
+   for (int i = 0, j = ck->blocks.count - 1; i < j; i++, j--) {
+      memblock_t *tmp = ck->blocks.items[i];
+      ck->blocks.items[i] = ck->blocks.items[j];
+      ck->blocks.items[j] = tmp;
+   }
+
+#ifdef __ELF__
+   dl_iterate_phdr(checkpoint_image_cb, ck);
+#endif
+}
+
+static void checkpoint_end(checkpoint_t *ck)
+{
+   hash_free(ck->index);
+   hset_free(ck->nets);
+   ACLEAR(ck->signals);
+   ACLEAR(ck->procs);
+   ACLEAR(ck->wakeables);
+   ACLEAR(ck->nexuses);
+   ACLEAR(ck->blocks);
+   ACLEAR(ck->images);
+}
+
+static void checkpoint_walk_scope(checkpoint_t *ck, rt_scope_t *s)
+{
+   for (rt_signal_t *sig = s->signals; sig; sig = sig->chain) {
+      APUSH(ck->signals, sig);
+
+      if (sig->flags & NET_F_IMPLICIT) {
+         rt_implicit_t *imp = container_of(sig, rt_implicit_t, signal);
+         hash_put(ck->index, &(imp->wakeable),
+                  (void *)(uintptr_t)(ck->wakeables.count + 1));
+         APUSH(ck->wakeables, &(imp->wakeable));
+      }
+   }
+
+   for (rt_proc_t *p = s->procs; p; p = p->chain) {
+      APUSH(ck->procs, p);
+
+      hash_put(ck->index, &(p->wakeable),
+               (void *)(uintptr_t)(ck->wakeables.count + 1));
+      APUSH(ck->wakeables, &(p->wakeable));
+   }
+
+   for (rt_scope_t *c = s->child; c; c = c->chain)
+      checkpoint_walk_scope(ck, c);
+}
+
+static void checkpoint_index_nexuses(checkpoint_t *ck)
+{
+   for (int i = 0; i < ck->signals.count; i++) {
+      rt_signal_t *s = ck->signals.items[i];
+      rt_nexus_t *n = &(s->nexus);
+      for (int j = 0; j < s->n_nexus; j++, n = n->chain) {
+         hash_put(ck->index, n, (void *)(uintptr_t)(ck->nexuses.count + 1));
+         APUSH(ck->nexuses, n);
+      }
+   }
+}
+
+static int checkpoint_lookup(checkpoint_t *ck, const void *ptr)
+{
+   const uintptr_t index = (uintptr_t)hash_get(ck->index, ptr);
+   assert(index > 0);
+   return index - 1;
+}
+
+__attribute__((noreturn))
+static void checkpoint_corrupt(checkpoint_t *ck)
+{
+   fatal("%s: checkpoint does not match the current design",
+         fbuf_file_name(ck->fbuf));
+}
+
+static int checkpoint_read_index(checkpoint_t *ck, int limit)
+{
+   const uint64_t index = fbuf_get_uint(ck->fbuf);
+   if (index >= limit)
+      checkpoint_corrupt(ck);
+
+   return index;
+}
+
+static bool checkpoint_mark_pointer(void **ptr, void *ctx)
+{
+   checkpoint_t *ck = ctx;
+
+   // Only words on the heap are saved in the checkpoint
+   if (mspace_offset(ck->model->mspace, ptr) < 0)
+      return false;
+   else if (hset_contains(ck->pointers, ptr))
+      return false;
+
+   hset_insert(ck->pointers, ptr);
+   return true;
+}
+
+static void checkpoint_find_pointers(checkpoint_t *ck, rt_scope_t *s)
+{
+   rt_model_t *m = ck->model;
+
+   if (s->kind == SCOPE_INSTANCE || s->kind == SCOPE_PACKAGE) {
+      void *frame = *mptr_get(s->privdata);
+      if (frame != NULL)
+         jit_walk_frame(m->jit, jit_lazy_compile(m->jit, s->name), frame,
+                        checkpoint_mark_pointer, ck);
+   }
+
+   for (rt_proc_t *p = s->procs; p; p = p->chain) {
+      void *frame = *mptr_get(p->privdata);
+      if (frame != NULL)
+         jit_walk_frame(m->jit, p->handle, frame, checkpoint_mark_pointer, ck);
+   }
+
+   for (rt_scope_t *c = s->child; c; c = c->chain)
+      checkpoint_find_pointers(ck, c);
+}
+
+static void checkpoint_put_word(const uintptr_t *ptr, fbuf_t *f, void *ctx)
+{
+   checkpoint_t *ck = ctx;
+   rt_model_t *m = ck->model;
+
+   // Only words which the variable types say hold pointers may need to
+   // be relocated as the memory they point to can be at a different
+   // address when the checkpoint is restored
+
+   const uintptr_t word = *ptr;
+   if (word == 0 || !hset_contains(ck->pointers, ptr)) {
+      write_u8(CK_RAW, f);
+      write_u64(word, f);
+      return;
+   }
+
+   const ptrdiff_t offset = mspace_offset(m->mspace, (void *)word);
+   if (offset >= 0) {
+      write_u8(CK_MSPACE, f);
+      fbuf_put_uint(f, offset);
+      return;
+   }
+
+   for (int i = 0; i < ck->blocks.count; i++) {
+      const memblock_t *mb = ck->blocks.items[i];
+      if (word >= (uintptr_t)mb->ptr && word < (uintptr_t)mb->ptr + mb->pagesz) {
+         write_u8(CK_STATIC, f);
+         fbuf_put_uint(f, i);
+         fbuf_put_uint(f, word - (uintptr_t)mb->ptr);
+         return;
+      }
+   }
+
+   ident_t name;
+   size_t cpool_offset;
+   if (jit_find_cpool(m->jit, (void *)word, &name, &cpool_offset)) {
+      write_u8(CK_CPOOL, f);
+      ident_write(name, ck->ident_wr);
+      fbuf_put_uint(f, cpool_offset);
+      return;
+   }
+
+   uint32_t id;
+   if (jit_find_file((void *)word, &id)) {
+      write_u8(CK_FILE, f);
+      fbuf_put_uint(f, id);
+      return;
+   }
+
+   for (int i = 0; i < ck->images.count; i++) {
+      const ckpt_image_t *img = &(ck->images.items[i]);
+      if (word >= img->start && word < img->end) {
+         write_u8(CK_IMAGE, f);
+         ident_write(img->name, ck->ident_wr);
+         fbuf_put_uint(f, word - img->base);
+         return;
+      }
+   }
+
+   write_u8(CK_RAW, f);
+   write_u64(word, f);
+}
+
+static uintptr_t checkpoint_get_word(fbuf_t *f, void *ctx)
+{
+   checkpoint_t *ck = ctx;
+   rt_model_t *m = ck->model;
+
+   switch (read_u8(f)) {
+   case CK_RAW:
+      return read_u64(f);
+
+   case CK_MSPACE:
+      return (uintptr_t)mspace_pointer(m->mspace, fbuf_get_uint(f));
+
+   case CK_STATIC:
+      {
+         const memblock_t *mb =
+            ck->blocks.items[checkpoint_read_index(ck, ck->blocks.count)];
+         const uint64_t offset = fbuf_get_uint(f);
+         if (offset >= mb->pagesz)
+            checkpoint_corrupt(ck);
+
+         return (uintptr_t)mb->ptr + offset;
+      }
+
+   case CK_CPOOL:
+      {
+         ident_t name = ident_read(ck->ident_rd);
+         const uint64_t offset = fbuf_get_uint(f);
+
+         unsigned char *cpool = jit_get_cpool(m->jit, name);
+         if (cpool == NULL)
+            fatal("%s: cannot find constant pool for %s",
+                  fbuf_file_name(f), istr(name));
+
+         return (uintptr_t)cpool + offset;
+      }
+
+   case CK_FILE:
+      {
+         void *fp = jit_get_file(fbuf_get_uint(f));
+         if (fp == NULL)
+            checkpoint_corrupt(ck);
+
+         return (uintptr_t)fp;
+      }
+
+   case CK_IMAGE:
+      {
+         ident_t name = ident_read(ck->ident_rd);
+         const uint64_t offset = fbuf_get_uint(f);
+
+         for (int i = 0; i < ck->images.count; i++) {
+            if (ck->images.items[i].name == name)
+               return ck->images.items[i].base + offset;
+         }
+
+         fatal("%s: %s is not loaded", fbuf_file_name(f),
+               *istr(name) ? istr(name) : "executable");
+      }
+
+   default:
+      checkpoint_corrupt(ck);
+   }
+}
+
+static void checkpoint_put_value(checkpoint_t *ck, rt_nexus_t *n,
+                                 rt_value_t *v)
+{
+   write_raw(value_ptr(n, v), n->width * n->size, ck->fbuf);
+}
+
+static rt_value_t checkpoint_get_value(checkpoint_t *ck, rt_nexus_t *n)
+{
+   rt_value_t v = alloc_value(ck->model, n);
+   read_raw(value_ptr(n, &v), n->width * n->size, ck->fbuf);
+   return v;
+}
+
+static void checkpoint_put_source(checkpoint_t *ck, rt_nexus_t *n,
+                                  rt_source_t *src)
+{
+   fbuf_put_uint(ck->fbuf, checkpoint_lookup(ck, n));
+
+   int nth = 0;
+   if (src == NULL)
+      nth = -1;
+   else {
+      for (rt_source_t *it = &(n->sources); it != src; it = it->chain_input)
+         nth++;
+   }
+
+   fbuf_put_int(ck->fbuf, nth);
+}
+
+static rt_source_t *checkpoint_get_source(checkpoint_t *ck, rt_nexus_t **pn)
+{
+   rt_nexus_t *n =
+      ck->nexuses.items[checkpoint_read_index(ck, ck->nexuses.count)];
+
+   const int nth = fbuf_get_int(ck->fbuf);
+
+   rt_source_t *src = NULL;
+   if (nth >= 0) {
+      src = &(n->sources);
+      for (int i = 0; i < nth && src != NULL; i++)
+         src = src->chain_input;
+
+      if (src == NULL || n->n_sources == 0)
+         checkpoint_corrupt(ck);
+   }
+
+   *pn = n;
+   return src;
+}
+
+static bool is_live_pending_entry(rt_pending_t *p)
+{
+   // Entries for a sensitivity list stay valid after the process wakes
+   return p->wake != NULL
+      && (!p->oneshot || p->wakeup_gen == p->wake->wakeup_gen);
+}
+
+static void checkpoint_save_nexus(checkpoint_t *ck, rt_nexus_t *n)
+{
+   fbuf_t *f = ck->fbuf;
+
+   write_u8(!!(n->flags & NET_F_FORCED), f);
+   if (n->flags & NET_F_FORCED)
+      checkpoint_put_value(ck, n, &(n->forcing));
+
+   fbuf_put_uint(f, n->n_sources);
+   if (n->n_sources > 0) {
+      for (rt_source_t *s = &(n->sources); s; s = s->chain_input) {
+         write_u8(s->disconnected, f);
+
+         if (s->tag != SOURCE_DRIVER)
+            continue;
+
+         waveform_t *w = &(s->u.driver.waveforms);
+         write_u64(w->when, f);
+         checkpoint_put_value(ck, n, &(w->value));
+
+         int nfuture = 0;
+         for (waveform_t *it = w->next; it; it = it->next)
+            nfuture++;
+
+         fbuf_put_uint(f, nfuture);
+         for (waveform_t *it = w->next; it; it = it->next) {
+            write_u64(it->when, f);
+            checkpoint_put_value(ck, n, &(it->value));
+         }
+      }
+   }
+
+   rt_net_t *net = n->net;
+   if (net == NULL || hset_contains(ck->nets, net)) {
+      write_u8(0, f);
+      return;
+   }
+
+   hset_insert(ck->nets, net);
+
+   write_u8(1, f);
+   write_u64(net->last_event, f);
+   write_u64(net->last_active, f);
+   fbuf_put_int(f, net->event_delta);
+   fbuf_put_int(f, net->active_delta);
+
+   // Entries for watches are created again by the tool that restores
+   // the checkpoint
+   SCOPED_A(rt_pending_t *) pending = AINIT;
+   if (is_live_pending_entry(&(net->pend0)))
+      APUSH(pending, &(net->pend0));
+
+   for (int i = 0; i < net->npending; i++) {
+      if (is_live_pending_entry(&(net->pending[i])))
+         APUSH(pending, &(net->pending[i]));
+   }
+
+   int nsaved = 0;
+   for (int i = 0; i < pending.count; i++)
+      nsaved += pending.items[i]->wake->kind != W_WATCH;
+
+   fbuf_put_uint(f, nsaved);
+   for (int i = 0; i < pending.count; i++) {
+      rt_pending_t *p = pending.items[i];
+      if (p->wake->kind != W_WATCH) {
+         fbuf_put_uint(f, checkpoint_lookup(ck, p->wake));
+         write_u8(p->oneshot, f);
+      }
+   }
+}
+
+static void checkpoint_restore_nexus(checkpoint_t *ck, rt_nexus_t *n)
+{
+   rt_model_t *m = ck->model;
+   fbuf_t *f = ck->fbuf;
+
+   if (n->flags & NET_F_FORCED) {
+      n->flags &= ~NET_F_FORCED;
+      free_value(n, n->forcing);
+      n->forcing.qword = 0;
+   }
+
+   if (read_u8(f)) {
+      n->flags |= NET_F_FORCED;
+      n->forcing = checkpoint_get_value(ck, n);
+   }
+
+   if (fbuf_get_uint(f) != n->n_sources)
+      checkpoint_corrupt(ck);
+
+   if (n->n_sources > 0) {
+      for (rt_source_t *s = &(n->sources); s; s = s->chain_input) {
+         s->disconnected = read_u8(f);
+
+         if (s->tag != SOURCE_DRIVER)
+            continue;
+
+         waveform_t *w = &(s->u.driver.waveforms);
+         for (waveform_t *it = w->next, *next; it; it = next) {
+            next = it->next;
+            free_value(n, it->value);
+            free_waveform(m, it);
+         }
+
+         w->when = read_u64(f);
+         w->next = NULL;
+         read_raw(value_ptr(n, &(w->value)), n->width * n->size, f);
+
+         const int nfuture = fbuf_get_uint(f);
+         for (int i = 0; i < nfuture; i++) {
+            waveform_t *new = alloc_waveform(m);
+            new->when  = read_u64(f);
+            new->next  = NULL;
+            new->value = checkpoint_get_value(ck, n);
+
+            w = (w->next = new);
+         }
+      }
+   }
+
+   if (!read_u8(f))
+      return;
+
+   rt_net_t *net = n->net;
+   if (net == NULL || hset_contains(ck->nets, net))
+      checkpoint_corrupt(ck);
+
+   hset_insert(ck->nets, net);
+
+   net->last_event   = read_u64(f);
+   net->last_active  = read_u64(f);
+   net->event_delta  = fbuf_get_int(f);
+   net->active_delta = fbuf_get_int(f);
+
+   // Keep only pending entries for watches added by this tool
+   if (net->pend0.wake != NULL && net->pend0.wake->kind != W_WATCH)
+      net->pend0.wake = NULL;
+
+   for (int i = 0; i < net->npending; i++) {
+      rt_pending_t *p = &(net->pending[i]);
+      if (p->wake != NULL && p->wake->kind != W_WATCH)
+         p->wake = NULL;
+   }
+
+   const int npending = fbuf_get_uint(f);
+   for (int i = 0; i < npending; i++) {
+      rt_wakeable_t *wake =
+         ck->wakeables.items[checkpoint_read_index(ck, ck->wakeables.count)];
+      const bool oneshot = read_u8(f);
+
+      sched_event(m, net, wake, oneshot);
+   }
+}
+
+static void checkpoint_save_wakeable(checkpoint_t *ck, rt_wakeable_t *w)
+{
+   write_u32(w->wakeup_gen, ck->fbuf);
+   write_u8(w->pending, ck->fbuf);
+   write_u8(w->postponed, ck->fbuf);
+}
+
+static void checkpoint_restore_wakeable(checkpoint_t *ck, rt_wakeable_t *w)
+{
+   w->wakeup_gen = read_u32(ck->fbuf);
+   w->pending    = read_u8(ck->fbuf);
+   w->postponed  = read_u8(ck->fbuf);
+}
+
+static void checkpoint_save_events(checkpoint_t *ck)
+{
+   rt_model_t *m = ck->model;
+   fbuf_t *f = ck->fbuf;
+
+   // Take every event out of the queue in order and insert them into
+   // a fresh queue: restoring does the same so the order of events
+   // with the same time is identical afterwards
+   SCOPED_A(event_t *) events = AINIT;
+   while (wheel_size(m->eventq) > 0)
+      APUSH(events, wheel_extract_min(m->eventq));
+
+   wheel_free(m->eventq);
+   m->eventq = wheel_new(UINT64_C(1) << MIN(opt_get_int(OPT_EVENT_HORIZON), 63));
+
+   memset(m->batchcache, '\0', sizeof(m->batchcache));
+
+   int nsaved = 0, ntimeouts = 0;
+   for (int i = 0; i < events.count; i++) {
+      event_t *e = events.items[i];
+      wheel_insert(m->eventq, e->when, e);
+
+      if (e->kind == EVENT_TIMEOUT)
+         ntimeouts++;
+      else if (!is_stale_event(e))
+         nsaved++;
+   }
+
+   if (ntimeouts > 0)
+      warnf("%d pending timeout callbacks are not saved in checkpoint %s",
+            ntimeouts, fbuf_file_name(f));
+
+   fbuf_put_uint(f, nsaved);
+
+   for (int i = 0; i < events.count; i++) {
+      event_t *e = events.items[i];
+      if (e->kind == EVENT_TIMEOUT || is_stale_event(e))
+         continue;
 
-   if (is_delta_cycle)
-      m->iteration = m->iteration + 1;
-   else {
-      event_t *peek = heap_min(m->eventq_heap);
-      while (unlikely(is_stale_event(peek))) {
-         // Discard stale events
-         rt_free(m->event_stack, heap_extract_min(m->eventq_heap));
-         if (heap_size(m->eventq_heap) == 0)
-            return;
-         else
-            peek = heap_min(m->eventq_heap);
+      write_u64(e->when, f);
+      write_u8(e->kind, f);
+
+      switch (e->kind) {
+      case EVENT_PROCESS:
+         fbuf_put_uint(f, checkpoint_lookup(ck, &(e->proc.proc->wakeable)));
+         write_u32(e->proc.wakeup_gen, f);
+         break;
+      case EVENT_DRIVER:
+         fbuf_put_uint(f, e->drivers.count);
+         for (int j = 0; j < e->drivers.count; j++) {
+            event_driver_t *d = &(e->drivers.items[j]);
+            checkpoint_put_source(ck, d->nexus, d->source);
+         }
+         break;
+      case EVENT_DISCONNECT:
+         checkpoint_put_source(ck, e->driver.nexus, e->driver.source);
+         break;
+      case EVENT_TIMEOUT:
+         break;
       }
-      m->now = peek->when;
-      m->iteration = 0;
    }
+}
 
-   TRACE("begin cycle");
+static void checkpoint_restore_events(checkpoint_t *ck)
+{
+   rt_model_t *m = ck->model;
+   fbuf_t *f = ck->fbuf;
 
-#if TRACE_DELTAQ > 0
-   if (__trace_on)
-      deltaq_dump(m);
-#endif
+   // Discard everything scheduled during initialisation except timeout
+   // callbacks which were added by this tool
+   SCOPED_A(event_t *) timeouts = AINIT;
+   while (wheel_size(m->eventq) > 0) {
+      event_t *e = wheel_extract_min(m->eventq);
+      if (e->kind == EVENT_TIMEOUT)
+         APUSH(timeouts, e);
+      else {
+         if (e->kind == EVENT_DRIVER)
+            ACLEAR(e->drivers);
+         rt_free(m->event_stack, e);
+      }
+   }
 
-   swap_workq(&m->procq, &m->delta_procq);
-   swap_workq(&m->driverq, &m->delta_driverq);
+   wheel_free(m->eventq);
+   m->eventq = wheel_new(UINT64_C(1) << MIN(opt_get_int(OPT_EVENT_HORIZON), 63));
 
-   if (!is_delta_cycle) {
-      global_event(m, RT_NEXT_TIME_STEP);
+   memset(m->batchcache, '\0', sizeof(m->batchcache));
 
-      for (;;) {
-         event_t *e = heap_extract_min(m->eventq_heap);
-         switch (e->kind) {
-         case EVENT_PROCESS:
-            if (!is_stale_event(e)) {
-               assert(!e->proc.proc->wakeable.pending);
-               workq_do(m->procq, async_run_process, e->proc.proc);
-               e->proc.proc->wakeable.pending = true;
-               ++(e->proc.proc->wakeable.wakeup_gen);
+   for (int i = 0; i < timeouts.count; i++) {
+      event_t *e = timeouts.items[i];
+      wheel_insert(m->eventq, MAX(e->when, m->now), e);
+   }
+
+   const int nevents = fbuf_get_uint(f);
+   for (int i = 0; i < nevents; i++) {
+      event_t *e = rt_alloc(m->event_stack);
+      e->when = read_u64(f);
+      e->kind = read_u8(f);
+
+      switch (e->kind) {
+      case EVENT_PROCESS:
+         {
+            const int index =
+               checkpoint_read_index(ck, ck->wakeables.count);
+            rt_wakeable_t *w = ck->wakeables.items[index];
+            if (w->kind != W_PROC)
+               checkpoint_corrupt(ck);
+
+            e->proc.proc = container_of(w, rt_proc_t, wakeable);
+            e->proc.wakeup_gen = read_u32(f);
+         }
+         break;
+      case EVENT_DRIVER:
+         {
+            const int count = fbuf_get_uint(f);
+            e->drivers = (driver_list_t){};
+            for (int j = 0; j < count; j++) {
+               event_driver_t d;
+               d.source = checkpoint_get_source(ck, &(d.nexus));
+               APUSH(e->drivers, d);
             }
-            rt_free(m->event_stack, e);
-            break;
-         case EVENT_DRIVER:
-            workq_do(m->driverq, async_update_driver, e->driver.source);
-            rt_free(m->event_stack, e);
-            break;
-         case EVENT_TIMEOUT:
-            workq_do(m->driverq, async_timeout_callback, e);
-            // Event freed in callback
-            break;
-         case EVENT_DISCONNECT:
-            workq_do(m->driverq, async_disconnect, e->driver.source);
-            rt_free(m->event_stack, e);
-            break;
          }
+         break;
+      case EVENT_DISCONNECT:
+         e->driver.source = checkpoint_get_source(ck, &(e->driver.nexus));
+         break;
+      default:
+         checkpoint_corrupt(ck);
+      }
 
-         if (heap_size(m->eventq_heap) == 0)
-            break;
+      if (e->when < m->now)
+         checkpoint_corrupt(ck);
 
-         event_t *peek = heap_min(m->eventq_heap);
-         if (peek->when > m->now)
-            break;
+      wheel_insert(m->eventq, e->when, e);
+   }
+}
+
+static void checkpoint_save_coverage(checkpoint_t *ck)
+{
+   rt_model_t *m = ck->model;
+   fbuf_t *f = ck->fbuf;
+
+   int32_t counts[3] = {};
+   if (m->cover != NULL)
+      cover_count_tags(m->cover, &counts[0], &counts[1], &counts[2]);
+
+   uint64_t *stmts LOCAL = xmalloc_array(MAX(counts[0], 1), sizeof(uint64_t));
+   int32_t *branches LOCAL = xmalloc_array(MAX(counts[1], 1), sizeof(int32_t));
+   if (m->cover != NULL) {
+      collect_coverage(m, stmts, branches);
+      cover_flush_toggles(m->cover);
+   }
+
+   const int32_t *toggles = ffi_find_symbol(NULL, "cover_toggles");
+
+   write_u32(counts[0], f);
+   write_raw(stmts, counts[0] * sizeof(uint64_t), f);
+
+   write_u32(counts[1], f);
+   write_raw(branches, counts[1] * sizeof(int32_t), f);
+
+   const int32_t ntoggles = toggles != NULL ? counts[2] : 0;
+   write_u32(ntoggles, f);
+   write_raw(toggles, ntoggles * sizeof(int32_t), f);
+}
+
+static void checkpoint_restore_coverage(checkpoint_t *ck)
+{
+   rt_model_t *m = ck->model;
+   fbuf_t *f = ck->fbuf;
+
+   int32_t counts[3] = {};
+   if (m->cover != NULL)
+      cover_count_tags(m->cover, &counts[0], &counts[1], &counts[2]);
+
+   if (read_u32(f) != counts[0])
+      checkpoint_corrupt(ck);
+
+   uint64_t *stmts LOCAL = xmalloc_array(MAX(counts[0], 1), sizeof(uint64_t));
+   read_raw(stmts, counts[0] * sizeof(uint64_t), f);
+
+   if (read_u32(f) != counts[1])
+      checkpoint_corrupt(ck);
+
+   int32_t *branches LOCAL = xmalloc_array(MAX(counts[1], 1), sizeof(int32_t));
+   read_raw(branches, counts[1] * sizeof(int32_t), f);
+
+   if (m->cover != NULL) {
+      restore_coverage(m, stmts, branches);
+      cover_flush_toggles(m->cover);   // Discard any pending toggles
+   }
+
+   int32_t *toggles = ffi_find_symbol(NULL, "cover_toggles");
+   const int32_t ntoggles = read_u32(f);
+
+   if (ntoggles == 0)
+      return;
+   else if (toggles == NULL || ntoggles != counts[2])
+      checkpoint_corrupt(ck);
+
+   read_raw(toggles, ntoggles * sizeof(int32_t), f);
+}
+
+static bool is_checkpoint_time(rt_model_t *m)
+{
+   // Checkpoints are only written between time steps
+   if (m->next_is_delta || m->iteration < 0)
+      return false;
+
+   event_t *peek = wheel_min(m->eventq);
+   return peek->when > m->checkpoint_time;
+}
+
+static void write_checkpoint(rt_model_t *m)
+{
+   fbuf_t *f = fbuf_open(m->checkpoint_file, FBUF_OUT, FBUF_CS_ADLER32);
+   if (f == NULL)
+      fatal_errno("failed to create %s", m->checkpoint_file);
+
+   TRACE("write checkpoint to %s", m->checkpoint_file);
+
+   checkpoint_t ck = {};
+   checkpoint_begin(&ck, m, f);
+   checkpoint_walk_scope(&ck, m->root);
+   checkpoint_index_nexuses(&ck);
+
+   ck.ident_wr = ident_write_begin(f);
+
+   write_u32(CHECKPOINT_MAGIC, f);
+   write_u32(CHECKPOINT_VERSION, f);
+   ident_write(tree_ident(m->top), ck.ident_wr);
+   write_u64(m->now, f);
+   fbuf_put_int(f, m->iteration);
+   fbuf_put_uint(f, ck.signals.count);
+   fbuf_put_uint(f, ck.procs.count);
+
+   jit_save_files(f);
+
+   ck.pointers = hset_new(1024);
+   checkpoint_find_pointers(&ck, m->root);
+
+   mspace_save(m->mspace, m->base_image, f, checkpoint_put_word, &ck);
+
+   hset_free(ck.pointers);
+   ck.pointers = NULL;
+
+   // The nexus structure of each signal may have changed since
+   // initialisation if a process drives part of a signal
+   for (int i = 0; i < ck.signals.count; i++) {
+      rt_signal_t *s = ck.signals.items[i];
+      fbuf_put_uint(f, s->n_nexus);
+
+      rt_nexus_t *n = &(s->nexus);
+      for (int j = 0; j < s->n_nexus; j++, n = n->chain)
+         fbuf_put_uint(f, n->width);
+
+      const int nvalues = (s->flags & NET_F_IMPLICIT) ? 2 : 3;
+      write_raw(s->shared.data, nvalues * s->shared.size, f);
+   }
+
+   for (int i = 0; i < ck.wakeables.count; i++)
+      checkpoint_save_wakeable(&ck, ck.wakeables.items[i]);
+
+   for (int i = 0; i < ck.nexuses.count; i++)
+      checkpoint_save_nexus(&ck, ck.nexuses.items[i]);
+
+   for (int i = 0; i < ck.procs.count; i++) {
+      rt_proc_t *p = ck.procs.items[i];
+      assert(p->deferred.count == 0);
+
+      write_u8(tlab_valid(p->tlab), f);
+      if (tlab_valid(p->tlab)) {
+         fbuf_put_uint(f, mspace_offset(m->mspace, p->tlab.base));
+         fbuf_put_uint(f, p->tlab.alloc - p->tlab.base);
       }
    }
 
-   workq_start(m->driverq);
-   workq_drain(m->driverq);
+   checkpoint_save_events(&ck);
+   checkpoint_save_coverage(&ck);
 
-   workq_start(m->effq);
-   workq_drain(m->effq);
+   ident_write_end(ck.ident_wr);
+   fbuf_close(f, NULL);
 
-   // Update implicit signals
-   if (m->implicitq != NULL) {
-      workq_start(m->implicitq);
-      workq_drain(m->implicitq);
+   checkpoint_end(&ck);
+
+   notef("saved checkpoint at %s to %s", trace_time(m->now),
+         m->checkpoint_file);
+}
+
+void model_checkpoint(rt_model_t *m, uint64_t when, const char *file)
+{
+   assert(m->base_image == NULL);
+
+   free(m->checkpoint_file);
+   m->checkpoint_file = xstrdup(file);
+   m->checkpoint_time = when;
+
+   mspace_set_zero_padding(m->mspace, true);
+}
+
+void model_reload_options(rt_model_t *m)
+{
+   // Run options may change after the model was created and reset, for
+   // example in a child forked by --server for a new request
+
+   m->stop_delta = opt_get_int(OPT_STOP_DELTA);
+   m->parallel   = opt_get_int(OPT_RT_PARALLEL);
+   m->profile    = opt_get_int(OPT_RT_PROFILE);
+
+   __trace_on = opt_get_int(OPT_RT_TRACE);
+
+   // Move any events scheduled during initialisation into a queue with
+   // the new horizon preserving their order
+   SCOPED_A(event_t *) events = AINIT;
+   while (wheel_size(m->eventq) > 0)
+      APUSH(events, wheel_extract_min(m->eventq));
+
+   wheel_free(m->eventq);
+   m->eventq = wheel_new(UINT64_C(1) << MIN(opt_get_int(OPT_EVENT_HORIZON), 63));
+
+   memset(m->batchcache, '\0', sizeof(m->batchcache));
+
+   for (int i = 0; i < events.count; i++)
+      wheel_insert(m->eventq, events.items[i]->when, events.items[i]);
+}
+
+void model_restore(rt_model_t *m, const char *file)
+{
+   MODEL_ENTRY(m);
+
+   if (m->force_stop)
+      return;   // Error in intialisation
+
+   fbuf_t *f = fbuf_open(file, FBUF_IN, FBUF_CS_ADLER32);
+   if (f == NULL)
+      fatal_errno("failed to open %s", file);
+
+   checkpoint_t ck = {};
+   checkpoint_begin(&ck, m, f);
+   checkpoint_walk_scope(&ck, m->root);
+
+   ck.ident_rd = ident_read_begin(f);
+
+   if (read_u32(f) != CHECKPOINT_MAGIC)
+      fatal("%s is not a checkpoint file", file);
+   else if (read_u32(f) != CHECKPOINT_VERSION)
+      fatal("%s was created by a different version of " PACKAGE_NAME, file);
+
+   ident_t top = ident_read(ck.ident_rd);
+   if (top != tree_ident(m->top))
+      fatal("%s is a checkpoint of %s not %s", file, istr(top),
+            istr(tree_ident(m->top)));
+
+   m->now           = read_u64(f);
+   m->iteration     = fbuf_get_int(f);
+   m->next_is_delta = false;
+
+   if (fbuf_get_uint(f) != ck.signals.count
+       || fbuf_get_uint(f) != ck.procs.count)
+      checkpoint_corrupt(&ck);
+
+   jit_restore_files(f);
+
+   mspace_restore(m->mspace, f, checkpoint_get_word, &ck);
+
+   for (int i = 0; i < ck.signals.count; i++) {
+      rt_signal_t *s = ck.signals.items[i];
+
+      const int n_nexus = fbuf_get_uint(f);
+      for (int j = 0, offset = 0; j < n_nexus; j++) {
+         const int width = fbuf_get_uint(f);
+         if (width <= 0 || (offset + width) * s->nexus.size > s->shared.size)
+            checkpoint_corrupt(&ck);
+
+         split_nexus(m, s, offset, width);
+         offset += width;
+      }
+
+      if (s->n_nexus != n_nexus)
+         checkpoint_corrupt(&ck);
+
+      const int nvalues = (s->flags & NET_F_IMPLICIT) ? 2 : 3;
+      read_raw(s->shared.data, nvalues * s->shared.size, f);
    }
 
-#if TRACE_SIGNALS > 0
-   if (__trace_on)
-      dump_signals(m, m->root);
-#endif
+   // Anything scheduled by splitting nexuses above or during
+   // initialisation is replaced by the saved state
+   workq_free(m->delta_procq);
+   workq_free(m->delta_driverq);
+   m->delta_procq   = workq_new(m);
+   m->delta_driverq = workq_new(m);
 
-   // Run all non-postponed processes and event callbacks
-   workq_start(m->procq);
-   workq_drain(m->procq);
+   checkpoint_index_nexuses(&ck);
 
-   global_event(m, RT_END_OF_PROCESSES);
+   // Wakeable state must be restored before pending lists are rebuilt
+   for (int i = 0; i < ck.wakeables.count; i++)
+      checkpoint_restore_wakeable(&ck, ck.wakeables.items[i]);
 
-   if (!m->next_is_delta) {
-      m->can_create_delta = false;
-      global_event(m, RT_LAST_KNOWN_DELTA_CYCLE);
+   for (int i = 0; i < ck.nexuses.count; i++)
+      checkpoint_restore_nexus(&ck, ck.nexuses.items[i]);
 
-      // Run all postponed processes and event callbacks
-      workq_start(m->postponedq);
-      workq_drain(m->postponedq);
+   for (int i = 0; i < ck.procs.count; i++) {
+      rt_proc_t *p = ck.procs.items[i];
+      assert(!tlab_valid(p->tlab));   // Not used during reset
 
-      m->can_create_delta = true;
+      if (read_u8(f)) {
+         const uint64_t offset = fbuf_get_uint(f);
+         const uint64_t used = fbuf_get_uint(f);
+         if (used > TLAB_SIZE)
+            checkpoint_corrupt(&ck);
+
+         tlab_adopt(m->mspace, &(p->tlab), mspace_pointer(m->mspace, offset),
+                    used);
+      }
    }
-   else if (m->stop_delta > 0 && m->iteration == m->stop_delta)
-      reached_iteration_limit(m);
+
+   checkpoint_restore_events(&ck);
+   checkpoint_restore_coverage(&ck);
+
+   ident_read_end(ck.ident_rd);
+   fbuf_close(f, NULL);
+
+   checkpoint_end(&ck);
+
+   notef("restored checkpoint at %s from %s", trace_time(m->now), file);
 }
 
 static bool should_stop_now(rt_model_t *m, uint64_t stop_time)
@@ -2539,10 +4395,10 @@ static bool should_stop_now(rt_model_t *m, uint64_t stop_time)
       return true;
    else if (m->next_is_delta)
       return false;
-   else if (heap_size(m->eventq_heap) == 0)
+   else if (wheel_size(m->eventq) == 0)
       return true;
    else {
-      event_t *peek = heap_min(m->eventq_heap);
+      event_t *peek = wheel_min(m->eventq);
       return peek->when > stop_time;
    }
 }
@@ -2554,18 +4410,39 @@ void model_run(rt_model_t *m, uint64_t stop_time)
    if (m->force_stop)
       return;   // Was error during intialisation
 
-   stop_workers();   // Runtime is not thread-safe
+   if (!m->parallel)
+      stop_workers();   // Worker threads only used for the process phase
 
    global_event(m, RT_START_OF_SIMULATION);
 
-   while (!should_stop_now(m, stop_time))
+   while (!should_stop_now(m, stop_time)) {
+      if (unlikely(m->base_image != NULL) && is_checkpoint_time(m)) {
+         write_checkpoint(m);
+         mspace_image_free(m->base_image);
+         m->base_image = NULL;
+         mspace_set_zero_padding(m->mspace, false);
+      }
+
       model_cycle(m);
+   }
+
+   if (m->base_image != NULL && !m->force_stop)
+      warnf("simulation stopped before checkpoint time %s",
+            trace_time(m->checkpoint_time));
 
    global_event(m, RT_END_OF_SIMULATION);
 
    emit_coverage(m);
 }
 
+static void check_reject_limit(rt_signal_t *s, uint64_t after, uint64_t reject)
+{
+   if (unlikely(reject > after))
+      jit_msg(NULL, DIAG_FATAL, "signal %s pulse reject limit %s is greater "
+              "than delay %s", istr(tree_ident(s->where)),
+              trace_time(reject), trace_time(after));
+}
+
 static inline void check_postponed(int64_t after)
 {
    if (unlikely(active_proc->wakeable.postponed && (after == 0)))
@@ -2620,6 +4497,11 @@ int64_t model_now(rt_model_t *m, unsigned *deltas)
    return m->now;
 }
 
+int model_exit_status(rt_model_t *m)
+{
+   return jit_exit_status(m->jit);
+}
+
 void model_stop(rt_model_t *m)
 {
    m->force_stop = true;
@@ -2647,8 +4529,33 @@ void model_set_timeout_cb(rt_model_t *m, uint64_t when, timeout_fn_t fn,
    e->timeout.fn   = fn;
    e->timeout.user = user;
 
-   assert(when > m->now);   // TODO: delta timeouts?
-   heap_insert(m->eventq_heap, e->when, e);
+   assert(when > 0);   // TODO: delta timeouts?
+   wheel_insert(m->eventq, e->when, e);
+}
+
+static rt_watch_t *new_watch(rt_model_t *m, rt_signal_t *s, sig_event_fn_t fn,
+                             void *user, bool postponed)
+{
+   rt_watch_t *w = rt_alloc(m->watch_stack);
+   w->signal    = s;
+   w->fn        = fn;
+   w->chain_all = m->watches;
+   w->user_data = user;
+   w->dirty_map = NULL;
+   w->dirty_bit = 0;
+
+   w->wakeable.kind       = W_WATCH;
+   w->wakeable.postponed  = postponed;
+   w->wakeable.pending    = false;
+   w->wakeable.wakeup_gen = 0;
+
+   m->watches = w;
+
+   rt_nexus_t *n = &(w->signal->nexus);
+   for (int i = 0; i < s->n_nexus; i++, n = n->chain)
+      sched_event(m, get_net(m, n), &(w->wakeable), false);
+
+   return w;
 }
 
 rt_watch_t *model_set_event_cb(rt_model_t *m, rt_signal_t *s, sig_event_fn_t fn,
@@ -2665,26 +4572,18 @@ rt_watch_t *model_set_event_cb(rt_model_t *m, rt_signal_t *s, sig_event_fn_t fn,
 
       return NULL;
    }
-   else {
-      rt_watch_t *w = rt_alloc(m->watch_stack);
-      w->signal    = s;
-      w->fn        = fn;
-      w->chain_all = m->watches;
-      w->user_data = user;
-
-      w->wakeable.kind       = W_WATCH;
-      w->wakeable.postponed  = postponed;
-      w->wakeable.pending    = false;
-      w->wakeable.wakeup_gen = 0;
-
-      m->watches = w;
+   else
+      return new_watch(m, s, fn, user, postponed);
+}
 
-      rt_nexus_t *n = &(w->signal->nexus);
-      for (int i = 0; i < s->n_nexus; i++, n = n->chain)
-         sched_event(m, get_net(m, n), &(w->wakeable), false);
+rt_watch_t *model_set_dirty_bit(rt_model_t *m, rt_signal_t *s, uint64_t *map,
+                                unsigned bit)
+{
+   rt_watch_t *w = new_watch(m, s, NULL, NULL, false);
+   w->dirty_map = map;
+   w->dirty_bit = bit;
 
-      return w;
-   }
+   return w;
 }
 
 void model_interrupt(rt_model_t *m)
@@ -2763,6 +4662,11 @@ void x_drive_signal(sig_shared_t *ss, uint32_t offset, int32_t count)
    }
 }
 
+void x_claim_cover(int32_t n_stmts, int32_t n_branches)
+{
+   claim_cover_shard(get_model(), n_stmts, n_branches);
+}
+
 int64_t x_now(void)
 {
    return __model ? __model->now : 0;
@@ -2789,8 +4693,11 @@ void x_sched_waveform_s(sig_shared_t *ss, uint32_t offset, uint64_t scalar,
          trace_time(reject));
 
    check_postponed(after);
+   check_reject_limit(s, after, reject);
 
    rt_model_t *m = get_model();
+   MODEL_LOCK(m);
+
    rt_nexus_t *n = split_nexus(m, s, offset, 1);
 
    rt_value_t value = alloc_value(m, n);
@@ -2809,8 +4716,11 @@ void x_sched_waveform(sig_shared_t *ss, uint32_t offset, void *values,
          count, trace_time(after), trace_time(reject));
 
    check_postponed(after);
+   check_reject_limit(s, after, reject);
 
    rt_model_t *m = get_model();
+   MODEL_LOCK(m);
+
    rt_nexus_t *n = split_nexus(m, s, offset, count);
    char *vptr = values;
    for (; count > 0; n = n->chain) {
@@ -2834,6 +4744,8 @@ int32_t x_test_net_event(sig_shared_t *ss, uint32_t offset, int32_t count)
          istr(tree_ident(s->where)), offset, count);
 
    rt_model_t *m = get_model();
+   MODEL_LOCK(m);
+
    rt_nexus_t *n = split_nexus(m, s, offset, count);
    for (; count > 0; n = n->chain) {
       rt_net_t *net = get_net(m, n);
@@ -2855,6 +4767,8 @@ int32_t x_test_net_active(sig_shared_t *ss, uint32_t offset, int32_t count)
          istr(tree_ident(s->where)), offset, count);
 
    rt_model_t *m = get_model();
+   MODEL_LOCK(m);
+
    rt_nexus_t *n = split_nexus(m, s, offset, count);
    for (; count > 0; n = n->chain) {
       rt_net_t *net = get_net(m, n);
@@ -2884,9 +4798,19 @@ void x_sched_event(sig_shared_t *ss, uint32_t offset, int32_t count,
       wake = &(active_proc->wakeable);
 
    rt_model_t *m = get_model();
+   MODEL_LOCK(m);
+
    rt_nexus_t *n = split_nexus(m, s, offset, count);
    for (; count > 0; n = n->chain) {
-      sched_event(m, get_net(m, n), wake, oneshot);
+      if (unlikely(m->parallel_phase))
+         defer_action((rt_deferred_t){
+               .kind    = DEFER_EVENT,
+               .nexus   = n,
+               .wake    = wake,
+               .oneshot = oneshot
+            });
+      else
+         sched_event(m, get_net(m, n), wake, oneshot);
 
       count -= n->width;
       assert(count >= 0);
@@ -2929,6 +4853,8 @@ int64_t x_last_event(sig_shared_t *ss, uint32_t offset, int32_t count)
    int64_t last = TIME_HIGH;
 
    rt_model_t *m = get_model();
+   MODEL_LOCK(m);
+
    rt_nexus_t *n = split_nexus(m, s, offset, count);
    for (; count > 0; n = n->chain) {
       rt_net_t *net = get_net(m, n);
@@ -2952,6 +4878,8 @@ int64_t x_last_active(sig_shared_t *ss, uint32_t offset, int32_t count)
    int64_t last = TIME_HIGH;
 
    rt_model_t *m = get_model();
+   MODEL_LOCK(m);
+
    rt_nexus_t *n = split_nexus(m, s, offset, count);
    for (; count > 0; n = n->chain) {
       rt_net_t *net = get_net(m, n);
@@ -3133,19 +5061,23 @@ bool x_driving(sig_shared_t *ss, uint32_t offset, int32_t count)
    int ntotal = 0, ndriving = 0;
    bool found = false;
    rt_model_t *m = get_model();
-   rt_nexus_t *n = split_nexus(m, s, offset, count);
-   for (; count > 0; n = n->chain) {
-      if (n->n_sources > 0) {
-         rt_source_t *src = find_driver(n);
-         if (src != NULL) {
-            if (!src->disconnected) ndriving++;
-            found = true;
+   {
+      MODEL_LOCK(m);
+
+      rt_nexus_t *n = split_nexus(m, s, offset, count);
+      for (; count > 0; n = n->chain) {
+         if (n->n_sources > 0) {
+            rt_source_t *src = find_driver(n);
+            if (src != NULL) {
+               if (!src->disconnected) ndriving++;
+               found = true;
+            }
          }
-      }
 
-      ntotal++;
-      count -= n->width;
-      assert(count >= 0);
+         ntotal++;
+         count -= n->width;
+         assert(count >= 0);
+      }
    }
 
    if (!found)
@@ -3165,22 +5097,32 @@ void *x_driving_value(sig_shared_t *ss, uint32_t offset, int32_t count)
    void *result = local_alloc(s->shared.size);
 
    uint8_t *p = result;
+   bool missing = false;
    rt_model_t *m = get_model();
-   rt_nexus_t *n = split_nexus(m, s, offset, count);
-   for (; count > 0; n = n->chain) {
-      rt_source_t *src = find_driver(n);
-      if (src == NULL)
-         jit_msg(NULL, DIAG_FATAL, "process %s does not contain a driver "
-                 "for %s", istr(active_proc->name), istr(tree_ident(s->where)));
+   {
+      MODEL_LOCK(m);
+
+      rt_nexus_t *n = split_nexus(m, s, offset, count);
+      for (; count > 0; n = n->chain) {
+         rt_source_t *src = find_driver(n);
+         if (src == NULL) {
+            missing = true;
+            break;
+         }
 
-      memcpy(p, value_ptr(n, &(src->u.driver.waveforms.value)),
-             n->width * n->size);
-      p += n->width * n->size;
+         memcpy(p, value_ptr(n, &(src->u.driver.waveforms.value)),
+                n->width * n->size);
+         p += n->width * n->size;
 
-      count -= n->width;
-      assert(count >= 0);
+         count -= n->width;
+         assert(count >= 0);
+      }
    }
 
+   if (missing)
+      jit_msg(NULL, DIAG_FATAL, "process %s does not contain a driver "
+              "for %s", istr(active_proc->name), istr(tree_ident(s->where)));
+
    return result;
 }
 
@@ -3225,6 +5167,8 @@ void x_disconnect(sig_shared_t *ss, uint32_t offset, int32_t count,
    check_postponed(after);
 
    rt_model_t *m = get_model();
+   MODEL_LOCK(m);
+
    rt_nexus_t *n = split_nexus(m, s, offset, count);
    for (; count > 0; n = n->chain) {
       count -= n->width;
@@ -3244,6 +5188,8 @@ void x_force(sig_shared_t *ss, uint32_t offset, int32_t count, void *values)
    check_postponed(0);
 
    rt_model_t *m = get_model();
+   MODEL_LOCK(m);
+
    rt_nexus_t *n = split_nexus(m, s, offset, count);
    char *vptr = values;
    for (; count > 0; n = n->chain) {
@@ -3272,6 +5218,8 @@ void x_release(sig_shared_t *ss, uint32_t offset, int32_t count)
    check_postponed(0);
 
    rt_model_t *m = get_model();
+   MODEL_LOCK(m);
+
    rt_nexus_t *n = split_nexus(m, s, offset, count);
    for (; count > 0; n = n->chain) {
       count -= n->width;
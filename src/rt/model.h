@@ -27,13 +27,19 @@ void model_reset(rt_model_t *m);
 void model_run(rt_model_t *m, uint64_t stop_time);
 bool model_can_create_delta(rt_model_t *m);
 int64_t model_now(rt_model_t *m, unsigned *deltas);
+int model_exit_status(rt_model_t *m);
 void model_stop(rt_model_t *m);
 void model_interrupt(rt_model_t *m);
+void model_checkpoint(rt_model_t *m, uint64_t when, const char *file);
+void model_restore(rt_model_t *m, const char *file);
+void model_reload_options(rt_model_t *m);
 
 void model_set_global_cb(rt_model_t *m, rt_event_t event, rt_event_fn_t fn,
                          void *user);
 rt_watch_t *model_set_event_cb(rt_model_t *m, rt_signal_t *s, sig_event_fn_t fn,
                                void *user, bool postponed);
+rt_watch_t *model_set_dirty_bit(rt_model_t *m, rt_signal_t *s, uint64_t *map,
+                                unsigned bit);
 void model_set_timeout_cb(rt_model_t *m, uint64_t when, timeout_fn_t fn,
                           void *user);
 
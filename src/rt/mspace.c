@@ -19,9 +19,11 @@
 #include "array.h"
 #include "cpustate.h"
 #include "diag.h"
+#include "fbuf.h"
 #include "mask.h"
 #include "opt.h"
 #include "rt/mspace.h"
+#include "thread.h"
 
 #include <assert.h>
 #include <stdlib.h>
@@ -57,6 +59,11 @@ typedef struct {
    work_list_t worklist;
 } gc_state_t;
 
+typedef struct {
+   intptr_t *top;
+   intptr_t *limit;
+} stack_range_t;
+
 typedef struct _free_list free_list_t;
 
 struct _free_list {
@@ -65,6 +72,12 @@ struct _free_list {
    size_t       size;
 };
 
+struct _mspace_image {
+   size_t      used;
+   uint64_t    layout;
+   char       *space;
+};
+
 struct _mspace {
    size_t           maxsize;
    unsigned         maxlines;
@@ -77,14 +90,22 @@ struct _mspace {
    uint64_t         create_us;
    unsigned         total_gc;
    unsigned         num_cycles;
+   nvc_lock_t       lock;
+   int              mutators;
+   int              nparked;
+   unsigned         epoch;
+   stack_range_t    parked[MAX_THREADS];
+   bool             zero_padding;
 #ifdef DEBUG
    bool             stress;
 #endif
 };
 
 static __thread intptr_t *stack_limit = NULL;
+static __thread bool      is_mutator = false;
 
 static void mspace_gc(mspace_t *m);
+static void mspace_stop_world_gc(mspace_t *m);
 static bool is_mspace_ptr(mspace_t *m, char *p);
 
 mspace_t *mspace_new(size_t size)
@@ -158,8 +179,10 @@ void *mspace_alloc(mspace_t *m, size_t size)
    if (size == 0)
       return NULL;
 
+   nvc_lock(&(m->lock));
+
 #ifdef DEBUG
-   if (m->stress)
+   if (m->stress && m->mutators == 0)
       mspace_gc(m);
 #endif
 
@@ -197,13 +220,25 @@ void *mspace_alloc(mspace_t *m, size_t size)
             // allocate THP on Linux
             *(volatile char *)base = 0;
 
+            if (m->zero_padding) {
+               MSPACE_UNPOISON(base + size, asize - size);
+               memset(base + size, '\0', asize - size);
+               MSPACE_POISON(base + size, asize - size);
+            }
+
+            nvc_unlock(&(m->lock));
             return base;
          }
       }
 
-      mspace_gc(m);
+      if (m->mutators > 0)
+         mspace_stop_world_gc(m);
+      else
+         mspace_gc(m);
    } while (retry--);
 
+   nvc_unlock(&(m->lock));
+
    if (m->oomfn) {
       (*m->oomfn)(m, size);
       return NULL;
@@ -221,6 +256,8 @@ static void mspace_return_memory(mspace_t *m, char *ptr, size_t size)
    const int nlines = (size + LINE_SIZE) / LINE_SIZE;
    const size_t asize = nlines * LINE_SIZE;
 
+   SCOPED_LOCK(m->lock);
+
    free_list_t **tail;
    for (tail = &(m->free_list); *tail; tail = &((*tail)->next)) {
       if ((*tail)->ptr + (*tail)->size == ptr) {
@@ -266,8 +303,39 @@ void mspace_set_oom_handler(mspace_t *m, mspace_oom_fn_t fn)
    m->oomfn = fn;
 }
 
+void mspace_set_zero_padding(mspace_t *m, bool zero)
+{
+   // The checkpoint writer visits every element up to the end of the
+   // last line of an object so the padding must not hold stale data
+   SCOPED_LOCK(m->lock);
+   m->zero_padding = zero;
+}
+
+void mspace_mutator_enter(mspace_t *m)
+{
+   // The calling thread may now hold references to heap objects while
+   // running concurrently with other mutator threads
+   assert(!is_mutator);
+   is_mutator = true;
+
+   SCOPED_LOCK(m->lock);
+   m->mutators++;
+}
+
+void mspace_mutator_leave(mspace_t *m)
+{
+   assert(is_mutator);
+   is_mutator = false;
+
+   SCOPED_LOCK(m->lock);
+   assert(m->mutators > 0);
+   m->mutators--;
+}
+
 mptr_t mptr_new(mspace_t *m, const char *name)
 {
+   SCOPED_LOCK(m->lock);
+
    mptr_t ptr;
    if (m->free_mptrs != NULL) {
       ptr = m->free_mptrs;
@@ -294,6 +362,8 @@ void mptr_free(mspace_t *m, mptr_t *ptr)
    if (*ptr == MPTR_INVALID)
       return;
 
+   SCOPED_LOCK(m->lock);
+
    if ((*ptr)->next != NULL)
       (*ptr)->next->prev = (*ptr)->prev;
 
@@ -334,6 +404,21 @@ void tlab_acquire(mspace_t *m, tlab_t *t)
    *mptr_get(t->mptr) = t->base;
 }
 
+void tlab_adopt(mspace_t *m, tlab_t *t, void *base, size_t used)
+{
+   // Take ownership of an existing TLAB after the heap is restored
+   assert(!tlab_valid(*t));
+   assert(is_mspace_ptr(m, base));
+
+   t->mspace = m;
+   t->base   = base;
+   t->limit  = t->base + TLAB_SIZE;
+   t->alloc  = t->base + used;
+   t->mptr   = mptr_new(m, "tlab");
+
+   *mptr_get(t->mptr) = t->base;
+}
+
 void tlab_release(tlab_t *t)
 {
    if (!tlab_valid(*t))
@@ -424,6 +509,17 @@ static void mspace_gc(mspace_t *m)
    for (intptr_t *p = stack_top; p < stack_limit; p++)
       mspace_mark_root(m, *p, &state);
 
+   // Also scan the stacks of any other threads stopped waiting for
+   // this collection to complete
+   for (int i = 0; i < MAX_THREADS; i++) {
+      const stack_range_t *r = &(m->parked[i]);
+      if (r->top == NULL)
+         continue;
+
+      for (intptr_t *p = r->top; p < r->limit; p++)
+         mspace_mark_root(m, *p, &state);
+   }
+
    while (state.worklist.count > 0) {
       const uint64_t enc = APOP(state.worklist);
       const int line = enc >> 32;
@@ -489,6 +585,78 @@ static void mspace_gc(mspace_t *m)
    ACLEAR(state.worklist);
 }
 
+__attribute__((noinline))
+static void mspace_stop_world_gc(mspace_t *m)
+{
+   // Other mutator threads may have references to heap objects on
+   // their stacks or in registers so wait until they are all blocked
+   // here before collecting
+
+   if (!is_mutator)
+      fatal_trace("GC requested by non-mutator thread");
+
+   struct cpu_state cpu;
+   capture_registers(&cpu);
+
+   const int id = thread_id();
+   assert(m->parked[id].top == NULL);
+
+   // The register state is on the stack below the frame of the caller
+   m->parked[id].top   = (intptr_t *)cpu.sp;
+   m->parked[id].limit = stack_limit;
+   m->nparked++;
+
+   const unsigned epoch = m->epoch;
+   while (m->epoch == epoch && m->nparked < m->mutators) {
+      nvc_unlock(&(m->lock));
+      spin_wait();
+      nvc_lock(&(m->lock));
+   }
+
+   if (m->epoch == epoch) {
+      // The last thread to stop performs the collection
+      mspace_gc(m);
+      m->epoch++;
+   }
+
+   m->parked[id].top = m->parked[id].limit = NULL;
+   m->nparked--;
+}
+
+__attribute__((noinline))
+void mspace_safepoint_lock(mspace_t *m, nvc_lock_t *lock)
+{
+   // The owner of the lock may be waiting for this thread to stop for
+   // a collection so allow the GC to scan our stack while blocked
+
+   if (!is_mutator) {
+      nvc_lock(lock);
+      return;
+   }
+
+   struct cpu_state cpu;
+   capture_registers(&cpu);
+
+   const int id = thread_id();
+
+   {
+      SCOPED_LOCK(m->lock);
+
+      assert(m->parked[id].top == NULL);
+      m->parked[id].top   = (intptr_t *)cpu.sp;
+      m->parked[id].limit = stack_limit;
+      m->nparked++;
+   }
+
+   nvc_lock(lock);
+
+   // Cannot continue until any collection in progress has finished
+   SCOPED_LOCK(m->lock);
+
+   m->parked[id].top = m->parked[id].limit = NULL;
+   m->nparked--;
+}
+
 void *mspace_find(mspace_t *m, void *ptr, size_t *size)
 {
    if (!is_mspace_ptr(m, ptr)) {
@@ -509,3 +677,173 @@ void *mspace_find(mspace_t *m, void *ptr, size_t *size)
    *size = objlen * LINE_SIZE;
    return m->space + line * LINE_SIZE;
 }
+
+ptrdiff_t mspace_offset(mspace_t *m, const void *ptr)
+{
+   if (is_mspace_ptr(m, (char *)ptr))
+      return (char *)ptr - m->space;
+   else
+      return -1;
+}
+
+void *mspace_pointer(mspace_t *m, ptrdiff_t offset)
+{
+   assert(offset >= 0 && offset < m->maxsize);
+   return m->space + offset;
+}
+
+static uint64_t *mask_words(bit_mask_t *mask)
+{
+   return mask->size > 64 ? mask->ptr : &(mask->bits);
+}
+
+static uint64_t mspace_layout_hash(mspace_t *m)
+{
+   // A saved heap can only be restored if every object is in exactly
+   // the same place as when the base image was taken
+   const size_t nwords = (m->maxlines + 63) / 64;
+   const uint64_t *words = mask_words(&(m->headmask));
+
+   uint64_t hash = UINT64_C(0xcbf29ce484222325);
+   for (size_t i = 0; i < nwords; i++)
+      hash = (hash ^ words[i]) * UINT64_C(0x100000001b3);
+
+   return hash;
+}
+
+__attribute__((no_sanitize_address))
+mspace_image_t *mspace_image_new(mspace_t *m)
+{
+   SCOPED_LOCK(m->lock);
+
+   // Allocation is first-fit so everything above the start of the free
+   // block at the end of the heap has never been used
+   size_t used = m->maxsize;
+   for (free_list_t *it = m->free_list; it; it = it->next) {
+      if (it->ptr + it->size == m->space + m->maxsize)
+         used = it->ptr - m->space;
+   }
+
+   mspace_image_t *img = xcalloc(sizeof(mspace_image_t));
+   img->used   = used;
+   img->layout = mspace_layout_hash(m);
+   img->space  = xmalloc(MAX(used, 1));
+
+   memcpy(img->space, m->space, used);
+
+   return img;
+}
+
+void mspace_image_free(mspace_image_t *img)
+{
+   free(img->space);
+   free(img);
+}
+
+__attribute__((no_sanitize_address))
+void mspace_save(mspace_t *m, const mspace_image_t *base, fbuf_t *f,
+                 mspace_put_fn_t fn, void *ctx)
+{
+   assert(m->mutators == 0);
+
+   write_u64(m->maxsize, f);
+   write_u64(base->layout, f);
+
+   const size_t nwords = (m->maxlines + 63) / 64;
+   write_raw(mask_words(&(m->headmask)), nwords * sizeof(uint64_t), f);
+
+   bit_mask_t freemask;
+   mask_init(&freemask, m->maxlines);
+
+   int nfree = 0;
+   for (free_list_t *it = m->free_list; it; it = it->next, nfree++)
+      mask_set_range(&freemask, (it->ptr - m->space) / LINE_SIZE,
+                     it->size / LINE_SIZE);
+
+   fbuf_put_uint(f, nfree);
+   for (free_list_t *it = m->free_list; it; it = it->next) {
+      fbuf_put_uint(f, it->ptr - m->space);
+      fbuf_put_uint(f, it->size);
+   }
+
+   // Only words in allocated lines which differ from the base image
+   // are saved and each is prefixed with the distance from the last
+   const uintptr_t *words = (uintptr_t *)m->space;
+   const uintptr_t *old = (uintptr_t *)base->space;
+   const size_t nbase = base->used / sizeof(uintptr_t);
+
+   size_t last = 0;
+   for (int line = 0; line < m->maxlines; line++) {
+      if (mask_test(&freemask, line))
+         continue;
+
+      for (int i = 0; i < LINE_WORDS; i++) {
+         const size_t w = line * LINE_WORDS + i;
+         if (w < nbase && words[w] == old[w])
+            continue;
+
+         fbuf_put_uint(f, w - last + 1);
+         (*fn)(&(words[w]), f, ctx);
+         last = w;
+      }
+   }
+
+   fbuf_put_uint(f, 0);
+
+   mask_free(&freemask);
+}
+
+void mspace_restore(mspace_t *m, fbuf_t *f, mspace_get_fn_t fn, void *ctx)
+{
+   // Not locked as the callback may need to allocate
+   assert(m->mutators == 0);
+
+   if (read_u64(f) != m->maxsize)
+      fatal("%s was saved with a different heap size",
+            fbuf_file_name(f));
+
+   if (read_u64(f) != mspace_layout_hash(m))
+      fatal("%s: heap layout does not match the current design",
+            fbuf_file_name(f));
+
+   const size_t nwords = (m->maxlines + 63) / 64;
+   read_raw(mask_words(&(m->headmask)), nwords * sizeof(uint64_t), f);
+
+   for (free_list_t *it = m->free_list, *tmp; it; it = tmp) {
+      tmp = it->next;
+      free(it);
+   }
+   m->free_list = NULL;
+
+   MSPACE_UNPOISON(m->space, m->maxsize);
+
+   const int nfree = fbuf_get_uint(f);
+   free_list_t **tail = &(m->free_list);
+   for (int i = 0; i < nfree; i++) {
+      free_list_t *fl = xmalloc(sizeof(free_list_t));
+      fl->next = NULL;
+      fl->ptr  = m->space + fbuf_get_uint(f);
+      fl->size = fbuf_get_uint(f);
+
+      if (!is_mspace_ptr(m, fl->ptr) || fl->size % LINE_SIZE != 0)
+         fatal("%s: corrupt heap free list", fbuf_file_name(f));
+
+      MSPACE_POISON(fl->ptr, fl->size);
+
+      *tail = fl;
+      tail = &(fl->next);
+   }
+
+   uintptr_t *words = (uintptr_t *)m->space;
+   const size_t maxwords = m->maxsize / sizeof(uintptr_t);
+
+   size_t last = 0, gap;
+   while ((gap = fbuf_get_uint(f))) {
+      const size_t w = last + gap - 1;
+      if (w >= maxwords)
+         fatal("%s: corrupt heap image", fbuf_file_name(f));
+
+      words[w] = (*fn)(f, ctx);
+      last = w;
+   }
+}
@@ -19,11 +19,16 @@
 #define _RT_MSPACE_H
 
 #include "prim.h"
+#include "thread.h"
 
 #define MPTR_INVALID NULL
 typedef struct _mptr *mptr_t;
 
 typedef void (*mspace_oom_fn_t)(mspace_t *, size_t);
+typedef void (*mspace_put_fn_t)(const uintptr_t *, fbuf_t *, void *);
+typedef uintptr_t (*mspace_get_fn_t)(fbuf_t *, void *);
+
+typedef struct _mspace_image mspace_image_t;
 
 #define TLAB_SIZE (64 * 1024)
 
@@ -55,9 +60,22 @@ void *mspace_alloc(mspace_t *m, size_t size);
 void *mspace_alloc_array(mspace_t *m, int nelems, size_t size);
 void *mspace_alloc_flex(mspace_t *m, size_t fixed, int nelems, size_t size);
 void mspace_set_oom_handler(mspace_t *m, mspace_oom_fn_t fn);
+void mspace_set_zero_padding(mspace_t *m, bool zero);
+void mspace_mutator_enter(mspace_t *m);
+void mspace_mutator_leave(mspace_t *m);
+void mspace_safepoint_lock(mspace_t *m, nvc_lock_t *lock);
 void *mspace_find(mspace_t *m, void *ptr, size_t *size);
+ptrdiff_t mspace_offset(mspace_t *m, const void *ptr);
+void *mspace_pointer(mspace_t *m, ptrdiff_t offset);
+
+mspace_image_t *mspace_image_new(mspace_t *m);
+void mspace_image_free(mspace_image_t *img);
+void mspace_save(mspace_t *m, const mspace_image_t *base, fbuf_t *f,
+                 mspace_put_fn_t fn, void *ctx);
+void mspace_restore(mspace_t *m, fbuf_t *f, mspace_get_fn_t fn, void *ctx);
 
 void tlab_acquire(mspace_t *m, tlab_t *t);
+void tlab_adopt(mspace_t *m, tlab_t *t, void *base, size_t used);
 void tlab_release(tlab_t *t);
 void *tlab_alloc(tlab_t *t, size_t size);
 
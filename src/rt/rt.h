@@ -23,7 +23,7 @@
 
 #include <stdint.h>
 
-#define RT_ABI_VERSION 7
+#define RT_ABI_VERSION 8
 #define RT_ALIGN_MASK  0x7
 
 #define TIME_HIGH INT64_MAX  // Value of TIME'HIGH
@@ -44,6 +44,7 @@ typedef enum {
    R_MEMO      = (1 << 0),
    R_IDENT     = (1 << 1),
    R_COMPOSITE = (1 << 2),
+   R_FOLD      = (1 << 3),
 } res_flags_t;
 
 typedef enum {
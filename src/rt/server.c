@@ -0,0 +1,358 @@
+//
+//  Copyright (C) 2022  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "util.h"
+#include "rt/server.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if !defined __CYGWIN__ && !defined __MINGW32__
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#endif
+
+//
+// Fork server: the parent process elaborates and initialises the
+// design once then forks a copy-on-write child for each request
+// received on a Unix domain socket.  A request consists of the
+// client's standard input, output and error file descriptors, its
+// working directory, and the run command line.  The child replies
+// with the exit status of the simulation.
+//
+
+#define SERVER_MAGIC 0x5356564e   // NVVS
+#define MAX_REQUEST  0x100000
+
+typedef struct {
+   uint32_t magic;
+   uint32_t length;
+} request_header_t;
+
+#if !defined __CYGWIN__ && !defined __MINGW32__
+
+static int reply_fd = -1;
+
+static void make_address(const char *path, struct sockaddr_un *addr)
+{
+   memset(addr, '\0', sizeof(struct sockaddr_un));
+   addr->sun_family = AF_UNIX;
+
+   if (strlen(path) >= sizeof(addr->sun_path))
+      fatal("socket path %s is too long", path);
+
+   strcpy(addr->sun_path, path);
+}
+
+static void write_all(int fd, const void *buf, size_t len)
+{
+   for (const char *p = buf; len > 0; ) {
+      const ssize_t n = write(fd, p, len);
+      if (n < 0 && errno == EINTR)
+         continue;
+      else if (n <= 0)
+         fatal_errno("write");
+
+      p += n;
+      len -= n;
+   }
+}
+
+static bool read_all(int fd, void *buf, size_t len)
+{
+   for (char *p = buf; len > 0; ) {
+      const ssize_t n = read(fd, p, len);
+      if (n < 0 && errno == EINTR)
+         continue;
+      else if (n < 0)
+         fatal_errno("read");
+      else if (n == 0)
+         return false;
+
+      p += n;
+      len -= n;
+   }
+
+   return true;
+}
+
+static void reap_children(void)
+{
+   int status;
+   while (waitpid(-1, &status, WNOHANG) > 0)
+      ;
+}
+
+static void receive_request(int fd, int *argc, char ***argv)
+{
+   request_header_t hdr;
+   int fds[3];
+
+   struct iovec iov = {
+      .iov_base = &hdr,
+      .iov_len  = sizeof(hdr),
+   };
+
+   union {
+      char           buf[CMSG_SPACE(sizeof(fds))];
+      struct cmsghdr align;
+   } control;
+
+   struct msghdr msg = {
+      .msg_iov        = &iov,
+      .msg_iovlen     = 1,
+      .msg_control    = control.buf,
+      .msg_controllen = sizeof(control.buf),
+   };
+
+   ssize_t n;
+   do {
+      n = recvmsg(fd, &msg, MSG_WAITALL);
+   } while (n < 0 && errno == EINTR);
+
+   if (n < 0)
+      fatal_errno("recvmsg");
+   else if (n == 0)
+      _exit(EXIT_SUCCESS);   // Probe from server_listen in another process
+   else if (n != sizeof(hdr) || hdr.magic != SERVER_MAGIC)
+      fatal("invalid request received by server");
+   else if (hdr.length == 0 || hdr.length > MAX_REQUEST)
+      fatal("request length %u is invalid", hdr.length);
+
+   struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+   if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET
+       || cmsg->cmsg_type != SCM_RIGHTS
+       || cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+      fatal("request does not contain standard file descriptors");
+
+   memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+   char *body = xmalloc(hdr.length + 1);
+   if (!read_all(fd, body, hdr.length))
+      fatal("truncated request received by server");
+
+   body[hdr.length] = '\0';
+
+   // The simulation output goes to the client's terminal or log file
+   fflush(stdout);
+   fflush(stderr);
+
+   for (int i = 0; i < 3; i++) {
+      if (dup2(fds[i], i) < 0)
+         fatal_errno("dup2");
+      close(fds[i]);
+   }
+
+   // Body is the working directory followed by the arguments each
+   // terminated with a NUL character
+   const char *cwd = body;
+   if (chdir(cwd) != 0)
+      fatal_errno("cannot change directory to %s", cwd);
+
+   int nargs = 0;
+   for (const char *p = body; p < body + hdr.length; p += strlen(p) + 1)
+      nargs++;
+
+   char **args = xcalloc_array(nargs + 1, sizeof(char *));
+   args[0] = body;   // Replaces program name
+   for (int i = 1; i < nargs; i++)
+      args[i] = args[i - 1] + strlen(args[i - 1]) + 1;
+
+   *argc = nargs;
+   *argv = args;
+}
+
+void server_listen(const char *path, int *argc, char ***argv)
+{
+   struct sockaddr_un addr;
+   make_address(path, &addr);
+
+   int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (sock < 0)
+      fatal_errno("socket");
+
+   // Remove a stale socket left behind by a previous server but not
+   // one that is still accepting connections
+   struct stat st;
+   if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+      int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+      if (probe < 0)
+         fatal_errno("socket");
+
+      const int rc = connect(probe, (struct sockaddr *)&addr, sizeof(addr));
+      const int error = errno;
+      close(probe);
+
+      if (rc < 0 && error == ECONNREFUSED)
+         unlink(path);
+      else
+         fatal("server already running on %s", path);
+   }
+
+   if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+      fatal_errno("cannot bind to %s", path);
+
+   if (listen(sock, SOMAXCONN) < 0)
+      fatal_errno("listen");
+
+   notef("waiting for requests on %s", path);
+
+   for (;;) {
+      int conn = accept(sock, NULL, NULL);
+      if (conn < 0) {
+         if (errno == EINTR || errno == ECONNABORTED)
+            continue;
+
+         fatal_errno("accept");
+      }
+
+      reap_children();
+
+      fflush(stdout);
+      fflush(stderr);
+
+      const pid_t pid = fork();
+      if (pid < 0)
+         fatal_errno("fork");
+      else if (pid == 0) {
+         close(sock);
+
+         reply_fd = conn;
+         receive_request(conn, argc, argv);
+         return;
+      }
+
+      close(conn);
+   }
+}
+
+void server_reply(int status)
+{
+   assert(reply_fd != -1);
+
+   fflush(stdout);
+   fflush(stderr);
+
+   const int32_t word = status;
+   write_all(reply_fd, &word, sizeof(word));
+
+   close(reply_fd);
+   reply_fd = -1;
+}
+
+int server_request(const char *path, int argc, char **argv)
+{
+   struct sockaddr_un addr;
+   make_address(path, &addr);
+
+   int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (sock < 0)
+      fatal_errno("socket");
+
+   if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+      fatal_errno("cannot connect to %s", path);
+
+   char cwd[PATH_MAX];
+   if (getcwd(cwd, sizeof(cwd)) == NULL)
+      fatal_errno("getcwd");
+
+   size_t length = strlen(cwd) + 1;
+   for (int i = 0; i < argc; i++)
+      length += strlen(argv[i]) + 1;
+
+   if (length > MAX_REQUEST)
+      fatal("too many arguments for server request");
+
+   char *body LOCAL = xmalloc(length), *p = body;
+   p = stpcpy(p, cwd) + 1;
+   for (int i = 0; i < argc; i++)
+      p = stpcpy(p, argv[i]) + 1;
+
+   assert(p == body + length);
+
+   request_header_t hdr = {
+      .magic  = SERVER_MAGIC,
+      .length = length,
+   };
+
+   struct iovec iov = {
+      .iov_base = &hdr,
+      .iov_len  = sizeof(hdr),
+   };
+
+   const int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+
+   union {
+      char           buf[CMSG_SPACE(sizeof(fds))];
+      struct cmsghdr align;
+   } control;
+   memset(&control, '\0', sizeof(control));
+
+   struct msghdr msg = {
+      .msg_iov        = &iov,
+      .msg_iovlen     = 1,
+      .msg_control    = control.buf,
+      .msg_controllen = sizeof(control.buf),
+   };
+
+   struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+   cmsg->cmsg_level = SOL_SOCKET;
+   cmsg->cmsg_type  = SCM_RIGHTS;
+   cmsg->cmsg_len   = CMSG_LEN(sizeof(fds));
+   memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+   fflush(stdout);
+   fflush(stderr);
+
+   if (sendmsg(sock, &msg, 0) != sizeof(hdr))
+      fatal_errno("sendmsg");
+
+   write_all(sock, body, length);
+
+   // The server closes the connection without a reply if the child
+   // process exits early, for example after a fatal error
+   int32_t status;
+   if (!read_all(sock, &status, sizeof(status)))
+      status = EXIT_FAILURE;
+
+   close(sock);
+   return status;
+}
+
+#else  // __CYGWIN__ || __MINGW32__
+
+void server_listen(const char *path, int *argc, char ***argv)
+{
+   fatal("server mode is not supported on this platform");
+}
+
+void server_reply(int status)
+{
+}
+
+int server_request(const char *path, int argc, char **argv)
+{
+   fatal("server mode is not supported on this platform");
+}
+
+#endif  // __CYGWIN__ || __MINGW32__
@@ -0,0 +1,27 @@
+//
+//  Copyright (C) 2022  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef _SERVER_H
+#define _SERVER_H
+
+#include "prim.h"
+
+void server_listen(const char *path, int *argc, char ***argv);
+void server_reply(int status);
+int server_request(const char *path, int argc, char **argv);
+
+#endif  // _SERVER_H
@@ -19,6 +19,7 @@
 #define _RT_STRUCTS_H
 
 #include "prim.h"
+#include "array.h"
 #include "jit/jit.h"
 #include "jit/jit-ffi.h"
 #include "rt/mspace.h"
@@ -39,15 +40,37 @@ typedef struct {
    bool            postponed;
 } rt_wakeable_t;
 
+typedef enum {
+   DEFER_PROCESS,
+   DEFER_DRIVER,
+   DEFER_FORCE_RELEASE,
+   DEFER_DISCONNECT,
+   DEFER_EVENT,
+} defer_kind_t;
+
+// Side effect of a process running concurrently with others which is
+// applied later by the main thread in a deterministic order
+typedef struct {
+   defer_kind_t   kind;
+   bool           oneshot;
+   uint64_t       delta;
+   rt_nexus_t    *nexus;
+   rt_source_t   *source;
+   rt_wakeable_t *wake;
+} rt_deferred_t;
+
 typedef struct _rt_proc {
-   rt_wakeable_t  wakeable;
-   tree_t         where;
-   ident_t        name;
-   jit_handle_t   handle;
-   tlab_t         tlab;
-   rt_scope_t    *scope;
-   rt_proc_t     *chain;
-   mptr_t         privdata;
+   rt_wakeable_t     wakeable;
+   tree_t            where;
+   ident_t           name;
+   jit_handle_t      handle;
+   tlab_t            tlab;
+   rt_scope_t       *scope;
+   rt_proc_t        *chain;
+   mptr_t            privdata;
+   A(rt_deferred_t)  deferred;
+   uint64_t          profile_runs;
+   uint64_t          profile_ns;
 } rt_proc_t;
 
 typedef enum {
@@ -67,6 +90,8 @@ typedef struct {
    rt_source_t  *source;
 } event_driver_t;
 
+typedef A(event_driver_t) driver_list_t;
+
 typedef struct {
    rt_proc_t    *proc;
    wakeup_gen_t  wakeup_gen;
@@ -78,6 +103,7 @@ struct event {
    union {
       event_timeout_t  timeout;
       event_driver_t   driver;
+      driver_list_t    drivers;
       event_proc_t     proc;
       rt_nexus_t      *effective;
    };
@@ -168,6 +194,7 @@ typedef struct {
    ffi_closure_t closure;
    res_flags_t   flags;
    int32_t       ileft;
+   int32_t       nlits;
    int8_t        tab2[16][16];
    int8_t        tab1[16];
 } res_memo_t;
@@ -260,6 +287,8 @@ typedef struct _rt_watch {
    sig_event_fn_t  fn;
    rt_watch_t     *chain_all;
    void           *user_data;
+   uint64_t       *dirty_map;
+   unsigned        dirty_bit;
 } rt_watch_t;
 
 
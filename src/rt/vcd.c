@@ -0,0 +1,378 @@
+//
+//  Copyright (C) 2022  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "util.h"
+#include "array.h"
+#include "rt/vcd.h"
+#include "thread.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//
+// Streaming VCD writer: value changes are formatted directly into a
+// large output buffer which is written to the file whenever it fills
+// up, optionally on a background thread while the simulation carries
+// on filling a second buffer
+//
+
+#define VCD_BUF_SIZE (1 << 20)
+#define VCD_MAX_ID   8
+
+typedef struct {
+   vcd_var_kind_t kind;
+   unsigned       size;
+   uint8_t        idlen;
+   char           id[VCD_MAX_ID];
+} vcd_var_t;
+
+typedef A(vcd_var_t) var_array_t;
+
+typedef struct {
+   char   *data;
+   size_t  len;
+   size_t  limit;
+} vcd_buf_t;
+
+typedef enum {
+   FLUSH_IDLE,
+   FLUSH_PENDING,
+   FLUSH_STOP
+} flush_state_t;
+
+typedef struct _vcd_writer {
+   FILE         *file;
+   char         *path;
+   var_array_t   vars;
+   bool          defined;
+   bool          background;
+   vcd_buf_t     bufs[2];
+   vcd_buf_t    *active;
+   vcd_buf_t    *pending;
+   nvc_thread_t *thread;
+   int32_t       state;
+} vcd_writer_t;
+
+static void vcd_write_buf(vcd_writer_t *vw, vcd_buf_t *b)
+{
+   if (b->len > 0 && fwrite(b->data, b->len, 1, vw->file) != 1)
+      fatal_errno("%s", vw->path);
+
+   // Make the data visible to other tools reading the file while the
+   // simulation is still running
+   if (fflush(vw->file) != 0)
+      fatal_errno("%s", vw->path);
+
+   b->len = 0;
+}
+
+static void *vcd_flush_thread(void *arg)
+{
+   vcd_writer_t *vw = arg;
+
+   for (;;) {
+      thread_wait(&vw->state, FLUSH_IDLE);
+
+      const int32_t state = load_acquire(&vw->state);
+      if (state == FLUSH_STOP)
+         break;
+
+      assert(state == FLUSH_PENDING);
+      vcd_write_buf(vw, vw->pending);
+
+      store_release(&vw->state, FLUSH_IDLE);
+      thread_wake(&vw->state);
+   }
+
+   return NULL;
+}
+
+static void vcd_flush(vcd_writer_t *vw)
+{
+   if (vw->thread == NULL) {
+      vcd_write_buf(vw, vw->active);
+      return;
+   }
+
+   // Wait for the previous buffer to be written before handing over
+   // the current one
+   thread_wait(&vw->state, FLUSH_PENDING);
+   assert(vw->state == FLUSH_IDLE);
+
+   vw->pending = vw->active;
+   vw->active = vw->active == &(vw->bufs[0]) ? &(vw->bufs[1]) : &(vw->bufs[0]);
+   assert(vw->active->len == 0);
+
+   store_release(&vw->state, FLUSH_PENDING);
+   thread_wake(&vw->state);
+}
+
+static void vcd_make_space(vcd_writer_t *vw, size_t size)
+{
+   // The initial values are written after the header so buffer them
+   // in memory until the end of the definitions
+   if (vw->defined)
+      vcd_flush(vw);
+
+   vcd_buf_t *b = vw->active;
+   if (b->len + size > b->limit) {
+      b->limit = MAX(b->limit * 2, b->len + size);
+      b->data  = xrealloc(b->data, b->limit);
+   }
+}
+
+static inline char *vcd_reserve(vcd_writer_t *vw, size_t size)
+{
+   if (unlikely(vw->active->len + size > vw->active->limit))
+      vcd_make_space(vw, size);
+
+   char *p = vw->active->data + vw->active->len;
+   vw->active->len += size;
+   return p;
+}
+
+static inline char *vcd_put_id(char *p, const vcd_var_t *var)
+{
+   memcpy(p, var->id, var->idlen);
+   p[var->idlen] = '\n';
+   return p + var->idlen + 1;
+}
+
+static size_t vcd_escape(char *dst, const uint8_t *src, size_t len)
+{
+   // Same escaping as used by GtkWave so strings do not contain spaces
+   char *p = dst;
+   for (size_t i = 0; i < len; i++) {
+      const uint8_t ch = src[i];
+      switch (ch) {
+      case '\'': case '"': case '\\': case '?':
+         *p++ = '\\';
+         *p++ = ch;
+         break;
+      case '\a': *p++ = '\\'; *p++ = 'a'; break;
+      case '\b': *p++ = '\\'; *p++ = 'b'; break;
+      case '\f': *p++ = '\\'; *p++ = 'f'; break;
+      case '\n': *p++ = '\\'; *p++ = 'n'; break;
+      case '\r': *p++ = '\\'; *p++ = 'r'; break;
+      case '\t': *p++ = '\\'; *p++ = 't'; break;
+      case '\v': *p++ = '\\'; *p++ = 'v'; break;
+      default:
+         if (ch > ' ' && ch <= '~')
+            *p++ = ch;
+         else {
+            *p++ = '\\';
+            *p++ = '0' + (ch >> 6);
+            *p++ = '0' + ((ch >> 3) & 7);
+            *p++ = '0' + (ch & 7);
+         }
+      }
+   }
+
+   return p - dst;
+}
+
+vcd_writer_t *vcd_writer_new(const char *file, bool background)
+{
+   vcd_writer_t *vw = xcalloc(sizeof(vcd_writer_t));
+   vw->path       = xstrdup(file);
+   vw->background = background;
+   vw->active     = &(vw->bufs[0]);
+   vw->state      = FLUSH_IDLE;
+
+   if ((vw->file = fopen(file, "wb")) == NULL)
+      fatal_errno("%s", file);
+
+   vw->active->limit = VCD_BUF_SIZE;
+   vw->active->data  = xmalloc(VCD_BUF_SIZE);
+
+   char tmbuf[64];
+   time_t now = time(NULL);
+   struct tm *tm = localtime(&now);
+   if (tm == NULL || strftime(tmbuf, sizeof(tmbuf), "%c", tm) == 0)
+      tmbuf[0] = '\0';
+
+   fprintf(vw->file, "$date\n\t%s\n$end\n", tmbuf);
+   fprintf(vw->file, "$version\n\t" PACKAGE_STRING "\n$end\n");
+   fprintf(vw->file, "$timescale\n\t1fs\n$end\n");
+
+   return vw;
+}
+
+void vcd_writer_close(vcd_writer_t *vw)
+{
+   if (!vw->defined)
+      vcd_end_definitions(vw);
+
+   vcd_flush(vw);
+
+   if (vw->thread != NULL) {
+      thread_wait(&vw->state, FLUSH_PENDING);
+
+      store_release(&vw->state, FLUSH_STOP);
+      thread_wake(&vw->state);
+      thread_join(vw->thread);
+
+      free(vw->bufs[1].data);
+   }
+
+   if (fclose(vw->file) != 0)
+      fatal_errno("%s", vw->path);
+
+   ACLEAR(vw->vars);
+   free(vw->bufs[0].data);
+   free(vw->path);
+   free(vw);
+}
+
+void vcd_set_scope(vcd_writer_t *vw, const char *kind, const char *name)
+{
+   assert(!vw->defined);
+   fprintf(vw->file, "$scope %s %s $end\n", kind, name);
+}
+
+void vcd_set_upscope(vcd_writer_t *vw)
+{
+   assert(!vw->defined);
+   fputs("$upscope $end\n", vw->file);
+}
+
+vcd_handle_t vcd_create_var(vcd_writer_t *vw, vcd_var_kind_t kind,
+                            unsigned size, const char *name)
+{
+   assert(!vw->defined);
+
+   vcd_var_t var = { .kind = kind, .size = size };
+
+   // Identifier codes are the shortest string of printable characters
+   // in the range '!' to '~' which maps to each variable index
+   for (unsigned value = vw->vars.count + 1; value > 0; value /= 94) {
+      assert(var.idlen < VCD_MAX_ID);
+      value--;
+      var.id[var.idlen++] = '!' + value % 94;
+   }
+
+   static const char *kind_str[] = { "logic", "integer", "real", "string" };
+   const unsigned width =
+      kind == VCD_VAR_REAL ? 64 : kind == VCD_VAR_STRING ? 0 : size;
+
+   fprintf(vw->file, "$var %s %u %.*s %s $end\n", kind_str[kind],
+           width, var.idlen, var.id, name);
+
+   APUSH(vw->vars, var);
+   return vw->vars.count - 1;
+}
+
+void vcd_end_definitions(vcd_writer_t *vw)
+{
+   assert(!vw->defined);
+
+   fputs("$enddefinitions $end\n#0\n$dumpvars\n", vw->file);
+
+   // Any value changes emitted so far are the initial values
+   vcd_write_buf(vw, vw->active);
+   fputs("$end\n", vw->file);
+
+   vw->defined = true;
+
+   if (vw->background) {
+      vw->bufs[1].limit = vw->bufs[0].limit;
+      vw->bufs[1].data  = xmalloc(vw->bufs[1].limit);
+
+      vw->thread = thread_create(vcd_flush_thread, vw, "vcd writer");
+   }
+}
+
+void vcd_emit_time_change(vcd_writer_t *vw, uint64_t time)
+{
+   if (!vw->defined) {
+      // The initial values are always at time zero
+      assert(time == 0);
+      return;
+   }
+
+   char buf[32];
+   const int nchars = checked_sprintf(buf, sizeof(buf), "#%"PRIu64"\n", time);
+   memcpy(vcd_reserve(vw, nchars), buf, nchars);
+}
+
+void vcd_emit_value_change(vcd_writer_t *vw, vcd_handle_t handle,
+                           const void *value)
+{
+   assert(handle < vw->vars.count);
+   const vcd_var_t *var = &(vw->vars.items[handle]);
+
+   switch (var->kind) {
+   case VCD_VAR_LOGIC:
+   case VCD_VAR_INTEGER:
+      if (var->size == 1 && var->kind == VCD_VAR_LOGIC) {
+         char *p = vcd_reserve(vw, var->idlen + 2);
+         *p++ = *(const char *)value;
+         vcd_put_id(p, var);
+      }
+      else {
+         char *p = vcd_reserve(vw, var->size + var->idlen + 3);
+         *p++ = 'b';
+         memcpy(p, value, var->size);
+         p += var->size;
+         *p++ = ' ';
+         vcd_put_id(p, var);
+      }
+      break;
+
+   case VCD_VAR_REAL:
+      {
+         double d;
+         memcpy(&d, value, sizeof(double));
+
+         char buf[64];
+         const int nchars = checked_sprintf(buf, sizeof(buf), "r%.16g ", d);
+
+         char *p = vcd_reserve(vw, nchars + var->idlen + 1);
+         memcpy(p, buf, nchars);
+         vcd_put_id(p + nchars, var);
+      }
+      break;
+
+   case VCD_VAR_STRING:
+      vcd_emit_variable_length_value_change(vw, handle, value,
+                                            strlen(value));
+      break;
+   }
+}
+
+void vcd_emit_variable_length_value_change(vcd_writer_t *vw,
+                                           vcd_handle_t handle,
+                                           const void *value, size_t len)
+{
+   assert(handle < vw->vars.count);
+   const vcd_var_t *var = &(vw->vars.items[handle]);
+
+   // Reserve enough space for every character to be escaped and then
+   // give back what was not used
+   const size_t worst = len * 4 + var->idlen + 3;
+   char *start = vcd_reserve(vw, worst), *p = start;
+   *p++ = 's';
+   p += vcd_escape(p, value, len);
+   *p++ = ' ';
+   p = vcd_put_id(p, var);
+
+   vw->active->len -= worst - (p - start);
+}
@@ -0,0 +1,47 @@
+//
+//  Copyright (C) 2022  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef _RT_VCD_H
+#define _RT_VCD_H
+
+#include "prim.h"
+
+typedef struct _vcd_writer vcd_writer_t;
+typedef uint32_t vcd_handle_t;
+
+typedef enum {
+   VCD_VAR_LOGIC,
+   VCD_VAR_INTEGER,
+   VCD_VAR_REAL,
+   VCD_VAR_STRING
+} vcd_var_kind_t;
+
+vcd_writer_t *vcd_writer_new(const char *file, bool background);
+void vcd_writer_close(vcd_writer_t *vw);
+void vcd_set_scope(vcd_writer_t *vw, const char *kind, const char *name);
+void vcd_set_upscope(vcd_writer_t *vw);
+vcd_handle_t vcd_create_var(vcd_writer_t *vw, vcd_var_kind_t kind,
+                            unsigned size, const char *name);
+void vcd_end_definitions(vcd_writer_t *vw);
+void vcd_emit_time_change(vcd_writer_t *vw, uint64_t time);
+void vcd_emit_value_change(vcd_writer_t *vw, vcd_handle_t handle,
+                           const void *value);
+void vcd_emit_variable_length_value_change(vcd_writer_t *vw,
+                                           vcd_handle_t handle,
+                                           const void *value, size_t len);
+
+#endif  // _RT_VCD_H
@@ -25,19 +25,24 @@
 #include "rt/model.h"
 #include "rt/rt.h"
 #include "rt/structs.h"
+#include "rt/vcd.h"
 #include "rt/wave.h"
+#include "thread.h"
 #include "tree.h"
 #include "type.h"
 
 #include <assert.h>
-#include <unistd.h>
-#include <limits.h>
+#include <inttypes.h>
 #include <string.h>
 
-#if !defined __CYGWIN__ && !defined __MINGW32__
-#include <libgen.h>
+#if defined __x86_64__ && (defined __GNUC__ || defined __clang__)
+#define HAVE_SSSE3_FORMAT 1
+#include <tmmintrin.h>
 #endif
 
+#define RING_MIN_SIZE (1 << 22)
+#define RING_BATCH    16
+
 typedef struct {
    char  *text;
    size_t len;
@@ -45,9 +50,34 @@ typedef struct {
 
 typedef A(glob_t) glob_array_t;
 
+typedef A(uint32_t) glob_states_t;
+
+// All the include and exclude globs are compiled into a single NFA
+// where each state is an offset into the concatenated pattern text.
+// The set of live states is computed once for each scope in the
+// hierarchy so that sub-trees which no pattern can match are skipped
+// without visiting their signals.
+typedef struct {
+   char          *text;
+   size_t         len;
+   uint32_t       nexcl;      // States below this are exclude patterns
+   unsigned       nincl;
+   uint32_t      *mark;
+   uint32_t       gen;
+   glob_states_t  start;
+   glob_states_t  cur;
+   glob_states_t  next;
+} glob_nfa_t;
+
+typedef enum {
+   FILTER_NONE,
+   FILTER_SOME,
+   FILTER_ALL
+} glob_filter_t;
+
 typedef struct _fst_data fst_data_t;
 
-typedef void (*fst_fmt_fn_t)(rt_watch_t *, fst_data_t *);
+typedef void (*fst_fmt_fn_t)(fst_data_t *, const void *);
 
 typedef struct {
    int64_t  mult;
@@ -72,12 +102,37 @@ typedef struct {
    } u;
 } fst_type_t;
 
+typedef struct {
+   ident_t            name;
+   enum fstScopeType  type;
+} fst_scope_t;
+
+typedef A(fst_scope_t) scope_array_t;
+
+// Arrays dumped with --dump-arrays keep a copy of the last value
+// written so that only elements which changed are output.  In sparse
+// mode the FST variable for each element is only created the first
+// time it changes.
+typedef struct {
+   fst_data_t     *elem;
+   uint8_t        *shadow;
+   size_t          stride;
+   enum fstVarDir  vardir;
+   int64_t         low;
+   char           *name;
+   char           *suffix;
+   char           *type_name;
+   fst_scope_t    *scopes;
+   unsigned        nscopes;
+} fst_memory_t;
+
 typedef struct _fst_data {
    wave_dumper_t *dumper;
    fst_type_t    *type;
    rt_watch_t    *watch;
    tree_t         decl;
    rt_signal_t   *signal;
+   fst_memory_t  *memory;
    range_kind_t   dir;
    unsigned       size;
    unsigned       count;
@@ -90,88 +145,278 @@ typedef struct {
    text_buf_t *hier;
 } gtkw_writer_t;
 
+typedef enum {
+   REC_CHANGE,
+   REC_PAD,
+   REC_STOP,
+} ring_rec_kind_t;
+
+typedef struct {
+   fst_data_t      *data;
+   uint64_t         time;
+   uint32_t         size;
+   ring_rec_kind_t  kind;
+   uint8_t          value[];
+} ring_rec_t;
+
+typedef struct {
+   uint64_t changes;
+   uint64_t bytes;
+   uint64_t stalls;
+   uint64_t stall_ns;
+   uint32_t max_used;
+} ring_stats_t;
+
+// Single producer single consumer queue of value changes passed from
+// the simulation thread to the FST writer thread
+typedef struct {
+   uint8_t      *buf;
+   uint32_t      size;
+   nvc_thread_t *thread;
+   uint64_t      last_time;
+   ring_stats_t  stats;
+   int32_t       head __attribute__((aligned(64)));
+   int32_t       consumer_waiting;
+   int32_t       tail __attribute__((aligned(64)));
+   int32_t       producer_waiting;
+} wave_ring_t;
+
+typedef A(fst_data_t *) data_array_t;
+
+typedef struct {
+   uint8_t *buf;
+   size_t   len;
+   size_t   limit;
+} flight_seg_t;
+
+// Bounded in-memory history of value changes which is only written to
+// the waveform file when the trigger condition occurs: each segment
+// begins with a snapshot of every signal so the older one can be
+// discarded once the newer one spans the requested interval
+typedef struct {
+   uint64_t         history;
+   uint64_t         seg_start;
+   vhdl_severity_t  trigger;
+   flight_seg_t     segs[2];
+} flight_rec_t;
+
 typedef struct _wave_dumper {
    tree_t         top;
    void          *fst_ctx;
    rt_model_t    *model;
    gtkw_writer_t *gtkw;
-   FILE          *vcdfile;
-   char          *tmpfst;
+   vcd_writer_t  *vcd;
+   wave_ring_t   *ring;
+   size_t         max_value;
    uint64_t       last_time;
+   uint64_t       start;
+   uint64_t       stop;
+   flight_rec_t  *flight;
+   scope_array_t  scopes;
+   data_array_t   signals;
+   uint64_t      *dirty;
 } wave_dumper_t;
 
 static glob_array_t incl;
 static glob_array_t excl;
 
+// Character maps are padded to sixteen bytes so they can be used
+// directly as a shuffle table
+static const char std_ulogic_map[16] = "UX01ZWLH-";
+static const char bit_map[16] = "01";
+
+// Binary representation of each byte value
+static char bit_table[256][8];
+
 static void fst_process_signal(wave_dumper_t *wd, rt_scope_t *scope, tree_t d,
                                tree_t cons, text_buf_t *tb);
-static bool wave_should_dump(ident_t name);
+static void glob_nfa_init(glob_nfa_t *nfa);
+static void glob_nfa_free(glob_nfa_t *nfa);
+static void glob_nfa_feed(glob_nfa_t *nfa, const glob_states_t *from,
+                          const char *str);
+static glob_filter_t glob_nfa_filter(glob_nfa_t *nfa,
+                                     const glob_states_t *states);
+static bool wave_should_dump(glob_nfa_t *nfa, const glob_states_t *scope,
+                             ident_t name);
+static void ring_stop(wave_dumper_t *wd);
+static void fst_sample(wave_dumper_t *wd, uint64_t now);
+static void flight_stop(wave_dumper_t *wd, bool write);
+static void fst_free_memory(fst_memory_t *mem);
 
 static void fst_close(rt_model_t *m, void *arg)
 {
    wave_dumper_t *wd = arg;
 
-   fstWriterEmitTimeChange(wd->fst_ctx, model_now(m, NULL));
-   fstWriterClose(wd->fst_ctx);
+   const uint64_t now = model_now(m, NULL);
 
-   if (wd->vcdfile) {
-      void *xc = fstReaderOpen(wd->tmpfst);
-      if (xc == NULL)
-         fatal("fstReaderOpen failed for temporary FST file");
+   // There may be unsampled changes if the simulation was stopped in
+   // the middle of a time step
+   fst_sample(wd, now);
 
-      fstReaderSetVcdExtensions(xc, 1);
-      if (!fstReaderProcessHier(xc, wd->vcdfile))
-         fatal("fstReaderProcessHier failed");
+   if (wd->flight != NULL) {
+      // Also write out the history if the simulation failed without
+      // reaching the trigger severity
+      const bool failed = model_exit_status(m) != 0;
+      if (!failed)
+         notef("flight recorder was not triggered: no waveform data "
+               "written");
 
-      fstReaderSetFacProcessMaskAll(xc);
-      fstReaderIterBlocks(xc, NULL, NULL, wd->vcdfile);
+      flight_stop(wd, failed);
+   }
 
-      fstReaderClose(xc);
-      fclose(wd->vcdfile);
-      wd->vcdfile = NULL;
+   if (wd->ring != NULL)
+      ring_stop(wd);
 
-      if (unlink(wd->tmpfst) != 0)
-         fatal_errno("unlink: %s", wd->tmpfst);
+   const uint64_t end = MIN(now, wd->stop);
 
-#if !defined __CYGWIN__ && !defined __MINGW32__
-      char *tmpdir = dirname(wd->tmpfst);
-      if (rmdir(tmpdir) != 0)
-         fatal_errno("unlink: %s", tmpdir);
-#endif
+   if (wd->vcd != NULL) {
+      if (end != wd->last_time)
+         vcd_emit_time_change(wd->vcd, end);
+      vcd_writer_close(wd->vcd);
+      wd->vcd = NULL;
+   }
+   else {
+      fstWriterEmitTimeChange(wd->fst_ctx, end);
+      fstWriterClose(wd->fst_ctx);
+      wd->fst_ctx = NULL;
+   }
+
+   for (int i = 0; i < wd->signals.count; i++) {
+      fst_data_t *data = wd->signals.items[i];
+      if (data->memory != NULL) {
+         fst_free_memory(data->memory);
+         data->memory = NULL;
+      }
+   }
+
+   ACLEAR(wd->signals);
+   free(wd->dirty);
+   wd->dirty = NULL;
+
+   wd->model = NULL;
+}
+
+static void wave_emit_value(fst_data_t *data, int nth, const void *value)
+{
+   if (data->dumper->vcd != NULL)
+      vcd_emit_value_change(data->dumper->vcd, data->handle[nth], value);
+   else
+      fstWriterEmitValueChange(data->dumper->fst_ctx,
+                               data->handle[nth], value);
+}
+
+static void wave_emit_string(fst_data_t *data, int nth, const void *value,
+                             size_t len)
+{
+   if (data->dumper->vcd != NULL)
+      vcd_emit_variable_length_value_change(data->dumper->vcd,
+                                            data->handle[nth], value, len);
+   else
+      fstWriterEmitVariableLengthValueChange(data->dumper->fst_ctx,
+                                             data->handle[nth], value, len);
+}
+
+static fstHandle wave_create_var(wave_dumper_t *wd, fst_type_t *ft,
+                                 enum fstVarDir dir, unsigned size,
+                                 const char *name, type_t type)
+{
+   if (wd->vcd != NULL) {
+      vcd_var_kind_t kind;
+      switch (ft->vartype) {
+      case FST_VT_VCD_INTEGER: kind = VCD_VAR_INTEGER; break;
+      case FST_VT_VCD_REAL:    kind = VCD_VAR_REAL; break;
+      case FST_VT_GEN_STRING:  kind = VCD_VAR_STRING; break;
+      default:                 kind = VCD_VAR_LOGIC; break;
+      }
 
-      free(wd->tmpfst);
-      wd->tmpfst = NULL;
+      return vcd_create_var(wd->vcd, kind, size, name);
    }
+   else
+      return fstWriterCreateVar2(wd->fst_ctx, ft->vartype, dir, size, name,
+                                 0, type_pp(type), FST_SVT_VHDL_SIGNAL,
+                                 ft->sdt);
+}
+
+static void wave_set_scope(wave_dumper_t *wd, enum fstScopeType st,
+                           const char *name, const char *component)
+{
+   if (wd->vcd != NULL) {
+      const char *kind;
+      switch (st) {
+      case FST_ST_VHDL_RECORD:       kind = "vhdl_record"; break;
+      case FST_ST_VHDL_BLOCK:        kind = "vhdl_block"; break;
+      case FST_ST_VHDL_FOR_GENERATE: kind = "vhdl_for_generate"; break;
+      case FST_ST_VHDL_PACKAGE:      kind = "vhdl_package"; break;
+      default:                       kind = "vhdl_architecture"; break;
+      }
 
-   wd->fst_ctx = NULL;
-   wd->model   = NULL;
+      vcd_set_scope(wd->vcd, kind, name);
+   }
+   else
+      fstWriterSetScope(wd->fst_ctx, st, name, component);
+
+   // Remember the current scope in case variables need to be added to
+   // it later
+   APUSH(wd->scopes, ((fst_scope_t){ ident_new(name), st }));
 }
 
-static void fst_fmt_int(rt_watch_t *w, fst_data_t *data)
+static void wave_set_upscope(wave_dumper_t *wd)
 {
-   uint64_t val[data->count];
-   signal_expand(data->signal, 0, val, data->count);
+   if (wd->vcd != NULL)
+      vcd_set_upscope(wd->vcd);
+   else
+      fstWriterSetUpscope(wd->fst_ctx);
+
+   ATRIM(wd->scopes, wd->scopes.count - 1);
+}
+
+static uint64_t fst_get_int(fst_data_t *data, const void *value, int nth)
+{
+   switch (data->signal->nexus.size) {
+   case 1: return ((const uint8_t *)value)[nth];
+   case 2: return ((const uint16_t *)value)[nth];
+   case 4: return ((const uint32_t *)value)[nth];
+   case 8: return ((const uint64_t *)value)[nth];
+   default:
+      fatal_trace("invalid integer size %d", data->signal->nexus.size);
+   }
+}
+
+static void fst_fmt_int(fst_data_t *data, const void *value)
+{
+   const int size = data->type->size;
+   assert(size <= 64);
 
    for (int i = 0; i < data->count; i++) {
-      char buf[data->type->size + 1];
-      for (size_t j = 0; j < data->type->size; j++)
-         buf[data->type->size - 1 - j] = (val[i] & (1 << j)) ? '1' : '0';
-      buf[data->type->size] = '\0';
+      const uint64_t val = fst_get_int(data, value, i);
+
+      char buf[size + 1], *p = buf;
+
+      // Leading bits which do not make up a whole byte
+      const int partial = size % 8;
+      if (partial > 0) {
+         memcpy(p, bit_table[(val >> (size - partial)) & 0xff] + 8 - partial,
+                partial);
+         p += partial;
+      }
+
+      for (int shift = size - partial - 8; shift >= 0; shift -= 8, p += 8)
+         memcpy(p, bit_table[(val >> shift) & 0xff], 8);
+
+      *p = '\0';
 
-      fstWriterEmitValueChange(data->dumper->fst_ctx, data->handle[i], buf);
+      wave_emit_value(data, i, buf);
    }
 }
 
-static void fst_fmt_real(rt_watch_t *w, fst_data_t *data)
+static void fst_fmt_real(fst_data_t *data, const void *value)
 {
-   const void *buf = signal_value(data->signal);
-   fstWriterEmitValueChange(data->dumper->fst_ctx, data->handle[0], buf);
+   wave_emit_value(data, 0, value);
 }
 
-static void fst_fmt_physical(rt_watch_t *w, fst_data_t *data)
+static void fst_fmt_physical(fst_data_t *data, const void *value)
 {
-   uint64_t val;
-   signal_expand(data->signal, 0, &val, 1);
+   const uint64_t val = fst_get_int(data, value, 0);
 
    fst_unit_t *unit = data->type->u.units;
    while ((val % unit->mult) != 0)
@@ -181,53 +426,453 @@ static void fst_fmt_physical(rt_watch_t *w, fst_data_t *data)
    checked_sprintf(buf, sizeof(buf), "%"PRIi64" %s",
                    val / unit->mult, unit->name);
 
-   fstWriterEmitVariableLengthValueChange(
-      data->dumper->fst_ctx, data->handle[0], buf, strlen(buf));
+   wave_emit_string(data, 0, buf, strlen(buf));
+}
+
+#ifdef HAVE_SSSE3_FORMAT
+__attribute__((target("ssse3")))
+static int fst_map_chars_ssse3(const char *map, const uint8_t *p, char *out,
+                               int size)
+{
+   // Enumeration values are all less than sixteen so each one can be
+   // used as an index into the character map with PSHUFB
+   const __m128i tab = _mm_loadu_si128((const __m128i *)map);
+
+   int j = 0;
+   for (; j + 16 <= size; j += 16) {
+      const __m128i a = _mm_loadu_si128((const __m128i *)(p + j));
+      _mm_storeu_si128((__m128i *)(out + j), _mm_shuffle_epi8(tab, a));
+   }
+
+   return j;
+}
+#endif
+
+static void fst_map_chars(const char *map, const uint8_t *p, char *out,
+                          int size)
+{
+   int j = 0;
+#ifdef HAVE_SSSE3_FORMAT
+   if (size >= 16 && __builtin_cpu_supports("ssse3"))
+      j = fst_map_chars_ssse3(map, p, out, size);
+#endif
+
+   for (; j < size; j++)
+      out[j] = map[p[j]];
 }
 
-static void fst_fmt_chars(rt_watch_t *w, fst_data_t *data)
+static void fst_fmt_chars(fst_data_t *data, const void *value)
 {
-   const uint8_t *p = signal_value(data->signal);
+   const uint8_t *p = value;
    for (int i = 0; i < data->count; i++, p += data->size) {
       if (likely(data->type->u.map != NULL)) {
          char buf[data->size];
-         for (int j = 0; j < data->size; j++)
-            buf[j] = data->type->u.map[p[j]];
-         fstWriterEmitValueChange(data->dumper->fst_ctx, data->handle[i], buf);
+         fst_map_chars(data->type->u.map, p, buf, data->size);
+         wave_emit_value(data, i, buf);
       }
       else
-         fstWriterEmitVariableLengthValueChange(
-            data->dumper->fst_ctx, data->handle[i], p, data->size);
+         wave_emit_string(data, i, p, data->size);
    }
 }
 
-static void fst_fmt_enum(rt_watch_t *w, fst_data_t *data)
+static void fst_fmt_enum(fst_data_t *data, const void *value)
 {
-   uint64_t val;
-   signal_expand(data->signal, 0, &val, 1);
+   const uint64_t val = fst_get_int(data, value, 0);
 
    fst_enum_t *e = &(data->type->u.literals);
    assert(val < e->count);
 
    const char *literal = e->strings + val * e->size;
-   fstWriterEmitVariableLengthValueChange(data->dumper->fst_ctx,
-                                          data->handle[0],
-                                          literal,
-                                          strnlen(literal, e->size));
+   wave_emit_string(data, 0, literal, strnlen(literal, e->size));
+}
+
+static void fst_create_element(fst_data_t *data, int nth)
+{
+   fst_memory_t *mem = data->memory;
+   void *ctx = data->dumper->fst_ctx;
+
+   // Variables can be added to an FST file after value changes have
+   // been written as long as the enclosing scopes are entered again
+   for (int i = 0; i < mem->nscopes; i++)
+      fstWriterSetScope(ctx, mem->scopes[i].type, istr(mem->scopes[i].name),
+                        NULL);
+
+   char *name LOCAL = xasprintf("%s[%"PRIi64"]%s", mem->name,
+                                mem->low + nth, mem->suffix);
+
+   data->handle[nth] = fstWriterCreateVar2(ctx, data->type->vartype,
+                                           mem->vardir, data->size, name, 0,
+                                           mem->type_name, FST_SVT_VHDL_SIGNAL,
+                                           data->type->sdt);
+
+   for (int i = 0; i < mem->nscopes; i++)
+      fstWriterSetUpscope(ctx);
+}
+
+static void fst_fmt_memory(fst_data_t *data, const void *value)
+{
+   fst_memory_t *mem = data->memory;
+
+   const bool initial = (mem->shadow == NULL);
+   if (initial)
+      mem->shadow = xmalloc_array(data->count, mem->stride);
+
+   const uint8_t *p = value;
+   uint8_t *old = mem->shadow;
+   for (int i = 0; i < data->count; i++, p += mem->stride, old += mem->stride) {
+      if (!initial && memcmp(p, old, mem->stride) == 0)
+         continue;
+
+      memcpy(old, p, mem->stride);
+
+      // Only FST handles start from one so zero can mean the element
+      // variable has not been created yet in sparse mode
+      if (mem->name != NULL && data->handle[i] == 0) {
+         // Sparse mode does not dump the initial value
+         if (initial)
+            continue;
+
+         fst_create_element(data, i);
+      }
+
+      mem->elem->handle[0] = data->handle[i];
+      (*data->type->fn)(mem->elem, p);
+   }
+}
+
+static inline void fst_format(fst_data_t *data, const void *value)
+{
+   if (data->memory != NULL)
+      fst_fmt_memory(data, value);
+   else
+      (*data->type->fn)(data, value);
+}
+
+static void fst_free_memory(fst_memory_t *mem)
+{
+   free(mem->elem);
+   free(mem->shadow);
+   free(mem->name);
+   free(mem->suffix);
+   free(mem->type_name);
+   free(mem->scopes);
+   free(mem);
+}
+
+static uint32_t ring_used(wave_ring_t *r, uint32_t head)
+{
+   return head - (uint32_t)atomic_load(&r->tail);
+}
+
+static void ring_wait_space(wave_ring_t *r, uint32_t head, uint32_t need)
+{
+   if (likely(r->size - ring_used(r, head) >= need))
+      return;
+
+   // The writer thread has fallen behind: block the simulation until
+   // enough records have been consumed
+   const uint64_t start_ns = get_timestamp_ns();
+   r->stats.stalls++;
+
+   for (;;) {
+      const int32_t tail = atomic_load(&r->tail);
+      if (r->size - (head - (uint32_t)tail) >= need)
+         break;
+
+      atomic_store(&r->producer_waiting, 1);
+      thread_wait(&r->tail, tail);
+      atomic_store(&r->producer_waiting, 0);
+   }
+
+   r->stats.stall_ns += get_timestamp_ns() - start_ns;
+}
+
+static void ring_publish(wave_ring_t *r, uint32_t head, bool force)
+{
+   atomic_store(&r->head, head);
+
+   // Waking the writer thread is expensive so wait until there is a
+   // reasonable batch of records for it to process
+   if (atomic_load(&r->consumer_waiting)
+       && (force || ring_used(r, head) >= r->size / RING_BATCH))
+      thread_wake(&r->head);
+}
+
+static void ring_push(wave_ring_t *r, ring_rec_kind_t kind, fst_data_t *data,
+                      uint64_t time, const void *value, size_t len)
+{
+   const uint32_t need = ALIGN_UP(sizeof(ring_rec_t) + len, 8);
+   uint32_t head = relaxed_load(&r->head);
+
+   const uint32_t offset = head & (r->size - 1);
+   if (offset + need > r->size) {
+      // Records are never split across the end of the buffer
+      const uint32_t pad = r->size - offset;
+      ring_wait_space(r, head, pad);
+
+      if (pad >= sizeof(ring_rec_t)) {
+         ring_rec_t *rec = (ring_rec_t *)(r->buf + offset);
+         rec->kind = REC_PAD;
+         rec->size = pad;
+      }
+
+      ring_publish(r, (head += pad), false);
+   }
+
+   ring_wait_space(r, head, need);
+
+   ring_rec_t *rec = (ring_rec_t *)(r->buf + (head & (r->size - 1)));
+   rec->kind = kind;
+   rec->size = need;
+   rec->data = data;
+   rec->time = time;
+   memcpy(rec->value, value, len);
+
+   r->stats.changes += (kind == REC_CHANGE);
+   r->stats.bytes += need;
+   r->stats.max_used = MAX(r->stats.max_used, ring_used(r, head) + need);
+
+   ring_publish(r, head + need, kind == REC_STOP);
+}
+
+static void *ring_thread_fn(void *arg)
+{
+   wave_dumper_t *wd = arg;
+   wave_ring_t *r = wd->ring;
+
+   for (uint32_t tail = atomic_load(&r->tail);;) {
+      const int32_t head = atomic_load(&r->head);
+      if ((uint32_t)head == tail) {
+         atomic_store(&r->consumer_waiting, 1);
+         thread_wait(&r->head, head);
+         atomic_store(&r->consumer_waiting, 0);
+         continue;
+      }
+
+      const uint32_t offset = tail & (r->size - 1);
+      const ring_rec_t *rec = (ring_rec_t *)(r->buf + offset);
+
+      if (r->size - offset < sizeof(ring_rec_t))
+         tail += r->size - offset;    // Implicit padding at end
+      else if (rec->kind == REC_STOP)
+         return NULL;
+      else {
+         if (rec->kind == REC_CHANGE) {
+            if (rec->time != r->last_time) {
+               fstWriterEmitTimeChange(wd->fst_ctx, rec->time);
+               r->last_time = rec->time;
+            }
+
+            fst_format(rec->data, rec->value);
+         }
+
+         tail += rec->size;
+      }
+
+      atomic_store(&r->tail, tail);
+
+      if (atomic_load(&r->producer_waiting))
+         thread_wake(&r->tail);
+   }
+}
+
+static void ring_start(wave_dumper_t *wd)
+{
+   wave_ring_t *r = xcalloc(sizeof(wave_ring_t));
+   r->size      = next_power_of_2(MAX(RING_MIN_SIZE, 2 * wd->max_value));
+   r->buf       = xmalloc(r->size);
+   r->last_time = wd->last_time;
+
+   wd->ring = r;
+
+   r->thread = thread_create(ring_thread_fn, wd, "wave writer");
 }
 
-static void fst_event_cb(uint64_t now, rt_signal_t *s, rt_watch_t *w,
-                         void *user)
+static void ring_stop(wave_dumper_t *wd)
 {
-   fst_data_t *data = user;
+   wave_ring_t *r = wd->ring;
 
-   if (now != data->dumper->last_time) {
-      fstWriterEmitTimeChange(data->dumper->fst_ctx, now);
-      data->dumper->last_time = now;
+   ring_push(r, REC_STOP, NULL, 0, NULL, 0);
+   thread_join(r->thread);
+
+   wd->last_time = r->last_time;
+
+   if (opt_get_int(OPT_RT_STATS)) {
+      const ring_stats_t *s = &(r->stats);
+      notef("wave: %"PRIu64" changes %"PRIu64"kB max:%u%% stalls:%"PRIu64
+            " waited:%"PRIu64"ms", s->changes, s->bytes / 1024,
+            (unsigned)(100 * (uint64_t)s->max_used / r->size), s->stalls,
+            s->stall_ns / 1000000);
+   }
+
+   free(r->buf);
+   free(r);
+   wd->ring = NULL;
+}
+
+static void fst_emit_value(wave_dumper_t *wd, fst_data_t *data,
+                           uint64_t now, const void *value)
+{
+   if (wd->ring != NULL) {
+      // Formatting and compression happens on the writer thread
+      ring_push(wd->ring, REC_CHANGE, data, now, value,
+                data->signal->shared.size);
+      return;
+   }
+
+   if (now != wd->last_time) {
+      if (wd->vcd != NULL)
+         vcd_emit_time_change(wd->vcd, now);
+      else
+         fstWriterEmitTimeChange(wd->fst_ctx, now);
+      wd->last_time = now;
+   }
+
+   fst_format(data, value);
+}
+
+static void flight_push(flight_seg_t *seg, fst_data_t *data, uint64_t now,
+                        const void *value, size_t len)
+{
+   const size_t need = ALIGN_UP(sizeof(ring_rec_t) + len, 8);
+   if (seg->len + need > seg->limit) {
+      seg->limit = MAX(seg->limit * 2, seg->len + need);
+      seg->buf   = xrealloc(seg->buf, seg->limit);
+   }
+
+   ring_rec_t *rec = (ring_rec_t *)(seg->buf + seg->len);
+   rec->kind = REC_CHANGE;
+   rec->size = need;
+   rec->data = data;
+   rec->time = now;
+   memcpy(rec->value, value, len);
+
+   seg->len += need;
+}
+
+static void flight_rotate(wave_dumper_t *wd, uint64_t now)
+{
+   flight_rec_t *fr = wd->flight;
+
+   // Reuse the memory from the oldest segment which is no longer
+   // needed to cover the history interval
+   const flight_seg_t oldest = fr->segs[0];
+   fr->segs[0] = fr->segs[1];
+   fr->segs[1] = oldest;
+   fr->segs[1].len = 0;
+   fr->seg_start = now;
+
+   for (int i = 0; i < wd->signals.count; i++) {
+      fst_data_t *data = wd->signals.items[i];
+      flight_push(&(fr->segs[1]), data, now, signal_value(data->signal),
+                  data->signal->shared.size);
+   }
+}
+
+static void flight_stop(wave_dumper_t *wd, bool write)
+{
+   flight_rec_t *fr = wd->flight;
+   wd->flight = NULL;
+
+   for (int i = 0; i < 2; i++) {
+      flight_seg_t *seg = &(fr->segs[i]);
+      for (size_t pos = 0; write && pos < seg->len;) {
+         const ring_rec_t *rec = (ring_rec_t *)(seg->buf + pos);
+         fst_emit_value(wd, rec->data, rec->time, rec->value);
+         pos += rec->size;
+      }
+
+      free(seg->buf);
+   }
+
+   free(fr);
+}
+
+static void fst_emit_change(wave_dumper_t *wd, fst_data_t *data,
+                            uint64_t now)
+{
+   rt_signal_t *s = data->signal;
+
+   if (wd->flight != NULL)
+      flight_push(&(wd->flight->segs[1]), data, now, signal_value(s),
+                  s->shared.size);
+   else
+      fst_emit_value(wd, data, now, signal_value(s));
+}
+
+static void fst_sample(wave_dumper_t *wd, uint64_t now)
+{
+   const int nwords = (wd->signals.count + 63) / 64;
+
+   flight_rec_t *fr = wd->flight;
+
+   if (now < wd->start || now > wd->stop) {
+      // Outside of the --wave-start and --wave-stop window
+      memset(wd->dirty, 0, nwords * sizeof(uint64_t));
+   }
+   else if (fr != NULL && now - fr->seg_start >= fr->history) {
+      // The snapshot at the start of the new segment already includes
+      // all the changes in this time step
+      memset(wd->dirty, 0, nwords * sizeof(uint64_t));
+      flight_rotate(wd, now);
+   }
+   else {
+      // Emit the final value of each signal that had an event in the
+      // current time step regardless of how many delta cycles it took
+      for (int i = 0; i < nwords; i++) {
+         for (uint64_t word = wd->dirty[i]; word != 0; word &= word - 1) {
+            const int bit = __builtin_ctzll(word);
+            fst_emit_change(wd, wd->signals.items[i * 64 + bit], now);
+         }
+
+         wd->dirty[i] = 0;
+      }
    }
 
-   if (likely(data != NULL))
-      (*data->type->fn)(w, data);
+   if (fr != NULL && severity_reported(fr->trigger)) {
+      notef("flight recorder triggered: writing waveform history");
+
+      // Switch to dumping every change directly after writing out the
+      // history
+      flight_stop(wd, true);
+   }
+}
+
+static void fst_mark_all(wave_dumper_t *wd)
+{
+   const int nwords = (wd->signals.count + 63) / 64;
+   memset(wd->dirty, 0xff, nwords * sizeof(uint64_t));
+
+   if (wd->signals.count % 64 != 0)
+      wd->dirty[nwords - 1] = (UINT64_C(1) << (wd->signals.count % 64)) - 1;
+}
+
+static void fst_start_cb(uint64_t now, void *arg)
+{
+   // Dump the value of every signal at the end of the first time step
+   // in the window
+   fst_mark_all(arg);
+}
+
+static void fst_sample_cb(rt_model_t *m, void *arg)
+{
+   wave_dumper_t *wd = arg;
+
+   fst_sample(wd, model_now(m, NULL));
+
+   model_set_global_cb(m, RT_LAST_KNOWN_DELTA_CYCLE, fst_sample_cb, wd);
+}
+
+static void fst_watch_signal(wave_dumper_t *wd, fst_data_t *data)
+{
+   data->dumper = wd;
+
+   wd->max_value = MAX(wd->max_value, data->signal->shared.size);
+
+   APUSH(wd->signals, data);
+
+   if (wd->start == 0)
+      fst_emit_change(wd, data, 0);
 }
 
 static fst_unit_t *fst_make_unit_map(type_t type)
@@ -305,7 +950,7 @@ static fst_type_t *fst_type_for(type_t type, const loc_t *loc)
             ft->sdt     = FST_SDT_VHDL_STD_ULOGIC;
             ft->vartype = FST_VT_SV_LOGIC;
             ft->fn      = fst_fmt_chars;
-            ft->u.map   = "UX01ZWLH-";
+            ft->u.map   = std_ulogic_map;
             ft->size    = 1;
             break;
 
@@ -313,7 +958,7 @@ static fst_type_t *fst_type_for(type_t type, const loc_t *loc)
             ft->sdt     = FST_SDT_VHDL_BIT;
             ft->vartype = FST_VT_SV_LOGIC;
             ft->fn      = fst_fmt_chars;
-            ft->u.map   = "01";
+            ft->u.map   = bit_map;
             ft->size    = 1;
             break;
 
@@ -493,27 +1138,46 @@ static void fst_create_array_var(wave_dumper_t *wd, tree_t d, rt_signal_t *s,
       data->size  = (e_high - e_low + 1) * ft->size;
       data->type  = ft;
 
-      for (int i = 0; i < length; i++) {
+      fst_memory_t *mem = xcalloc(sizeof(fst_memory_t));
+      mem->stride = length > 0 ? s->shared.size / length : 0;
+      mem->elem   = xcalloc_flex(sizeof(fst_data_t), 1, sizeof(fstHandle));
+
+      data->memory = mem;
+
+      // VCD does not allow variables to be declared after the header
+      if (opt_get_int(OPT_DUMP_ARRAYS) == DUMP_ARRAYS_SPARSE
+          && wd->vcd == NULL) {
          tb_rewind(tb);
          tb_istr(tb, tree_ident(d));
-         tb_printf(tb, "[%"PRIi64"]", low + i);
-         if (is_memory)
-            tb_printf(tb, "[%d:%d]", msb, lsb);
          tb_downcase(tb);
 
-         data->handle[i] = fstWriterCreateVar2(
-            wd->fst_ctx,
-            ft->vartype,
-            dir,
-            data->size,
-            tb_get(tb),
-            0,
-            type_pp(elem),
-            FST_SVT_VHDL_SIGNAL,
-            ft->sdt);
+         mem->name      = xstrdup(tb_get(tb));
+         mem->suffix    = is_memory
+            ? xasprintf("[%d:%d]", msb, lsb) : xstrdup("");
+         mem->type_name = xstrdup(type_pp(elem));
+         mem->vardir    = dir;
+         mem->low       = low;
+         mem->nscopes   = wd->scopes.count;
+         mem->scopes    = xmalloc_array(mem->nscopes, sizeof(fst_scope_t));
+         memcpy(mem->scopes, wd->scopes.items,
+                mem->nscopes * sizeof(fst_scope_t));
       }
+      else {
+         for (int i = 0; i < length; i++) {
+            tb_rewind(tb);
+            tb_istr(tb, tree_ident(d));
+            tb_printf(tb, "[%"PRIi64"]", low + i);
+            if (is_memory)
+               tb_printf(tb, "[%d:%d]", msb, lsb);
+            tb_downcase(tb);
+
+            data->handle[i] = wave_create_var(wd, ft, dir, data->size,
+                                              tb_get(tb), elem);
+         }
 
-      fstWriterSetAttrEnd(wd->fst_ctx);
+         if (wd->vcd == NULL)
+            fstWriterSetAttrEnd(wd->fst_ctx);
+      }
    }
    else {
       fst_type_t *ft = fst_type_for(type, tree_loc(d));
@@ -525,16 +1189,8 @@ static void fst_create_array_var(wave_dumper_t *wd, tree_t d, rt_signal_t *s,
       data->size  = (high - low + 1) * ft->size;
       data->count = 1;
 
-      data->handle[0] = fstWriterCreateVar2(
-         wd->fst_ctx,
-         ft->vartype,
-         dir,
-         data->size,
-         tb_get(tb),
-         0,
-         type_pp(type),
-         FST_SVT_VHDL_SIGNAL,
-         ft->sdt);
+      data->handle[0] = wave_create_var(wd, ft, dir, data->size,
+                                        tb_get(tb), type);
 
       if (wd->gtkw != NULL)
          fprintf(wd->gtkw->file, "%s.%s\n", tb_get(wd->gtkw->hier), tb_get(tb));
@@ -543,11 +1199,20 @@ static void fst_create_array_var(wave_dumper_t *wd, tree_t d, rt_signal_t *s,
    data->decl   = d;
    data->signal = s;
    data->dir    = tree_subkind(r);
-   data->dumper = wd;
-   data->watch  = model_set_event_cb(wd->model, data->signal,
-                                     fst_event_cb, data, true);
 
-   fst_event_cb(0, data->signal, data->watch, data);
+   if (data->memory != NULL) {
+      // Single element view of the array used for formatting
+      fst_data_t *view = data->memory->elem;
+      view->dumper = wd;
+      view->type   = data->type;
+      view->decl   = d;
+      view->signal = s;
+      view->dir    = data->dir;
+      view->size   = data->size;
+      view->count  = 1;
+   }
+
+   fst_watch_signal(wd, data);
 }
 
 static void fst_create_scalar_var(wave_dumper_t *wd, tree_t d, rt_signal_t *s,
@@ -561,7 +1226,6 @@ static void fst_create_scalar_var(wave_dumper_t *wd, tree_t d, rt_signal_t *s,
    data->type   = ft;
    data->count  = 1;
    data->size   = ft->size;
-   data->dumper = wd;
 
    enum fstVarDir dir = FST_VD_IMPLICIT;
 
@@ -578,16 +1242,12 @@ static void fst_create_scalar_var(wave_dumper_t *wd, tree_t d, rt_signal_t *s,
    tb_istr(tb, tree_ident(d));
    tb_downcase(tb);
 
-   data->handle[0] = fstWriterCreateVar2(wd->fst_ctx, ft->vartype, dir,
-                                         ft->size, tb_get(tb), 0, type_pp(type),
-                                         FST_SVT_VHDL_SIGNAL, ft->sdt);
+   data->handle[0] = wave_create_var(wd, ft, dir, ft->size, tb_get(tb), type);
 
    data->decl   = d;
    data->signal = s;
-   data->watch  = model_set_event_cb(wd->model, data->signal, fst_event_cb,
-                                     data, true);
 
-   fst_event_cb(0, data->signal, data->watch, data);
+   fst_watch_signal(wd, data);
 
    if (wd->gtkw != NULL)
       fprintf(wd->gtkw->file, "%s.%s\n", tb_get(wd->gtkw->hier), tb_get(tb));
@@ -601,7 +1261,7 @@ static void fst_create_record_var(wave_dumper_t *wd, tree_t d,
    tb_istr(tb, tree_ident(d));
    tb_downcase(tb);
 
-   fstWriterSetScope(wd->fst_ctx, FST_ST_VHDL_RECORD, tb_get(tb), NULL);
+   wave_set_scope(wd, FST_ST_VHDL_RECORD, tb_get(tb), NULL);
 
    size_t hlen = 0;
    if (wd->gtkw != NULL) {
@@ -617,7 +1277,7 @@ static void fst_create_record_var(wave_dumper_t *wd, tree_t d,
       fst_process_signal(wd, scope, f, cons, tb);
    }
 
-   fstWriterSetUpscope(wd->fst_ctx);
+   wave_set_upscope(wd);
 
    if (wd->gtkw != NULL)
       tb_trim(wd->gtkw->hier, hlen);
@@ -665,15 +1325,18 @@ static void fst_process_hier(wave_dumper_t *wd, tree_t h, tree_t block)
       break;
    }
 
-   const loc_t *loc = tree_loc(h);
-   fstWriterSetSourceStem(wd->fst_ctx, loc_file_str(loc), loc->first_line, 1);
+   if (wd->fst_ctx != NULL) {
+      const loc_t *loc = tree_loc(h);
+      fstWriterSetSourceStem(wd->fst_ctx, loc_file_str(loc),
+                             loc->first_line, 1);
+   }
 
    LOCAL_TEXT_BUF tb = tb_new();
    tb_istr(tb, tree_ident(block));
    tb_downcase(tb);
 
    // TODO: store the component name in T_HIER somehow?
-   fstWriterSetScope(wd->fst_ctx, st, tb_get(tb), "");
+   wave_set_scope(wd, st, tb_get(tb), "");
 
    if (wd->gtkw != NULL) {
       if (tb_len(wd->gtkw->hier) > 0)
@@ -685,14 +1348,40 @@ static void fst_process_hier(wave_dumper_t *wd, tree_t h, tree_t block)
    }
 }
 
-static void fst_walk_design(wave_dumper_t *wd, tree_t block)
+static void fst_walk_design(wave_dumper_t *wd, glob_nfa_t *nfa, tree_t block,
+                            const glob_states_t *parent, ident_t ppath)
 {
    tree_t h = tree_decl(block, 0);
    assert(tree_kind(h) == T_HIER);
-   fst_process_hier(wd, h, block);
 
    ident_t hpath = tree_ident(h);
 
+   // Signals are matched against the full path "<hpath>:<name>" so
+   // compute the pattern states for the "<hpath>:" prefix, continuing
+   // from the parent scope where possible
+   const char *hstr = istr(hpath), *tail = hstr;
+   const glob_states_t *from = &(nfa->start);
+   if (ppath != NULL) {
+      const size_t plen = strlen(istr(ppath));
+      if (strncmp(hstr, istr(ppath), plen) == 0 && hstr[plen] == ':') {
+         from = parent;
+         tail = hstr + plen + 1;
+      }
+   }
+
+   glob_nfa_feed(nfa, from, tail);
+   glob_nfa_feed(nfa, &(nfa->cur), ":");
+
+   const glob_filter_t filter = glob_nfa_filter(nfa, &(nfa->cur));
+   if (filter == FILTER_NONE)
+      return;   // Nothing in this scope or below can be dumped
+
+   glob_states_t states = AINIT;
+   ARESIZE(states, nfa->cur.count);
+   memcpy(states.items, nfa->cur.items, states.count * sizeof(uint32_t));
+
+   fst_process_hier(wd, h, block);
+
    rt_scope_t *scope = find_scope(wd->model, block);
    if (scope == NULL)
       fatal_trace("missing scope for %s", istr(hpath));
@@ -702,19 +1391,19 @@ static void fst_walk_design(wave_dumper_t *wd, tree_t block)
    const int nports = tree_ports(block);
    for (int i = 0; i < nports; i++) {
       tree_t p = tree_port(block, i);
-      ident_t path = ident_prefix(hpath, ident_downcase(tree_ident(p)), ':');
-      if (wave_should_dump(path))
+      if (filter == FILTER_ALL
+          || wave_should_dump(nfa, &states, tree_ident(p)))
          fst_process_signal(wd, scope, p, NULL, tb);
    }
 
    const int ndecls = tree_decls(block);
    for (int i = 0; i < ndecls; i++) {
       tree_t d = tree_decl(block, i);
-      if (tree_kind(d) == T_SIGNAL_DECL) {
-         ident_t path = ident_prefix(hpath, ident_downcase(tree_ident(d)), ':');
-         if (wave_should_dump(path))
-            fst_process_signal(wd, scope, d, NULL, tb);
-      }
+      if (tree_kind(d) != T_SIGNAL_DECL)
+         continue;
+      else if (filter == FILTER_ALL
+               || wave_should_dump(nfa, &states, tree_ident(d)))
+         fst_process_signal(wd, scope, d, NULL, tb);
    }
 
    const int nstmts = tree_stmts(block);
@@ -722,7 +1411,7 @@ static void fst_walk_design(wave_dumper_t *wd, tree_t block)
       tree_t s = tree_stmt(block, i);
       switch (tree_kind(s)) {
       case T_BLOCK:
-         fst_walk_design(wd, s);
+         fst_walk_design(wd, nfa, s, &states, hpath);
          break;
       case T_PROCESS:
          break;
@@ -732,7 +1421,7 @@ static void fst_walk_design(wave_dumper_t *wd, tree_t block)
       }
    }
 
-   fstWriterSetUpscope(wd->fst_ctx);
+   wave_set_upscope(wd);
 
    if (wd->gtkw != NULL) {
       const char *h = tb_get(wd->gtkw->hier);
@@ -740,6 +1429,8 @@ static void fst_walk_design(wave_dumper_t *wd, tree_t block)
       if (prev != NULL)
          tb_trim(wd->gtkw->hier, prev - h);
    }
+
+   ACLEAR(states);
 }
 
 void wave_dumper_restart(wave_dumper_t *wd, rt_model_t *m)
@@ -747,7 +1438,32 @@ void wave_dumper_restart(wave_dumper_t *wd, rt_model_t *m)
    wd->last_time = UINT64_MAX;
    wd->model     = m;
 
-   fst_walk_design(wd, tree_stmt(wd->top, 0));
+   glob_nfa_t nfa;
+   glob_nfa_init(&nfa);
+   fst_walk_design(wd, &nfa, tree_stmt(wd->top, 0), NULL, NULL);
+   glob_nfa_free(&nfa);
+
+   assert(wd->scopes.count == 0);
+   ACLEAR(wd->scopes);
+
+   // Events only set a bit in the dirty map rather than calling back
+   // into the dumper for each change
+   wd->dirty = xcalloc_array((wd->signals.count + 63) / 64, sizeof(uint64_t));
+
+   for (int i = 0; i < wd->signals.count; i++) {
+      fst_data_t *data = wd->signals.items[i];
+      data->watch = model_set_dirty_bit(m, data->signal, wd->dirty, i);
+   }
+
+   model_set_global_cb(m, RT_LAST_KNOWN_DELTA_CYCLE, fst_sample_cb, wd);
+
+   if (wd->start > 0) {
+      const uint64_t now = model_now(m, NULL);
+      if (wd->start > now)
+         model_set_timeout_cb(m, wd->start - now, fst_start_cb, wd);
+      else
+         fst_mark_all(wd);
+   }
 
    if (wd->gtkw != NULL) {
       fclose(wd->gtkw->file);
@@ -756,50 +1472,43 @@ void wave_dumper_restart(wave_dumper_t *wd, rt_model_t *m)
       wd->gtkw = NULL;
    }
 
+   if (wd->vcd != NULL)
+      vcd_end_definitions(wd->vcd);
+   else if (opt_get_int(OPT_WAVE_THREAD))
+      ring_start(wd);
+
    model_set_global_cb(m, RT_END_OF_SIMULATION, fst_close, wd);
 }
 
 wave_dumper_t *wave_dumper_new(const char *file, const char *gtkw_file,
                                tree_t top, wave_format_t format)
 {
+   if (bit_table[0][0] == '\0') {
+      for (int i = 0; i < 256; i++) {
+         for (int j = 0; j < 8; j++)
+            bit_table[i][j] = (i & (0x80 >> j)) ? '1' : '0';
+      }
+   }
+
    wave_dumper_t *wd = xcalloc(sizeof(wave_dumper_t));
    wd->top       = top;
    wd->last_time = UINT64_MAX;
+   wd->stop      = UINT64_MAX;
 
-   if (format == WAVE_FORMAT_VCD) {
-#if defined __CYGWIN__ || defined __MINGW32__
-      const char *tmpdir = ".";
-#else
-      char tmpdir[PATH_MAX] = "/tmp/vcdXXXXXX";
-      checked_sprintf(tmpdir, PATH_MAX, "%s/vcdXXXXXX",
-                      getenv("TMPDIR") ?: "/tmp");
-      if (mkdtemp(tmpdir) == NULL)
-         fatal_errno("mkdtemp");
-#endif
-
-      wd->vcdfile = fopen(file, "wb");
-      if (wd->vcdfile == NULL)
-         fatal_errno("%s", file);
-
-      wd->tmpfst  = xasprintf("%s" DIR_SEP "temp.fst", tmpdir);
-      wd->fst_ctx = fstWriterCreate(wd->tmpfst, 1);
-   }
+   if (format == WAVE_FORMAT_VCD)
+      wd->vcd = vcd_writer_new(file, opt_get_int(OPT_WAVE_THREAD));
    else {
-      wd->vcdfile = NULL;
-      wd->tmpfst  = NULL;
-      wd->fst_ctx = fstWriterCreate(file, 1);
+      if ((wd->fst_ctx = fstWriterCreate(file, 1)) == NULL)
+         fatal("fstWriterCreate failed");
+
+      fstWriterSetFileType(wd->fst_ctx, FST_FT_VHDL);
+      fstWriterSetTimescale(wd->fst_ctx, -15);
+      fstWriterSetVersion(wd->fst_ctx, PACKAGE_STRING);
+      fstWriterSetPackType(wd->fst_ctx, 0);
+      fstWriterSetRepackOnClose(wd->fst_ctx, 1);
+      fstWriterSetParallelMode(wd->fst_ctx, 0);
    }
 
-   if (wd->fst_ctx == NULL)
-      fatal("fstWriterCreate failed");
-
-   fstWriterSetFileType(wd->fst_ctx, FST_FT_VHDL);
-   fstWriterSetTimescale(wd->fst_ctx, -15);
-   fstWriterSetVersion(wd->fst_ctx, PACKAGE_STRING);
-   fstWriterSetPackType(wd->fst_ctx, 0);
-   fstWriterSetRepackOnClose(wd->fst_ctx, 1);
-   fstWriterSetParallelMode(wd->fst_ctx, 0);
-
    if (gtkw_file != NULL) {
       wd->gtkw = xcalloc(sizeof(gtkw_writer_t));
       if ((wd->gtkw->file = fopen(gtkw_file, "w")) == NULL)
@@ -820,6 +1529,33 @@ void wave_dumper_free(wave_dumper_t *wd)
    free(wd);
 }
 
+void wave_dumper_set_window(wave_dumper_t *wd, uint64_t start,
+                            uint64_t stop)
+{
+   assert(start < stop);
+   assert(wd->model == NULL);
+
+   wd->start = start;
+   wd->stop  = stop;
+
+   if (wd->flight != NULL)
+      wd->flight->seg_start = start;
+}
+
+void wave_dumper_set_flight(wave_dumper_t *wd, uint64_t history,
+                            vhdl_severity_t trigger)
+{
+   assert(history > 0);
+   assert(wd->model == NULL);
+
+   flight_rec_t *fr = xcalloc(sizeof(flight_rec_t));
+   fr->history   = history;
+   fr->trigger   = trigger;
+   fr->seg_start = wd->start;
+
+   wd->flight = fr;
+}
+
 void wave_include_glob(const char *glob)
 {
    APUSH(incl, ((glob_t){ .text = strdup(glob), .len = strlen(glob) }));
@@ -871,17 +1607,139 @@ void wave_include_file(const char *base)
    wave_process_file(exclf, false);
 }
 
-static bool wave_should_dump(ident_t name)
+static void glob_nfa_init(glob_nfa_t *nfa)
 {
-   for (int i = 0; i < excl.count; i++) {
-      if (ident_glob(name, excl.items[i].text, excl.items[i].len))
-         return false;
+   size_t len = 1;
+   for (int i = 0; i < excl.count; i++)
+      len += excl.items[i].len + 1;
+   for (int i = 0; i < incl.count; i++)
+      len += incl.items[i].len + 1;
+
+   memset(nfa, '\0', sizeof(glob_nfa_t));
+   nfa->len   = len;
+   nfa->text  = xmalloc(len);
+   nfa->mark  = xcalloc_array(len, sizeof(uint32_t));
+   nfa->nincl = incl.count;
+
+   char *p = nfa->text;
+   for (int i = 0; i < excl.count + incl.count; i++) {
+      const glob_t *g = i < excl.count
+         ? &(excl.items[i]) : &(incl.items[i - excl.count]);
+
+      if (i == excl.count)
+         nfa->nexcl = p - nfa->text;
+
+      APUSH(nfa->start, p - nfa->text);
+      memcpy(p, g->text, g->len);
+      p += g->len;
+      *p++ = '\0';
    }
 
-   for (int i = 0; i < incl.count; i++) {
-      if (ident_glob(name, incl.items[i].text, incl.items[i].len))
-         return true;
+   if (incl.count == 0)
+      nfa->nexcl = p - nfa->text;
+}
+
+static void glob_nfa_free(glob_nfa_t *nfa)
+{
+   ACLEAR(nfa->start);
+   ACLEAR(nfa->cur);
+   ACLEAR(nfa->next);
+   free(nfa->text);
+   free(nfa->mark);
+}
+
+static inline void glob_nfa_add(glob_nfa_t *nfa, uint32_t state)
+{
+   if (nfa->mark[state] != nfa->gen) {
+      nfa->mark[state] = nfa->gen;
+      APUSH(nfa->next, state);
+   }
+}
+
+static void glob_nfa_feed(glob_nfa_t *nfa, const glob_states_t *from,
+                          const char *str)
+{
+   // Leaves the set of states after consuming all of STR in nfa->cur
+   ATRIM(nfa->next, 0);
+   for (int i = 0; i < from->count; i++)
+      APUSH(nfa->next, from->items[i]);
+
+   for (const char *p = str; *p != '\0' && nfa->next.count > 0; p++) {
+      const glob_states_t tmp = nfa->cur;
+      nfa->cur = nfa->next;
+      nfa->next = tmp;
+      ATRIM(nfa->next, 0);
+
+      if (++(nfa->gen) == 0) {
+         memset(nfa->mark, '\0', nfa->len * sizeof(uint32_t));
+         nfa->gen = 1;
+      }
+
+      // A star matches one or more characters as in ident_glob
+      for (int i = 0; i < nfa->cur.count; i++) {
+         const uint32_t state = nfa->cur.items[i];
+         const char g = nfa->text[state];
+         if (g == '*') {
+            glob_nfa_add(nfa, state);
+            glob_nfa_add(nfa, state + 1);
+         }
+         else if (g == *p && g != '\0')
+            glob_nfa_add(nfa, state + 1);
+      }
+   }
+
+   const glob_states_t tmp = nfa->cur;
+   nfa->cur = nfa->next;
+   nfa->next = tmp;
+}
+
+static glob_filter_t glob_nfa_filter(glob_nfa_t *nfa,
+                                     const glob_states_t *states)
+{
+   // Decide whether every, some, or no non-empty extension of the
+   // prefix that led to this set of states should be dumped
+   bool excl_live = false, incl_live = false, incl_all = nfa->nincl == 0;
+   for (int i = 0; i < states->count; i++) {
+      const uint32_t state = states->items[i];
+      const char *g = nfa->text + state;
+      if (g[0] == '\0')
+         continue;
+
+      const bool all = g[0] == '*' && g[1] == '\0';
+      if (state < nfa->nexcl) {
+         if (all)
+            return FILTER_NONE;
+         excl_live = true;
+      }
+      else {
+         incl_live = true;
+         incl_all |= all;
+      }
+   }
+
+   if (!incl_live && nfa->nincl > 0)
+      return FILTER_NONE;
+   else if (!excl_live && incl_all)
+      return FILTER_ALL;
+   else
+      return FILTER_SOME;
+}
+
+static bool wave_should_dump(glob_nfa_t *nfa, const glob_states_t *scope,
+                             ident_t name)
+{
+   glob_nfa_feed(nfa, scope, istr(ident_downcase(name)));
+
+   bool include = nfa->nincl == 0;
+   for (int i = 0; i < nfa->cur.count; i++) {
+      const uint32_t state = nfa->cur.items[i];
+      if (nfa->text[state] != '\0')
+         continue;
+      else if (state < nfa->nexcl)
+         return false;
+      else
+         include = true;
    }
 
-   return (incl.count == 0);
+   return include;
 }
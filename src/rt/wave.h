@@ -19,16 +19,27 @@
 #define _RT_WAVE_H
 
 #include "prim.h"
+#include "diag.h"
 
 typedef enum {
    WAVE_FORMAT_FST,
    WAVE_FORMAT_VCD
 } wave_format_t;
 
+typedef enum {
+   DUMP_ARRAYS_NONE,
+   DUMP_ARRAYS_ALL,
+   DUMP_ARRAYS_SPARSE
+} dump_arrays_t;
+
 wave_dumper_t *wave_dumper_new(const char *file, const char *gtkw_file,
                                tree_t top, wave_format_t format);
 void wave_dumper_free(wave_dumper_t *wd);
 void wave_dumper_restart(wave_dumper_t *wd, rt_model_t *m);
+void wave_dumper_set_window(wave_dumper_t *wd, uint64_t start,
+                            uint64_t stop);
+void wave_dumper_set_flight(wave_dumper_t *wd, uint64_t history,
+                            vhdl_severity_t trigger);
 
 void wave_include_glob(const char *glob);
 void wave_exclude_glob(const char *glob);
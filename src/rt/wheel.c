@@ -0,0 +1,285 @@
+//
+//  Copyright (C) 2022  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "util.h"
+#include "rt/heap.h"
+#include "rt/wheel.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+
+//
+// Hierarchical timing wheel: each level has 64 slots and level N
+// holds keys which first differ from the current time in bits
+// [6N, 6N+6). Keys beyond the last level are kept in a binary heap
+// and moved into the wheel once the current time reaches them.
+//
+
+#define SLOT_BITS  6
+#define NUM_SLOTS  (1 << SLOT_BITS)
+#define MAX_LEVELS 10
+#define NODE_CHUNK 1024
+
+typedef struct _wheel_node wheel_node_t;
+typedef struct _node_chunk node_chunk_t;
+
+struct _wheel_node {
+   wheel_node_t *next;
+   uint64_t      key;
+   void         *user;
+};
+
+typedef struct {
+   wheel_node_t *head;
+   wheel_node_t *tail;
+} wheel_slot_t;
+
+typedef struct {
+   uint64_t     occupied;
+   wheel_slot_t slots[NUM_SLOTS];
+} wheel_level_t;
+
+struct _node_chunk {
+   node_chunk_t *next;
+   wheel_node_t  nodes[NODE_CHUNK];
+};
+
+struct _wheel {
+   uint64_t       now;
+   size_t         count;
+   unsigned       nlevels;
+   wheel_node_t  *min;
+   wheel_node_t  *freelist;
+   node_chunk_t  *chunks;
+   heap_t        *overflow;
+   wheel_level_t  levels[0];
+};
+
+wheel_t *wheel_new(uint64_t horizon)
+{
+   const int bits = horizon <= 1 ? 1 : 64 - __builtin_clzll(horizon - 1);
+   const int nlevels = MIN((bits + SLOT_BITS - 1) / SLOT_BITS, MAX_LEVELS);
+
+   wheel_t *w = xcalloc_flex(sizeof(wheel_t), nlevels, sizeof(wheel_level_t));
+   w->nlevels  = nlevels;
+   w->overflow = heap_new(128);
+
+   return w;
+}
+
+void wheel_free(wheel_t *w)
+{
+   for (node_chunk_t *it = w->chunks, *tmp; it; it = tmp) {
+      tmp = it->next;
+      free(it);
+   }
+
+   heap_free(w->overflow);
+   free(w);
+}
+
+static wheel_node_t *wheel_alloc_node(wheel_t *w)
+{
+   if (unlikely(w->freelist == NULL)) {
+      node_chunk_t *c = xmalloc(sizeof(node_chunk_t));
+      c->next = w->chunks;
+      w->chunks = c;
+
+      for (int i = 0; i < NODE_CHUNK; i++) {
+         c->nodes[i].next = w->freelist;
+         w->freelist = &(c->nodes[i]);
+      }
+   }
+
+   wheel_node_t *n = w->freelist;
+   w->freelist = n->next;
+   return n;
+}
+
+static void wheel_place(wheel_t *w, wheel_node_t *n)
+{
+   const uint64_t diff = n->key ^ w->now;
+   const int level =
+      diff < NUM_SLOTS ? 0 : (63 - __builtin_clzll(diff)) / SLOT_BITS;
+
+   if (level >= w->nlevels) {
+      heap_insert(w->overflow, n->key, n);
+      return;
+   }
+
+   const int slot = (n->key >> (level * SLOT_BITS)) & (NUM_SLOTS - 1);
+
+   wheel_level_t *l = &(w->levels[level]);
+   wheel_slot_t *s = &(l->slots[slot]);
+
+   n->next = NULL;
+
+   if (s->tail == NULL)
+      s->head = s->tail = n;
+   else
+      s->tail = s->tail->next = n;
+
+   l->occupied |= UINT64_C(1) << slot;
+}
+
+static void wheel_cascade(wheel_t *w, int level)
+{
+   // Advance the current time to the start of the first occupied slot
+   // in this level and redistribute its contents to lower levels
+
+   wheel_level_t *l = &(w->levels[level]);
+   const int slot = __builtin_ctzll(l->occupied);
+   const uint64_t mask = (UINT64_C(1) << ((level + 1) * SLOT_BITS)) - 1;
+
+   w->now = (w->now & ~mask) | ((uint64_t)slot << (level * SLOT_BITS));
+
+   wheel_node_t *list = l->slots[slot].head;
+   l->slots[slot].head = l->slots[slot].tail = NULL;
+   l->occupied &= ~(UINT64_C(1) << slot);
+
+   for (wheel_node_t *it = list, *next; it; it = next) {
+      next = it->next;
+      wheel_place(w, it);
+   }
+}
+
+static void wheel_refill(wheel_t *w)
+{
+   // Move all overflow keys which are now within the horizon into the
+   // wheel
+   const int shift = w->nlevels * SLOT_BITS;
+   while (heap_size(w->overflow) > 0) {
+      wheel_node_t *n = heap_min(w->overflow);
+      if ((n->key ^ w->now) >> shift)
+         break;
+
+      heap_extract_min(w->overflow);
+      wheel_place(w, n);
+   }
+}
+
+static wheel_node_t *wheel_find_min(wheel_t *w)
+{
+   for (int i = 0; i < w->nlevels; i++) {
+      wheel_level_t *l = &(w->levels[i]);
+      if (l->occupied == 0)
+         continue;
+
+      wheel_node_t *min = l->slots[__builtin_ctzll(l->occupied)].head;
+      if (i > 0) {
+         // Keys in higher level slots are not sorted
+         for (wheel_node_t *it = min->next; it; it = it->next) {
+            if (it->key < min->key)
+               min = it;
+         }
+      }
+
+      return min;
+   }
+
+   return heap_min(w->overflow);
+}
+
+void *wheel_min(wheel_t *w)
+{
+   if (unlikely(w->count == 0))
+      fatal_trace("wheel underflow") LCOV_EXCL_LINE;
+
+   if (w->min == NULL)
+      w->min = wheel_find_min(w);
+
+   return w->min->user;
+}
+
+void *wheel_extract_min(wheel_t *w)
+{
+   if (unlikely(w->count == 0))
+      fatal_trace("wheel underflow") LCOV_EXCL_LINE;
+
+   wheel_node_t *n = NULL;
+   for (;;) {
+      wheel_level_t *l0 = &(w->levels[0]);
+      if (l0->occupied != 0) {
+         const int slot = __builtin_ctzll(l0->occupied);
+         wheel_slot_t *s = &(l0->slots[slot]);
+
+         n = s->head;
+         if ((s->head = n->next) == NULL) {
+            s->tail = NULL;
+            l0->occupied &= ~(UINT64_C(1) << slot);
+         }
+         break;
+      }
+
+      int level = 1;
+      while (level < w->nlevels && w->levels[level].occupied == 0)
+         level++;
+
+      if (level < w->nlevels)
+         wheel_cascade(w, level);
+      else {
+         n = heap_extract_min(w->overflow);
+         w->now = n->key;
+         wheel_refill(w);
+         break;
+      }
+   }
+
+   assert(n->key >= w->now);
+   w->now = n->key;
+   w->min = NULL;
+   w->count--;
+
+   void *user = n->user;
+   n->next = w->freelist;
+   w->freelist = n;
+   return user;
+}
+
+void wheel_insert(wheel_t *w, uint64_t key, void *user)
+{
+   if (unlikely(key < w->now))
+      fatal_trace("wheel key %"PRIu64" is before current time %"PRIu64,
+                  key, w->now);
+
+   wheel_node_t *n = wheel_alloc_node(w);
+   n->key  = key;
+   n->user = user;
+
+   wheel_place(w, n);
+
+   if (w->min != NULL && key < w->min->key)
+      w->min = n;
+
+   w->count++;
+}
+
+size_t wheel_size(wheel_t *w)
+{
+   return w->count;
+}
+
+void wheel_rewind(wheel_t *w, uint64_t now)
+{
+   // Extracting a key moves the current time forwards which can only be
+   // undone once the wheel is empty as placement depends on it
+   if (unlikely(w->count > 0))
+      fatal_trace("cannot rewind non-empty wheel");
+
+   w->now = now;
+}
@@ -35,7 +35,6 @@
 #include <sanitizer/tsan_interface.h>
 #endif
 
-#define MAX_THREADS  64
 #define LOCK_SPINS   15
 #define MIN_TAKE     8
 #define PARKING_BAYS 64
@@ -73,11 +72,20 @@ STATIC_ASSERT(sizeof(lock_stats_t) == 64)
    __tsan_mutex_pre_unlock(addr, __tsan_mutex_linker_init);
 #define TSAN_POST_UNLOCK(addr) \
    __tsan_mutex_post_unlock(addr, __tsan_mutex_linker_init);
+#define TSAN_PRE_TRYLOCK(addr) \
+   __tsan_mutex_pre_lock(addr, __tsan_mutex_linker_init    \
+                         | __tsan_mutex_try_lock);
+#define TSAN_POST_TRYLOCK(addr, ok) \
+   __tsan_mutex_post_lock(addr, __tsan_mutex_linker_init   \
+                          | __tsan_mutex_try_lock          \
+                          | ((ok) ? 0 : __tsan_mutex_try_lock_failed), 0);
 #else
 #define TSAN_PRE_LOCK(addr)
 #define TSAN_POST_LOCK(addr)
 #define TSAN_PRE_UNLOCK(addr)
 #define TSAN_POST_UNLOCK(addr)
+#define TSAN_PRE_TRYLOCK(addr)
+#define TSAN_POST_TRYLOCK(addr, ok)
 #endif
 
 #define PTHREAD_CHECK(op, ...) do {             \
@@ -238,7 +246,7 @@ static void print_lock_stats(void)
 }
 #endif
 
-static void join_worker_threads(void)
+static void join_worker_threads(bool at_exit)
 {
    atomic_store(&should_stop, true);
 
@@ -253,17 +261,34 @@ static void join_worker_threads(void)
          continue;  // Freed thread struct
       case USER_THREAD:
       case MAIN_THREAD:
-         fatal_trace("leaked a user thread: %s", t->name);
+         // User threads such as the waveform writer may still be
+         // running while the simulation is in progress
+         if (at_exit)
+            fatal_trace("leaked a user thread: %s", t->name);
+         continue;
       }
    }
 
-   assert(atomic_load(&running_threads) == 1);
+   assert(!at_exit || atomic_load(&running_threads) == 1);
+}
+
+static void join_threads_at_exit(void)
+{
+   join_worker_threads(true);
 }
 
 void stop_workers(void)
 {
    // Temporary until runtime is thread-safe
-   join_worker_threads();
+   join_worker_threads(false);
+}
+
+void restart_workers(void)
+{
+   // Allow worker threads to be created again after stop_workers, for
+   // example in a child process after fork
+   assert(atomic_load(&running_threads) == 1);
+   atomic_store(&should_stop, false);
 }
 
 static nvc_thread_t *thread_new(thread_fn_t fn, void *arg,
@@ -312,7 +337,7 @@ void thread_init(void)
       atexit(print_lock_stats);
 #endif
 
-   atexit(join_worker_threads);
+   atexit(join_threads_at_exit);
 }
 
 int thread_id(void)
@@ -383,13 +408,13 @@ static parking_bay_t *parking_bay_for(void *cookie)
    return &(parking_bays[a % PARKING_BAYS]);
 }
 
-static void thread_park(void *cookie, park_fn_t fn)
+static void thread_park(void *cookie, park_fn_t fn, void *arg)
 {
    parking_bay_t *bay = parking_bay_for(cookie);
 
    PTHREAD_CHECK(pthread_mutex_lock, &(bay->mutex));
    {
-      if ((*fn)(bay, cookie)) {
+      if ((*fn)(bay, arg)) {
          bay->parked++;
          PTHREAD_CHECK(pthread_cond_wait, &(bay->cond), &(bay->mutex));
          assert(bay->parked > 0);
@@ -427,6 +452,44 @@ void spin_wait(void)
 #endif
 }
 
+typedef struct {
+   int32_t *word;
+   int32_t  value;
+} wait_args_t;
+
+static bool wait_park_cb(parking_bay_t *bay, void *arg)
+{
+   const wait_args_t *args = arg;
+
+   // This is called with the park mutex held so cannot race with the
+   // unpark in thread_wake
+   return relaxed_load(args->word) == args->value;
+}
+
+static void wake_unpark_cb(parking_bay_t *bay, void *cookie)
+{
+   // Taking the park mutex is sufficient to avoid a lost wakeup
+}
+
+void thread_wait(int32_t *word, int32_t value)
+{
+   // Block until the value at WORD is no longer VALUE: the thread
+   // changing it must call thread_wake afterwards
+   for (int spins = 0; load_acquire(word) == value; spins++) {
+      if (spins < LOCK_SPINS)
+         spin_wait();
+      else {
+         wait_args_t args = { word, value };
+         thread_park(word, wait_park_cb, &args);
+      }
+   }
+}
+
+void thread_wake(int32_t *word)
+{
+   thread_unpark(word, wake_unpark_cb);
+}
+
 static bool lock_park_cb(parking_bay_t *bay, void *cookie)
 {
    nvc_lock_t *lock = cookie;
@@ -473,7 +536,7 @@ void nvc_lock(nvc_lock_t *lock)
          atomic_cas(lock, IS_LOCKED, IS_LOCKED | HAS_PARKED);
 
          LOCK_EVENT(parks, 1);
-         thread_park(lock, lock_park_cb);
+         thread_park(lock, lock_park_cb, lock);
 
          if ((state = relaxed_load(lock)) & IS_LOCKED) {
             // Someone else grabbed the lock before our thread was unparked
@@ -496,6 +559,18 @@ void nvc_lock(nvc_lock_t *lock)
    TSAN_POST_LOCK(lock);
 }
 
+bool nvc_trylock(nvc_lock_t *lock)
+{
+   TSAN_PRE_TRYLOCK(lock);
+
+   int8_t state = relaxed_load(lock);
+   const bool locked =
+      !(state & IS_LOCKED) && atomic_cas(lock, state, state | IS_LOCKED);
+
+   TSAN_POST_TRYLOCK(lock, locked);
+   return locked;
+}
+
 void nvc_unlock(nvc_lock_t *lock)
 {
    TSAN_PRE_UNLOCK(lock);
@@ -795,6 +870,18 @@ static void create_workers(int needed)
    }
 }
 
+static void workq_run_inline(workq_t *wq)
+{
+   assert(wq->state == IDLE);
+   wq->state = START;
+
+   assert(wq->rptr == 0);
+   for (int i = 0; i < wq->wptr; i++)
+      (*wq->entryq[i].fn)(wq->context, wq->entryq[i].arg);
+
+   wq->rptr = wq->comp = wq->wptr;
+}
+
 void workq_start(workq_t *wq)
 {
    if (my_thread->kind != MAIN_THREAD)
@@ -810,16 +897,17 @@ void workq_start(workq_t *wq)
       assert(wq->state == IDLE);
       wq->state = START;
    }
-   else {
-      assert(wq->state == IDLE);
-      wq->state = START;
+   else
+      workq_run_inline(wq);
+}
 
-      assert(wq->rptr == 0);
-      for (int i = 0; i < wq->wptr; i++)
-         (*wq->entryq[i].fn)(wq->context, wq->entryq[i].arg);
+void workq_start_serial(workq_t *wq)
+{
+   if (my_thread->kind != MAIN_THREAD)
+      fatal_trace("workq_start_serial can only be called from the main thread");
 
-      wq->rptr = wq->comp = wq->wptr;
-   }
+   wq->parallel = false;
+   workq_run_inline(wq);
 }
 
 static void workq_parallel_drain(workq_t *wq)
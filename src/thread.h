@@ -18,8 +18,11 @@
 #ifndef _THREAD_H
 #define _THREAD_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
+#define MAX_THREADS 64
+
 #define atomic_add(p, n) __atomic_add_fetch((p), (n), __ATOMIC_SEQ_CST)
 #define atomic_fetch_add(p, n) __atomic_fetch_add((p), (n), __ATOMIC_SEQ_CST)
 #define atomic_load(p) __atomic_load_n((p), __ATOMIC_SEQ_CST)
@@ -56,12 +59,17 @@ nvc_thread_t *thread_create(thread_fn_t fn, void *arg, const char *fmt, ...)
 void *thread_join(nvc_thread_t *thread);
 
 void stop_workers(void);
+void restart_workers(void);
 
 void spin_wait(void);
 
+void thread_wait(int32_t *word, int32_t value);
+void thread_wake(int32_t *word);
+
 typedef int8_t nvc_lock_t;
 
 void nvc_lock(nvc_lock_t *lock);
+bool nvc_trylock(nvc_lock_t *lock);
 void nvc_unlock(nvc_lock_t *lock);
 
 #ifdef DEBUG
@@ -85,6 +93,7 @@ typedef void (*scan_fn_t)(void *, void *, void *);
 workq_t *workq_new(void *context);
 void workq_free(workq_t *wq);
 void workq_start(workq_t *wq);
+void workq_start_serial(workq_t *wq);
 void workq_do(workq_t *wq, task_fn_t fn, void *arg);
 void workq_drain(workq_t *wq);
 void workq_scan(workq_t *wq, scan_fn_t fn, void *arg);
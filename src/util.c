@@ -1530,6 +1530,27 @@ void *map_file(int fd, size_t size)
    return ptr;
 }
 
+void *map_file_writable(int fd, size_t size)
+{
+#ifdef __MINGW32__
+   HANDLE handle = CreateFileMapping((HANDLE) _get_osfhandle(fd), NULL,
+                                     PAGE_READWRITE, 0, size, NULL);
+   if (!handle)
+      fatal_errno("CreateFileMapping");
+
+   void *ptr = MapViewOfFileEx(handle, FILE_MAP_WRITE, 0,
+                               0, (SIZE_T) size, (LPVOID) NULL);
+   CloseHandle(handle);
+   if (ptr == NULL)
+      fatal_errno("MapViewOfFileEx");
+#else
+   void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   if (ptr == MAP_FAILED)
+      fatal_errno("mmap");
+#endif
+   return ptr;
+}
+
 void unmap_file(void *ptr, size_t size)
 {
 #ifdef __MINGW32__
@@ -1554,7 +1575,7 @@ void make_dir(const char *path)
 uint64_t get_timestamp_us()
 {
 #if defined __MINGW32__
-   return 0;  // TODO
+   return get_timestamp_ns() / 1000;
 #else
    struct timespec ts;
    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
@@ -1563,6 +1584,30 @@ uint64_t get_timestamp_us()
 #endif
 }
 
+uint64_t get_timestamp_ns(void)
+{
+#if defined __MINGW32__
+   static LARGE_INTEGER freq;
+   if (freq.QuadPart == 0 && !QueryPerformanceFrequency(&freq))
+      fatal_errno("QueryPerformanceFrequency");
+
+   LARGE_INTEGER ticks;
+   if (!QueryPerformanceCounter(&ticks))
+      fatal_errno("QueryPerformanceCounter");
+
+   // Convert whole seconds separately to avoid overflow
+   const uint64_t secs = ticks.QuadPart / freq.QuadPart;
+   const uint64_t rem  = ticks.QuadPart % freq.QuadPart;
+   return secs * UINT64_C(1000000000)
+      + rem * UINT64_C(1000000000) / freq.QuadPart;
+#else
+   struct timespec ts;
+   if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+      fatal_errno("clock_gettime");
+   return ts.tv_nsec + (ts.tv_sec * UINT64_C(1000000000));
+#endif
+}
+
 void open_pipe(int *rfd, int *wfd)
 {
    int fds[2];
@@ -261,6 +261,7 @@ typedef struct {
 void nvc_rusage(nvc_rusage_t *ru);
 
 uint64_t get_timestamp_us();
+uint64_t get_timestamp_ns(void);
 unsigned nvc_nprocs(void);
 
 void progress(const char *fmt, ...)
@@ -271,6 +272,7 @@ void file_write_lock(int fd);
 void file_unlock(int fd);
 
 void *map_file(int fd, size_t size);
+void *map_file_writable(int fd, size_t size);
 void unmap_file(void *ptr, size_t size);
 void make_dir(const char *path);
 char *search_path(const char *name);
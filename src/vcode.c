@@ -205,13 +205,14 @@ struct _vcode_unit {
 #define VCODE_FOR_EACH_MATCHING_OP(name, k) \
    VCODE_FOR_EACH_OP(name) if (name->kind == k)
 
-#define VCODE_VERSION      27
+#define VCODE_VERSION      28
 #define VCODE_CHECK_UNIONS 0
 
 static __thread vcode_unit_t  active_unit = NULL;
 static __thread vcode_block_t active_block = VCODE_INVALID_BLOCK;
 
 static hash_t         *registry = NULL;
+static hash_t         *records = NULL;
 static vcode_dump_fn_t dump_callback = NULL;
 static void           *dump_arg = NULL;
 
@@ -527,6 +528,12 @@ void vcode_unit_unref(vcode_unit_t unit)
    if (unit->name != NULL)
       hash_delete(registry, unit->name);
 
+   if (records != NULL) {
+      // May hold a reference to this unit
+      hash_free(records);
+      records = NULL;
+   }
+
    for (unsigned i = 0; i < unit->blocks.count; i++) {
       block_t *b = &(unit->blocks.items[i]);
 
@@ -2246,7 +2253,6 @@ bool vtype_eq(vcode_type_t a, vcode_type_t b)
       case VCODE_TYPE_ACCESS:
          return vtype_eq(at->pointed, bt->pointed);
       case VCODE_TYPE_OFFSET:
-      case VCODE_TYPE_OPAQUE:
       case VCODE_TYPE_DEBUG_LOCUS:
          return true;
       case VCODE_TYPE_RESOLUTION:
@@ -2256,6 +2262,7 @@ bool vtype_eq(vcode_type_t a, vcode_type_t b)
          return vtype_eq(at->base, bt->base);
       case VCODE_TYPE_RECORD:
       case VCODE_TYPE_CONTEXT:
+      case VCODE_TYPE_OPAQUE:
          return at->name == bt->name;
       }
 
@@ -2545,12 +2552,13 @@ vcode_type_t vtype_char(void)
    return vtype_int(0, 255);
 }
 
-vcode_type_t vtype_opaque(void)
+vcode_type_t vtype_opaque(ident_t name)
 {
    assert(active_unit != NULL);
 
    vtype_t *n = vtype_array_alloc(&(active_unit->types));
    n->kind = VCODE_TYPE_OPAQUE;
+   n->name = name;
 
    return vtype_new(n);
 }
@@ -2644,7 +2652,8 @@ vcode_type_t vtype_field(vcode_type_t type, int field)
 ident_t vtype_name(vcode_type_t type)
 {
    vtype_t *vt = vcode_type_data(type);
-   assert(vt->kind == VCODE_TYPE_RECORD || vt->kind == VCODE_TYPE_CONTEXT);
+   assert(vt->kind == VCODE_TYPE_RECORD || vt->kind == VCODE_TYPE_CONTEXT
+          || vt->kind == VCODE_TYPE_OPAQUE);
    return vt->name;
 }
 
@@ -2938,6 +2947,47 @@ vcode_unit_t vcode_find_unit(ident_t name)
       return hash_get(registry, name);
 }
 
+static int vcode_unit_find_record(vcode_unit_t vu, ident_t name)
+{
+   for (int i = 0; i < vu->types.count; i++) {
+      const vtype_t *vt = &(vu->types.items[i]);
+      if (vt->kind == VCODE_TYPE_RECORD && vt->name == name
+          && vt->fields.count > 0)
+         return i;
+   }
+
+   return -1;
+}
+
+vcode_unit_t vcode_find_named_record(ident_t name, vcode_type_t *type)
+{
+   if (registry == NULL)
+      return NULL;
+   else if (records == NULL)
+      records = hash_new(128);
+
+   // Remember which unit defines each record to avoid searching every
+   // unit for each access value
+   vcode_unit_t vu = hash_get(records, name);
+   if (vu == NULL) {
+      const void *key;
+      void *value;
+      hash_iter_t it = HASH_BEGIN;
+      while (vu == NULL && hash_iter(registry, &it, &key, &value)) {
+         if (vcode_unit_find_record(value, name) >= 0)
+            vu = value;
+      }
+
+      if (vu == NULL)
+         return NULL;
+
+      hash_put(records, name, vu);
+   }
+
+   *type = MAKE_HANDLE(vu->depth, vcode_unit_find_record(vu, name));
+   return vu;
+}
+
 static void vcode_add_child(vcode_unit_t context, vcode_unit_t child)
 {
    if (context->kind == VCODE_UNIT_THUNK && child->kind != VCODE_UNIT_THUNK)
@@ -5778,11 +5828,11 @@ static void vcode_write_unit(vcode_unit_t unit, fbuf_t *f,
          fbuf_put_uint(f, t->base);
          break;
 
-      case VCODE_TYPE_OPAQUE:
       case VCODE_TYPE_DEBUG_LOCUS:
          break;
 
       case VCODE_TYPE_CONTEXT:
+      case VCODE_TYPE_OPAQUE:
          ident_write(t->name, ident_wr_ctx);
          break;
 
@@ -5955,11 +6005,11 @@ static vcode_unit_t vcode_read_unit(fbuf_t *f, ident_rd_ctx_t ident_rd_ctx,
          t->base = fbuf_get_uint(f);
          break;
 
-      case VCODE_TYPE_OPAQUE:
       case VCODE_TYPE_DEBUG_LOCUS:
          break;
 
       case VCODE_TYPE_CONTEXT:
+      case VCODE_TYPE_OPAQUE:
          t->name = ident_read(ident_rd_ctx);
          break;
 
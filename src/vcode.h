@@ -243,7 +243,7 @@ vcode_type_t vtype_signal(vcode_type_t base);
 vcode_type_t vtype_offset(void);
 vcode_type_t vtype_time(void);
 vcode_type_t vtype_char(void);
-vcode_type_t vtype_opaque(void);
+vcode_type_t vtype_opaque(ident_t name);
 vcode_type_t vtype_find_named_record(ident_t name);
 vcode_type_t vtype_named_record(ident_t name, const vcode_type_t *field_types,
                                 int nfields);
@@ -275,6 +275,7 @@ int vtype_repr_bits(vtype_repr_t repr);
 bool vtype_repr_signed(vtype_repr_t repr);
 
 vcode_unit_t vcode_find_unit(ident_t name);
+vcode_unit_t vcode_find_named_record(ident_t name, vcode_type_t *type);
 vcode_unit_t vcode_unit_next(vcode_unit_t unit);
 vcode_unit_t vcode_unit_child(vcode_unit_t unit);
 void vcode_unit_unref(vcode_unit_t unit);
@@ -51,14 +51,19 @@ static void print_result(double ops_sec, double usec_op)
       printf("%.1f ops/s; %.1f us/op\n", ops_sec, usec_op);
 }
 
-static void run_benchmark(tree_t pack, tree_t proc)
+static double run_benchmark(tree_t pack, tree_t proc)
 {
-   color_printf("$!magenta$## %s$$\n\n", istr(tree_ident(proc)));
+   color_printf("$!magenta$## %s$$", istr(tree_ident(proc)));
+   if (!opt_get_int(OPT_JIT_THREADED))
+      color_printf(" $magenta$(switch dispatch)$$");
+   printf("\n\n");
 
    ident_t name = tree_ident2(proc);
 
    jit_t *j = jit_new();
 
+   jit_register_native_plugin(j);
+
 #ifdef LLVM_HAS_LLJIT
    jit_register_llvm_plugin(j);
 #endif
@@ -96,14 +101,33 @@ static void run_benchmark(tree_t pack, tree_t proc)
       fflush(stdout);
    }
 
+   const double usec_mean = mean(usec_op + 1, ITERATIONS);
+
    color_printf("\n$!green$--> ");
-   print_result(mean(ops_sec + 1, ITERATIONS), mean(usec_op + 1, ITERATIONS));
+   print_result(mean(ops_sec + 1, ITERATIONS), usec_mean);
    color_printf("$$\n");
 
    jit_free(j);
+
+   return usec_mean;
+}
+
+static void compare_dispatch(tree_t pack, tree_t proc)
+{
+   // Run the benchmark with both interpreter dispatch loops
+   opt_set_int(OPT_JIT_THREADED, 1);
+   const double threaded = run_benchmark(pack, proc);
+
+   opt_set_int(OPT_JIT_THREADED, 0);
+   const double loop = run_benchmark(pack, proc);
+
+   opt_set_int(OPT_JIT_THREADED, 1);
+
+   color_printf("$!green$--> threaded dispatch speedup %.2fx$$\n\n",
+                loop / threaded);
 }
 
-static void find_benchmarks(tree_t pack, const char *filter)
+static void find_benchmarks(tree_t pack, const char *filter, bool compare)
 {
    ident_t test_i = ident_new("TEST_");
 
@@ -115,8 +139,12 @@ static void find_benchmarks(tree_t pack, const char *filter)
 
       ident_t id = tree_ident(d);
       if (ident_starts_with(id, test_i)
-          && (filter == NULL || strcasestr(istr(id), filter) != NULL))
-         run_benchmark(pack, d);
+          && (filter == NULL || strcasestr(istr(id), filter) != NULL)) {
+         if (compare)
+            compare_dispatch(pack, d);
+         else
+            run_benchmark(pack, d);
+      }
    }
 }
 
@@ -124,8 +152,11 @@ static void usage(void)
 {
    printf("Usage: jitperf [OPTION]... [FILE]...\n"
           "\n"
+          " -c\t\t\tCompare threaded and switch interpreter dispatch\n"
           " -f PATTERN\t\t Only run tests matching PATTERN\n"
+          " -i\t\t\tInterpret only\n"
           " -L PATH\t\tAdd PATH to library search paths\n"
+          " -s\t\t\tUse switch interpreter dispatch\n"
           "\n");
 
    LOCAL_TEXT_BUF tb = tb_new();
@@ -157,8 +188,9 @@ int main(int argc, char **argv)
    opterr = 0;
 
    const char *filter = NULL;
+   bool compare = false;
    int c, index = 0;
-   const char *spec = "L:hf:i";
+   const char *spec = "L:hf:ics";
    while ((c = getopt_long(argc, argv, spec, long_options, &index)) != -1) {
       switch (c) {
       case 0:
@@ -175,6 +207,16 @@ int main(int argc, char **argv)
          break;
       case 'i':
          opt_set_int(OPT_JIT_THRESHOLD, 0);
+         opt_set_int(OPT_JIT_BASELINE, 0);
+         break;
+      case 'c':
+         // Comparing dispatch loops only makes sense when interpreting
+         opt_set_int(OPT_JIT_THRESHOLD, 0);
+         opt_set_int(OPT_JIT_BASELINE, 0);
+         compare = true;
+         break;
+      case 's':
+         opt_set_int(OPT_JIT_THREADED, 0);
          break;
       default:
          if (optopt == 0)
@@ -222,7 +264,7 @@ int main(int argc, char **argv)
       if (pack == NULL)
          fatal("no package found in %s", argv[i]);
 
-      find_benchmarks(pack, filter);
+      find_benchmarks(pack, filter, compare);
    }
 
    eval_free(eval);
@@ -0,0 +1,20 @@
+set -xe
+
+pwd
+which nvc
+
+nvc --std=2008 -a $TESTDIR/regress/checkpoint1.vhd -e checkpoint1
+
+nvc --std=2008 -r checkpoint1 2>&1 | grep "Report Note" > ref.txt
+mv out.txt ref_out.txt
+
+for t in 0ns 123ns 255ns; do
+  nvc --std=2008 -r --checkpoint=$t:ck.bin checkpoint1
+  nvc --std=2008 -r --restore=ck.bin checkpoint1 2>&1 | grep "Report Note" > restore.txt
+  diff -u ref.txt restore.txt
+  diff -u ref_out.txt out.txt
+done
+
+nvc --std=2008 -r --checkpoint=1000ns:late.bin checkpoint1 2>&1 \
+  | grep "simulation stopped before checkpoint time"
+test ! -f late.bin
@@ -0,0 +1,83 @@
+use std.textio.all;
+
+entity checkpoint1 is
+end entity;
+
+architecture test of checkpoint1 is
+    type int_ptr is access integer;
+
+    type node_t;
+    type node_ptr is access node_t;
+    type node_t is record
+        value : integer;
+        chain : node_ptr;
+    end record;
+
+    signal clk   : bit := '0';
+    signal count : integer := 0;
+    signal v     : bit_vector(7 downto 0);
+begin
+
+    clk <= not clk after 5 ns when now < 400 ns;
+
+    counter: process (clk) is
+    begin
+        if clk'event and clk = '1' then
+            count <= count + 1;
+            v(3 downto 0) <= "1010";
+        end if;
+    end process;
+
+    check: process is
+        variable p   : int_ptr;
+        variable acc : integer := 0;
+        variable l   : line;
+        file f       : text open write_mode is "out.txt";
+    begin
+        p := new integer'(5);
+        loop
+            wait until clk = '1';
+            acc := acc + count;
+            p.all := p.all + 1;
+            write(l, integer'image(acc));
+            writeline(f, l);
+            exit when now >= 390 ns;
+        end loop;
+        report "acc=" & integer'image(acc) & " p=" & integer'image(p.all)
+            & " count=" & integer'image(count) & " v=" & to_string(v);
+        wait;
+    end process;
+
+    list: process is
+        variable head : node_ptr;
+        variable node : node_ptr;
+        variable sum  : integer := 0;
+
+        procedure wait_cycles (n : integer) is
+        begin
+            for i in 1 to n loop
+                wait until clk = '1';
+            end loop;
+        end procedure;
+    begin
+        for i in 1 to 15 loop
+            head := new node_t'(i, head);
+            wait_cycles(2);
+        end loop;
+        node := head;
+        while node /= null loop
+            sum := sum * 2 + node.value;
+            node := node.chain;
+        end loop;
+        report "sum=" & integer'image(sum);
+        wait;
+    end process;
+
+    delayed: process is
+    begin
+        wait for 250 ns;
+        v(7 downto 4) <= "1100" after 17 ns;
+        wait;
+    end process;
+
+end architecture;
@@ -0,0 +1,24 @@
+set -xe
+
+pwd
+which nvc
+which fstdump
+
+# Only record hit flags, the report should match counting mode
+nvc -a $TESTDIR/regress/cover5.vhd -e -gG_VAL=1 --cover=all,hits-only cover5 -r
+mv work/_WORK.COVER5.elab.covdb DB1.covdb
+nvc -c --report html DB1.covdb 2>&1 | tee out.txt
+
+# Counters are kept per-thread when running processes concurrently
+nvc -a $TESTDIR/regress/cover5.vhd -e -gG_VAL=2 --cover=all cover5 -r --parallel
+mv work/_WORK.COVER5.elab.covdb DB2.covdb
+nvc -c --report html DB2.covdb 2>&1 | tee -a out.txt
+
+nvc -c --merge DB_MERGED.covdb --report html DB1.covdb DB2.covdb 2>&1 | tee -a out.txt
+
+if [ ! -f html/index.html ]; then
+  echo "missing coverage report"
+  exit 1
+fi
+
+diff -u $TESTDIR/regress/gold/cover7.txt out.txt
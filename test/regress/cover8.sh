@@ -0,0 +1,24 @@
+set -xe
+
+pwd
+which nvc
+which fstdump
+
+nvc -a $TESTDIR/regress/cover8.vhd -e --cover=toggle cover8 -r
+nvc -c --report html work/_WORK.COVER8.elab.covdb 2>&1 | tee out.txt
+
+nvc -a $TESTDIR/regress/cover8.vhd -e --cover=toggle,count-from-undefined cover8 -r
+nvc -c --report html work/_WORK.COVER8.elab.covdb 2>&1 | tee -a out.txt
+
+nvc -a $TESTDIR/regress/cover8.vhd -e --cover=toggle,count-from-to-z cover8 -r
+nvc -c --report html work/_WORK.COVER8.elab.covdb 2>&1 | tee -a out.txt
+
+nvc -a $TESTDIR/regress/cover8.vhd -e --cover=toggle,count-from-undefined,count-from-to-z cover8 -r
+nvc -c --report html work/_WORK.COVER8.elab.covdb 2>&1 | tee -a out.txt
+
+if [ ! -f html/index.html ]; then
+  echo "missing coverage report"
+  exit 1
+fi
+
+diff -u $TESTDIR/regress/gold/cover8.txt out.txt
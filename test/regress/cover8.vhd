@@ -0,0 +1,24 @@
+library ieee;
+use ieee.std_logic_1164.all;
+
+entity cover8 is
+end entity;
+
+architecture test of cover8 is
+   signal wide : std_logic_vector(99 downto 0);
+begin
+   process
+      variable seed : natural := 12345;
+      constant vals : std_logic_vector(0 to 3) := "01ZU";
+   begin
+      -- Wide enough that most bits are checked sixteen at a time
+      for n in 1 to 6 loop
+         for i in wide'range loop
+            seed := (seed * 75 + 74) mod 65537;
+            wide(i) <= vals((seed / 7) mod 4);
+         end loop;
+         wait for 1 ns;
+      end loop;
+      wait;
+   end process;
+end architecture;
@@ -0,0 +1,49 @@
+set -xe
+
+pwd
+which nvc
+which fstdump
+
+nvc -a $TESTDIR/regress/cover2.vhd -e --cover=all cover2 -r
+mv work/_WORK.COVER2.elab.covdb DB1.covdb
+
+# Merge into a memory-mappable database and then update it in place
+nvc -c --merge DB_MAPPED.covdb --mapped DB1.covdb 2>&1 | tee out.txt
+nvc -c --update DB_MAPPED.covdb --report html DB1.covdb 2>&1 | tee -a out.txt
+
+if [ ! -f html/index.html ]; then
+  echo "missing coverage report"
+  exit 1
+fi
+
+# Only load a single instance from the mapped database
+nvc -c --report html_sub --hier work.cover2.sub_module_inst_2 \
+    DB_MAPPED.covdb 2>&1 | tee -a out.txt
+
+# Mapped and default format databases can be merged together
+nvc -c --report html_mixed --hier work.cover2.sub_module_inst_2 \
+    DB1.covdb DB_MAPPED.covdb 2>&1 | tee -a out.txt
+
+diff -u $TESTDIR/regress/gold/cover9.txt out.txt
+
+# Corrupt offsets must be rejected when the database is opened
+expect_corrupt() {
+  if nvc -c --report html_bad $1 2>err.txt; then
+    echo "corrupt database $1 was accepted"
+    exit 1
+  fi
+  grep -q "coverage database $1 is corrupt" err.txt
+}
+
+# Remove the terminating NUL from the string table
+cp DB_MAPPED.covdb BAD1.covdb
+printf 'X' | dd of=BAD1.covdb bs=1 conv=notrunc \
+   seek=$(( $(stat -c %s BAD1.covdb) - 1 ))
+expect_corrupt BAD1.covdb
+
+# Point the first tag record past the end of the string table
+ntags=$(od -An -tu4 -j32 -N4 DB_MAPPED.covdb | tr -d ' ')
+cp DB_MAPPED.covdb BAD2.covdb
+printf '\377\377\377\177' | dd of=BAD2.covdb bs=1 conv=notrunc \
+   seek=$(( (48 + ntags * 4 + 7) / 8 * 8 ))
+expect_corrupt BAD2.covdb
@@ -0,0 +1,42 @@
+set -xe
+
+nvc -a $TESTDIR/regress/jitcache1.vhd -e jitcache1
+
+# Compile every function on its first call before the process finishes
+export NVC_JIT_THRESHOLD=1
+export NVC_JIT_ASYNC=0
+
+nvc -r jitcache1 2>&1 | grep "x=" > ref.txt
+
+if [ ! -d work/_NVC_JIT ]; then
+  echo "skipping: no JIT code cache in this build"
+  exit 0
+fi
+
+ls work/_NVC_JIT/*.o > first.txt
+[ -s first.txt ]
+
+# A second run links the cached objects instead of writing them again
+touch -d '2000-01-01' work/_NVC_JIT/*.o
+nvc -r jitcache1 2>&1 | grep "x=" > out.txt
+diff -u ref.txt out.txt
+ls work/_NVC_JIT/*.o > second.txt
+diff -u first.txt second.txt
+[ -z "$(find work/_NVC_JIT -name '*.o' -newer ref.txt)" ]
+
+# Truncated or foreign objects are replaced by generating the code again
+for f in $(cat first.txt); do
+  echo "not an object file" > $f
+done
+nvc -r jitcache1 2>&1 | grep "x=" > out.txt
+diff -u ref.txt out.txt
+for f in $(cat first.txt); do
+  ! grep -q "not an object file" $f
+done
+
+f=$(head -1 first.txt)
+head -c 200 $f > truncated.o
+mv truncated.o $f
+nvc -r jitcache1 2>&1 | grep "x=" > out.txt
+diff -u ref.txt out.txt
+[ $(wc -c < $f) -gt 200 ]
@@ -0,0 +1,33 @@
+entity jitcache1 is
+end entity;
+
+architecture test of jitcache1 is
+
+    function step (x : natural) return natural is
+    begin
+        return (x * 7 + 3) mod 1009;
+    end function;
+
+    function churn (n : natural) return natural is
+        variable x : natural := 1;
+    begin
+        for i in 1 to n loop
+            x := step(x);
+        end loop;
+        return x;
+    end function;
+
+begin
+
+    process is
+        variable x : natural;
+    begin
+        for i in 1 to 10 loop
+            x := churn(100 * i);
+            wait for 1 ns;
+        end loop;
+        report "x=" & integer'image(x);
+        wait;
+    end process;
+
+end architecture;
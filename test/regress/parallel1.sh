@@ -0,0 +1,10 @@
+set -xe
+
+nvc -a $TESTDIR/regress/parallel1.vhd -e parallel1
+
+# Port-mapped signals driven from many instances must give the same
+# result when processes and updates run concurrently
+nvc -r parallel1 > serial.out 2>&1
+nvc -r --parallel parallel1 > parallel.out 2>&1
+diff -u serial.out parallel.out
+grep -q done parallel.out
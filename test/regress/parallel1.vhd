@@ -0,0 +1,88 @@
+library ieee;
+use ieee.std_logic_1164.all;
+
+entity parallel1_sub is
+    generic ( id : natural );
+    port ( clk : in std_logic;
+           v   : out integer := 0;
+           b   : out std_logic := 'Z' );
+end entity;
+
+architecture test of parallel1_sub is
+begin
+
+    process (clk) is
+        variable count : natural := 0;
+    begin
+        if rising_edge(clk) then
+            count := count + 1;
+            v <= id * count;
+
+            -- Two instances take turns driving the shared bus
+            if id = 0 and count mod 2 = 0 then
+                b <= '0';
+            elsif id = 1 and count mod 2 = 1 then
+                b <= '1';
+            else
+                b <= 'Z';
+            end if;
+        end if;
+    end process;
+
+end architecture;
+
+-------------------------------------------------------------------------------
+
+library ieee;
+use ieee.std_logic_1164.all;
+
+entity parallel1 is
+end entity;
+
+architecture test of parallel1 is
+    constant N : natural := 32;
+
+    type int_vector is array (natural range <>) of integer;
+
+    signal clk   : std_logic := '0';
+    signal vals  : int_vector(0 to N - 1);
+    signal bus_s : std_logic;
+begin
+
+    g: for i in 0 to N - 1 generate
+        u: entity work.parallel1_sub
+            generic map ( i )
+            port map ( clk, vals(i), bus_s );
+    end generate;
+
+    clkgen: process is
+    begin
+        for i in 1 to 20 loop
+            clk <= '1';
+            wait for 5 ns;
+            clk <= '0';
+            wait for 5 ns;
+        end loop;
+        wait;
+    end process;
+
+    check: process is
+    begin
+        for c in 1 to 20 loop
+            wait until falling_edge(clk);
+            for i in 0 to N - 1 loop
+                assert vals(i) = i * c
+                    report "vals(" & integer'image(i) & ") = "
+                    & integer'image(vals(i)) severity failure;
+            end loop;
+            if c mod 2 = 1 then
+                assert bus_s = '1' severity failure;
+            else
+                assert bus_s = '0' severity failure;
+            end if;
+        end loop;
+        report "done";
+        wait;
+    end process;
+
+end architecture;
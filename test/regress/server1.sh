@@ -0,0 +1,40 @@
+set -xe
+
+pwd
+which nvc
+
+nvc -a $TESTDIR/regress/server1.vhd -e server1
+
+nvc -r --server=server1.sock server1 > server.log 2>&1 &
+pid=$!
+trap "kill $pid; rm -f server1.sock" EXIT
+
+for i in $(seq 50); do
+  [ -S server1.sock ] && break
+  sleep 0.1
+done
+
+nvc -r --connect=server1.sock server1 2>&1 | grep "count=100"
+nvc -r --connect=server1.sock --stop-time=50ns 2>&1 | tee out.txt
+[ ! -s out.txt ]
+
+nvc -r --connect=server1.sock --wave --format=vcd
+grep -q '\$var' server1.vcd
+
+# Options read when the model is created apply to each request
+nvc -r --connect=server1.sock --profile --parallel 2>&1 | tee out.txt
+grep -q "Simulation profile" out.txt
+grep "count=100" out.txt
+
+if nvc -r --connect=server1.sock other; then
+  echo "expected failure for wrong top-level"
+  exit 1
+fi
+
+# A second server must not take over the socket of a live one
+if nvc -r --server=server1.sock server1 > second.log 2>&1; then
+  echo "expected failure for second server"
+  exit 1
+fi
+grep "server already running on server1.sock" second.log
+nvc -r --connect=server1.sock server1 2>&1 | grep "count=100"
@@ -0,0 +1,17 @@
+entity server1 is
+end entity;
+
+architecture test of server1 is
+    signal count : natural := 0;
+begin
+
+    count <= count + 1 after 1 ns when count < 150;
+
+    process is
+    begin
+        wait for 100 ns;
+        report "count=" & integer'image(count);
+        wait;
+    end process;
+
+end architecture;
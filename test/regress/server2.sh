@@ -0,0 +1,31 @@
+set -xe
+
+pwd
+which nvc
+
+nvc -a $TESTDIR/regress/server2.vhd -e server2
+
+nvc -r server2 2>&1 | grep "Report Note" > ref.txt
+
+# Functions are queued for the background compiler while the design is
+# initialised and again in each forked child
+export NVC_JIT_THRESHOLD=1
+export NVC_JIT_BASELINE=1
+export NVC_JIT_ASYNC=1
+
+nvc -r --server=server2.sock server2 > server.log 2>&1 &
+pid=$!
+trap "kill $pid; rm -f server2.sock" EXIT
+
+for i in $(seq 50); do
+  [ -S server2.sock ] && break
+  sleep 0.1
+done
+
+for i in $(seq 5); do
+  nvc -r --connect=server2.sock server2 2>&1 | grep "Report Note" > out.txt
+  diff -u ref.txt out.txt
+done
+
+kill -0 $pid
+! grep -i "fatal\|error" server.log
@@ -0,0 +1,36 @@
+entity server2 is
+end entity;
+
+architecture test of server2 is
+
+    function step (x : natural) return natural is
+    begin
+        return (x * 7 + 3) mod 1009;
+    end function;
+
+    function churn (n : natural) return natural is
+        variable x : natural := 1;
+    begin
+        for i in 1 to n loop
+            x := step(x);
+        end loop;
+        return x;
+    end function;
+
+    -- Calls to STEP during initialisation queue it for compilation
+    -- before the server starts forking
+    signal init : natural := churn(5000);
+begin
+
+    process is
+        variable x : natural;
+    begin
+        for i in 1 to 10 loop
+            x := churn(1000 + i);
+            wait for 1 ns;
+        end loop;
+        report "init=" & integer'image(init) & " x=" & integer'image(x);
+        wait;
+    end process;
+
+end architecture;
@@ -0,0 +1,53 @@
+library ieee;
+use ieee.std_logic_1164.all;
+
+entity signal29 is
+end entity;
+
+architecture test of signal29 is
+    constant N : integer := 37;
+
+    signal s  : std_logic_vector(1 to N);
+    signal d1, d2, d3 : std_logic_vector(1 to N) := (others => 'Z');
+begin
+
+    s <= d1;
+    s <= d2;
+    s <= d3;
+
+    stim: process is
+        variable x : integer;
+        variable expect : std_logic;
+        variable v : std_ulogic_vector(1 to 3);
+    begin
+        x := 42;
+        for iter in 1 to 200 loop
+            for i in 1 to N loop
+                for j in 1 to 3 loop
+                    x := (x * 75 + 74) mod 65537;
+                    v(j) := std_ulogic'val(x mod 9);
+                end loop;
+                d1(i) <= v(1);
+                d2(i) <= v(2);
+                d3(i) <= v(3);
+            end loop;
+            wait for 1 ns;
+            for k in 1 to N loop
+                v := (d1(k), d2(k), d3(k));
+                expect := resolved(v);
+                assert s(k) = expect
+                    report "mismatch at " & integer'image(k)
+                    & " iteration " & integer'image(iter) severity failure;
+            end loop;
+        end loop;
+
+        d1 <= (others => 'H');
+        d2 <= (others => 'Z');
+        d3 <= (others => 'Z');
+        wait for 1 ns;
+        assert s = (1 to N => 'H');
+
+        wait;
+    end process;
+
+end architecture;
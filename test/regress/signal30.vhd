@@ -0,0 +1,48 @@
+entity signal30 is
+end entity;
+
+architecture test of signal30 is
+    type bit2 is ('a', 'b');
+    type bit2_vector is array (natural range <>) of bit2;
+
+    -- Behaves like OR for up to three drivers but like AND for four so
+    -- cannot be resolved by folding the two driver table
+    function resolve (v : bit2_vector) return bit2 is
+        variable any, all_b : boolean := false;
+    begin
+        all_b := true;
+        for i in v'range loop
+            any := any or v(i) = 'b';
+            all_b := all_b and v(i) = 'b';
+        end loop;
+        if v'length = 4 then
+            return bit2'val(boolean'pos(all_b));
+        else
+            return bit2'val(boolean'pos(any));
+        end if;
+    end function;
+
+    subtype rbit2 is resolve bit2;
+
+    signal s3 : rbit2;
+    signal s4 : rbit2;
+begin
+
+    s3 <= 'a';
+    s3 <= 'b';
+    s3 <= 'a';
+
+    s4 <= 'a';
+    s4 <= 'b';
+    s4 <= 'a';
+    s4 <= 'a';
+
+    process is
+    begin
+        wait for 1 ns;
+        assert s3 = 'b';
+        assert s4 = 'a';
+        wait;
+    end process;
+
+end architecture;
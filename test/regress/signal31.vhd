@@ -0,0 +1,26 @@
+entity signal31 is
+end entity;
+
+architecture test of signal31 is
+    signal s : bit_vector(1 to 8);
+    signal t : bit_vector(1 to 8);
+begin
+
+    t <= not s;
+
+    stim: process is
+        variable i : integer := 3;
+    begin
+        wait for 1 ns;
+        s(i) <= force '1';              -- Splits nexus after reset
+        wait for 1 ns;
+        assert s = "00100000";
+        assert t = "11011111";
+        s(i) <= release;
+        wait for 1 ns;
+        assert s = "00000000";
+        assert t = "11111111";
+        wait;
+    end process;
+
+end architecture;
@@ -0,0 +1,17 @@
+entity vhpi6 is
+end entity;
+
+architecture test of vhpi6 is
+    signal s : bit;
+begin
+
+    p1: s <= '1' after 1 ns;
+
+    p2: process is
+    begin
+        wait on s for 10 ns;            -- Timeout becomes stale
+        assert now = 1 ns;
+        wait;
+    end process;
+
+end architecture;
@@ -0,0 +1,10 @@
+set -xe
+
+pwd
+which nvc
+which fstdump
+
+nvc --std=2008 -a $TESTDIR/regress/wave11.vhd -e wave11 -r -w
+
+fstdump wave11.fst > wave11.dump
+diff -u $TESTDIR/regress/gold/wave11.dump wave11.dump
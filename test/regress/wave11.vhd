@@ -0,0 +1,30 @@
+library ieee;
+use ieee.std_logic_1164.all;
+
+entity wave11 is
+end entity;
+
+architecture test of wave11 is
+    type big_int is range -2**62 to 2**62;
+
+    signal v : std_logic_vector(39 downto 0) := (others => 'U');
+    signal b : bit_vector(1 to 20) := (others => '0');
+    signal n : big_int := 0;
+    signal i : integer range -5 to 17 := 0;
+begin
+
+    process is
+    begin
+        wait for 1 ns;
+        v <= X"0123456789";
+        b <= (1 => '1', 20 => '1', others => '0');
+        n <= 2**40 + 5;
+        i <= -5;
+        wait for 1 ns;
+        v <= "UX01ZWLH-0UX01ZWLH-0UX01ZWLH-0UX01ZWLH-0";
+        n <= -3;
+        i <= 17;
+        wait;
+    end process;
+
+end architecture;
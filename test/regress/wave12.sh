@@ -0,0 +1,19 @@
+set -xe
+
+pwd
+which nvc
+which fstdump
+
+nvc -a $TESTDIR/regress/wave12.vhd -e wave12
+
+# Not triggered as the assertion is below the trigger severity
+nvc -r --exit-severity=failure --flight-recorder=30ns \
+    --flight-trigger=failure -w wave12 2>err
+grep "flight recorder was not triggered" err
+
+nvc -r --exit-severity=failure --flight-recorder=30ns \
+    --wave-start=10ns --wave-stop=170ns -w wave12 2>err
+grep "flight recorder triggered" err
+
+fstdump wave12.fst > wave12.dump
+diff -u $TESTDIR/regress/gold/wave12.dump wave12.dump
@@ -0,0 +1,25 @@
+entity wave12 is
+end entity;
+
+architecture test of wave12 is
+    signal clk : bit := '0';
+    signal n   : integer := 0;
+begin
+
+    clk <= not clk after 5 ns when now < 200 ns;
+
+    process (clk) is
+    begin
+        if clk'event and clk = '1' then
+            n <= n + 1;
+        end if;
+    end process;
+
+    process is
+    begin
+        wait for 152 ns;
+        report "something went wrong" severity error;
+        wait;
+    end process;
+
+end architecture;
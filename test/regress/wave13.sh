@@ -0,0 +1,12 @@
+set -xe
+
+pwd
+which nvc
+which fstdump
+
+nvc -a $TESTDIR/regress/wave13.vhd -e wave13 -r -w \
+    --include=':wave13:m1:*' --include='*:gs' --include='*bar' \
+    --exclude='*:u2:*' --exclude=':wave13:m2:g(2)*'
+
+fstdump wave13.fst > wave13.dump
+diff -u $TESTDIR/regress/gold/wave13.dump wave13.dump
@@ -0,0 +1,34 @@
+entity leaf is
+    port ( x : in bit; y : out bit );
+end entity;
+architecture a of leaf is
+    signal foo, bar : bit;
+begin
+    foo <= x; bar <= not foo; y <= bar;
+end architecture;
+
+entity mid is
+    port ( i : in bit; o : out bit );
+end entity;
+architecture a of mid is
+    signal t, foo : bit;
+begin
+    u1: entity work.leaf port map (i, t);
+    u2: entity work.leaf port map (t, foo);
+    g: for k in 1 to 2 generate
+        signal gs : bit;
+    begin
+        gs <= foo;
+    end generate;
+    o <= foo;
+end architecture;
+
+entity wave13 is
+end entity;
+architecture a of wave13 is
+    signal clk, out1, foobar : bit;
+begin
+    clk <= not clk after 5 ns when now < 20 ns;
+    m1: entity work.mid port map (clk, out1);
+    m2: entity work.mid port map (out1, foobar);
+end architecture;
@@ -0,0 +1,10 @@
+set -xe
+
+pwd
+which nvc
+which fstdump
+
+nvc -a $TESTDIR/regress/wave4.vhd -e wave4 -r -w --dump-arrays=sparse
+
+fstdump wave4.fst > wave14.dump
+diff -u $TESTDIR/regress/gold/wave14.dump wave14.dump
@@ -0,0 +1,11 @@
+set -xe
+
+pwd
+which nvc
+
+nvc -a $TESTDIR/regress/wave15.vhd -e wave15 -r -w --format=vcd \
+    --dump-arrays
+
+# Skip the date and version which change between runs
+sed '1,6d' wave15.vcd > wave15.dump
+diff -u $TESTDIR/regress/gold/wave15.vcd wave15.dump
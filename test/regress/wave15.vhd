@@ -0,0 +1,19 @@
+entity wave15 is
+end entity;
+
+architecture test of wave15 is
+    type mem_t is array (0 to 3) of integer;
+    signal m : mem_t := (10, 20, 30, 40);
+begin
+
+    stim: process is
+    begin
+        wait for 1 ns;
+        m(0) <= 11;
+        wait for 1 ns;
+        m(2) <= 31;
+        m(3) <= 41;
+        wait;
+    end process;
+
+end architecture;
@@ -0,0 +1,14 @@
+set -xe
+
+pwd
+which nvc
+
+nvc --std=2008 -a $TESTDIR/regress/wave9.vhd -e wave9 -r -w --format=vcd
+
+# Skip the date and version which change between runs
+sed '1,6d' wave9.vcd > wave9.dump
+diff -u $TESTDIR/regress/gold/wave9.vcd wave9.dump
+
+nvc -r wave9 -w --format=vcd --wave-thread
+sed '1,6d' wave9.vcd > wave9.dump
+diff -u $TESTDIR/regress/gold/wave9.vcd wave9.dump
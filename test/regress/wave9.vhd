@@ -0,0 +1,39 @@
+entity wave9 is
+end entity;
+
+architecture test of wave9 is
+    type state_t is (IDLE, RUN, DONE);
+
+    type rec_t is record
+        n : integer;
+        b : bit;
+    end record;
+
+    signal clk : bit := '0';
+    signal v   : bit_vector(3 downto 0) := "0000";
+    signal n   : integer := 0;
+    signal r   : real := 0.0;
+    signal t   : time := 0 ns;
+    signal s   : state_t := IDLE;
+    signal str : string(1 to 3) := "a b";
+    signal c   : character := 'x';
+    signal rec : rec_t;
+begin
+
+    clk <= not clk after 5 ns when now < 30 ns;
+
+    process (clk) is
+    begin
+        if clk'event and clk = '1' then
+            v   <= v(2 downto 0) & not v(3);
+            n   <= n + 3;
+            r   <= r + 0.25;
+            t   <= t + 1 ps;
+            s   <= state_t'rightof(s) when s /= DONE else IDLE;
+            str <= str(2 to 3) & str(1);
+            c   <= character'succ(c);
+            rec <= (rec.n + 1, not rec.b);
+        end if;
+    end process;
+
+end architecture;
@@ -1484,6 +1484,305 @@ START_TEST(test_cfg2)
 }
 END_TEST
 
+START_TEST(test_cprop1)
+{
+   jit_t *j = jit_new();
+
+   const char *text1 =
+      "    MOV     R0, #5        \n"
+      "    RECV    R1, #0        \n"
+      "    ADD     R2, R1, R0    \n"
+      "    MOV     R3, R2        \n"
+      "    ADD     R4, R3, #1    \n"
+      "    MOV     R5, #1        \n"
+      "    MOV     R5, #2        \n"
+      "    ADD     R4, R4, R5    \n"
+      "    SEND    #0, R4        \n"
+      "    RET                   \n";
+
+   jit_handle_t h1 = jit_assemble(j, ident_new("myfunc1"), text1);
+
+   jit_func_t *f1 = jit_get_func(j, h1);
+   ck_assert_int_eq(jit_do_cprop(f1), 3);
+
+   ck_assert_int_eq(f1->irbuf[2].arg2.kind, JIT_VALUE_INT64);
+   ck_assert_int_eq(f1->irbuf[2].arg2.int64, 5);
+   ck_assert_int_eq(f1->irbuf[4].arg1.kind, JIT_VALUE_REG);
+   ck_assert_int_eq(f1->irbuf[4].arg1.reg, 2);
+   ck_assert_int_eq(f1->irbuf[7].arg2.kind, JIT_VALUE_INT64);
+   ck_assert_int_eq(f1->irbuf[7].arg2.int64, 2);
+
+   ck_assert_int_eq(jit_do_dce(f1), 4);
+   ck_assert_int_eq(f1->irbuf[0].op, J_NOP);
+   ck_assert_int_eq(f1->irbuf[3].op, J_NOP);
+   ck_assert_int_eq(f1->irbuf[5].op, J_NOP);
+   ck_assert_int_eq(f1->irbuf[6].op, J_NOP);
+
+   ck_assert_int_eq(jit_delete_nops(f1), 4);
+   ck_assert_int_eq(f1->nirs, 6);
+
+   jit_scalar_t result, p0 = { .integer = 5 };
+   fail_unless(jit_fastcall(j, h1, &result, p0, p0, NULL));
+   ck_assert_int_eq(result.integer, 13);
+
+   const char *text2 =
+      "    RECV    R0, #0        \n"
+      "    MOV     R1, #0        \n"
+      "L1: MOV     R2, R1        \n"
+      "    ADD     R1, R1, #1    \n"
+      "    CMP.EQ  R1, R0        \n"
+      "    JUMP.F  L1            \n"
+      "    SEND    #0, R2        \n"
+      "    RET                   \n";
+
+   jit_handle_t h2 = jit_assemble(j, ident_new("myfunc2"), text2);
+
+   jit_func_t *f2 = jit_get_func(j, h2);
+   ck_assert_int_eq(jit_do_cprop(f2), 0);
+
+   ck_assert_int_eq(f2->irbuf[6].arg2.kind, JIT_VALUE_REG);
+   ck_assert_int_eq(f2->irbuf[6].arg2.reg, 2);
+
+   jit_free(j);
+}
+END_TEST
+
+START_TEST(test_fold1)
+{
+   jit_t *j = jit_new();
+
+   const char *text1 =
+      "    MOV     R0, #3        \n"
+      "    CMP.EQ  R0, #3        \n"
+      "    CSET    R1            \n"
+      "    JUMP.T  L1            \n"
+      "    SEND    #0, #5        \n"
+      "    RET                   \n"
+      "L1: SEND    #0, R1        \n"
+      "    RET                   \n";
+
+   jit_handle_t h1 = jit_assemble(j, ident_new("myfunc"), text1);
+
+   jit_func_t *f = jit_get_func(j, h1);
+   ck_assert_int_eq(jit_do_cprop(f), 1);
+   ck_assert_int_eq(jit_do_fold_branches(f), 2);
+
+   ck_assert_int_eq(f->irbuf[2].op, J_MOV);
+   ck_assert_int_eq(f->irbuf[2].arg1.kind, JIT_VALUE_INT64);
+   ck_assert_int_eq(f->irbuf[2].arg1.int64, 1);
+   ck_assert_int_eq(f->irbuf[3].op, J_JUMP);
+   ck_assert_int_eq(f->irbuf[3].cc, JIT_CC_NONE);
+
+   ck_assert_int_eq(jit_do_unreachable(f), 1);
+   ck_assert_int_eq(f->irbuf[4].op, J_NOP);
+   ck_assert_int_eq(f->irbuf[5].op, J_NOP);
+
+   ck_assert_int_eq(jit_do_dce(f), 1);
+   ck_assert_int_eq(f->irbuf[0].op, J_NOP);
+
+   ck_assert_int_eq(jit_delete_nops(f), 3);
+   ck_assert_int_eq(f->nirs, 5);
+   ck_assert_int_eq(f->irbuf[2].op, J_JUMP);
+   ck_assert_int_eq(f->irbuf[2].arg1.label, 3);
+   ck_assert_int_eq(f->irbuf[3].target, 1);
+
+   jit_scalar_t result, p0 = { .integer = 0 };
+   fail_unless(jit_fastcall(j, h1, &result, p0, p0, NULL));
+   ck_assert_int_eq(result.integer, 1);
+
+   jit_free(j);
+}
+END_TEST
+
+START_TEST(test_dse1)
+{
+   jit_t *j = jit_new();
+
+   const char *text1 =
+      "    RECV      R0, #0        \n"
+      "    STORE.32  #1, [R0]      \n"
+      "    STORE.32  #2, [R0]      \n"
+      "    LOAD.32   R1, [R0]      \n"
+      "    STORE.32  R1, [R0]      \n"
+      "    RECV      R0, #1        \n"
+      "    STORE.32  #3, [R0]      \n"
+      "    RET                     \n";
+
+   jit_handle_t h1 = jit_assemble(j, ident_new("myfunc"), text1);
+
+   jit_func_t *f = jit_get_func(j, h1);
+   ck_assert_int_eq(jit_do_dse(f), 1);
+
+   ck_assert_int_eq(f->irbuf[1].op, J_NOP);
+   ck_assert_int_eq(f->irbuf[2].op, J_STORE);
+   ck_assert_int_eq(f->irbuf[4].op, J_STORE);
+
+   jit_free(j);
+}
+END_TEST
+
+static void check_native(const char *text, const jit_scalar_t (*inputs)[2],
+                         int ninputs)
+{
+   // Run the same function in the interpreter and as native code from
+   // the baseline tier and check the results are identical
+
+   jit_t *ji = jit_new();
+   jit_handle_t hi = jit_assemble(ji, ident_new("myfunc"), text);
+
+   jit_t *jn = jit_new();
+   jit_register_native_plugin(jn);
+   jit_handle_t hn = jit_assemble(jn, ident_new("myfunc"), text);
+
+   jit_scalar_t result, dummy = { .integer = 0 };
+
+   // The first call is interpreted and then compiles the function
+   jit_scalar_t warmup[4] = { inputs[0][0], inputs[0][1] };
+   jit_scalar_t p0 = { .pointer = warmup };
+   fail_unless(jit_fastcall(jn, hn, &result, p0, dummy, NULL));
+
+#if defined __x86_64__ && !defined __MINGW32__ && !__SANITIZE_ADDRESS__
+   fail_unless(jit_get_func(jn, hn)->entry != jit_interp);
+#endif
+
+   for (int i = 0; i < ninputs; i++) {
+      jit_scalar_t expect[4] = { inputs[i][0], inputs[i][1] };
+      jit_scalar_t p1 = { .pointer = expect };
+      fail_unless(jit_fastcall(ji, hi, &result, p1, dummy, NULL));
+
+      jit_scalar_t actual[4] = { inputs[i][0], inputs[i][1] };
+      jit_scalar_t p2 = { .pointer = actual };
+      fail_unless(jit_fastcall(jn, hn, &result, p2, dummy, NULL));
+
+      for (int j = 0; j < 4; j++)
+         ck_assert_int_eq(actual[j].integer, expect[j].integer);
+   }
+
+   jit_free(ji);
+   jit_free(jn);
+}
+
+static void check_native_op(const char *op, const jit_scalar_t (*inputs)[2],
+                            int ninputs)
+{
+   // Operands are loaded from the first two words of the array passed
+   // as the argument and the result and flags stored in the next two
+   char *text LOCAL = xasprintf(
+      "    RECV      R9, #0        \n"
+      "    LOAD.64   R0, [R9]      \n"
+      "    ADD       R8, R9, #8    \n"
+      "    LOAD.64   R1, [R8]      \n"
+      "    MOV       R2, #0        \n"
+      "    %s                      \n"
+      "    CSET      R3            \n"
+      "    ADD       R8, R9, #16   \n"
+      "    STORE.64  R2, [R8]      \n"
+      "    ADD       R8, R9, #24   \n"
+      "    STORE.64  R3, [R8]      \n"
+      "    RET                     \n", op);
+
+   check_native(text, inputs, ninputs);
+}
+
+START_TEST(test_native1)
+{
+   opt_set_int(OPT_JIT_ASYNC, 0);
+   opt_set_int(OPT_JIT_BASELINE, 1);
+
+#define I(x) { .integer = (x) }
+#define R(x) { .real = (x) }
+
+   const jit_scalar_t ints[][2] = {
+      { I(100), I(27) }, { I(127), I(1) }, { I(-128), I(-1) },
+      { I(200), I(100) }, { I(-5), I(3) }, { I(0x7fff), I(1) },
+      { I(-32768), I(-1) }, { I(0xffff), I(2) }, { I(300), I(300) },
+      { I(INT32_MAX), I(1) }, { I(INT32_MIN), I(-1) },
+      { I(UINT32_MAX), I(2) }, { I(70000), I(70000) },
+      { I(INT64_MAX), I(1) }, { I(INT64_MIN), I(-1) }, { I(-1), I(-1) },
+      { I(0), I(0) },
+   };
+
+   static const char *arith[] = { "ADD", "SUB", "MUL" };
+   static const char *cc[] = { "O", "C" };
+   static const int sizes[] = { 8, 16, 32, 64 };
+
+   for (int i = 0; i < ARRAY_LEN(arith); i++) {
+      for (int j = 0; j < ARRAY_LEN(cc); j++) {
+         for (int k = 0; k < ARRAY_LEN(sizes); k++) {
+            char *op LOCAL = xasprintf("%s.%s.%d  R2, R0, R1", arith[i],
+                                       cc[j], sizes[k]);
+            check_native_op(op, ints, ARRAY_LEN(ints));
+         }
+      }
+   }
+
+   check_native_op("CMP.LT  R0, R1 \n CSEL  R2, R0, R1", ints,
+                   ARRAY_LEN(ints));
+   check_native_op("CMP.EQ  R0, R1 \n CSEL  R2, R1, #42", ints,
+                   ARRAY_LEN(ints));
+
+   const jit_scalar_t reals[][2] = {
+      { R(1.0), R(2.0) }, { R(2.0), R(1.0) }, { R(1.5), R(1.5) },
+      { R(-0.0), R(0.0) }, { R(NAN), R(1.0) }, { R(1.0), R(NAN) },
+      { R(NAN), R(NAN) }, { R(INFINITY), R(NAN) },
+   };
+
+   static const char *fcc[] = { "EQ", "NE", "LT", "GT", "LE", "GE" };
+
+   for (int i = 0; i < ARRAY_LEN(fcc); i++) {
+      char *op LOCAL = xasprintf("FCMP.%s  R0, R1 \n CSEL  R2, R0, R1",
+                                 fcc[i]);
+      check_native_op(op, reals, ARRAY_LEN(reals));
+   }
+
+   const char *text1 =
+      "    RECV      R9, #0        \n"
+      "    LOAD.64   R0, [R9]      \n"
+      "    $CASE     R0, #1, L1    \n"
+      "    $CASE     R0, #-5, L2   \n"
+      "    $CASE     R0, #300, L3  \n"
+      "    MOV       R2, #100      \n"
+      "    JUMP      L4            \n"
+      "L1: MOV       R2, #10       \n"
+      "    JUMP      L4            \n"
+      "L2: MOV       R2, #20       \n"
+      "    JUMP      L4            \n"
+      "L3: MOV       R2, #30       \n"
+      "L4: ADD       R8, R9, #16   \n"
+      "    STORE.64  R2, [R8]      \n"
+      "    RET                     \n";
+
+   const jit_scalar_t cases[][2] = {
+      { I(1), I(0) }, { I(-5), I(0) }, { I(300), I(0) }, { I(2), I(0) },
+      { I(INT64_MIN), I(0) },
+   };
+
+   check_native(text1, cases, ARRAY_LEN(cases));
+
+   // Copy the two input words over the outputs and then overlapping
+   // part of the array with the count taken from the second word
+   const char *text2 =
+      "    RECV      R9, #0        \n"
+      "    ADD       R8, R9, #16   \n"
+      "    MOV       R5, #16       \n"
+      "    $COPY     R5, R8, R9    \n"
+      "    ADD       R8, R9, #8    \n"
+      "    LOAD.64   R5, [R8]      \n"
+      "    ADD       R7, R9, #3    \n"
+      "    $COPY     R5, R7, R9    \n"
+      "    RET                     \n";
+
+   const jit_scalar_t copies[][2] = {
+      { I(0x0102030405060708), I(0) }, { I(-1), I(5) }, { I(42), I(13) },
+   };
+
+   check_native(text2, copies, ARRAY_LEN(copies));
+
+#undef I
+#undef R
+}
+END_TEST
+
 Suite *get_jit_tests(void)
 {
    Suite *s = suite_create("jit");
@@ -1525,6 +1824,10 @@ Suite *get_jit_tests(void)
    tcase_add_test(tc, test_lvn3);
    tcase_add_test(tc, test_issue575);
    tcase_add_test(tc, test_cfg2);
+   tcase_add_test(tc, test_cprop1);
+   tcase_add_test(tc, test_fold1);
+   tcase_add_test(tc, test_dse1);
+   tcase_add_test(tc, test_native1);
    suite_add_tcase(s, tc);
 
    return s;
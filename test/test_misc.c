@@ -22,6 +22,7 @@
 #include "mask.h"
 #include "opt.h"
 #include "rt/heap.h"
+#include "rt/wheel.h"
 #include "thread.h"
 
 #include <assert.h>
@@ -295,6 +296,85 @@ START_TEST(test_heap_rand)
 }
 END_TEST
 
+START_TEST(test_wheel_basic)
+{
+   wheel_t *w = wheel_new(1 << 12);
+
+   wheel_insert(w, 5, (void*)5);
+   wheel_insert(w, 2, (void*)2);
+   wheel_insert(w, 62, (void*)62);
+   wheel_insert(w, 100000, (void*)100000);
+   wheel_insert(w, 700, (void*)700);
+
+   fail_unless(wheel_size(w) == 5);
+
+   fail_unless(wheel_min(w) == (void*)2);
+
+   fail_unless(wheel_extract_min(w) == (void*)2);
+   fail_unless(wheel_extract_min(w) == (void*)5);
+
+   wheel_insert(w, 6, (void*)6);
+   fail_unless(wheel_min(w) == (void*)6);
+
+   fail_unless(wheel_extract_min(w) == (void*)6);
+   fail_unless(wheel_extract_min(w) == (void*)62);
+   fail_unless(wheel_extract_min(w) == (void*)700);
+   fail_unless(wheel_extract_min(w) == (void*)100000);
+
+   fail_unless(wheel_size(w) == 0);
+
+   wheel_free(w);
+}
+END_TEST
+
+START_TEST(test_wheel_rewind)
+{
+   wheel_t *w = wheel_new(1 << 12);
+
+   wheel_insert(w, 5, (void*)5);
+   wheel_insert(w, 3000, (void*)3000);
+
+   fail_unless(wheel_extract_min(w) == (void*)5);
+   fail_unless(wheel_extract_min(w) == (void*)3000);
+
+   // Keys before the last extracted key are valid after rewinding
+   wheel_rewind(w, 5);
+   wheel_insert(w, 70, (void*)70);
+   wheel_insert(w, 6, (void*)6);
+
+   fail_unless(wheel_extract_min(w) == (void*)6);
+   fail_unless(wheel_extract_min(w) == (void*)70);
+   fail_unless(wheel_size(w) == 0);
+
+   wheel_free(w);
+}
+END_TEST
+
+START_TEST(test_wheel_rand)
+{
+   wheel_t *w = wheel_new(1 << 20);
+
+   static const int N = 4096;
+   uintptr_t keys[N];
+
+   for (int i = 0; i < N; i++) {
+      keys[i] = rand();
+      wheel_insert(w, keys[i], (void*)keys[i]);
+   }
+
+   qsort(keys, N, sizeof(uintptr_t), magnitude_compar);
+
+   for (int i = 0; i < N; i++) {
+      fail_unless(wheel_min(w) == (void*)keys[i]);
+      fail_unless(wheel_extract_min(w) == (void*)keys[i]);
+   }
+
+   fail_unless(wheel_size(w) == 0);
+
+   wheel_free(w);
+}
+END_TEST
+
 START_TEST(test_color_printf)
 {
    setenv("NVC_COLORS", "always", 1);
@@ -562,6 +642,12 @@ Suite *get_misc_tests(void)
    tcase_add_test(tc_heap, test_heap_walk);
    suite_add_tcase(s, tc_heap);
 
+   TCase *tc_wheel = tcase_create("wheel");
+   tcase_add_test(tc_wheel, test_wheel_basic);
+   tcase_add_test(tc_wheel, test_wheel_rand);
+   tcase_add_test(tc_wheel, test_wheel_rewind);
+   suite_add_tcase(s, tc_wheel);
+
    TCase *tc_util = tcase_create("util");
    tcase_add_test(tc_util, test_color_printf);
    suite_add_tcase(s, tc_util);
@@ -0,0 +1,63 @@
+#include "vhpi_user.h"
+
+#include <stdio.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define fail_if(x)                                                      \
+   if (x) vhpi_assert(vhpiFailure, "assertion '%s' failed at %s:%d",    \
+                      #x, __FILE__, __LINE__)
+#define fail_unless(x) fail_if(!(x))
+
+static void check_error(void)
+{
+   vhpiErrorInfoT info;
+   if (vhpi_check_error(&info))
+      vhpi_assert(vhpiFailure, "unexpected error '%s'", info.message);
+}
+
+static void after_1ns(const vhpiCbDataT *cb_data)
+{
+   vhpi_printf("after_1ns callback");
+}
+
+static void end_of_sim(const vhpiCbDataT *cb_data)
+{
+   vhpi_printf("end of sim callback");
+
+   long cycles;
+   vhpiTimeT now;
+   vhpi_get_time(&now, &cycles);
+
+   // The stale timeout at 10 ns was discarded without advancing time
+   fail_unless(now.low == 1000000);
+   fail_unless(now.high == 0);
+
+   vhpiTimeT time_1ns = {
+      .low = 1000000
+   };
+
+   vhpiCbDataT cb_data1 = {
+      .reason = vhpiCbAfterDelay,
+      .cb_rtn = after_1ns,
+      .time   = &time_1ns
+   };
+   vhpi_register_cb(&cb_data1, 0);
+   check_error();
+}
+
+static void startup()
+{
+   vhpiCbDataT cb_data1 = {
+      .reason = vhpiCbEndOfSimulation,
+      .cb_rtn = end_of_sim,
+   };
+   vhpi_register_cb(&cb_data1, 0);
+   check_error();
+}
+
+void (*vhpi_startup_routines[])() = {
+   startup,
+   NULL
+};